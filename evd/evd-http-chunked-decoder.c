@@ -20,7 +20,6 @@
  * for more details.
  */
 
-#include <stdio.h>
 #include <string.h>
 #include <gio/gio.h>
 
@@ -37,20 +36,25 @@ struct _EvdHttpChunkedDecoderPrivate
 
   guint status;
 
-  gchar hdr_buf[10];
-  gsize hdr_buf_len;
+  guint hdr_digits;
 
   guint crlf_pos;
 };
 
 enum
 {
-  READING_CHUNK_HEADER,
+  READING_CHUNK_SIZE,
+  READING_CHUNK_EXT,
   READING_CONTENT,
-  READING_CRLF_1,
-  READING_CRLF_2
+  READING_CONTENT_CRLF,
+  READING_TRAILER_START,
+  READING_TRAILER_LINE,
+  READING_TRAILER_END
 };
 
+/* more hex digits than this would overflow the chunk-size */
+#define MAX_CHUNK_SIZE_DIGITS (sizeof (gsize) * 2)
+
 static void             evd_http_chunked_decoder_class_init (EvdHttpChunkedDecoderClass *class);
 static void             evd_http_chunked_decoder_init       (EvdHttpChunkedDecoder *self);
 
@@ -97,6 +101,18 @@ evd_http_chunked_decoder_init (EvdHttpChunkedDecoder *self)
   reset (G_CONVERTER (self));
 }
 
+static GConverterResult
+parse_error (GError **error, const gchar *msg)
+{
+  g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, msg);
+
+  return G_CONVERTER_ERROR;
+}
+
+/* Every state consumes as many bytes as it can in one go: chunk-size digits
+   in a tight loop, chunk extensions and trailer lines by jumping to the next
+   LF with memchr(), and chunk payloads with a single memcpy(). Only the CRLF
+   that closes a chunk payload is matched byte by byte. */
 static GConverterResult
 convert (GConverter       *converter,
          const void       *inbuf,
@@ -109,128 +125,180 @@ convert (GConverter       *converter,
          GError          **error)
 {
   EvdHttpChunkedDecoder *self = EVD_HTTP_CHUNKED_DECODER (converter);
+  EvdHttpChunkedDecoderPrivate *priv = self->priv;
   GConverterResult result = G_CONVERTER_CONVERTED;
-  gsize bw = 0;
   const gchar *_inbuf = (const gchar *) inbuf;
-  char c;
-  gboolean done = FALSE;
+  gchar *_outbuf = (gchar *) outbuf;
+  gsize bw = 0;
   gsize pos = 0;
+  gboolean done = FALSE;
 
-  while (! done && pos < inbuf_size && bw < outbuf_size)
+  while (! done && pos < inbuf_size)
     {
-      c = _inbuf[pos];
-
-      switch (self->priv->status)
+      switch (priv->status)
         {
-        case READING_CHUNK_HEADER:
+        case READING_CHUNK_SIZE:
           {
-            if ( (c >= '0' && c <= '9') ||
-                 (c >= 'a' && c <= 'f') ||
-                 (c >= 'A' && c <= 'F') ||
-                 (c == 32) )
+            gint digit;
+
+            while (pos < inbuf_size &&
+                   (digit = g_ascii_xdigit_value (_inbuf[pos])) >= 0)
               {
-                pos++;
+                if (priv->hdr_digits == MAX_CHUNK_SIZE_DIGITS)
+                  {
+                    result = parse_error (error,
+                                  "Chunk-size of chunked encoded content is too large");
+                    done = TRUE;
+                    break;
+                  }
 
-                self->priv->hdr_buf[ self->priv->hdr_buf_len ] = c;
-                self->priv->hdr_buf_len++;
+                priv->chunk_left = (priv->chunk_left << 4) | digit;
+                priv->hdr_digits++;
+                pos++;
               }
-            else if (self->priv->hdr_buf_len > 0)
+
+            if (done || pos == inbuf_size)
+              break;
+
+            if (priv->hdr_digits == 0)
               {
-                self->priv->hdr_buf[ self->priv->hdr_buf_len ] = '\0';
-                sscanf (self->priv->hdr_buf,
-                        "%x",
-                        (guint *) &self->priv->chunk_left);
+                result = parse_error (error,
+                              "Failed to parse chunk-size of chunked encoded content");
+                done = TRUE;
+                break;
+              }
 
-                self->priv->hdr_buf_len = 0;
+            priv->hdr_digits = 0;
+            priv->status = READING_CHUNK_EXT;
 
-                self->priv->status = READING_CRLF_1;
+            break;
+          }
+
+        case READING_CHUNK_EXT:
+          {
+            const gchar *lf;
+
+            /* chunk extensions (if any) are ignored, up to the end of line */
+            lf = memchr (_inbuf + pos, '\n', inbuf_size - pos);
+            if (lf == NULL)
+              {
+                pos = inbuf_size;
+                break;
               }
+
+            pos = lf - _inbuf + 1;
+
+            if (priv->chunk_left == 0)
+              priv->status = READING_TRAILER_START;
             else
-              {
-                g_set_error (error,
-                             G_IO_ERROR,
-                             G_IO_ERROR_INVALID_DATA,
-                             "Failed to parse chunk-size of chunked encoded content");
+              priv->status = READING_CONTENT;
 
-                result = G_CONVERTER_ERROR;
+            break;
+          }
+
+        case READING_CONTENT:
+          {
+            gsize move_size;
+
+            if (bw == outbuf_size)
+              {
                 done = TRUE;
+                break;
               }
 
+            move_size = MIN (priv->chunk_left, inbuf_size - pos);
+            move_size = MIN (move_size, outbuf_size - bw);
+
+            memcpy (_outbuf + bw, _inbuf + pos, move_size);
+
+            pos += move_size;
+            bw += move_size;
+            priv->chunk_left -= move_size;
+
+            if (priv->chunk_left == 0)
+              priv->status = READING_CONTENT_CRLF;
+
             break;
           }
 
-        case READING_CRLF_1:
-        case READING_CRLF_2:
+        case READING_CONTENT_CRLF:
           {
-            gboolean err = FALSE;
+            if (_inbuf[pos] != (priv->crlf_pos == 0 ? '\r' : '\n'))
+              {
+                result = parse_error (error,
+                                      "Failed to parse chunked encoded content");
+                done = TRUE;
+                break;
+              }
 
-            if (self->priv->crlf_pos == 0)
+            pos++;
+
+            if (priv->crlf_pos == 0)
               {
-                if (c == '\r')
-                  self->priv->crlf_pos++;
-                else
-                  {
-                    g_debug ("kaka: %d", c);
-                    err = TRUE;
-                  }
+                priv->crlf_pos = 1;
               }
             else
               {
-                if (c == '\n')
-                  {
-                    self->priv->crlf_pos = 0;
-
-                    if (self->priv->status == READING_CRLF_1)
-                      {
-                        if (self->priv->chunk_left == 0)
-                          {
-                            result = G_CONVERTER_FINISHED;
-                            done = TRUE;
-                          }
-                        else
-                          self->priv->status = READING_CONTENT;
-                      }
-                    else
-                      self->priv->status = READING_CHUNK_HEADER;
-                  }
-                else
-                  err = TRUE;
+                priv->crlf_pos = 0;
+                priv->status = READING_CHUNK_SIZE;
               }
 
-            if (err)
-              {
-                g_set_error (error,
-                             G_IO_ERROR,
-                             G_IO_ERROR_INVALID_DATA,
-                             "Failed to parse chunked encoded content");
+            break;
+          }
 
-                result = G_CONVERTER_ERROR;
+        case READING_TRAILER_START:
+          {
+            /* an empty line ends the trailer, and the whole content */
+            if (_inbuf[pos] == '\r')
+              {
+                pos++;
+                priv->status = READING_TRAILER_END;
+              }
+            else if (_inbuf[pos] == '\n')
+              {
+                pos++;
+                result = G_CONVERTER_FINISHED;
                 done = TRUE;
               }
             else
               {
-                pos++;
+                priv->status = READING_TRAILER_LINE;
               }
 
             break;
           }
 
-        case READING_CONTENT:
+        case READING_TRAILER_LINE:
           {
-            gsize move_size;
+            const gchar *lf;
 
-            move_size = MIN (self->priv->chunk_left,
-                             inbuf_size - pos);
-            move_size = MIN (move_size, outbuf_size - bw);
+            lf = memchr (_inbuf + pos, '\n', inbuf_size - pos);
+            if (lf == NULL)
+              {
+                pos = inbuf_size;
+              }
+            else
+              {
+                pos = lf - _inbuf + 1;
+                priv->status = READING_TRAILER_START;
+              }
 
-            g_memmove (outbuf + bw, inbuf + pos, move_size);
+            break;
+          }
 
-            pos += move_size;
-            bw += move_size;
-            self->priv->chunk_left -= move_size;
+        case READING_TRAILER_END:
+          {
+            if (_inbuf[pos] != '\n')
+              {
+                result = parse_error (error,
+                                      "Failed to parse chunked encoded content");
+                done = TRUE;
+                break;
+              }
 
-            if (self->priv->chunk_left == 0)
-              self->priv->status = READING_CRLF_2;
+            pos++;
+            result = G_CONVERTER_FINISHED;
+            done = TRUE;
 
             break;
           }
@@ -242,7 +310,7 @@ convert (GConverter       *converter,
   if (bytes_written != NULL)
     *bytes_written = bw;
 
-  if (result != G_CONVERTER_ERROR && flags & G_CONVERTER_FLUSH)
+  if (result == G_CONVERTER_CONVERTED && flags & G_CONVERTER_FLUSH)
     result = G_CONVERTER_FLUSHED;
 
   return result;
@@ -255,9 +323,9 @@ reset (GConverter *converter)
 
   self->priv->chunk_left = 0;
 
-  self->priv->status = READING_CHUNK_HEADER;
+  self->priv->status = READING_CHUNK_SIZE;
 
-  self->priv->hdr_buf_len = 0;
+  self->priv->hdr_digits = 0;
 
   self->priv->crlf_pos = 0;
 }
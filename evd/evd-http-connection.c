@@ -21,6 +21,7 @@
  */
 
 #include <string.h>
+#include <errno.h>
 
 #include "evd-http-connection.h"
 
@@ -61,6 +62,11 @@ struct _EvdHttpConnectionPrivate
   gboolean keepalive;
 
   GConverter *chunked_decoder;
+
+  GConverter *content_encoder;
+
+  gchar *read_buffer;
+  gsize max_content_size;
 };
 
 /* properties */
@@ -138,6 +144,10 @@ evd_http_connection_init (EvdHttpConnection *self)
   priv->keepalive = FALSE;
 
   priv->chunked_decoder = G_CONVERTER (evd_http_chunked_decoder_new ());
+  priv->content_encoder = NULL;
+
+  priv->read_buffer = NULL;
+  priv->max_content_size = 0;
 
   priv->last_buf_block = NULL;
 }
@@ -176,6 +186,9 @@ evd_http_connection_finalize (GObject *obj)
 
   g_object_unref (self->priv->chunked_decoder);
 
+  if (self->priv->content_encoder != NULL)
+    g_object_unref (self->priv->content_encoder);
+
   if (self->priv->last_buf_block != NULL)
     g_slice_free1 (CONTENT_BLOCK_SIZE, self->priv->last_buf_block);
 
@@ -311,6 +324,7 @@ evd_http_connection_on_read_headers (EvdHttpConnection *self,
             soup_message_headers_get_encoding (headers);
           self->priv->content_len =
             soup_message_headers_get_content_length (headers);
+          self->priv->content_read = 0;
 
           /* detect if is keep-alive */
           conn_header = soup_message_headers_get_one (headers, "Connection");
@@ -357,6 +371,7 @@ evd_http_connection_on_read_headers (EvdHttpConnection *self,
             soup_message_headers_get_encoding (response->headers);
           self->priv->content_len =
             soup_message_headers_get_content_length (response->headers);
+          self->priv->content_read = 0;
         }
       else
         {
@@ -558,6 +573,17 @@ evd_http_connection_read_headers_async (EvdHttpConnection   *self,
   evd_http_connection_read_headers_block (self);
 }
 
+static void
+evd_http_connection_set_content_too_large_error (EvdHttpConnection  *self,
+                                                 GError            **error)
+{
+  g_set_error (error,
+               EVD_ERRNO_ERROR,
+               EMSGSIZE,
+               "Content exceeds the maximum size of %" G_GSIZE_FORMAT " bytes",
+               self->priv->max_content_size);
+}
+
 static void
 evd_http_connection_read_next_content_block (EvdHttpConnection *self)
 {
@@ -592,60 +618,107 @@ evd_http_connection_read_next_content_block (EvdHttpConnection *self)
                                           new_block_size);
 }
 
+static gboolean
+evd_http_connection_decode_chunked_content (EvdHttpConnection  *self,
+                                            gsize               size,
+                                            gchar              *dest,
+                                            gsize              *decoded_size,
+                                            gboolean           *done,
+                                            GError            **error)
+{
+  gchar outbuf[1024 + 1] = { 0, };
+  GConverterResult conv_result;
+  gsize total_bytes_read = 0;
+  gsize bytes_read = 0;
+  gsize bytes_written = 0;
+
+  do
+    {
+      conv_result =
+        g_converter_convert (self->priv->chunked_decoder,
+                             self->priv->last_buf_block + total_bytes_read,
+                             size - total_bytes_read,
+                             outbuf,
+                             1024,
+                             G_CONVERTER_NO_FLAGS,
+                             &bytes_read,
+                             &bytes_written,
+                             error);
+
+      total_bytes_read += bytes_read;
+
+      /* decoded content goes either to the caller's buffer, or
+         accumulates in the internal one */
+      if (dest != NULL)
+        memcpy (dest + *decoded_size, outbuf, bytes_written);
+      else
+        g_string_append_len (self->priv->buf, outbuf, bytes_written);
+
+      *decoded_size += bytes_written;
+      self->priv->content_read += bytes_written;
+    }
+  while (conv_result != G_CONVERTER_ERROR &&
+         conv_result != G_CONVERTER_FINISHED &&
+         total_bytes_read < size);
+
+  if (conv_result == G_CONVERTER_FINISHED)
+    {
+      g_converter_reset (self->priv->chunked_decoder);
+      *done = TRUE;
+
+      /* whatever follows the last chunk belongs to the next message */
+      if (total_bytes_read < size)
+        {
+          GInputStream *stream;
+
+          stream = g_io_stream_get_input_stream (G_IO_STREAM (self));
+          if (evd_buffered_input_stream_unread (EVD_BUFFERED_INPUT_STREAM (stream),
+                                       self->priv->last_buf_block + total_bytes_read,
+                                       size - total_bytes_read,
+                                       NULL,
+                                       error) < 0)
+            {
+              return FALSE;
+            }
+        }
+    }
+  else if (conv_result == G_CONVERTER_ERROR)
+    {
+      g_converter_reset (self->priv->chunked_decoder);
+      *done = TRUE;
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
 static gboolean
 evd_http_connection_process_read_content (EvdHttpConnection  *self,
                                           gsize               size,
+                                          gchar              *dest,
+                                          gsize              *content_size,
                                           gboolean           *done,
                                           GError            **error)
 {
-  gboolean result = TRUE;
+  *content_size = 0;
 
   if (self->priv->encoding == SOUP_ENCODING_CHUNKED)
     {
-      gchar outbuf[1024 + 1] = { 0, };
-      GConverterResult result;
-      gsize total_bytes_read = 0;
-      gsize bytes_read = 0;
-      gsize bytes_written = 0;
-
-      do
-        {
-          result =
-            g_converter_convert (self->priv->chunked_decoder,
-                                 self->priv->last_buf_block + total_bytes_read,
-                                 size - total_bytes_read,
-                                 outbuf,
-                                 1024,
-                                 G_CONVERTER_NO_FLAGS,
-                                 &bytes_read,
-                                 &bytes_written,
-                                 error);
-
-          total_bytes_read += bytes_read;
-
-          g_string_append_len (self->priv->buf, outbuf, bytes_written);
-          self->priv->content_read += bytes_written;
-        }
-      while (result != G_CONVERTER_ERROR &&
-             result != G_CONVERTER_FINISHED &&
-             total_bytes_read < size);
-
-      if (result == G_CONVERTER_FINISHED)
+      if (! evd_http_connection_decode_chunked_content (self,
+                                                        size,
+                                                        dest,
+                                                        content_size,
+                                                        done,
+                                                        error))
         {
-          g_converter_reset (self->priv->chunked_decoder);
-          *done = TRUE;
-        }
-      else if (result == G_CONVERTER_ERROR)
-        {
-          result = FALSE;
-
-          g_converter_reset (self->priv->chunked_decoder);
-          *done = TRUE;
+          return FALSE;
         }
     }
   else
     {
       self->priv->content_read += size;
+      *content_size = size;
 
       /* are we done reading? */
       if (! evd_connection_is_connected (EVD_CONNECTION (self))
@@ -660,7 +733,16 @@ evd_http_connection_process_read_content (EvdHttpConnection  *self,
         }
     }
 
-  return result;
+  if (self->priv->max_content_size > 0 &&
+      self->priv->content_read > self->priv->max_content_size)
+    {
+      evd_http_connection_set_content_too_large_error (self, error);
+      *done = TRUE;
+
+      return FALSE;
+    }
+
+  return TRUE;
 }
 
 static void
@@ -671,17 +753,24 @@ evd_http_connection_on_read_content_block (GObject      *obj,
   EvdHttpConnection *self = EVD_HTTP_CONNECTION (user_data);
   GError *error = NULL;
   gssize size;
+  gsize content_size = 0;
   gboolean done = FALSE;
   gpointer source_tag;
 
+  source_tag =
+    g_simple_async_result_get_source_tag (self->priv->async_result);
+
   if ( (size = g_input_stream_read_finish (G_INPUT_STREAM (obj),
                                            res,
                                            &error)) > 0)
     {
       if (! evd_http_connection_process_read_content (self,
-                                                      size,
-                                                      &done,
-                                                      &error))
+                                  size,
+                                  source_tag == evd_http_connection_read_content ?
+                                    self->priv->read_buffer : NULL,
+                                  &content_size,
+                                  &done,
+                                  &error))
         {
           g_simple_async_result_set_from_error (self->priv->async_result, error);
           g_error_free (error);
@@ -699,9 +788,6 @@ evd_http_connection_on_read_content_block (GObject      *obj,
       done = TRUE;
     }
 
-  source_tag =
-    g_simple_async_result_get_source_tag (self->priv->async_result);
-
   if (source_tag == evd_http_connection_read_all_content)
     {
       if (done)
@@ -716,7 +802,7 @@ evd_http_connection_on_read_content_block (GObject      *obj,
           struct ContentReadData *data;
 
           data = g_new0 (struct ContentReadData, 1);
-          data->size = size;
+          data->size = content_size;
           data->more = ! done;
 
           g_simple_async_result_set_op_res_gpointer (self->priv->async_result,
@@ -724,6 +810,7 @@ evd_http_connection_on_read_content_block (GObject      *obj,
                                                      g_free);
         }
 
+      self->priv->read_buffer = NULL;
       done = TRUE;
     }
 
@@ -801,6 +888,36 @@ evd_http_connection_on_write_request_headers (GObject      *obj,
   g_object_unref (self);
 }
 
+static gboolean
+evd_http_connection_write_raw (EvdHttpConnection  *self,
+                               const gchar        *buffer,
+                               gsize               size,
+                               GError            **error)
+{
+  GOutputStream *stream;
+  gssize size_written;
+
+  stream = g_io_stream_get_output_stream (G_IO_STREAM (self));
+
+  size_written = g_output_stream_write (stream, buffer, size, NULL, error);
+  if (size_written < 0)
+    {
+      return FALSE;
+    }
+  else if (size_written < size)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_AGAIN,
+                   "Resource temporarily unavailable, output buffer full");
+      return FALSE;
+    }
+  else
+    {
+      return TRUE;
+    }
+}
+
 static gboolean
 evd_http_connection_write_chunk (EvdHttpConnection   *self,
                                  const gchar         *buffer,
@@ -811,27 +928,21 @@ evd_http_connection_write_chunk (EvdHttpConnection   *self,
   GError *_error = NULL;
   gboolean result = TRUE;
 
-  self->priv->encoding = SOUP_ENCODING_EOF;
-
   chunk_hdr = g_strdup_printf ("%x\r\n", (guint) size);
-  result = evd_http_connection_write_content (self,
-                                              chunk_hdr,
-                                              strlen (chunk_hdr),
-                                              TRUE,
-                                              &_error);
+  result = evd_http_connection_write_raw (self,
+                                          chunk_hdr,
+                                          strlen (chunk_hdr),
+                                          &_error);
 
   if (result && size > 0)
-    result = evd_http_connection_write_content (self,
-                                                buffer,
-                                                size,
-                                                TRUE,
-                                                _error == NULL ? &_error : NULL);
+    result = evd_http_connection_write_raw (self,
+                                            buffer,
+                                            size,
+                                            _error == NULL ? &_error : NULL);
 
   if (result)
-    result = evd_http_connection_write_content (self, "\r\n", 2, TRUE,
-                                                _error == NULL ? &_error : NULL);
-
-  self->priv->encoding = SOUP_ENCODING_CHUNKED;
+    result = evd_http_connection_write_raw (self, "\r\n", 2,
+                                            _error == NULL ? &_error : NULL);
 
   g_free (chunk_hdr);
   if (_error != NULL)
@@ -840,6 +951,110 @@ evd_http_connection_write_chunk (EvdHttpConnection   *self,
   return result;
 }
 
+static gboolean
+evd_http_connection_write_content_internal (EvdHttpConnection  *self,
+                                            const gchar        *buffer,
+                                            gsize               size,
+                                            gboolean            more,
+                                            GError            **error)
+{
+  if (self->priv->encoding == SOUP_ENCODING_CHUNKED)
+    {
+       if (size == 0 || evd_http_connection_write_chunk (self,
+                                                         buffer,
+                                                         size,
+                                                         error))
+        {
+          if (! more)
+            return evd_http_connection_write_chunk (self,
+                                                    NULL,
+                                                    0,
+                                                    error);
+          else
+            return TRUE;
+        }
+      else
+        {
+          return FALSE;
+        }
+    }
+  else
+    {
+      return evd_http_connection_write_raw (self, buffer, size, error);
+    }
+}
+
+static gboolean
+evd_http_connection_write_encoded_content (EvdHttpConnection  *self,
+                                           const gchar        *buffer,
+                                           gsize               size,
+                                           gboolean            more,
+                                           GError            **error)
+{
+  GConverter *encoder = self->priv->content_encoder;
+  GConverterResult conv_result;
+  gchar out[CONTENT_BLOCK_SIZE];
+  gsize bytes_read;
+  gsize bytes_written;
+  gboolean result = TRUE;
+
+  if (more && size == 0)
+    return TRUE;
+
+  /* flush encoder after every write, so that what was written can be
+     decoded by the peer right away (e.g, a long-polling frame) */
+  do
+    {
+      conv_result = g_converter_convert (encoder,
+                                         buffer,
+                                         size,
+                                         out,
+                                         CONTENT_BLOCK_SIZE,
+                                         more ?
+                                           G_CONVERTER_FLUSH :
+                                           G_CONVERTER_INPUT_AT_END,
+                                         &bytes_read,
+                                         &bytes_written,
+                                         error);
+      if (conv_result == G_CONVERTER_ERROR)
+        {
+          result = FALSE;
+          break;
+        }
+
+      buffer += bytes_read;
+      size -= bytes_read;
+
+      if (bytes_written > 0 &&
+          ! evd_http_connection_write_content_internal (self,
+                                                       out,
+                                                       bytes_written,
+                                                       TRUE,
+                                                       error))
+        {
+          result = FALSE;
+          break;
+        }
+    }
+  while (conv_result == G_CONVERTER_CONVERTED);
+
+  if (! more)
+    {
+      /* response is over, encoder is not needed anymore */
+      g_object_unref (self->priv->content_encoder);
+      self->priv->content_encoder = NULL;
+
+      if (result)
+        result = evd_http_connection_write_content_internal (self,
+                                                            NULL,
+                                                            0,
+                                                            FALSE,
+                                                            error);
+    }
+
+  return result;
+}
+
 /* public methods */
 
 EvdHttpConnection *
@@ -1058,51 +1273,18 @@ evd_http_connection_write_content (EvdHttpConnection  *self,
 {
   g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (self), FALSE);
 
-  if (self->priv->encoding == SOUP_ENCODING_CHUNKED)
-    {
-       if (size == 0 || evd_http_connection_write_chunk (self,
-                                                         buffer,
-                                                         size,
-                                                         error))
-        {
-          if (! more)
-            return evd_http_connection_write_chunk (self,
-                                                    NULL,
-                                                    0,
-                                                    error);
-          else
-            return TRUE;
-        }
-      else
-        {
-          return FALSE;
-        }
-    }
+  if (self->priv->content_encoder != NULL)
+    return evd_http_connection_write_encoded_content (self,
+                                                      buffer,
+                                                      size,
+                                                      more,
+                                                      error);
   else
-    {
-      GOutputStream *stream;
-      gssize size_written;
-
-      stream = g_io_stream_get_output_stream (G_IO_STREAM (self));
-
-      size_written = g_output_stream_write (stream, buffer, size, NULL, error);
-      if (size_written < 0)
-        {
-          return FALSE;
-        }
-      else if (size_written < size)
-        {
-          g_set_error (error,
-                       G_IO_ERROR,
-                       G_IO_ERROR_AGAIN,
-                       "Resource temporarily unavailable, output buffer full");
-          return FALSE;
-        }
-      else
-        {
-          return TRUE;
-        }
-    }
+    return evd_http_connection_write_content_internal (self,
+                                                       buffer,
+                                                       size,
+                                                       more,
+                                                       error);
 }
 
 /**
@@ -1141,9 +1323,12 @@ evd_http_connection_read_content (EvdHttpConnection   *self,
       return;
     }
 
-  if (self->priv->encoding == SOUP_ENCODING_CONTENT_LENGTH &&
-      self->priv->content_len == 0)
+  if (self->priv->encoding == SOUP_ENCODING_NONE ||
+      (self->priv->encoding == SOUP_ENCODING_CONTENT_LENGTH &&
+       self->priv->content_read >= self->priv->content_len))
     {
+      g_io_stream_clear_pending (G_IO_STREAM (self));
+
       g_simple_async_result_set_op_res_gssize (res, 0);
 
       g_simple_async_result_complete_in_idle (res);
@@ -1152,8 +1337,46 @@ evd_http_connection_read_content (EvdHttpConnection   *self,
       return;
     }
 
+  if (self->priv->encoding == SOUP_ENCODING_CONTENT_LENGTH)
+    {
+      if (self->priv->max_content_size > 0 &&
+          self->priv->content_len > self->priv->max_content_size)
+        {
+          g_io_stream_clear_pending (G_IO_STREAM (self));
+
+          evd_http_connection_set_content_too_large_error (self, &error);
+          g_simple_async_result_set_from_error (res, error);
+          g_error_free (error);
+
+          g_simple_async_result_complete_in_idle (res);
+          g_object_unref (res);
+
+          return;
+        }
+
+      /* never read beyond the end of the content */
+      size = MIN (size, self->priv->content_len - self->priv->content_read);
+    }
+
   self->priv->async_result = res;
-  evd_http_connection_read_content_block (self, buffer, size);
+
+  if (self->priv->encoding == SOUP_ENCODING_CHUNKED)
+    {
+      /* raw content is read into an internal block, and decoded into
+         the caller's buffer. Decoded content is never bigger than the
+         raw one, so it always fits. */
+      if (self->priv->last_buf_block == NULL)
+        self->priv->last_buf_block = g_slice_alloc (CONTENT_BLOCK_SIZE);
+
+      self->priv->read_buffer = buffer;
+      evd_http_connection_read_content_block (self,
+                                              self->priv->last_buf_block,
+                                              MIN (size, CONTENT_BLOCK_SIZE));
+    }
+  else
+    {
+      evd_http_connection_read_content_block (self, buffer, size);
+    }
 }
 
 /**
@@ -1245,6 +1468,22 @@ evd_http_connection_read_all_content (EvdHttpConnection   *self,
       return;
     }
 
+  if (self->priv->encoding == SOUP_ENCODING_CONTENT_LENGTH &&
+      self->priv->max_content_size > 0 &&
+      self->priv->content_len > self->priv->max_content_size)
+    {
+      g_io_stream_clear_pending (G_IO_STREAM (self));
+
+      evd_http_connection_set_content_too_large_error (self, &error);
+      g_simple_async_result_set_from_error (res, error);
+      g_error_free (error);
+
+      g_simple_async_result_complete_in_idle (res);
+      g_object_unref (res);
+
+      return;
+    }
+
   self->priv->content_read = 0;
   g_string_set_size (self->priv->buf, 0);
 
@@ -1433,6 +1672,63 @@ evd_http_connection_get_current_request (EvdHttpConnection *self)
   return self->priv->current_request;
 }
 
+/**
+ * evd_http_connection_set_content_encoder:
+ * @encoder: (allow-none): a #GConverter, or %NULL
+ *
+ * Sets a converter (e.g, a #GZlibCompressor) that all content written with
+ * evd_http_connection_write_content() will pass through until the current
+ * response is finished. The encoder is flushed after every write, and
+ * dropped once content is written with @more set to %FALSE. It is up to the
+ * caller to announce the corresponding Content-Encoding in the response
+ * headers.
+ **/
+void
+evd_http_connection_set_content_encoder (EvdHttpConnection *self,
+                                         GConverter        *encoder)
+{
+  g_return_if_fail (EVD_IS_HTTP_CONNECTION (self));
+  g_return_if_fail (encoder == NULL || G_IS_CONVERTER (encoder));
+
+  if (encoder != NULL)
+    g_object_ref (encoder);
+
+  if (self->priv->content_encoder != NULL)
+    g_object_unref (self->priv->content_encoder);
+
+  self->priv->content_encoder = encoder;
+}
+
+/**
+ * evd_http_connection_set_max_content_size:
+ * @size: maximum size in bytes of a request's content, or 0 for no limit
+ *
+ * Limits the amount of (decoded) content that can be read from the current
+ * and subsequent messages. Reading content beyond this limit fails with
+ * an %EVD_ERRNO_ERROR error of code %EMSGSIZE.
+ **/
+void
+evd_http_connection_set_max_content_size (EvdHttpConnection *self,
+                                          gsize              size)
+{
+  g_return_if_fail (EVD_IS_HTTP_CONNECTION (self));
+
+  self->priv->max_content_size = size;
+}
+
+/**
+ * evd_http_connection_get_max_content_size:
+ *
+ * Returns: the maximum content size, or 0 if there is no limit.
+ **/
+gsize
+evd_http_connection_get_max_content_size (EvdHttpConnection *self)
+{
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (self), 0);
+
+  return self->priv->max_content_size;
+}
+
 gboolean
 evd_http_connection_redirect (EvdHttpConnection  *self,
                               const gchar        *url,
@@ -147,6 +147,13 @@ void                evd_http_connection_set_current_request          (EvdHttpCon
                                                                       EvdHttpRequest    *request);
 EvdHttpRequest     *evd_http_connection_get_current_request          (EvdHttpConnection *self);
 
+void                evd_http_connection_set_content_encoder          (EvdHttpConnection *self,
+                                                                      GConverter        *encoder);
+
+void                evd_http_connection_set_max_content_size         (EvdHttpConnection *self,
+                                                                      gsize              size);
+gsize               evd_http_connection_get_max_content_size         (EvdHttpConnection *self);
+
 gboolean            evd_http_connection_redirect                     (EvdHttpConnection  *self,
                                                                       const gchar        *url,
                                                                       gboolean            permanently,
@@ -23,6 +23,7 @@
 #include <string.h>
 
 #include <libsoup/soup-method.h>
+#include <libsoup/soup-headers.h>
 
 #include "evd-http-request.h"
 
@@ -484,3 +485,62 @@ evd_http_request_is_cors_preflight (EvdHttpRequest *self)
     (soup_message_headers_get_one (headers, "Access-Control-Request-Headers") != NULL ||
      soup_message_headers_get_one (headers, "Access-Control-Request-Method") != NULL);
 }
+
+/**
+ * evd_http_request_accepts_encoding:
+ * @encoding: a content-coding name, like "gzip"
+ *
+ * Checks the request's Accept-Encoding header to tell whether the client
+ * accepts a response body encoded with @encoding.
+ *
+ * Returns: %TRUE if @encoding is acceptable, %FALSE otherwise
+ **/
+gboolean
+evd_http_request_accepts_encoding (EvdHttpRequest *self,
+                                   const gchar    *encoding)
+{
+  SoupMessageHeaders *headers;
+  const gchar *accept_encoding;
+  GSList *acceptable;
+  GSList *unacceptable = NULL;
+  GSList *node;
+  gboolean result = FALSE;
+  gboolean wildcard = FALSE;
+
+  g_return_val_if_fail (EVD_IS_HTTP_REQUEST (self), FALSE);
+  g_return_val_if_fail (encoding != NULL, FALSE);
+
+  headers = evd_http_message_get_headers (EVD_HTTP_MESSAGE (self));
+
+  accept_encoding = soup_message_headers_get_one (headers, "Accept-Encoding");
+  if (accept_encoding == NULL)
+    return FALSE;
+
+  acceptable = soup_header_parse_quality_list (accept_encoding, &unacceptable);
+
+  for (node = acceptable; node != NULL && ! result; node = node->next)
+    {
+      if (g_ascii_strcasecmp (node->data, encoding) == 0)
+        result = TRUE;
+      else if (g_strcmp0 (node->data, "*") == 0)
+        wildcard = TRUE;
+    }
+
+  /* '*' matches any coding not explicitly refused with q=0 */
+  if (! result && wildcard)
+    {
+      result = TRUE;
+
+      for (node = unacceptable; node != NULL; node = node->next)
+        if (g_ascii_strcasecmp (node->data, encoding) == 0)
+          {
+            result = FALSE;
+            break;
+          }
+    }
+
+  soup_header_free_list (acceptable);
+  soup_header_free_list (unacceptable);
+
+  return result;
+}
@@ -86,6 +86,9 @@ const gchar     *evd_http_request_get_origin                 (EvdHttpRequest *se
 gboolean         evd_http_request_is_cross_origin            (EvdHttpRequest *self);
 gboolean         evd_http_request_is_cors_preflight          (EvdHttpRequest *self);
 
+gboolean         evd_http_request_accepts_encoding           (EvdHttpRequest *self,
+                                                              const gchar    *encoding);
+
 G_END_DECLS
 
 #endif /* __EVD_HTTP_REQUEST_H__ */
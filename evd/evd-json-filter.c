@@ -23,6 +23,11 @@
 #include <string.h>
 #include <gio/gio.h>
 
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2_SCANNER 1
+#endif
+
 #include "evd-error.h"
 #include "evd-json-filter.h"
 #include "evd-marshal.h"
@@ -35,6 +40,10 @@ G_DEFINE_TYPE (EvdJsonFilter, evd_json_filter, G_TYPE_OBJECT)
 
 #define MAX_DEPTH 128
 
+/* the cache keeps its allocation between packets, unless a packet made it
+   grow beyond this */
+#define CACHE_KEEP_SIZE 0x00010000
+
 /*
  *  Code pieces taken from http://www.json.org/JSON_checker/.
  */
@@ -208,6 +217,7 @@ struct _EvdJsonFilterPrivate
 
   gint     content_start;
   GString *cache;
+  gsize    max_packet_size;
 
   EvdJsonFilterOnPacketHandler packet_cb;
   gpointer user_data;
@@ -242,7 +252,8 @@ evd_json_filter_init (EvdJsonFilter *self)
 
   /* initialize private members */
   priv->stack = g_new0 (gint, MAX_DEPTH);
-  priv->cache = g_string_new ("");
+  priv->cache = g_string_sized_new (256);
+  priv->max_packet_size = 0;
 
   evd_json_filter_reset (self);
 
@@ -458,6 +469,89 @@ evd_json_filter_process (EvdJsonFilter *self, gint next_char, gsize offset)
     return TRUE;
 }
 
+static inline gboolean
+is_white (gchar c)
+{
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+/* returns the offset of the first byte from @i on that the string state
+   does not simply loop on: a quote, a backslash, a control character or
+   a non-ASCII byte. Those are left to the state machine, so validation
+   is unchanged */
+static gsize
+skip_string_body (const gchar *buffer, gsize i, gsize size)
+{
+#ifdef HAVE_SSE2_SCANNER
+  const __m128i quote = _mm_set1_epi8 ('"');
+  const __m128i backslash = _mm_set1_epi8 ('\\');
+  const __m128i space = _mm_set1_epi8 (' ');
+
+  while (i + 16 <= size)
+    {
+      __m128i block;
+      gint mask;
+
+      block = _mm_loadu_si128 ((const __m128i *) (buffer + i));
+
+      /* signed comparison, so bytes >= 0x80 are caught too */
+      mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (block, quote),
+                                                            _mm_cmpeq_epi8 (block, backslash)),
+                                              _mm_cmplt_epi8 (block, space)));
+      if (mask != 0)
+        return i + g_bit_nth_lsf (mask, -1);
+
+      i += 16;
+    }
+#endif
+
+  while (i < size &&
+         buffer[i] != '"' &&
+         buffer[i] != '\\' &&
+         (guchar) buffer[i] >= ' ' &&
+         (guchar) buffer[i] < 128)
+    {
+      i++;
+    }
+
+  return i;
+}
+
+/* returns the offset of the first non-whitespace byte from @i */
+static gsize
+skip_white (const gchar *buffer, gsize i, gsize size)
+{
+#ifdef HAVE_SSE2_SCANNER
+  const __m128i space = _mm_set1_epi8 (' ');
+  const __m128i nl = _mm_set1_epi8 ('\n');
+  const __m128i cr = _mm_set1_epi8 ('\r');
+  const __m128i tab = _mm_set1_epi8 ('\t');
+
+  while (i + 16 <= size)
+    {
+      __m128i block;
+      gint mask;
+
+      block = _mm_loadu_si128 ((const __m128i *) (buffer + i));
+
+      mask = _mm_movemask_epi8 (_mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (block, space),
+                                                            _mm_cmpeq_epi8 (block, nl)),
+                                              _mm_or_si128 (_mm_cmpeq_epi8 (block, cr),
+                                                            _mm_cmpeq_epi8 (block, tab))));
+      mask = ~mask & 0xFFFF;
+      if (mask != 0)
+        return i + g_bit_nth_lsf (mask, -1);
+
+      i += 16;
+    }
+#endif
+
+  while (i < size && is_white (buffer[i]))
+    i++;
+
+  return i;
+}
+
 static void
 evd_json_filter_notify_packet (EvdJsonFilter *self,
                                const gchar   *buffer,
@@ -467,6 +561,39 @@ evd_json_filter_notify_packet (EvdJsonFilter *self,
     self->priv->packet_cb (self, buffer, size, self->priv->user_data);
 }
 
+static void
+evd_json_filter_clear_cache (EvdJsonFilter *self)
+{
+  if (self->priv->cache->allocated_len > CACHE_KEEP_SIZE)
+    {
+      g_string_free (self->priv->cache, TRUE);
+      self->priv->cache = g_string_sized_new (256);
+    }
+  else
+    {
+      g_string_truncate (self->priv->cache, 0);
+    }
+}
+
+static gboolean
+evd_json_filter_check_size (EvdJsonFilter  *self,
+                            gsize           size,
+                            GError        **error)
+{
+  if (self->priv->max_packet_size == 0 || size <= self->priv->max_packet_size)
+    return TRUE;
+
+  evd_json_filter_reset (self);
+
+  g_set_error (error,
+               G_IO_ERROR,
+               G_IO_ERROR_INVALID_DATA,
+               "JSON packet exceeds the maximum size of %" G_GSIZE_FORMAT " bytes",
+               self->priv->max_packet_size);
+
+  return FALSE;
+}
+
 /* public methods */
 
 EvdJsonFilter *
@@ -489,6 +616,7 @@ evd_json_filter_reset (EvdJsonFilter *self)
   self->priv->top = -1;
 
   self->priv->content_start = -1;
+  evd_json_filter_clear_cache (self);
 
   evd_json_filter_push (self, MODE_DONE);
 }
@@ -499,7 +627,7 @@ evd_json_filter_feed_len (EvdJsonFilter  *self,
                           gsize           size,
                           GError        **error)
 {
-  gint i;
+  gsize i;
 
   g_return_val_if_fail (EVD_IS_JSON_FILTER (self), FALSE);
   g_return_val_if_fail (buffer != NULL, FALSE);
@@ -507,12 +635,30 @@ evd_json_filter_feed_len (EvdJsonFilter  *self,
   i = 0;
   while (i < size)
     {
+      /* string bodies and whitespace between tokens leave the state and
+         the stack untouched, so they are skipped in blocks and only the
+         bytes that matter go through the state machine. No packet can
+         end inside them */
+      if (self->priv->state == ST)
+        {
+          i = skip_string_body (buffer, i, size);
+          if (i == size)
+            break;
+        }
+      else if (self->priv->state < ST && is_white (buffer[i]))
+        {
+          i = skip_white (buffer, i, size);
+          if (i == size)
+            break;
+        }
+
       if (! evd_json_filter_process (self, (gint) buffer[i], i))
         {
           g_set_error (error,
                        G_IO_ERROR,
                        G_IO_ERROR_INVALID_DATA,
-                       "Malformed JSON sequence at offset %d", i);
+                       "Malformed JSON sequence at offset %" G_GSIZE_FORMAT,
+                       i);
 
           return FALSE;
         }
@@ -523,17 +669,29 @@ evd_json_filter_feed_len (EvdJsonFilter  *self,
             {
               if (self->priv->cache->len > 0)
                 {
+                  if (! evd_json_filter_check_size (self,
+                                                    self->priv->cache->len + i + 1,
+                                                    error))
+                    {
+                      return FALSE;
+                    }
+
                   g_string_append_len (self->priv->cache, buffer, i+1);
 
                   evd_json_filter_notify_packet (self,
                                                  self->priv->cache->str,
                                                  self->priv->cache->len);
-
-                  g_string_free (self->priv->cache, TRUE);
-                  self->priv->cache = g_string_new ("");
                 }
               else
                 {
+                  if (! evd_json_filter_check_size (self,
+                                                    i - self->priv->content_start + 1,
+                                                    error))
+                    {
+                      return FALSE;
+                    }
+
+                  /* the whole packet is in the caller's buffer, no copy */
                   evd_json_filter_notify_packet (self,
                       (gchar *) ( (void *) buffer + self->priv->content_start),
                       i - self->priv->content_start + 1);
@@ -548,6 +706,14 @@ evd_json_filter_feed_len (EvdJsonFilter  *self,
 
   if (self->priv->content_start >= 0)
     {
+      if (! evd_json_filter_check_size (self,
+                                        self->priv->cache->len +
+                                        size - self->priv->content_start,
+                                        error))
+        {
+          return FALSE;
+        }
+
       g_string_append_len (self->priv->cache,
                      (gchar *) ( (void *) (buffer) + self->priv->content_start),
                      size - self->priv->content_start);
@@ -585,3 +751,34 @@ evd_json_filter_set_packet_handler (EvdJsonFilter                *self,
   self->priv->user_data = user_data;
   self->priv->user_data_free_func = user_data_free_func;
 }
+
+/**
+ * evd_json_filter_set_max_packet_size:
+ * @self: The #EvdJsonFilter
+ * @size: The maximum size of a packet in bytes, or 0 for no limit
+ *
+ * Limits the size of the packets the filter accepts. Feeding a packet
+ * bigger than @size fails with %G_IO_ERROR_INVALID_DATA and resets the
+ * filter, instead of buffering it. There is no limit by default.
+ **/
+void
+evd_json_filter_set_max_packet_size (EvdJsonFilter *self, gsize size)
+{
+  g_return_if_fail (EVD_IS_JSON_FILTER (self));
+
+  self->priv->max_packet_size = size;
+}
+
+/**
+ * evd_json_filter_get_max_packet_size:
+ * @self: The #EvdJsonFilter
+ *
+ * Returns: The maximum size of a packet in bytes, or 0 if there is no limit.
+ **/
+gsize
+evd_json_filter_get_max_packet_size (EvdJsonFilter *self)
+{
+  g_return_val_if_fail (EVD_IS_JSON_FILTER (self), 0);
+
+  return self->priv->max_packet_size;
+}
@@ -75,6 +75,10 @@ void              evd_json_filter_set_packet_handler         (EvdJsonFilter
                                                               gpointer                      user_data,
                                                               GDestroyNotify                user_data_free_func);
 
+void              evd_json_filter_set_max_packet_size        (EvdJsonFilter *self,
+                                                              gsize          size);
+gsize             evd_json_filter_get_max_packet_size        (EvdJsonFilter *self);
+
 G_END_DECLS
 
 #endif /* __EVD_JSON_FILTER_H__ */
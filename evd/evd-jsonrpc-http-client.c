@@ -42,6 +42,9 @@ struct _EvdJsonrpcHttpClientPrivate
 
   EvdJsonrpc *rpc;
   EvdHttpRequest *http_request;
+
+  gboolean batching;
+  GSimpleAsyncResult *batch_context;
 };
 
 typedef struct
@@ -135,6 +138,9 @@ evd_jsonrpc_http_client_init (EvdJsonrpcHttpClient *self)
   g_object_ref (self);
 
   priv->http_request = NULL;
+
+  priv->batching = FALSE;
+  priv->batch_context = NULL;
 }
 
 static void
@@ -292,6 +298,9 @@ on_content_read (GObject      *obj,
 
       g_free (content);
     }
+
+  /* the HTTP exchange is over */
+  g_object_unref (res);
 }
 
 static void
@@ -324,6 +333,8 @@ on_response_headers (GObject      *obj,
                                    data->invocation_id,
                                    error);
       g_error_free (error);
+
+      g_object_unref (res);
     }
   else
     {
@@ -348,6 +359,8 @@ on_response_headers (GObject      *obj,
                                        data->invocation_id,
                                        error);
           g_error_free (error);
+
+          g_object_unref (res);
         }
 
       soup_message_headers_free (headers);
@@ -379,6 +392,8 @@ on_request_sent (GObject      *obj,
                                    error);
       g_error_free (error);
 
+      g_object_unref (res);
+
       return;
     }
 
@@ -394,6 +409,8 @@ on_request_sent (GObject      *obj,
                                    data->invocation_id,
                                    error);
       g_error_free (error);
+
+      g_object_unref (res);
     }
   else
     {
@@ -450,6 +467,8 @@ on_connection (GObject      *obj,
                                    data->invocation_id,
                                    error);
       g_error_free (error);
+
+      g_object_unref (res);
     }
   else
     {
@@ -474,6 +493,11 @@ jsonrpc_on_send (EvdJsonrpc  *rpc,
   data->buf = g_strdup (buffer);
   data->invocation_id = invocation_id;
 
+  /* the call may complete before the HTTP exchange does, e.g if it times
+     out, so the exchange holds its own reference. A response arriving
+     after that is ignored by the JSON-RPC object */
+  g_object_ref (res);
+
   evd_connection_pool_get_connection (EVD_CONNECTION_POOL (data->self),
                                       data->cancellable,
                                       on_connection,
@@ -573,6 +597,11 @@ evd_jsonrpc_http_client_call_method (EvdJsonrpcHttpClient *self,
                                              data,
                                              free_call_data);
 
+  /* the first call of a batch carries the HTTP request of all of them. The
+     request keeps it alive until the exchange is over */
+  if (self->priv->batching && self->priv->batch_context == NULL)
+    self->priv->batch_context = res;
+
   evd_jsonrpc_call_method (self->priv->rpc,
                            method,
                            params,
@@ -628,3 +657,78 @@ evd_jsonrpc_http_client_call_method_finish (EvdJsonrpcHttpClient  *self,
       return FALSE;
     }
 }
+
+/**
+ * evd_jsonrpc_http_client_begin_batch:
+ *
+ * Starts a batch. Method calls made until
+ * evd_jsonrpc_http_client_end_batch() is called are sent together, in a
+ * single HTTP request, and their responses come back in a single HTTP
+ * response. Each call still completes on its own callback.
+ *
+ * The HTTP request is cancelled with the cancellable of the first call in
+ * the batch.
+ **/
+void
+evd_jsonrpc_http_client_begin_batch (EvdJsonrpcHttpClient *self)
+{
+  g_return_if_fail (EVD_IS_JSONRPC_HTTP_CLIENT (self));
+  g_return_if_fail (! self->priv->batching);
+
+  self->priv->batching = TRUE;
+  self->priv->batch_context = NULL;
+
+  evd_jsonrpc_begin_batch (self->priv->rpc);
+}
+
+/**
+ * evd_jsonrpc_http_client_end_batch:
+ *
+ * Sends the method calls made since evd_jsonrpc_http_client_begin_batch()
+ * was called, in a single HTTP request.
+ **/
+void
+evd_jsonrpc_http_client_end_batch (EvdJsonrpcHttpClient *self)
+{
+  GSimpleAsyncResult *context;
+
+  g_return_if_fail (EVD_IS_JSONRPC_HTTP_CLIENT (self));
+  g_return_if_fail (self->priv->batching);
+
+  context = self->priv->batch_context;
+  self->priv->batching = FALSE;
+  self->priv->batch_context = NULL;
+
+  /* there is always a transport, so this cannot fail */
+  evd_jsonrpc_end_batch (self->priv->rpc, context, NULL);
+}
+
+/**
+ * evd_jsonrpc_http_client_set_timeout_interval:
+ * @interval: The timeout in seconds, or 0 to disable it.
+ *
+ * Sets the time a method call waits for its response before failing with
+ * %G_IO_ERROR_TIMED_OUT. Calls never time out by default. See
+ * evd_jsonrpc_set_timeout_interval().
+ **/
+void
+evd_jsonrpc_http_client_set_timeout_interval (EvdJsonrpcHttpClient *self,
+                                              guint                 interval)
+{
+  g_return_if_fail (EVD_IS_JSONRPC_HTTP_CLIENT (self));
+
+  evd_jsonrpc_set_timeout_interval (self->priv->rpc, interval);
+}
+
+/**
+ * evd_jsonrpc_http_client_get_timeout_interval:
+ *
+ * Returns: The method call timeout in seconds, 0 if disabled.
+ **/
+guint
+evd_jsonrpc_http_client_get_timeout_interval (EvdJsonrpcHttpClient *self)
+{
+  g_return_val_if_fail (EVD_IS_JSONRPC_HTTP_CLIENT (self), 0);
+
+  return evd_jsonrpc_get_timeout_interval (self->priv->rpc);
+}
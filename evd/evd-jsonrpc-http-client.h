@@ -87,6 +87,13 @@ gboolean               evd_jsonrpc_http_client_call_method_finish      (EvdJsonr
                                                                         JsonNode             **json_error,
                                                                         GError               **error);
 
+void                   evd_jsonrpc_http_client_begin_batch             (EvdJsonrpcHttpClient *self);
+void                   evd_jsonrpc_http_client_end_batch               (EvdJsonrpcHttpClient *self);
+
+void                   evd_jsonrpc_http_client_set_timeout_interval    (EvdJsonrpcHttpClient *self,
+                                                                        guint                 interval);
+guint                  evd_jsonrpc_http_client_get_timeout_interval    (EvdJsonrpcHttpClient *self);
+
 G_END_DECLS
 
 #endif /* __EVD_JSONRPC_HTTP_CLIENT_H__ */
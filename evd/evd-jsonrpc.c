@@ -25,6 +25,7 @@
 #include "evd-jsonrpc.h"
 
 #include "evd-json-filter.h"
+#include "evd-utils.h"
 
 G_DEFINE_TYPE (EvdJsonrpc, evd_jsonrpc, EVD_TYPE_IPC_MECHANISM)
 
@@ -32,7 +33,11 @@ G_DEFINE_TYPE (EvdJsonrpc, evd_jsonrpc, EVD_TYPE_IPC_MECHANISM)
                                       EVD_TYPE_JSONRPC, \
                                       EvdJsonrpcPrivate))
 
-#define DEFAULT_TIMEOUT_INTERVAL 15
+#define DEFAULT_TIMEOUT_INTERVAL 0
+
+/* the output buffer keeps its allocation between messages, unless a
+   message made it grow beyond this */
+#define OUT_BUF_KEEP_SIZE 0x00010000
 
 struct _EvdJsonrpcPrivate
 {
@@ -42,10 +47,21 @@ struct _EvdJsonrpcPrivate
   gpointer send_cb_user_data;
   GDestroyNotify send_cb_user_data_free_func;
 
+  /* invocations by id, and in the order they time out */
   GHashTable *invocations;
+  GQueue *timeouts;
+  guint timeout_interval;
+  guint timeout_src_id;
 
   EvdJsonFilter *json_filter;
 
+  GString *out_buf;
+
+  /* outgoing batch, while one is open */
+  GString *batch_buf;
+  guint batch_id;
+  guint batch_len;
+
   gpointer context;
 
   EvdJsonrpcMethodCallCb method_call_cb;
@@ -60,11 +76,29 @@ typedef struct
   JsonNode *error;
 } MethodResponse;
 
+/* responses to a batch of calls received at once, sent back together
+   when all of them are answered */
+typedef struct
+{
+  gint ref_count;
+  EvdJsonrpc *rpc;
+  gpointer context;
+  guint pending;
+  GString *buf;
+} ResponseBatch;
+
 typedef struct
 {
+  guint id;
   GSimpleAsyncResult *result;
   JsonNode *remote_id;
   gpointer context;
+  guint batch_id;
+  ResponseBatch *batch;
+
+  gint64 deadline;
+  GQueue *timeouts;
+  GList *timeout_link;
 } InvocationData;
 
 static void     evd_jsonrpc_class_init           (EvdJsonrpcClass *class);
@@ -85,6 +119,11 @@ static void     transport_on_receive             (EvdIpcMechanism *ipc_mechanism
 
 static void     free_invocation_data             (InvocationData *data);
 
+static void     evd_jsonrpc_transport_write      (EvdJsonrpc   *self,
+                                                  const gchar  *msg,
+                                                  gpointer      user_context,
+                                                  guint         invocation_id);
+
 static void
 evd_jsonrpc_class_init (EvdJsonrpcClass *class)
 {
@@ -111,10 +150,14 @@ evd_jsonrpc_init (EvdJsonrpc *self)
   priv->send_cb = NULL;
   priv->send_cb_user_data = NULL;
 
-  priv->invocations = g_hash_table_new_full (g_str_hash,
-                                             g_str_equal,
-                                             g_free,
+  /* ids are local integers, so they key the table as they are */
+  priv->invocations = g_hash_table_new_full (g_direct_hash,
+                                             g_direct_equal,
+                                             NULL,
                                              (GDestroyNotify) free_invocation_data);
+  priv->timeouts = g_queue_new ();
+  priv->timeout_interval = DEFAULT_TIMEOUT_INTERVAL;
+  priv->timeout_src_id = 0;
 
   priv->json_filter = evd_json_filter_new ();
   evd_json_filter_set_packet_handler (priv->json_filter,
@@ -122,6 +165,12 @@ evd_jsonrpc_init (EvdJsonrpc *self)
                                       self,
                                       NULL);
 
+  priv->out_buf = g_string_sized_new (256);
+
+  priv->batch_buf = NULL;
+  priv->batch_id = 0;
+  priv->batch_len = 0;
+
   priv->context = NULL;
 
   priv->method_call_cb = NULL;
@@ -135,9 +184,28 @@ evd_jsonrpc_finalize (GObject *obj)
 {
   EvdJsonrpc *self = EVD_JSONRPC (obj);
 
+  GHashTableIter iter;
+  InvocationData *inv_data;
+
+  if (self->priv->timeout_src_id != 0)
+    g_source_remove (self->priv->timeout_src_id);
+
   g_object_unref (self->priv->json_filter);
 
+  if (self->priv->out_buf != NULL)
+    g_string_free (self->priv->out_buf, TRUE);
+
+  if (self->priv->batch_buf != NULL)
+    g_string_free (self->priv->batch_buf, TRUE);
+
+  /* pending response batches must not be sent from here */
+  g_hash_table_iter_init (&iter, self->priv->invocations);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &inv_data))
+    if (inv_data->batch != NULL)
+      inv_data->batch->rpc = NULL;
+
   g_hash_table_unref (self->priv->invocations);
+  g_queue_free (self->priv->timeouts);
 
   if (self->priv->send_cb_user_data != NULL &&
       self->priv->send_cb_user_data_free_func != NULL)
@@ -148,87 +216,497 @@ evd_jsonrpc_finalize (GObject *obj)
   G_OBJECT_CLASS (evd_jsonrpc_parent_class)->finalize (obj);
 }
 
-static gchar *
-evd_jsonrpc_build_message (EvdJsonrpc  *self,
+static void
+append_string (GString *buf, const gchar *str)
+{
+  const gchar *p;
+  const gchar *run;
+
+  g_string_append_c (buf, '"');
+
+  /* unescaped runs are appended at once */
+  run = str;
+  for (p = str; *p != '\0'; p++)
+    {
+      guchar c = (guchar) *p;
+
+      if (c >= 0x20 && c != '"' && c != '\\')
+        continue;
+
+      g_string_append_len (buf, run, p - run);
+      run = p + 1;
+
+      switch (c)
+        {
+        case '"':
+          g_string_append (buf, "\\\"");
+          break;
+        case '\\':
+          g_string_append (buf, "\\\\");
+          break;
+        case '\n':
+          g_string_append (buf, "\\n");
+          break;
+        case '\r':
+          g_string_append (buf, "\\r");
+          break;
+        case '\t':
+          g_string_append (buf, "\\t");
+          break;
+        case '\b':
+          g_string_append (buf, "\\b");
+          break;
+        case '\f':
+          g_string_append (buf, "\\f");
+          break;
+        default:
+          g_string_append_printf (buf, "\\u%04x", c);
+          break;
+        }
+    }
+
+  g_string_append_len (buf, run, p - run);
+  g_string_append_c (buf, '"');
+}
+
+static void
+append_node (GString *buf, JsonNode *node)
+{
+  switch (json_node_get_node_type (node))
+    {
+    case JSON_NODE_OBJECT:
+      {
+        JsonObject *obj;
+        GList *members;
+        GList *l;
+
+        obj = json_node_get_object (node);
+        members = json_object_get_members (obj);
+
+        g_string_append_c (buf, '{');
+        for (l = members; l != NULL; l = l->next)
+          {
+            if (l != members)
+              g_string_append_c (buf, ',');
+
+            append_string (buf, l->data);
+            g_string_append_c (buf, ':');
+            append_node (buf, json_object_get_member (obj, l->data));
+          }
+        g_string_append_c (buf, '}');
+
+        g_list_free (members);
+        break;
+      }
+
+    case JSON_NODE_ARRAY:
+      {
+        JsonArray *array;
+        guint len;
+        guint i;
+
+        array = json_node_get_array (node);
+        len = json_array_get_length (array);
+
+        g_string_append_c (buf, '[');
+        for (i = 0; i < len; i++)
+          {
+            if (i > 0)
+              g_string_append_c (buf, ',');
+
+            append_node (buf, json_array_get_element (array, i));
+          }
+        g_string_append_c (buf, ']');
+
+        break;
+      }
+
+    case JSON_NODE_VALUE:
+      switch (json_node_get_value_type (node))
+        {
+        case G_TYPE_INT64:
+          g_string_append_printf (buf,
+                                  "%" G_GINT64_FORMAT,
+                                  json_node_get_int (node));
+          break;
+
+        case G_TYPE_DOUBLE:
+          {
+            gchar st[G_ASCII_DTOSTR_BUF_SIZE];
+
+            g_string_append (buf,
+                             g_ascii_dtostr (st,
+                                             sizeof (st),
+                                             json_node_get_double (node)));
+            break;
+          }
+
+        case G_TYPE_BOOLEAN:
+          g_string_append (buf, json_node_get_boolean (node) ? "true" : "false");
+          break;
+
+        case G_TYPE_STRING:
+          append_string (buf, json_node_get_string (node));
+          break;
+
+        default:
+          g_string_append (buf, "null");
+          break;
+        }
+      break;
+
+    case JSON_NODE_NULL:
+    default:
+      g_string_append (buf, "null");
+      break;
+    }
+}
+
+/* serializes a message envelope straight into @buf. The id is the local
+   @local_id if not 0, @id otherwise. Params are spliced as is from
+   @params_json if not NULL, or serialized from @params */
+static void
+evd_jsonrpc_build_message (GString     *buf,
                            gboolean     request,
                            const gchar *method_name,
+                           guint        local_id,
                            JsonNode    *id,
                            JsonNode    *params,
+                           const gchar *params_json,
                            JsonNode    *error)
 {
-  JsonNode *root;
-  JsonObject *obj;
-  gchar *msg;
-  JsonGenerator *gen;
-  JsonNode *id_node;
-  JsonNode *error_node = NULL;
-  JsonNode *params_node = NULL;
+  g_string_append (buf, "{\"id\":");
 
-  root = json_node_new (JSON_NODE_OBJECT);
-  obj = json_object_new ();
-  json_node_set_object (root, obj);
-
-  if (id == NULL)
-    id_node = json_node_new (JSON_NODE_NULL);
+  /* local ids go out as strings, as older peers expect them so */
+  if (local_id != 0)
+    g_string_append_printf (buf, "\"%u\"", local_id);
+  else if (id != NULL)
+    append_node (buf, id);
   else
-    id_node = json_node_copy (id);
-
-  json_object_set_member (obj, "id", id_node);
+    g_string_append (buf, "null");
 
   if (request)
     {
-      JsonNode *method_node;
+      g_string_append (buf, ",\"method\":");
+      append_string (buf, method_name);
+
+      g_string_append (buf, ",\"params\":");
+      if (params_json != NULL)
+        g_string_append (buf, params_json);
+      else if (params != NULL)
+        append_node (buf, params);
+      else
+        g_string_append (buf, "[]");
+    }
+  else
+    {
+      g_string_append (buf, ",\"error\":");
+      if (error != NULL)
+        append_node (buf, error);
+      else
+        g_string_append (buf, "null");
 
-      if (params == NULL)
-        {
-          params_node = json_node_new (JSON_NODE_ARRAY);
-          json_node_take_array (params_node, json_array_new ());
-        }
+      g_string_append (buf, ",\"result\":");
+      if (params != NULL)
+        append_node (buf, params);
       else
+        g_string_append (buf, "null");
+    }
+
+  g_string_append_c (buf, '}');
+}
+
+/* the output buffer is taken while a message is written, so that messages
+   sent from within the transport callbacks get one of their own */
+static GString *
+take_out_buffer (EvdJsonrpc *self)
+{
+  GString *buf;
+
+  buf = self->priv->out_buf;
+  if (buf == NULL)
+    return g_string_sized_new (256);
+
+  self->priv->out_buf = NULL;
+  g_string_truncate (buf, 0);
+
+  return buf;
+}
+
+static void
+release_out_buffer (EvdJsonrpc *self, GString *buf)
+{
+  if (self->priv->out_buf == NULL && buf->allocated_len <= OUT_BUF_KEEP_SIZE)
+    self->priv->out_buf = buf;
+  else
+    g_string_free (buf, TRUE);
+}
+
+static void
+append_to_batch (EvdJsonrpc *self)
+{
+  if (self->priv->batch_len > 0)
+    g_string_append_c (self->priv->batch_buf, ',');
+
+  self->priv->batch_len++;
+}
+
+static gboolean on_invocation_timeout (gpointer user_data);
+
+static void
+arm_invocation_timeout (EvdJsonrpc *self)
+{
+  InvocationData *inv_data;
+  gint64 delay;
+
+  if (self->priv->timeout_src_id != 0)
+    return;
+
+  inv_data = g_queue_peek_head (self->priv->timeouts);
+  if (inv_data == NULL)
+    return;
+
+  delay = (inv_data->deadline - g_get_monotonic_time ()) / 1000;
+
+  self->priv->timeout_src_id = evd_timeout_add (NULL,
+                                                (guint) CLAMP (delay, 1, G_MAXUINT),
+                                                G_PRIORITY_DEFAULT,
+                                                on_invocation_timeout,
+                                                self);
+}
+
+static gboolean
+on_invocation_timeout (gpointer user_data)
+{
+  EvdJsonrpc *self = EVD_JSONRPC (user_data);
+  InvocationData *inv_data;
+  gint64 now;
+  GError *error = NULL;
+
+  self->priv->timeout_src_id = 0;
+
+  now = g_get_monotonic_time ();
+
+  /* the queue is in deadline order, expired invocations are at its head.
+     Removing an invocation takes it out of the queue */
+  while ((inv_data = g_queue_peek_head (self->priv->timeouts)) != NULL &&
+         inv_data->deadline <= now)
+    {
+      if (inv_data->result != NULL)
         {
-          params_node = json_node_copy (params);
+          if (error == NULL)
+            error = g_error_new_literal (G_IO_ERROR,
+                                         G_IO_ERROR_TIMED_OUT,
+                                         "JSON-RPC method call timed out");
+
+          g_simple_async_result_set_from_error (inv_data->result, error);
+          g_simple_async_result_complete_in_idle (inv_data->result);
         }
 
-      method_node = json_node_new (JSON_NODE_VALUE);
-      json_node_set_string (method_node, method_name);
-      json_object_set_member (obj, "method", method_node);
+      /* calls from the remote end that were never responded are dropped */
+
+      g_hash_table_remove (self->priv->invocations,
+                           GUINT_TO_POINTER (inv_data->id));
+    }
+
+  if (error != NULL)
+    g_error_free (error);
+
+  arm_invocation_timeout (self);
+
+  return FALSE;
+}
+
+static void
+evd_jsonrpc_add_invocation (EvdJsonrpc     *self,
+                            guint           id,
+                            InvocationData *inv_data)
+{
+  GList *link;
+
+  inv_data->id = id;
+
+  g_hash_table_insert (self->priv->invocations,
+                       GUINT_TO_POINTER (id),
+                       inv_data);
+
+  if (self->priv->timeout_interval == 0)
+    return;
+
+  inv_data->deadline = g_get_monotonic_time () +
+    (gint64) self->priv->timeout_interval * G_USEC_PER_SEC;
+  inv_data->timeouts = self->priv->timeouts;
+
+  /* keep the queue in deadline order. Unless the interval changed, the
+     new invocation goes last */
+  link = g_queue_peek_tail_link (self->priv->timeouts);
+  while (link != NULL &&
+         ((InvocationData *) link->data)->deadline > inv_data->deadline)
+    link = link->prev;
 
-      json_object_set_member (obj, "params", params_node);
+  if (link == NULL)
+    {
+      g_queue_push_head (self->priv->timeouts, inv_data);
+      inv_data->timeout_link = g_queue_peek_head_link (self->priv->timeouts);
+
+      /* the armed timer is too late now */
+      if (self->priv->timeout_src_id != 0)
+        {
+          g_source_remove (self->priv->timeout_src_id);
+          self->priv->timeout_src_id = 0;
+        }
     }
   else
     {
-      if (params == NULL)
-        params_node = json_node_new (JSON_NODE_NULL);
-      else
-        params_node = json_node_copy (params);
+      g_queue_insert_after (self->priv->timeouts, link, inv_data);
+      inv_data->timeout_link = link->next;
+    }
 
-      if (error == NULL)
-        error_node = json_node_new (JSON_NODE_NULL);
-      else
-        error_node = json_node_copy (error);
+  arm_invocation_timeout (self);
+}
+
+/* ids are sent as strings, but numbers are accepted too */
+static gboolean
+parse_invocation_id (JsonNode *node, guint *id)
+{
+  guint64 value;
+
+  if (node == NULL || ! JSON_NODE_HOLDS_VALUE (node))
+    return FALSE;
+
+  switch (json_node_get_value_type (node))
+    {
+    case G_TYPE_INT64:
+      if (json_node_get_int (node) <= 0)
+        return FALSE;
+
+      value = (guint64) json_node_get_int (node);
+      break;
+
+    case G_TYPE_STRING:
+      {
+        const gchar *st;
+        gchar *end = NULL;
+
+        st = json_node_get_string (node);
+        value = g_ascii_strtoull (st, &end, 10);
+        if (end == st || *end != '\0')
+          return FALSE;
+
+        break;
+      }
 
-      json_object_set_member (obj, "error", error_node);
-      json_object_set_member (obj, "result", params_node);
+    default:
+      return FALSE;
     }
 
-  gen = json_generator_new ();
-  json_generator_set_root (gen, root);
+  if (value == 0 || value > G_MAXUINT)
+    return FALSE;
+
+  *id = (guint) value;
+
+  return TRUE;
+}
+
+static ResponseBatch *
+response_batch_new (EvdJsonrpc *self, gpointer context)
+{
+  ResponseBatch *batch;
+
+  batch = g_slice_new (ResponseBatch);
+  batch->ref_count = 1;
+  batch->rpc = self;
+  batch->context = context;
 
-  msg = json_generator_to_data (gen, NULL);
+  /* one for the dispatch of the batch itself */
+  batch->pending = 1;
+  batch->buf = g_string_new ("[");
 
-  g_object_unref (gen);
+  return batch;
+}
+
+/* appends an error response to @batch, for a @msg that could not be
+   processed. The response carries the id of @msg if it has one */
+static void
+response_batch_append_error (ResponseBatch *batch,
+                             JsonNode      *msg,
+                             GError        *error)
+{
+  JsonNode *id_node = NULL;
+  JsonNode *error_node;
+  JsonObject *obj;
+
+  if (msg != NULL && JSON_NODE_HOLDS_OBJECT (msg))
+    id_node = json_object_get_member (json_node_get_object (msg), "id");
+
+  error_node = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_set_object (error_node, obj);
+
+  json_object_set_int_member (obj, "code", error->code);
+  json_object_set_string_member (obj, "message", error->message);
+
+  if (batch->buf->len > 1)
+    g_string_append_c (batch->buf, ',');
+
+  evd_jsonrpc_build_message (batch->buf,
+                             FALSE,
+                             NULL,
+                             0,
+                             id_node,
+                             NULL,
+                             NULL,
+                             error_node);
 
   json_object_unref (obj);
-  json_node_free (root);
+  json_node_free (error_node);
+}
+
+static ResponseBatch *
+response_batch_ref (ResponseBatch *batch)
+{
+  batch->ref_count++;
+
+  return batch;
+}
+
+static void
+response_batch_unref (ResponseBatch *batch)
+{
+  batch->ref_count--;
+  if (batch->ref_count > 0)
+    return;
 
-  return msg;
+  g_string_free (batch->buf, TRUE);
+  g_slice_free (ResponseBatch, batch);
+}
+
+/* to be called once per call in the batch, answered or dropped, and once
+   when the dispatch is over. The last one sends all the responses */
+static void
+response_batch_done (ResponseBatch *batch, guint invocation_id)
+{
+  batch->pending--;
+  if (batch->pending > 0 || batch->rpc == NULL)
+    return;
+
+  /* a batch of notifications has no response */
+  if (batch->buf->len > 1)
+    {
+      g_string_append_c (batch->buf, ']');
+      evd_jsonrpc_transport_write (batch->rpc,
+                                   batch->buf->str,
+                                   batch->context,
+                                   invocation_id);
+    }
 }
 
 static gboolean
-evd_jsonrpc_on_method_called (EvdJsonrpc  *self,
-                              JsonObject  *msg,
-                              gpointer     context,
-                              GError     **error)
+evd_jsonrpc_on_method_called (EvdJsonrpc     *self,
+                              JsonObject     *msg,
+                              gpointer        context,
+                              ResponseBatch  *batch,
+                              GError        **error)
 {
   JsonNode *node;
   JsonNode *args;
@@ -236,7 +714,6 @@ evd_jsonrpc_on_method_called (EvdJsonrpc  *self,
 
   InvocationData *inv_data;
   guint id;
-  gchar *id_st;
   JsonNode *id_node;
 
   node = json_object_get_member (msg, "method");
@@ -267,11 +744,16 @@ evd_jsonrpc_on_method_called (EvdJsonrpc  *self,
   inv_data->remote_id = id_node;
   inv_data->context = context;
 
+  if (batch != NULL)
+    {
+      inv_data->batch = response_batch_ref (batch);
+      batch->pending++;
+    }
+
   self->priv->invocation_counter++;
   id = self->priv->invocation_counter;
-  id_st = g_strdup_printf ("%u", id);
 
-  g_hash_table_insert (self->priv->invocations, id_st, inv_data);
+  evd_jsonrpc_add_invocation (self, id, inv_data);
 
   if (self->priv->method_call_cb != NULL)
     {
@@ -305,29 +787,29 @@ evd_jsonrpc_on_method_result (EvdJsonrpc  *self,
                               JsonObject  *msg,
                               gpointer     context)
 {
-  const gchar *id;
-  JsonNode *id_node;
+  guint id;
   JsonNode *result_node;
   JsonNode *error_node;
   MethodResponse *data;
-  InvocationData *inv_data;
+  InvocationData *inv_data = NULL;
   GSimpleAsyncResult *res;
 
-  id_node = json_object_get_member (msg, "id");
-  id = json_node_get_string (id_node);
+  if (parse_invocation_id (json_object_get_member (msg, "id"), &id))
+    inv_data = g_hash_table_lookup (self->priv->invocations,
+                                    GUINT_TO_POINTER (id));
 
-  inv_data = g_hash_table_lookup (self->priv->invocations, id);
-  if (inv_data == NULL)
+  /* responses to calls from the remote end are unexpected too */
+  if (inv_data == NULL || inv_data->result == NULL)
     {
       /* @TODO: do proper logging */
-      g_print ("Received unexpected JSON-RPC response message with id '%s'\n", id);
+      g_print ("Received unexpected JSON-RPC response message\n");
 
       return;
     }
 
   res = inv_data->result;
   g_object_ref (res);
-  g_hash_table_remove (self->priv->invocations, id);
+  g_hash_table_remove (self->priv->invocations, GUINT_TO_POINTER (id));
 
   result_node = json_object_get_member (msg, "result");
   error_node = json_object_get_member (msg, "error");
@@ -378,44 +860,32 @@ evd_jsonrpc_on_notification (EvdJsonrpc *self,
                                self->priv->cb_user_data);
 }
 
-static void
-evd_jsonrpc_on_json_packet (EvdJsonFilter *filter,
-                            const gchar   *buffer,
-                            gsize          size,
-                            gpointer       user_data)
+static gboolean
+evd_jsonrpc_process_message (EvdJsonrpc     *self,
+                             JsonNode       *node,
+                             ResponseBatch  *batch,
+                             GError        **error)
 {
-  EvdJsonrpc *self = EVD_JSONRPC (user_data);
-  JsonParser *parser;
-  JsonNode *root;
   JsonObject *obj;
-  GError *error = NULL;
-
-  parser = json_parser_new ();
 
-  json_parser_load_from_data (parser,
-                              buffer,
-                              size,
-                              NULL);
-
-  root = json_parser_get_root (parser);
-  g_assert (root != NULL);
-
-  if (! JSON_NODE_HOLDS_OBJECT (root))
+  if (! JSON_NODE_HOLDS_OBJECT (node))
     {
-      error = g_error_new (G_IO_ERROR,
+      g_set_error_literal (error,
+                           G_IO_ERROR,
                            G_IO_ERROR_INVALID_DATA,
                            "JSON-RPC message must be a JSON object");
-      goto out;
+      return FALSE;
     }
 
-  obj = json_node_get_object (root);
+  obj = json_node_get_object (node);
 
   if (! json_object_has_member (obj, "id"))
     {
-      error = g_error_new (G_IO_ERROR,
+      g_set_error_literal (error,
+                           G_IO_ERROR,
                            G_IO_ERROR_INVALID_DATA,
                            "JSON-RPC message must have an 'id' member");
-      goto out;
+      return FALSE;
     }
 
   if (json_object_has_member (obj, "result") &&
@@ -434,25 +904,99 @@ evd_jsonrpc_on_json_packet (EvdJsonFilter *filter,
       id_node = json_object_get_member (obj, "id");
 
       if (! json_node_is_null (id_node))
-        /* a method call */
-        evd_jsonrpc_on_method_called (self,
-                                      obj,
-                                      self->priv->context,
-                                      &error);
+        {
+          /* a method call */
+          return evd_jsonrpc_on_method_called (self,
+                                               obj,
+                                               self->priv->context,
+                                               batch,
+                                               error);
+        }
       else
-        /* a notification */
-        evd_jsonrpc_on_notification (self,
-                                     obj,
-                                     self->priv->context);
+        {
+          /* a notification */
+          evd_jsonrpc_on_notification (self,
+                                       obj,
+                                       self->priv->context);
+        }
     }
   else
     {
-      error = g_error_new (G_IO_ERROR,
+      g_set_error_literal (error,
+                           G_IO_ERROR,
                            G_IO_ERROR_INVALID_DATA,
                            "Invalid JSON-RPC message");
+      return FALSE;
     }
 
- out:
+  return TRUE;
+}
+
+static void
+evd_jsonrpc_on_json_packet (EvdJsonFilter *filter,
+                            const gchar   *buffer,
+                            gsize          size,
+                            gpointer       user_data)
+{
+  EvdJsonrpc *self = EVD_JSONRPC (user_data);
+  JsonParser *parser;
+  JsonNode *root;
+  GError *error = NULL;
+
+  parser = json_parser_new ();
+
+  json_parser_load_from_data (parser,
+                              buffer,
+                              size,
+                              NULL);
+
+  root = json_parser_get_root (parser);
+  g_assert (root != NULL);
+
+  if (JSON_NODE_HOLDS_ARRAY (root))
+    {
+      /* a batch of calls, notifications or results. Responses to the calls
+         are sent back together in a single message */
+      JsonArray *array;
+      ResponseBatch *batch;
+      guint len;
+      guint i;
+
+      array = json_node_get_array (root);
+      len = json_array_get_length (array);
+
+      batch = response_batch_new (self, self->priv->context);
+
+      if (len == 0)
+        {
+          g_set_error_literal (&error,
+                               G_IO_ERROR,
+                               G_IO_ERROR_INVALID_DATA,
+                               "JSON-RPC batch must not be empty");
+          response_batch_append_error (batch, NULL, error);
+          g_clear_error (&error);
+        }
+
+      for (i = 0; i < len; i++)
+        {
+          JsonNode *element;
+
+          element = json_array_get_element (array, i);
+          if (! evd_jsonrpc_process_message (self, element, batch, &error))
+            {
+              /* invalid elements are answered with an error */
+              response_batch_append_error (batch, element, error);
+              g_clear_error (&error);
+            }
+        }
+
+      response_batch_done (batch, 0);
+      response_batch_unref (batch);
+    }
+  else
+    {
+      evd_jsonrpc_process_message (self, root, NULL, &error);
+    }
 
   if (error != NULL)
     {
@@ -519,20 +1063,20 @@ evd_jsonrpc_respond_full (EvdJsonrpc  *self,
                           JsonNode    *error_node,
                           GError     **error)
 {
-  gchar *id_st;
   JsonNode *id_node;
-  gchar *msg;
+  GString *msg;
   gboolean res = TRUE;
   InvocationData *inv_data;
   gpointer context;
+  ResponseBatch *batch;
 
   g_return_val_if_fail (EVD_IS_JSONRPC (self), FALSE);
   g_return_val_if_fail (invocation_id > 0, FALSE);
 
-  id_st = g_strdup_printf ("%u", invocation_id);
-  inv_data = g_hash_table_lookup (self->priv->invocations, id_st);
+  inv_data = g_hash_table_lookup (self->priv->invocations,
+                                  GUINT_TO_POINTER (invocation_id));
 
-  if (inv_data == NULL)
+  if (inv_data == NULL || inv_data->result != NULL)
     {
       g_set_error_literal (error,
                            G_IO_ERROR,
@@ -553,40 +1097,102 @@ evd_jsonrpc_respond_full (EvdJsonrpc  *self,
       id_node = inv_data->remote_id;
       inv_data->remote_id = NULL;
       context = inv_data->context;
+      batch = inv_data->batch;
+      inv_data->batch = NULL;
 
-      g_hash_table_remove (self->priv->invocations, id_st);
+      g_hash_table_remove (self->priv->invocations,
+                           GUINT_TO_POINTER (invocation_id));
 
-      msg = evd_jsonrpc_build_message (self,
-                                       FALSE,
-                                       NULL,
-                                       id_node,
-                                       result_node,
-                                       error_node);
+      if (batch != NULL)
+        {
+          /* the response waits for the rest of the batch */
+          if (batch->buf->len > 1)
+            g_string_append_c (batch->buf, ',');
+
+          evd_jsonrpc_build_message (batch->buf,
+                                     FALSE,
+                                     NULL,
+                                     0,
+                                     id_node,
+                                     result_node,
+                                     NULL,
+                                     error_node);
+
+          response_batch_done (batch, invocation_id);
+          response_batch_unref (batch);
+        }
+      else
+        {
+          msg = take_out_buffer (self);
+          evd_jsonrpc_build_message (msg,
+                                     FALSE,
+                                     NULL,
+                                     0,
+                                     id_node,
+                                     result_node,
+                                     NULL,
+                                     error_node);
+
+          evd_jsonrpc_transport_write (self, msg->str, context, invocation_id);
+
+          release_out_buffer (self, msg);
+        }
 
       json_node_free (id_node);
-
-      evd_jsonrpc_transport_write (self, msg, context, invocation_id);
-
-      g_free (msg);
     }
 
-  g_free (id_st);
-
   return res;
 }
 
 static void
 free_invocation_data (InvocationData *data)
 {
+  if (data->timeout_link != NULL)
+    g_queue_delete_link (data->timeouts, data->timeout_link);
+
   if (data->result != NULL)
     g_object_unref (data->result);
 
   if (data->remote_id != NULL)
     json_node_free (data->remote_id);
 
+  /* a call of a batch dropped without response */
+  if (data->batch != NULL)
+    {
+      response_batch_done (data->batch, 0);
+      response_batch_unref (data->batch);
+    }
+
   g_slice_free (InvocationData, data);
 }
 
+/* fails all the calls sent in an outgoing batch. Returns FALSE if there is
+   no call pending for @batch_id */
+static gboolean
+evd_jsonrpc_fail_batch (EvdJsonrpc *self, guint batch_id, GError *error)
+{
+  GHashTableIter iter;
+  gpointer id;
+  InvocationData *inv_data;
+  GList *ids = NULL;
+  GList *node;
+  gboolean found;
+
+  g_hash_table_iter_init (&iter, self->priv->invocations);
+  while (g_hash_table_iter_next (&iter, &id, (gpointer *) &inv_data))
+    if (inv_data->batch_id == batch_id)
+      ids = g_list_prepend (ids, id);
+
+  found = ids != NULL;
+
+  for (node = ids; node != NULL; node = node->next)
+    evd_jsonrpc_transport_error (self, GPOINTER_TO_UINT (node->data), error);
+
+  g_list_free (ids);
+
+  return found;
+}
+
 /* public methods */
 
 EvdJsonrpc *
@@ -621,19 +1227,21 @@ evd_jsonrpc_transport_error (EvdJsonrpc *self,
                              GError     *error)
 {
   InvocationData *inv_data;
-  gchar *id_st;
 
   g_return_if_fail (EVD_IS_JSONRPC (self));
   g_return_if_fail (error != NULL);
 
-  id_st = g_strdup_printf ("%u", invocation_id);
-
-  inv_data = g_hash_table_lookup (self->priv->invocations, id_st);
+  inv_data = g_hash_table_lookup (self->priv->invocations,
+                                  GUINT_TO_POINTER (invocation_id));
   if (inv_data == NULL)
     {
-      /* @TODO: do proper logging */
-      g_debug ("Transport error for unknown invocation id");
-      g_free (id_st);
+      /* the id of a batch fails all the calls in it */
+      if (invocation_id == 0 ||
+          ! evd_jsonrpc_fail_batch (self, invocation_id, error))
+        {
+          /* @TODO: do proper logging */
+          g_debug ("Transport error for unknown invocation id");
+        }
 
       return;
     }
@@ -652,9 +1260,8 @@ evd_jsonrpc_transport_error (EvdJsonrpc *self,
          error. We can only hope for the remote endpoint to timeout. */
     }
 
-  g_hash_table_remove (self->priv->invocations, id_st);
-
-  g_free (id_st);
+  g_hash_table_remove (self->priv->invocations,
+                       GUINT_TO_POINTER (invocation_id));
 }
 
 /**
@@ -671,10 +1278,8 @@ evd_jsonrpc_call_method (EvdJsonrpc          *self,
                          gpointer             user_data)
 {
   GSimpleAsyncResult *res;
-  gchar *msg;
+  GString *msg;
   guint id;
-  gchar *id_st;
-  JsonNode *id_node;
   InvocationData *inv_data;
 
   g_return_if_fail (EVD_IS_JSONRPC (self));
@@ -685,7 +1290,9 @@ evd_jsonrpc_call_method (EvdJsonrpc          *self,
                                    user_data,
                                    evd_jsonrpc_call_method);
 
-  if ((context == NULL || ! EVD_IS_PEER (context)) &&
+  /* inside a batch, the transport is checked when it is sent */
+  if (self->priv->batch_buf == NULL &&
+      (context == NULL || ! EVD_IS_PEER (context)) &&
       self->priv->send_cb == NULL)
     {
       g_simple_async_result_set_error (res,
@@ -699,32 +1306,45 @@ evd_jsonrpc_call_method (EvdJsonrpc          *self,
 
   self->priv->invocation_counter++;
   id = self->priv->invocation_counter;
-  id_st = g_strdup_printf ("%u", id);
 
   inv_data = g_slice_new0 (InvocationData);
   inv_data->result = res;
   inv_data->context = context;
 
-  g_hash_table_insert (self->priv->invocations, id_st, inv_data);
+  evd_jsonrpc_add_invocation (self, id, inv_data);
 
-  id_node = json_node_new (JSON_NODE_VALUE);
-  json_node_set_string (id_node, id_st);
-
-  msg = evd_jsonrpc_build_message (self,
-                                   TRUE,
-                                   method_name,
-                                   id_node,
-                                   params,
-                                   NULL);
+  if (self->priv->batch_buf != NULL)
+    {
+      inv_data->batch_id = self->priv->batch_id;
+
+      append_to_batch (self);
+      evd_jsonrpc_build_message (self->priv->batch_buf,
+                                 TRUE,
+                                 method_name,
+                                 id,
+                                 NULL,
+                                 params,
+                                 NULL,
+                                 NULL);
+      return;
+    }
 
-  json_node_free (id_node);
+  msg = take_out_buffer (self);
+  evd_jsonrpc_build_message (msg,
+                             TRUE,
+                             method_name,
+                             id,
+                             NULL,
+                             params,
+                             NULL,
+                             NULL);
 
   evd_jsonrpc_transport_write (self,
-                               msg,
+                               msg->str,
                                context,
                                id);
 
-  g_free (msg);
+  release_out_buffer (self, msg);
 }
 
 /**
@@ -899,6 +1519,57 @@ evd_jsonrpc_respond_from_error (EvdJsonrpc  *self,
   return result;
 }
 
+static gboolean
+evd_jsonrpc_send_notification_internal (EvdJsonrpc   *self,
+                                        const gchar  *notification_name,
+                                        JsonNode     *params,
+                                        const gchar  *params_json,
+                                        gpointer      context,
+                                        GError      **error)
+{
+  GString *msg;
+
+  if (self->priv->batch_buf != NULL)
+    {
+      append_to_batch (self);
+      evd_jsonrpc_build_message (self->priv->batch_buf,
+                                 TRUE,
+                                 notification_name,
+                                 0,
+                                 NULL,
+                                 params,
+                                 params_json,
+                                 NULL);
+      return TRUE;
+    }
+
+  if ((context == NULL || ! EVD_IS_PEER (context)) &&
+      self->priv->send_cb == NULL)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_CLOSED,
+                   "Failed to send notificaton, no transport associated");
+      return FALSE;
+    }
+
+  msg = take_out_buffer (self);
+  evd_jsonrpc_build_message (msg,
+                             TRUE,
+                             notification_name,
+                             0,
+                             NULL,
+                             params,
+                             params_json,
+                             NULL);
+
+  evd_jsonrpc_transport_write (self, msg->str, context, 0);
+
+  release_out_buffer (self, msg);
+
+  return TRUE;
+}
+
 /**
  * evd_jsonrpc_send_notification:
  * @params: (allow-none):
@@ -914,31 +1585,160 @@ evd_jsonrpc_send_notification (EvdJsonrpc   *self,
                                gpointer      context,
                                GError      **error)
 {
-  gchar *msg;
+  g_return_val_if_fail (EVD_IS_JSONRPC (self), FALSE);
+  g_return_val_if_fail (notification_name != NULL, FALSE);
 
+  return evd_jsonrpc_send_notification_internal (self,
+                                                 notification_name,
+                                                 params,
+                                                 NULL,
+                                                 context,
+                                                 error);
+}
+
+/**
+ * evd_jsonrpc_send_notification_serialized:
+ * @params: (allow-none): the params of the notification, already serialized
+ * as a JSON array
+ * @context: (allow-none):
+ * @error: (allow-none):
+ *
+ * Like evd_jsonrpc_send_notification(), but the params are spliced into the
+ * message as they are, without parsing or serializing them again. Useful
+ * when the same params are sent to many peers, or come from another
+ * JSON-RPC message. @params must be a valid JSON array.
+ *
+ * Returns: %TRUE if the notification was sent, %FALSE otherwise.
+ **/
+gboolean
+evd_jsonrpc_send_notification_serialized (EvdJsonrpc   *self,
+                                          const gchar  *notification_name,
+                                          const gchar  *params,
+                                          gpointer      context,
+                                          GError      **error)
+{
   g_return_val_if_fail (EVD_IS_JSONRPC (self), FALSE);
   g_return_val_if_fail (notification_name != NULL, FALSE);
 
-  if ((context == NULL || ! EVD_IS_PEER (context)) &&
-      self->priv->send_cb == NULL)
+  return evd_jsonrpc_send_notification_internal (self,
+                                                 notification_name,
+                                                 NULL,
+                                                 params,
+                                                 context,
+                                                 error);
+}
+
+/**
+ * evd_jsonrpc_begin_batch:
+ *
+ * Starts a batch. Method calls and notifications issued until
+ * evd_jsonrpc_end_batch() is called are not sent right away, but
+ * together in a single message, so that they share one round trip of the
+ * transport. The remote end answers all the calls in a single message too.
+ *
+ * The context passed to the calls and notifications in a batch is ignored;
+ * the batch is sent with the one passed to evd_jsonrpc_end_batch().
+ **/
+void
+evd_jsonrpc_begin_batch (EvdJsonrpc *self)
+{
+  g_return_if_fail (EVD_IS_JSONRPC (self));
+  g_return_if_fail (self->priv->batch_buf == NULL);
+
+  self->priv->batch_buf = g_string_new ("[");
+  self->priv->batch_len = 0;
+
+  /* a batch takes an id of its own, for transport errors */
+  self->priv->invocation_counter++;
+  self->priv->batch_id = self->priv->invocation_counter;
+}
+
+/**
+ * evd_jsonrpc_end_batch:
+ * @context: (allow-none):
+ * @error: (allow-none):
+ *
+ * Sends the method calls and notifications issued since
+ * evd_jsonrpc_begin_batch() was called, in a single message. If there is
+ * no transport to send it, all the calls in the batch fail.
+ *
+ * Returns: %TRUE if the batch was sent, %FALSE otherwise.
+ **/
+gboolean
+evd_jsonrpc_end_batch (EvdJsonrpc  *self,
+                       gpointer     context,
+                       GError     **error)
+{
+  GString *batch_buf;
+  guint batch_id;
+  gboolean result = TRUE;
+
+  g_return_val_if_fail (EVD_IS_JSONRPC (self), FALSE);
+  g_return_val_if_fail (self->priv->batch_buf != NULL, FALSE);
+
+  batch_buf = self->priv->batch_buf;
+  batch_id = self->priv->batch_id;
+  self->priv->batch_buf = NULL;
+  self->priv->batch_id = 0;
+
+  if (self->priv->batch_len == 0)
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_CLOSED,
-                   "Failed to send notificaton, no transport associated");
-      return FALSE;
+      /* nothing to send */
     }
+  else if ((context == NULL || ! EVD_IS_PEER (context)) &&
+           self->priv->send_cb == NULL)
+    {
+      GError *_error = NULL;
 
-  msg = evd_jsonrpc_build_message (self,
-                                   TRUE,
-                                   notification_name,
-                                   NULL,
-                                   params,
-                                   NULL);
+      g_set_error_literal (&_error,
+                           G_IO_ERROR,
+                           G_IO_ERROR_CLOSED,
+                           "Failed to send batch, no transport associated");
 
-  evd_jsonrpc_transport_write (self, msg, context, 0);
+      evd_jsonrpc_fail_batch (self, batch_id, _error);
+      g_propagate_error (error, _error);
 
-  g_free (msg);
+      result = FALSE;
+    }
+  else
+    {
+      g_string_append_c (batch_buf, ']');
+      evd_jsonrpc_transport_write (self, batch_buf->str, context, batch_id);
+    }
 
-  return TRUE;
+  g_string_free (batch_buf, TRUE);
+
+  return result;
+}
+
+/**
+ * evd_jsonrpc_set_timeout_interval:
+ * @interval: The timeout in seconds, or 0 to disable it.
+ *
+ * Sets the time an invocation is kept waiting for a response. Method calls
+ * that time out fail with %G_IO_ERROR_TIMED_OUT, and calls from the remote
+ * end that are not responded in time are dropped, so responding them later
+ * fails. The new interval applies to invocations started after this call.
+ *
+ * Invocations never time out by default.
+ **/
+void
+evd_jsonrpc_set_timeout_interval (EvdJsonrpc *self, guint interval)
+{
+  g_return_if_fail (EVD_IS_JSONRPC (self));
+
+  self->priv->timeout_interval = interval;
+}
+
+/**
+ * evd_jsonrpc_get_timeout_interval:
+ *
+ * Returns: The invocation timeout in seconds, 0 if disabled.
+ **/
+guint
+evd_jsonrpc_get_timeout_interval (EvdJsonrpc *self)
+{
+  g_return_val_if_fail (EVD_IS_JSONRPC (self), 0);
+
+  return self->priv->timeout_interval;
 }
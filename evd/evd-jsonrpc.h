@@ -151,6 +151,20 @@ gboolean             evd_jsonrpc_send_notification            (EvdJsonrpc   *sel
                                                                JsonNode     *params,
                                                                gpointer      context,
                                                                GError      **error);
+gboolean             evd_jsonrpc_send_notification_serialized (EvdJsonrpc   *self,
+                                                               const gchar  *notification_name,
+                                                               const gchar  *params,
+                                                               gpointer      context,
+                                                               GError      **error);
+
+void                 evd_jsonrpc_begin_batch                  (EvdJsonrpc  *self);
+gboolean             evd_jsonrpc_end_batch                    (EvdJsonrpc  *self,
+                                                               gpointer     context,
+                                                               GError     **error);
+
+void                 evd_jsonrpc_set_timeout_interval         (EvdJsonrpc *self,
+                                                               guint       interval);
+guint                evd_jsonrpc_get_timeout_interval         (EvdJsonrpc *self);
 
 G_END_DECLS
 
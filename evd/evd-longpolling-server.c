@@ -21,7 +21,6 @@
  */
 
 #include <string.h>
-#include <stdio.h>
 #include <libsoup/soup-headers.h>
 
 #include "evd-longpolling-server.h"
@@ -30,6 +29,7 @@
 #include "evd-error.h"
 #include "evd-http-connection.h"
 #include "evd-peer-manager.h"
+#include "evd-utils.h"
 
 #define EVD_LONGPOLLING_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
                                                  EVD_TYPE_LONGPOLLING_SERVER, \
@@ -37,24 +37,62 @@
 
 #define PEER_DATA_KEY       "org.eventdance.lib.LongpollingServer.PEER_DATA"
 #define CONN_PEER_KEY_GET   PEER_DATA_KEY ".GET"
-#define CONN_PEER_KEY_POST  PEER_DATA_KEY ".POST"
+#define FRAMING_DATA_KEY    PEER_DATA_KEY ".FRAMING"
 
-#define ACTION_RECEIVE   "receive"
-#define ACTION_SEND      "send"
-#define ACTION_CLOSE     "close"
+
+#define RECEIVE_BLOCK_SIZE 4096
+
+/* a 64 bits length takes up to 10 bytes as a varint */
+#define MAX_VARINT_LEN 10
+
+#define MORE_BIT 0x80
+
+#define DEFAULT_COALESCING_DELAY -1
+#define MAX_COALESCING_DELAY     5
 
 /* private data */
 struct _EvdLongpollingServerPrivate
 {
   const gchar *current_peer_id;
+
+  /* delivery metrics */
+  guint64 responses;
+  guint64 frames;
+  guint64 bytes;
+
+  gint coalescing_delay;
 };
 
 typedef struct _EvdLongpollingServerPeerData EvdLongpollingServerPeerData;
 struct _EvdLongpollingServerPeerData
 {
   GQueue *conns;
+  guint flush_src_id;
 };
 
+typedef struct
+{
+  EvdLongpollingServer *self;
+  EvdPeer *peer;
+} EvdLongpollingServerFlush;
+
+typedef struct
+{
+  gchar *buf;
+  gsize size;
+  EvdMessageType type;
+} EvdLongpollingServerFrame;
+
+typedef struct
+{
+  EvdLongpollingServer *self;
+  EvdPeer *peer;
+  EvdLongpollingFraming framing;
+  gboolean invalid;
+  GString *buf;
+  gchar block[RECEIVE_BLOCK_SIZE];
+} EvdLongpollingServerReceiver;
+
 static void     evd_longpolling_server_class_init           (EvdLongpollingServerClass *class);
 static void     evd_longpolling_server_init                 (EvdLongpollingServer *self);
 
@@ -131,6 +169,12 @@ evd_longpolling_server_init (EvdLongpollingServer *self)
 
   priv->current_peer_id = NULL;
 
+  priv->responses = 0;
+  priv->frames = 0;
+  priv->bytes = 0;
+
+  priv->coalescing_delay = DEFAULT_COALESCING_DELAY;
+
   evd_service_set_io_stream_type (EVD_SERVICE (self), EVD_TYPE_HTTP_CONNECTION);
 }
 
@@ -146,136 +190,286 @@ evd_longpolling_server_finalize (GObject *obj)
   G_OBJECT_CLASS (evd_longpolling_server_parent_class)->finalize (obj);
 }
 
-static void
-evd_longpolling_server_read_msg_header (const gchar *buf,
-                                        gsize       *hdr_len,
-                                        gsize       *msg_len,
-                                        gboolean    *more_fragments)
+static EvdLongpollingFraming
+get_peer_framing (EvdPeer *peer)
 {
-  const gchar MORE_BIT = 0x80;
+  gpointer framing;
+
+  framing = g_object_get_data (G_OBJECT (peer), FRAMING_DATA_KEY);
+  if (framing == NULL)
+    return EVD_LONGPOLLING_FRAMING_TEXT;
+  else
+    return (EvdLongpollingFraming) GPOINTER_TO_UINT (framing);
+}
 
-  gchar hdr;
+/* text framing: lengths up to 125 take the first byte, and longer ones
+   follow it as 4 or 16 hex digits */
+static gssize
+read_text_header (const guint8 *buf, gsize size, guint64 *msg_len)
+{
+  guint8 hdr;
+  gsize hdr_len;
+  gsize i;
 
-  hdr = buf[0];
+  if (size == 0)
+    return 0;
 
-  if (more_fragments != NULL)
-    *more_fragments = (hdr & MORE_BIT) > 0;
-  hdr &= ~MORE_BIT;
+  hdr = buf[0] & ~MORE_BIT;
 
   if (hdr <= 0x7F - 2)
     {
-      if (hdr_len != NULL)
-        *hdr_len = 1;
-
-      if (msg_len != NULL)
-        *msg_len = hdr;
+      *msg_len = hdr;
+      return 1;
     }
-  else if (hdr == 0x7F - 1)
+
+  hdr_len = hdr == 0x7F - 1 ? 5 : 17;
+  if (size < hdr_len)
+    return 0;
+
+  *msg_len = 0;
+  for (i = 1; i < hdr_len; i++)
     {
-      if (hdr_len != NULL)
-        *hdr_len = 5;
+      gint digit;
+
+      /* older peers pad lengths with spaces */
+      if (buf[i] == ' ')
+        continue;
+
+      digit = g_ascii_xdigit_value (buf[i]);
+      if (digit < 0)
+        return -1;
 
-      if (msg_len != NULL)
-        sscanf (buf + 1, "%04x", (uint *) msg_len);
+      *msg_len = (*msg_len << 4) | digit;
+    }
+
+  return hdr_len;
+}
+
+static gsize
+write_text_header (guint8 *hdr, guint64 size)
+{
+  static const gchar hex[] = "0123456789abcdef";
+  gsize hdr_len;
+  gsize i;
+
+  if (size <= 0x7F - 2)
+    {
+      hdr[0] = (guint8) size;
+      return 1;
+    }
+  else if (size <= 0xFFFF)
+    {
+      hdr[0] = 0x7F - 1;
+      hdr_len = 5;
     }
   else
     {
-      if (hdr_len != NULL)
-        *hdr_len = 17;
+      hdr[0] = 0x7F;
+      hdr_len = 17;
+    }
 
-      if (msg_len != NULL)
-        sscanf (buf + 1, "%16x", (uint *) msg_len);
+  for (i = hdr_len - 1; i > 0; i--)
+    {
+      hdr[i] = hex[size & 0x0F];
+      size >>= 4;
     }
+
+  return hdr_len;
 }
 
-static void
-evd_longpolling_server_conn_on_content_read (GObject      *obj,
-                                             GAsyncResult *res,
-                                             gpointer      user_data)
+/* binary framing: lengths are unsigned LEB128 varints, 7 bits per byte
+   with the high bit set on all bytes but the last */
+static gssize
+read_varint_header (const guint8 *buf, gsize size, guint64 *msg_len)
 {
-  EvdLongpollingServer *self = EVD_LONGPOLLING_SERVER (user_data);
-  EvdHttpConnection *conn = EVD_HTTP_CONNECTION (obj);
+  gsize i;
 
-  EvdPeer *peer;
-  gchar *content;
-  gssize size;
-  GError *error = NULL;
+  *msg_len = 0;
+  for (i = 0; i < size; i++)
+    {
+      if (i == MAX_VARINT_LEN)
+        return -1;
+
+      *msg_len |= (guint64) (buf[i] & 0x7F) << (7 * i);
+
+      if ((buf[i] & 0x80) == 0)
+        return i + 1;
+    }
 
-  peer = g_object_get_data (G_OBJECT (conn), CONN_PEER_KEY_POST);
+  return 0;
+}
+
+static gsize
+write_varint_header (guint8 *hdr, guint64 size)
+{
+  gsize hdr_len = 0;
 
-  if ( (content = evd_http_connection_read_all_content_finish (conn,
-                                                               res,
-                                                               &size,
-                                                               &error)) != NULL)
+  do
     {
+      hdr[hdr_len] = size & 0x7F;
+      size >>= 7;
+
       if (size > 0)
-        {
-          EvdTransportInterface *iface;
-          gint i;
-          gsize hdr_len = 0;
-          gsize msg_len = 0;
-
-          iface = EVD_TRANSPORT_GET_INTERFACE (self);
-
-          i = 0;
-          while (i < size)
-            {
-              evd_longpolling_server_read_msg_header (content + i,
-                                                      &hdr_len,
-                                                      &msg_len,
-                                                      NULL);
-
-              iface->receive (EVD_TRANSPORT (self),
-                              peer,
-                              content + i + hdr_len,
-                              (gsize) msg_len);
-
-              i += msg_len + hdr_len;
-            }
-        }
+        hdr[hdr_len] |= 0x80;
 
-      g_free (content);
+      hdr_len++;
     }
+  while (size > 0);
+
+  return hdr_len;
+}
+
+/* resolves the action from the last segment of a request path, without
+   splitting or copying it */
+EvdLongpollingAction
+evd_longpolling_server_parse_action (const gchar *path)
+{
+  const gchar *action;
+
+  if (path == NULL)
+    return EVD_LONGPOLLING_ACTION_UNKNOWN;
+
+  action = strrchr (path, '/');
+  action = action != NULL ? action + 1 : path;
+
+  switch (action[0])
+    {
+    case 'r':
+      if (strcmp (action, "receive") == 0)
+        return EVD_LONGPOLLING_ACTION_RECEIVE;
+      break;
+
+    case 's':
+      if (strcmp (action, "send") == 0)
+        return EVD_LONGPOLLING_ACTION_SEND;
+      break;
+
+    case 'c':
+      if (strcmp (action, "close") == 0)
+        return EVD_LONGPOLLING_ACTION_CLOSE;
+      break;
+    }
+
+  return EVD_LONGPOLLING_ACTION_UNKNOWN;
+}
+
+/* returns the length of the frame header at @buf, 0 if @size is not enough
+   to hold it, or -1 if it is malformed */
+gssize
+evd_longpolling_server_read_frame_header (EvdLongpollingFraming  framing,
+                                          const gchar           *buf,
+                                          gsize                  size,
+                                          guint64               *msg_len)
+{
+  if (framing == EVD_LONGPOLLING_FRAMING_BINARY)
+    return read_varint_header ((const guint8 *) buf, size, msg_len);
   else
+    return read_text_header ((const guint8 *) buf, size, msg_len);
+}
+
+static void
+evd_longpolling_server_receive_frames (EvdLongpollingServerReceiver *receiver)
+{
+  EvdTransportInterface *iface;
+  GString *buf = receiver->buf;
+  gsize i = 0;
+
+  iface = EVD_TRANSPORT_GET_INTERFACE (receiver->self);
+
+  /* deliver all the complete frames available, and keep the trailing
+     partial frame (if any) until more content arrives */
+  while (i < buf->len)
     {
-      g_debug ("error reading content: %s", error->message);
-      g_error_free (error);
+      gssize hdr_len;
+      guint64 msg_len = 0;
+
+      hdr_len = evd_longpolling_server_read_frame_header (receiver->framing,
+                                                          buf->str + i,
+                                                          buf->len - i,
+                                                          &msg_len);
+      if (hdr_len < 0 || msg_len > G_MAXSIZE - RECEIVE_BLOCK_SIZE)
+        {
+          g_debug ("invalid long-polling frame header, ignoring rest of content");
+
+          receiver->invalid = TRUE;
+          i = buf->len;
+          break;
+        }
+
+      if (hdr_len == 0 || buf->len - i - hdr_len < msg_len)
+        break;
+
+      iface->receive (EVD_TRANSPORT (receiver->self),
+                      receiver->peer,
+                      buf->str + i + hdr_len,
+                      (gsize) msg_len);
+
+      i += hdr_len + msg_len;
     }
 
-  evd_longpolling_server_actual_send (self,
-                                peer,
-                                conn,
-                                NULL,
-                                0,
-                                NULL);
+  if (i > 0)
+    g_string_erase (buf, 0, i);
+}
 
-  g_object_unref (peer);
+static void
+evd_longpolling_server_free_receiver (EvdLongpollingServerReceiver *receiver)
+{
+  g_string_free (receiver->buf, TRUE);
+  g_object_unref (receiver->peer);
+  g_object_unref (receiver->self);
+
+  g_slice_free (EvdLongpollingServerReceiver, receiver);
 }
 
-static gchar *
-evd_longpolling_server_resolve_action (EvdLongpollingServer *self,
-                                       EvdHttpRequest       *request)
+static void
+evd_longpolling_server_conn_on_content_read (GObject      *obj,
+                                             GAsyncResult *res,
+                                             gpointer      user_data)
 {
-  SoupURI *uri;
-  const gchar *path;
-  gchar **tokens;
-  gint i;
-  gchar *action = NULL;
+  EvdLongpollingServerReceiver *receiver = user_data;
+  EvdHttpConnection *conn = EVD_HTTP_CONNECTION (obj);
 
-  uri = evd_http_request_get_uri (request);
-  path = uri->path;
+  gssize size;
+  gboolean more = FALSE;
+  GError *error = NULL;
 
-  tokens = g_strsplit (path, "/", 32);
+  size = evd_http_connection_read_content_finish (conn, res, &more, &error);
+  if (size < 0)
+    {
+      g_debug ("error reading content: %s", error->message);
+      g_error_free (error);
 
-  i = 0;
-  while (tokens[i] != NULL)
-    i++;
+      more = FALSE;
+    }
+  else if (size > 0 && ! receiver->invalid)
+    {
+      g_string_append_len (receiver->buf, receiver->block, size);
+      evd_longpolling_server_receive_frames (receiver);
+    }
+
+  if (more)
+    {
+      evd_http_connection_read_content (conn,
+                                        receiver->block,
+                                        RECEIVE_BLOCK_SIZE,
+                                        NULL,
+                                        evd_longpolling_server_conn_on_content_read,
+                                        receiver);
+      return;
+    }
 
-  action = g_strdup (tokens[i-1]);
+  if (receiver->buf->len > 0)
+    g_debug ("discarding %" G_GSIZE_FORMAT " bytes of incomplete frame",
+             receiver->buf->len);
 
-  g_strfreev (tokens);
+  evd_longpolling_server_actual_send (receiver->self,
+                                      receiver->peer,
+                                      conn,
+                                      NULL,
+                                      0,
+                                      NULL);
 
-  return action;
+  evd_longpolling_server_free_receiver (receiver);
 }
 
 static void
@@ -293,7 +487,7 @@ evd_longpolling_server_request_handler (EvdWebService     *web_service,
                                         EvdHttpRequest    *request)
 {
   EvdLongpollingServer *self = EVD_LONGPOLLING_SERVER (web_service);
-  gchar *action;
+  EvdLongpollingAction action;
   EvdPeer *peer;
   SoupURI *uri;
 
@@ -317,10 +511,10 @@ evd_longpolling_server_request_handler (EvdWebService     *web_service,
 
   evd_peer_touch (peer);
 
-  action = evd_longpolling_server_resolve_action (self, request);
+  action = evd_longpolling_server_parse_action (uri->path);
 
   /* receive? */
-  if (g_strcmp0 (action, ACTION_RECEIVE) == 0)
+  if (action == EVD_LONGPOLLING_ACTION_RECEIVE)
     {
       EvdLongpollingServerPeerData *data;
 
@@ -357,19 +551,29 @@ evd_longpolling_server_request_handler (EvdWebService     *web_service,
     }
 
   /* send? */
-  else if (g_strcmp0 (action, ACTION_SEND) == 0)
+  else if (action == EVD_LONGPOLLING_ACTION_SEND)
     {
-      g_object_ref (peer);
-      g_object_set_data (G_OBJECT (conn), CONN_PEER_KEY_POST, peer);
-
-      evd_http_connection_read_all_content (conn,
-                                    NULL,
-                                    evd_longpolling_server_conn_on_content_read,
-                                    self);
+      EvdLongpollingServerReceiver *receiver;
+
+      /* frames are parsed and delivered as content arrives, instead of
+         buffering the whole request body */
+      receiver = g_slice_new (EvdLongpollingServerReceiver);
+      receiver->self = g_object_ref (self);
+      receiver->peer = g_object_ref (peer);
+      receiver->framing = get_peer_framing (peer);
+      receiver->invalid = FALSE;
+      receiver->buf = g_string_new ("");
+
+      evd_http_connection_read_content (conn,
+                                        receiver->block,
+                                        RECEIVE_BLOCK_SIZE,
+                                        NULL,
+                                        evd_longpolling_server_conn_on_content_read,
+                                        receiver);
     }
 
   /* close? */
-  else if (g_strcmp0 (action, ACTION_CLOSE) == 0)
+  else if (action == EVD_LONGPOLLING_ACTION_CLOSE)
     {
       EVD_WEB_SERVICE_GET_CLASS (self)->respond (EVD_WEB_SERVICE (self),
                                                  conn,
@@ -386,48 +590,24 @@ evd_longpolling_server_request_handler (EvdWebService     *web_service,
     }
 
   self->priv->current_peer_id = NULL;
-
-  g_free (action);
 }
 
-static gboolean
-evd_longpolling_server_write_frame_delivery (EvdLongpollingServer  *self,
-                                             EvdHttpConnection     *conn,
-                                             const gchar           *buf,
-                                             gsize                  size,
-                                             GError               **error)
+static void
+append_frame (GString               *body,
+              EvdLongpollingFraming  framing,
+              const gchar           *buf,
+              gsize                  size)
 {
   guint8 hdr[17];
-  gsize hdr_len = 1;
-  gchar *len_st;
+  gsize hdr_len;
 
-  if (size <= 0x7F - 2)
-    {
-      hdr_len = 1;
-      hdr[0] = (guint8) size;
-    }
-  else if (size <= 0xFFFF)
-    {
-      hdr[0] = 0x7F - 1;
-      hdr_len = 5;
-
-      len_st = g_strdup_printf ("%04x", (uint) size);
-      g_memmove (hdr + 1, len_st, 4);
-      g_free (len_st);
-    }
+  if (framing == EVD_LONGPOLLING_FRAMING_BINARY)
+    hdr_len = write_varint_header (hdr, size);
   else
-    {
-      hdr[0] = 0x7F;
-      hdr_len = 17;
+    hdr_len = write_text_header (hdr, size);
 
-      len_st = g_strdup_printf ("%16x", (uint) size);
-      g_memmove (hdr + 1, len_st, 16);
-      g_free (len_st);
-    }
-
-  evd_http_connection_write_content (conn, (gchar *) hdr, hdr_len, TRUE, NULL);
-
-  return evd_http_connection_write_content (conn, buf, size, TRUE, error);
+  g_string_append_len (body, (gchar *) hdr, hdr_len);
+  g_string_append_len (body, buf, size);
 }
 
 static gboolean
@@ -455,15 +635,45 @@ evd_longpolling_server_actual_send (EvdLongpollingServer  *self,
                                     GError               **error)
 {
   SoupMessageHeaders *headers;
-  gboolean result = TRUE;
+  gboolean result = FALSE;
   EvdHttpRequest *request;
+  GQueue frames = G_QUEUE_INIT;
+  EvdLongpollingServerFrame *frame;
+  GString *body;
+  GConverter *encoder;
+  EvdLongpollingFraming framing;
+
+  framing = get_peer_framing (peer);
+
+  /* assemble the whole body first, frames in peer's backlog followed by
+     the requested frame, so that it goes out in a single write */
+  body = g_string_sized_new (size + 32);
+
+  frame = g_slice_new (EvdLongpollingServerFrame);
+  while ( (frame->buf = evd_peer_pop_message (peer,
+                                              &frame->size,
+                                              &frame->type)) != NULL)
+    {
+      append_frame (body, framing, frame->buf, frame->size);
+      g_queue_push_tail (&frames, frame);
+
+      frame = g_slice_new (EvdLongpollingServerFrame);
+    }
+  g_slice_free (EvdLongpollingServerFrame, frame);
+
+  if (buffer != NULL)
+    append_frame (body, framing, buffer, size);
 
   /* build and send HTTP headers */
   headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
-  soup_message_headers_replace (headers,
-                                "Content-type",
-                                "text/plain; charset=utf-8");
-  soup_message_headers_replace (headers, "Transfer-Encoding", "chunked");
+  if (framing == EVD_LONGPOLLING_FRAMING_BINARY)
+    soup_message_headers_replace (headers,
+                                  "Content-type",
+                                  "application/octet-stream");
+  else
+    soup_message_headers_replace (headers,
+                                  "Content-type",
+                                  "text/plain; charset=utf-8");
 
   if (evd_http_connection_get_keepalive (conn))
     soup_message_headers_replace (headers, "Connection", "keep-alive");
@@ -486,6 +696,23 @@ evd_longpolling_server_actual_send (EvdLongpollingServer  *self,
         }
     }
 
+  /* the size of the content is only unknown if it gets compressed */
+  encoder = evd_web_service_get_content_encoder (EVD_WEB_SERVICE (self),
+                                                 conn,
+                                                 headers,
+                                                 body->len);
+  if (encoder != NULL)
+    {
+      soup_message_headers_replace (headers, "Transfer-Encoding", "chunked");
+
+      evd_http_connection_set_content_encoder (conn, encoder);
+      g_object_unref (encoder);
+    }
+  else
+    {
+      soup_message_headers_set_content_length (headers, body->len);
+    }
+
   if (evd_http_connection_write_response_headers (conn,
                                                   SOUP_HTTP_1_1,
                                                   SOUP_STATUS_OK,
@@ -493,52 +720,85 @@ evd_longpolling_server_actual_send (EvdLongpollingServer  *self,
                                                   headers,
                                                   error))
     {
-      gchar *frame;
-      gsize frame_size;
-      EvdMessageType frame_type;
-
-      /* send frames in peer's backlog first */
-      while ( result &&
-              (frame = evd_peer_pop_message (peer, &frame_size, &frame_type)) != NULL)
-        {
-          if (! evd_longpolling_server_write_frame_delivery (self,
-                                                             conn,
-                                                             frame,
-                                                             frame_size,
-                                                             NULL))
-            {
-              evd_peer_unshift_message (peer, frame, frame_size, frame_type, NULL);
-
-              result = FALSE;
-            }
-
-          g_free (frame);
-        }
-
-      /* then send the requested frame */
-      if (result && buffer != NULL &&
-          ! evd_longpolling_server_write_frame_delivery (self,
-                                                   conn,
-                                                   buffer,
-                                                   size,
-                                                   NULL))
-        {
-          result = FALSE;
-        }
-
-      /* notify end of content */
-      evd_http_connection_write_content (conn, NULL, 0, FALSE, NULL);
+      result = evd_http_connection_write_content (conn,
+                                                  body->str,
+                                                  body->len,
+                                                  FALSE,
+                                                  error);
 
       /* flush connection's buffer, and shutdown connection after */
       EVD_WEB_SERVICE_GET_CLASS (self)->
         flush_and_return_connection (EVD_WEB_SERVICE (self), conn);
     }
+  else
+    {
+      evd_http_connection_set_content_encoder (conn, NULL);
+    }
+
+  if (result && body->len > 0)
+    {
+      self->priv->responses++;
+      self->priv->frames += g_queue_get_length (&frames) + (buffer != NULL ? 1 : 0);
+      self->priv->bytes += body->len;
+    }
 
+  /* return frames that could not be sent back to the peer's backlog,
+     keeping their original order */
+  while ( (frame = g_queue_pop_tail (&frames)) != NULL)
+    {
+      if (! result)
+        evd_peer_unshift_message (peer,
+                                  frame->buf,
+                                  frame->size,
+                                  frame->type,
+                                  NULL);
+
+      g_free (frame->buf);
+      g_slice_free (EvdLongpollingServerFrame, frame);
+    }
+
+  g_string_free (body, TRUE);
   soup_message_headers_free (headers);
 
   return result;
 }
 
+static gboolean
+evd_longpolling_server_flush_peer (gpointer user_data)
+{
+  EvdLongpollingServerFlush *flush = user_data;
+  EvdLongpollingServerPeerData *data;
+
+  data = g_object_get_data (G_OBJECT (flush->peer), PEER_DATA_KEY);
+
+  /* the backlog may have been delivered already by a new request */
+  if (data != NULL)
+    {
+      data->flush_src_id = 0;
+
+      if (g_queue_get_length (data->conns) > 0 &&
+          evd_peer_backlog_get_length (flush->peer) > 0)
+        {
+          EvdHttpConnection *conn;
+
+          conn = EVD_HTTP_CONNECTION (g_queue_pop_head (data->conns));
+
+          evd_longpolling_server_actual_send (flush->self,
+                                              flush->peer,
+                                              conn,
+                                              NULL,
+                                              0,
+                                              NULL);
+        }
+    }
+
+  g_object_unref (flush->peer);
+  g_object_unref (flush->self);
+  g_slice_free (EvdLongpollingServerFlush, flush);
+
+  return FALSE;
+}
+
 static gboolean
 evd_longpolling_server_select_conn_and_send (EvdLongpollingServer  *self,
                                              EvdPeer               *peer,
@@ -566,6 +826,32 @@ evd_longpolling_server_select_conn_and_send (EvdLongpollingServer  *self,
 
   evd_peer_touch (peer);
 
+  /* hold the frame in peer's backlog until the coalescing delay expires,
+     and deliver everything sent meanwhile in a single response */
+  if (self->priv->coalescing_delay >= 0)
+    {
+      if (! evd_peer_push_message (peer, buffer, size, type, error))
+        return FALSE;
+
+      if (data->flush_src_id == 0)
+        {
+          EvdLongpollingServerFlush *flush;
+
+          flush = g_slice_new (EvdLongpollingServerFlush);
+          flush->self = g_object_ref (self);
+          flush->peer = g_object_ref (peer);
+
+          data->flush_src_id =
+            evd_timeout_add (NULL,
+                             (guint) self->priv->coalescing_delay,
+                             G_PRIORITY_DEFAULT,
+                             evd_longpolling_server_flush_peer,
+                             flush);
+        }
+
+      return TRUE;
+    }
+
   conn = EVD_HTTP_CONNECTION (g_queue_pop_head (data->conns));
 
   if (evd_longpolling_server_actual_send (self,
@@ -670,3 +956,88 @@ evd_longpolling_server_new (void)
 
   return self;
 }
+
+/**
+ * evd_longpolling_server_set_peer_framing:
+ *
+ * Sets the wire format of the frames exchanged with @peer, as negotiated
+ * with it beforehand. Peers use %EVD_LONGPOLLING_FRAMING_TEXT by default.
+ **/
+void
+evd_longpolling_server_set_peer_framing (EvdLongpollingServer  *self,
+                                         EvdPeer               *peer,
+                                         EvdLongpollingFraming  framing)
+{
+  g_return_if_fail (EVD_IS_LONGPOLLING_SERVER (self));
+  g_return_if_fail (EVD_IS_PEER (peer));
+
+  g_object_set_data (G_OBJECT (peer),
+                     FRAMING_DATA_KEY,
+                     GUINT_TO_POINTER (framing));
+}
+
+EvdLongpollingFraming
+evd_longpolling_server_get_peer_framing (EvdLongpollingServer *self,
+                                         EvdPeer              *peer)
+{
+  g_return_val_if_fail (EVD_IS_LONGPOLLING_SERVER (self),
+                        EVD_LONGPOLLING_FRAMING_TEXT);
+  g_return_val_if_fail (EVD_IS_PEER (peer), EVD_LONGPOLLING_FRAMING_TEXT);
+
+  return get_peer_framing (peer);
+}
+
+/**
+ * evd_longpolling_server_set_coalescing_delay:
+ * @delay: milliseconds to hold messages back for, between 0 and 5, or -1
+ *
+ * Enables coalescing of the messages sent to each peer. When a peer has a
+ * pending request, the first message sent to it starts a window of @delay
+ * milliseconds, and the request is responded when it ends with every message
+ * sent within the window. A @delay of 0 makes the window last until the main
+ * loop finishes the current dispatch. -1, the default, disables it, and each
+ * message is responded right away.
+ **/
+void
+evd_longpolling_server_set_coalescing_delay (EvdLongpollingServer *self,
+                                             gint                  delay)
+{
+  g_return_if_fail (EVD_IS_LONGPOLLING_SERVER (self));
+  g_return_if_fail (delay >= -1 && delay <= MAX_COALESCING_DELAY);
+
+  self->priv->coalescing_delay = delay;
+}
+
+gint
+evd_longpolling_server_get_coalescing_delay (EvdLongpollingServer *self)
+{
+  g_return_val_if_fail (EVD_IS_LONGPOLLING_SERVER (self), -1);
+
+  return self->priv->coalescing_delay;
+}
+
+/**
+ * evd_longpolling_server_get_stats:
+ * @responses: (out) (allow-none): number of responses that carried content
+ * @frames: (out) (allow-none): number of frames delivered
+ * @bytes: (out) (allow-none): number of bytes of content delivered,
+ * including frame headers and before compression
+ *
+ * Gets delivery metrics of the transport. The average number of frames per
+ * response tells how well backlogged messages are being batched.
+ **/
+void
+evd_longpolling_server_get_stats (EvdLongpollingServer *self,
+                                  guint64              *responses,
+                                  guint64              *frames,
+                                  guint64              *bytes)
+{
+  g_return_if_fail (EVD_IS_LONGPOLLING_SERVER (self));
+
+  if (responses != NULL)
+    *responses = self->priv->responses;
+  if (frames != NULL)
+    *frames = self->priv->frames;
+  if (bytes != NULL)
+    *bytes = self->priv->bytes;
+}
@@ -28,9 +28,17 @@
 #endif
 
 #include "evd-web-service.h"
+#include "evd-peer.h"
 
 G_BEGIN_DECLS
 
+/* wire format of the frames exchanged with a peer */
+typedef enum
+{
+  EVD_LONGPOLLING_FRAMING_TEXT   = 1, /* hex-encoded lengths, the default */
+  EVD_LONGPOLLING_FRAMING_BINARY = 2  /* varint lengths, binary content */
+} EvdLongpollingFraming;
+
 typedef struct _EvdLongpollingServer EvdLongpollingServer;
 typedef struct _EvdLongpollingServerClass EvdLongpollingServerClass;
 typedef struct _EvdLongpollingServerPrivate EvdLongpollingServerPrivate;
@@ -69,6 +77,38 @@ GType                  evd_longpolling_server_get_type          (void) G_GNUC_CO
 
 EvdLongpollingServer * evd_longpolling_server_new               (void);
 
+void                   evd_longpolling_server_set_peer_framing  (EvdLongpollingServer  *self,
+                                                                 EvdPeer               *peer,
+                                                                 EvdLongpollingFraming  framing);
+EvdLongpollingFraming  evd_longpolling_server_get_peer_framing  (EvdLongpollingServer *self,
+                                                                 EvdPeer              *peer);
+
+void                   evd_longpolling_server_set_coalescing_delay (EvdLongpollingServer *self,
+                                                                    gint                  delay);
+gint                   evd_longpolling_server_get_coalescing_delay (EvdLongpollingServer *self);
+
+void                   evd_longpolling_server_get_stats         (EvdLongpollingServer *self,
+                                                                 guint64              *responses,
+                                                                 guint64              *frames,
+                                                                 guint64              *bytes);
+
+#ifdef EVD_COMPILATION
+typedef enum
+{
+  EVD_LONGPOLLING_ACTION_UNKNOWN,
+  EVD_LONGPOLLING_ACTION_RECEIVE,
+  EVD_LONGPOLLING_ACTION_SEND,
+  EVD_LONGPOLLING_ACTION_CLOSE
+} EvdLongpollingAction;
+
+EvdLongpollingAction   evd_longpolling_server_parse_action      (const gchar *path);
+
+gssize                 evd_longpolling_server_read_frame_header (EvdLongpollingFraming  framing,
+                                                                 const gchar           *buf,
+                                                                 gsize                  size,
+                                                                 guint64               *msg_len);
+#endif
+
 G_END_DECLS
 
 #endif /* __EVD_LONGPOLLING_SERVER_H__ */
@@ -0,0 +1,542 @@
+/*
+ * evd-peer-directory.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License at http://www.gnu.org/licenses/lgpl-3.0.txt
+ * for more details.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+
+#include <gio/gio.h>
+
+#include "evd-peer-directory.h"
+
+#include "evd-reproxy.h"
+#include "evd-io-stream-group.h"
+
+/**
+ * SECTION:evd-peer-directory
+ * @short_description: Directory of the peers owned by the workers of a host.
+ *
+ * A #EvdPeerDirectory lets several processes serve the same web transport
+ * without sticky routing. Each worker registers the peers it creates in a
+ * directory shared by all the workers, as symbolic links named after the
+ * peer id and pointing to the address where the owning worker can be
+ * reached (typically a UNIX socket). A worker receiving a request for a peer
+ * it does not own relays the connection to the owner.
+ *
+ * Entries also record the process id of the owning worker. Entries left
+ * behind by workers that exited without unregistering their peers are
+ * removed when they are looked up, and when a directory is created.
+ *
+ * The directory should live in a memory-backed filesystem, like /dev/shm
+ * or $XDG_RUNTIME_DIR.
+ **/
+
+G_DEFINE_TYPE (EvdPeerDirectory, evd_peer_directory, G_TYPE_OBJECT)
+
+#define EVD_PEER_DIRECTORY_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                             EVD_TYPE_PEER_DIRECTORY, \
+                                             EvdPeerDirectoryPrivate))
+
+/* private data */
+struct _EvdPeerDirectoryPrivate
+{
+  gchar *path;
+  gchar *worker_address;
+
+  /* owner address => EvdReproxy */
+  GHashTable *proxies;
+};
+
+/* properties */
+enum
+{
+  PROP_0,
+  PROP_PATH,
+  PROP_WORKER_ADDRESS
+};
+
+static void     evd_peer_directory_class_init         (EvdPeerDirectoryClass *class);
+static void     evd_peer_directory_init               (EvdPeerDirectory *self);
+static void     evd_peer_directory_constructed        (GObject *obj);
+
+static void     evd_peer_directory_finalize           (GObject *obj);
+
+static void     evd_peer_directory_set_property       (GObject      *obj,
+                                                       guint         prop_id,
+                                                       const GValue *value,
+                                                       GParamSpec   *pspec);
+static void     evd_peer_directory_get_property       (GObject    *obj,
+                                                       guint       prop_id,
+                                                       GValue     *value,
+                                                       GParamSpec *pspec);
+
+static void     remove_stale_entries                  (EvdPeerDirectory *self);
+
+static void
+evd_peer_directory_class_init (EvdPeerDirectoryClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+
+  obj_class->constructed = evd_peer_directory_constructed;
+  obj_class->finalize = evd_peer_directory_finalize;
+  obj_class->get_property = evd_peer_directory_get_property;
+  obj_class->set_property = evd_peer_directory_set_property;
+
+  g_object_class_install_property (obj_class, PROP_PATH,
+                                   g_param_spec_string ("path",
+                                                        "Path",
+                                                        "Filesystem path of the directory shared by all workers",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (obj_class, PROP_WORKER_ADDRESS,
+                                   g_param_spec_string ("worker-address",
+                                                        "Worker address",
+                                                        "Address where other workers can reach this one",
+                                                        NULL,
+                                                        G_PARAM_READWRITE |
+                                                        G_PARAM_CONSTRUCT_ONLY |
+                                                        G_PARAM_STATIC_STRINGS));
+
+  /* add private structure */
+  g_type_class_add_private (obj_class, sizeof (EvdPeerDirectoryPrivate));
+}
+
+static void
+evd_peer_directory_init (EvdPeerDirectory *self)
+{
+  EvdPeerDirectoryPrivate *priv;
+
+  priv = EVD_PEER_DIRECTORY_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->path = NULL;
+  priv->worker_address = NULL;
+
+  priv->proxies = g_hash_table_new_full (g_str_hash,
+                                         g_str_equal,
+                                         g_free,
+                                         g_object_unref);
+}
+
+static void
+evd_peer_directory_constructed (GObject *obj)
+{
+  EvdPeerDirectory *self = EVD_PEER_DIRECTORY (obj);
+
+  remove_stale_entries (self);
+
+  G_OBJECT_CLASS (evd_peer_directory_parent_class)->constructed (obj);
+}
+
+static void
+evd_peer_directory_finalize (GObject *obj)
+{
+  EvdPeerDirectory *self = EVD_PEER_DIRECTORY (obj);
+
+  g_hash_table_unref (self->priv->proxies);
+
+  g_free (self->priv->path);
+  g_free (self->priv->worker_address);
+
+  G_OBJECT_CLASS (evd_peer_directory_parent_class)->finalize (obj);
+}
+
+static void
+evd_peer_directory_set_property (GObject      *obj,
+                                 guint         prop_id,
+                                 const GValue *value,
+                                 GParamSpec   *pspec)
+{
+  EvdPeerDirectory *self;
+
+  self = EVD_PEER_DIRECTORY (obj);
+
+  switch (prop_id)
+    {
+    case PROP_PATH:
+      self->priv->path = g_value_dup_string (value);
+      break;
+
+    case PROP_WORKER_ADDRESS:
+      self->priv->worker_address = g_value_dup_string (value);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+    }
+}
+
+static void
+evd_peer_directory_get_property (GObject    *obj,
+                                 guint       prop_id,
+                                 GValue     *value,
+                                 GParamSpec *pspec)
+{
+  EvdPeerDirectory *self;
+
+  self = EVD_PEER_DIRECTORY (obj);
+
+  switch (prop_id)
+    {
+    case PROP_PATH:
+      g_value_set_string (value, self->priv->path);
+      break;
+
+    case PROP_WORKER_ADDRESS:
+      g_value_set_string (value, self->priv->worker_address);
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+    }
+}
+
+/* peer ids come from request URLs, so they are checked before being used
+   as file names */
+static gboolean
+is_valid_peer_id (const gchar *peer_id)
+{
+  const gchar *p;
+
+  if (peer_id[0] == '\0')
+    return FALSE;
+
+  for (p = peer_id; *p != '\0'; p++)
+    if (! g_ascii_isalnum (*p) && *p != '-' && *p != '_')
+      return FALSE;
+
+  return TRUE;
+}
+
+static gchar *
+get_entry_path (EvdPeerDirectory *self, const gchar *peer_id)
+{
+  return g_build_filename (self->priv->path, peer_id, NULL);
+}
+
+/* entries point to "<pid>:<address>" */
+static gchar *
+parse_entry_target (const gchar *target, pid_t *pid)
+{
+  gchar *end;
+  guint64 value;
+
+  value = g_ascii_strtoull (target, &end, 10);
+  if (end == target || *end != ':' || value == 0 || value > G_MAXINT)
+    return NULL;
+
+  *pid = (pid_t) value;
+
+  return g_strdup (end + 1);
+}
+
+static gboolean
+owner_is_alive (pid_t pid)
+{
+  /* EPERM means the process exists but runs as another user */
+  return kill (pid, 0) == 0 || errno == EPERM;
+}
+
+/* returns the address of the owner of @peer_id, or %NULL if there is no
+   entry for it. Entries whose owner is no longer running are removed */
+static gchar *
+read_entry (EvdPeerDirectory *self, const gchar *peer_id, pid_t *pid)
+{
+  gchar *entry;
+  gchar *target;
+  gchar *owner;
+  pid_t owner_pid = 0;
+
+  entry = get_entry_path (self, peer_id);
+
+  target = g_file_read_link (entry, NULL);
+  if (target == NULL)
+    {
+      g_free (entry);
+      return NULL;
+    }
+
+  owner = parse_entry_target (target, &owner_pid);
+  if (owner == NULL || ! owner_is_alive (owner_pid))
+    {
+      gchar *current;
+
+      /* another worker may have replaced the entry meanwhile */
+      current = g_file_read_link (entry, NULL);
+      if (g_strcmp0 (current, target) == 0)
+        unlink (entry);
+      g_free (current);
+
+      g_free (owner);
+      owner = NULL;
+    }
+  else if (pid != NULL)
+    {
+      *pid = owner_pid;
+    }
+
+  g_free (target);
+  g_free (entry);
+
+  return owner;
+}
+
+static void
+remove_stale_entries (EvdPeerDirectory *self)
+{
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (self->priv->path, 0, NULL);
+  if (dir == NULL)
+    return;
+
+  while ((name = g_dir_read_name (dir)) != NULL)
+    if (is_valid_peer_id (name))
+      g_free (read_entry (self, name, NULL));
+
+  g_dir_close (dir);
+}
+
+/* public methods */
+
+/**
+ * evd_peer_directory_new:
+ * @path: directory shared by all the workers, which must exist
+ * @worker_address: address where the other workers can reach the web
+ * transport of this worker, as accepted by evd_connection_pool_new()
+ *
+ * Returns: (transfer full):
+ **/
+EvdPeerDirectory *
+evd_peer_directory_new (const gchar *path, const gchar *worker_address)
+{
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (worker_address != NULL, NULL);
+
+  return g_object_new (EVD_TYPE_PEER_DIRECTORY,
+                       "path", path,
+                       "worker-address", worker_address,
+                       NULL);
+}
+
+const gchar *
+evd_peer_directory_get_path (EvdPeerDirectory *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER_DIRECTORY (self), NULL);
+
+  return self->priv->path;
+}
+
+const gchar *
+evd_peer_directory_get_worker_address (EvdPeerDirectory *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER_DIRECTORY (self), NULL);
+
+  return self->priv->worker_address;
+}
+
+/**
+ * evd_peer_directory_register:
+ *
+ * Publishes this worker as the owner of the peer identified by @peer_id.
+ *
+ * Returns: %TRUE on success, %FALSE on error.
+ **/
+gboolean
+evd_peer_directory_register (EvdPeerDirectory  *self,
+                             const gchar       *peer_id,
+                             GError           **error)
+{
+  gchar *entry;
+  gchar *target;
+  gint err = 0;
+
+  g_return_val_if_fail (EVD_IS_PEER_DIRECTORY (self), FALSE);
+  g_return_val_if_fail (peer_id != NULL, FALSE);
+
+  if (! is_valid_peer_id (peer_id))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_ARGUMENT,
+                   "Invalid peer id '%s'", peer_id);
+      return FALSE;
+    }
+
+  entry = get_entry_path (self, peer_id);
+  target = g_strdup_printf ("%d:%s",
+                            (gint) getpid (),
+                            self->priv->worker_address);
+
+  /* creating a symlink is atomic, so other workers never see a partial
+     entry */
+  if (symlink (target, entry) != 0)
+    err = errno;
+
+  /* reading an entry left by a dead worker removes it */
+  if (err == EEXIST)
+    {
+      gchar *owner;
+
+      owner = read_entry (self, peer_id, NULL);
+      if (owner == NULL)
+        err = symlink (target, entry) == 0 ? 0 : errno;
+
+      g_free (owner);
+    }
+
+  g_free (target);
+  g_free (entry);
+
+  if (err != 0)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   g_io_error_from_errno (err),
+                   "Failed to register peer in directory: %s",
+                   g_strerror (err));
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * evd_peer_directory_unregister:
+ *
+ * Removes the entry of the peer identified by @peer_id, if this worker owns
+ * it.
+ **/
+void
+evd_peer_directory_unregister (EvdPeerDirectory *self, const gchar *peer_id)
+{
+  gchar *owner;
+  pid_t pid = 0;
+
+  g_return_if_fail (EVD_IS_PEER_DIRECTORY (self));
+  g_return_if_fail (peer_id != NULL);
+
+  if (! is_valid_peer_id (peer_id))
+    return;
+
+  owner = read_entry (self, peer_id, &pid);
+
+  if (pid == getpid () &&
+      g_strcmp0 (owner, self->priv->worker_address) == 0)
+    {
+      gchar *entry;
+
+      entry = get_entry_path (self, peer_id);
+      unlink (entry);
+      g_free (entry);
+    }
+
+  g_free (owner);
+}
+
+/**
+ * evd_peer_directory_lookup:
+ *
+ * Returns: (transfer full) (allow-none): The address of the worker that owns
+ * the peer identified by @peer_id, or %NULL if no running worker has
+ * registered it.
+ **/
+gchar *
+evd_peer_directory_lookup (EvdPeerDirectory *self, const gchar *peer_id)
+{
+  g_return_val_if_fail (EVD_IS_PEER_DIRECTORY (self), NULL);
+  g_return_val_if_fail (peer_id != NULL, NULL);
+
+  if (! is_valid_peer_id (peer_id))
+    return NULL;
+
+  return read_entry (self, peer_id, NULL);
+}
+
+/**
+ * evd_peer_directory_forward:
+ * @conn: the connection @request was read from
+ *
+ * Relays @conn to the worker that owns the peer identified by @peer_id,
+ * starting with @request. From then on, all the traffic of @conn goes
+ * through that worker.
+ *
+ * Returns: %TRUE if the connection was relayed, %FALSE if the peer is
+ * unknown or owned by this worker.
+ **/
+gboolean
+evd_peer_directory_forward (EvdPeerDirectory  *self,
+                            const gchar       *peer_id,
+                            EvdHttpConnection *conn,
+                            EvdHttpRequest    *request)
+{
+  EvdReproxy *reproxy;
+  gchar *owner;
+  GError *error = NULL;
+
+  g_return_val_if_fail (EVD_IS_PEER_DIRECTORY (self), FALSE);
+  g_return_val_if_fail (peer_id != NULL, FALSE);
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), FALSE);
+  g_return_val_if_fail (EVD_IS_HTTP_REQUEST (request), FALSE);
+
+  owner = evd_peer_directory_lookup (self, peer_id);
+  if (owner == NULL ||
+      g_strcmp0 (owner, self->priv->worker_address) == 0)
+    {
+      g_free (owner);
+      return FALSE;
+    }
+
+  if (! evd_http_connection_unread_request_headers (conn, request, &error))
+    {
+      /* @TODO: do proper logging */
+      g_debug ("Failed to forward request for peer: %s", error->message);
+      g_error_free (error);
+      g_free (owner);
+
+      return FALSE;
+    }
+
+  /* one reverse proxy per owner worker, which keeps connections to it
+     ready */
+  reproxy = g_hash_table_lookup (self->priv->proxies, owner);
+  if (reproxy == NULL)
+    {
+      reproxy = evd_reproxy_new ();
+      evd_reproxy_add_backend (reproxy, owner);
+
+      g_hash_table_insert (self->priv->proxies, owner, reproxy);
+    }
+  else
+    {
+      g_free (owner);
+    }
+
+  evd_io_stream_group_add (EVD_IO_STREAM_GROUP (reproxy), G_IO_STREAM (conn));
+
+  return TRUE;
+}
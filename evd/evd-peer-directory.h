@@ -0,0 +1,92 @@
+/*
+ * evd-peer-directory.h
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License at http://www.gnu.org/licenses/lgpl-3.0.txt
+ * for more details.
+ */
+
+#ifndef __EVD_PEER_DIRECTORY_H__
+#define __EVD_PEER_DIRECTORY_H__
+
+#if !defined (__EVD_H_INSIDE__) && !defined (EVD_COMPILATION)
+#error "Only <evd.h> can be included directly."
+#endif
+
+#include <glib-object.h>
+
+#include "evd-http-connection.h"
+#include "evd-http-request.h"
+
+G_BEGIN_DECLS
+
+typedef struct _EvdPeerDirectory EvdPeerDirectory;
+typedef struct _EvdPeerDirectoryClass EvdPeerDirectoryClass;
+typedef struct _EvdPeerDirectoryPrivate EvdPeerDirectoryPrivate;
+
+struct _EvdPeerDirectory
+{
+  GObject parent;
+
+  EvdPeerDirectoryPrivate *priv;
+};
+
+struct _EvdPeerDirectoryClass
+{
+  GObjectClass parent_class;
+
+  /* padding for future expansion */
+  void (* _padding_0_) (void);
+  void (* _padding_1_) (void);
+  void (* _padding_2_) (void);
+  void (* _padding_3_) (void);
+  void (* _padding_4_) (void);
+  void (* _padding_5_) (void);
+  void (* _padding_6_) (void);
+  void (* _padding_7_) (void);
+};
+
+#define EVD_TYPE_PEER_DIRECTORY           (evd_peer_directory_get_type ())
+#define EVD_PEER_DIRECTORY(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), EVD_TYPE_PEER_DIRECTORY, EvdPeerDirectory))
+#define EVD_PEER_DIRECTORY_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), EVD_TYPE_PEER_DIRECTORY, EvdPeerDirectoryClass))
+#define EVD_IS_PEER_DIRECTORY(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EVD_TYPE_PEER_DIRECTORY))
+#define EVD_IS_PEER_DIRECTORY_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), EVD_TYPE_PEER_DIRECTORY))
+#define EVD_PEER_DIRECTORY_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), EVD_TYPE_PEER_DIRECTORY, EvdPeerDirectoryClass))
+
+
+GType              evd_peer_directory_get_type           (void) G_GNUC_CONST;
+
+EvdPeerDirectory * evd_peer_directory_new                (const gchar *path,
+                                                          const gchar *worker_address);
+
+const gchar *      evd_peer_directory_get_path           (EvdPeerDirectory *self);
+const gchar *      evd_peer_directory_get_worker_address (EvdPeerDirectory *self);
+
+gboolean           evd_peer_directory_register           (EvdPeerDirectory  *self,
+                                                          const gchar       *peer_id,
+                                                          GError           **error);
+void               evd_peer_directory_unregister         (EvdPeerDirectory *self,
+                                                          const gchar      *peer_id);
+
+gchar *            evd_peer_directory_lookup             (EvdPeerDirectory *self,
+                                                          const gchar      *peer_id);
+
+gboolean           evd_peer_directory_forward            (EvdPeerDirectory  *self,
+                                                          const gchar       *peer_id,
+                                                          EvdHttpConnection *conn,
+                                                          EvdHttpRequest    *request);
+
+G_END_DECLS
+
+#endif /* __EVD_PEER_DIRECTORY_H__ */
@@ -26,6 +26,7 @@
 
 #include "evd-marshal.h"
 #include "evd-utils.h"
+#include "evd-transport.h"
 
 G_DEFINE_TYPE (EvdPeerManager, evd_peer_manager, G_TYPE_OBJECT)
 
@@ -35,20 +36,53 @@ G_DEFINE_TYPE (EvdPeerManager, evd_peer_manager, G_TYPE_OBJECT)
 
 #define DEFAULT_PEER_CLEANUP_INTERVAL 5 /* seconds */
 
+/* expiry wheel, one slot per second. Must be a power of 2 */
+#define WHEEL_SLOTS 64
+
+/* maximum number of peers checked per cleanup run */
+#define PEER_CLEANUP_BUDGET 1024
+
+#define DEFAULT_MAX_BACKLOG_SIZE 0 /* unlimited */
+
 #define PEER_DATA_KEY "org.eventdance.lib.PeerManager.PEER_DATA"
 
 /* private data */
 struct _EvdPeerManagerPrivate
 {
   GHashTable *peers;
+  gchar *id_prefix;
+
+  /* peers are expired from a timer wheel, which is only visited for
+     the seconds that elapsed since the last cleanup */
+  GQueue *wheel[WHEEL_SLOTS];
+  gint64 wheel_time; /* the second of the next slot to expire */
+  guint wheel_size;
 
-  GTimer *peer_cleanup_timer;
   guint peer_cleanup_interval;
   guint peer_cleanup_src_id;
 
   GQueue *removal_list;
+
+  /* bytes in the backlogs of all peers */
+  gsize backlog_size;
+  gsize max_backlog_size;
+
+  /* publish/subscribe */
+  GHashTable *channels;
+  GHashTable *subscriptions;
 };
 
+typedef struct
+{
+  gchar *name;
+
+  /* set of subscribed peers */
+  GHashTable *peers;
+
+  guint64 published;
+  guint64 delivered;
+} EvdPeerManagerChannel;
+
 /* signals */
 enum
 {
@@ -71,6 +105,10 @@ static void     evd_peer_manager_close_peer_internal (EvdPeerManager *self,
                                                       EvdPeer        *peer,
                                                       gboolean        gracefully);
 
+static void     channel_free                         (gpointer data);
+
+static gboolean evd_peer_manager_cleanup_peers_cb    (gpointer user_data);
+
 static void
 evd_peer_manager_class_init (EvdPeerManagerClass *class)
 {
@@ -107,25 +145,46 @@ static void
 evd_peer_manager_init (EvdPeerManager *self)
 {
   EvdPeerManagerPrivate *priv;
+  gint i;
 
   priv = EVD_PEER_MANAGER_GET_PRIVATE (self);
   self->priv = priv;
 
-  priv->peers = g_hash_table_new_full (g_str_hash,
+  /* keys are the ids owned by the peers themselves */
+  priv->peers = g_hash_table_new_full (evd_peer_id_hash,
                                        g_str_equal,
-                                       g_free,
+                                       NULL,
                                        g_object_unref);
+  priv->id_prefix = NULL;
+
+  for (i = 0; i < WHEEL_SLOTS; i++)
+    priv->wheel[i] = g_queue_new ();
+  priv->wheel_time = g_get_monotonic_time () / G_USEC_PER_SEC;
+  priv->wheel_size = 0;
 
-  priv->peer_cleanup_timer = g_timer_new ();
   priv->peer_cleanup_interval = DEFAULT_PEER_CLEANUP_INTERVAL;
 
   priv->removal_list = g_queue_new ();
+
+  priv->backlog_size = 0;
+  priv->max_backlog_size = DEFAULT_MAX_BACKLOG_SIZE;
+
+  priv->channels = g_hash_table_new_full (g_str_hash,
+                                          g_str_equal,
+                                          NULL,
+                                          channel_free);
+  priv->subscriptions =
+    g_hash_table_new_full (g_direct_hash,
+                           g_direct_equal,
+                           NULL,
+                           (GDestroyNotify) g_hash_table_unref);
 }
 
 static void
 evd_peer_manager_dispose (GObject *obj)
 {
   EvdPeerManager *self = EVD_PEER_MANAGER (obj);
+  gint i;
 
   if (self->priv->peers != NULL)
     {
@@ -139,6 +198,16 @@ evd_peer_manager_dispose (GObject *obj)
         }
       g_queue_free (self->priv->removal_list);
 
+      for (i = 0; i < WHEEL_SLOTS; i++)
+        {
+          g_queue_foreach (self->priv->wheel[i], (GFunc) g_object_unref, NULL);
+          g_queue_free (self->priv->wheel[i]);
+          self->priv->wheel[i] = NULL;
+        }
+
+      g_hash_table_unref (self->priv->subscriptions);
+      g_hash_table_unref (self->priv->channels);
+
       g_hash_table_unref (self->priv->peers);
       self->priv->peers = NULL;
     }
@@ -151,17 +220,40 @@ evd_peer_manager_finalize (GObject *obj)
 {
   EvdPeerManager *self = EVD_PEER_MANAGER (obj);
 
-  g_timer_destroy (self->priv->peer_cleanup_timer);
-
   if (self->priv->peer_cleanup_src_id != 0)
     g_source_remove (self->priv->peer_cleanup_src_id);
 
+  g_free (self->priv->id_prefix);
+
   G_OBJECT_CLASS (evd_peer_manager_parent_class)->finalize (obj);
 
   if (self == evd_peer_manager_default)
     evd_peer_manager_default = NULL;
 }
 
+static void
+channel_free (gpointer data)
+{
+  EvdPeerManagerChannel *channel = data;
+
+  g_hash_table_unref (channel->peers);
+  g_free (channel->name);
+
+  g_slice_free (EvdPeerManagerChannel, channel);
+}
+
+static void
+channel_remove_peer (EvdPeerManager        *self,
+                     EvdPeerManagerChannel *channel,
+                     EvdPeer               *peer)
+{
+  g_hash_table_remove (channel->peers, peer);
+
+  /* channels exist only while they have subscribers */
+  if (g_hash_table_size (channel->peers) == 0)
+    g_hash_table_remove (self->priv->channels, channel->name);
+}
+
 static void
 evd_peer_manager_close_peer_internal (EvdPeerManager *self,
                                       EvdPeer        *peer,
@@ -175,40 +267,105 @@ evd_peer_manager_close_peer_internal (EvdPeerManager *self,
                  peer,
                  gracefully,
                  NULL);
+
+  /* subscriptions are kept during 'peer-closed', so that handlers can
+     still find out which channels the peer was subscribed to */
+  evd_peer_manager_unsubscribe_all (self, peer);
 }
 
-static gboolean
-evd_peer_manager_check_peer (gpointer key,
-                             gpointer value,
-                             gpointer user_data)
+static void
+wheel_insert (EvdPeerManager *self,
+              EvdPeer        *peer,
+              gint64          deadline,
+              gint64          min_slot_time)
 {
-  EvdPeerManager *self = EVD_PEER_MANAGER (user_data);
-  EvdPeer *peer = EVD_PEER (value);
+  gint64 slot_time;
 
-  if (evd_peer_is_alive (peer))
+  /* peers due later than the span of the wheel are checked again at its
+     last slot, and moved further */
+  slot_time = deadline / G_USEC_PER_SEC;
+  slot_time = MAX (slot_time, min_slot_time);
+  slot_time = MIN (slot_time, self->priv->wheel_time + WHEEL_SLOTS - 1);
+
+  g_queue_push_tail (self->priv->wheel[slot_time & (WHEEL_SLOTS - 1)], peer);
+  self->priv->wheel_size++;
+}
+
+static void
+evd_peer_manager_check_peer (EvdPeerManager *self,
+                             EvdPeer        *peer,
+                             gint64          now)
+{
+  const gchar *id;
+  gint64 deadline;
+
+  id = evd_peer_get_id (peer);
+
+  /* removed from the manager since it was scheduled */
+  if (g_hash_table_lookup (self->priv->peers, id) != peer)
     {
-      return FALSE;
+      g_object_unref (peer);
+      return;
+    }
+
+  /* peers touched since they were scheduled are just moved to the slot
+     of their current deadline, so touching a peer is never more expensive
+     than updating its timestamp */
+  deadline = evd_peer_get_deadline (peer);
+  if (deadline > now && ! evd_peer_is_closed (peer))
+    {
+      wheel_insert (self, peer, deadline, self->priv->wheel_time + 1);
+    }
+  else if (evd_peer_is_alive (peer))
+    {
+      /* idle, but still connected */
+      wheel_insert (self,
+                    peer,
+                    now + (gint64) self->priv->peer_cleanup_interval * G_USEC_PER_SEC,
+                    self->priv->wheel_time + 1);
     }
   else
     {
-      g_queue_push_tail (self->priv->removal_list, g_object_ref (peer));
-
-      return TRUE;
+      /* the wheel's reference is passed on to the removal list */
+      g_hash_table_remove (self->priv->peers, id);
+      g_queue_push_tail (self->priv->removal_list, peer);
     }
 }
 
 static void
 evd_peer_manager_cleanup_peers (EvdPeerManager *self)
 {
-  if (g_timer_elapsed (self->priv->peer_cleanup_timer, NULL) <=
-      self->priv->peer_cleanup_interval)
-    return;
+  gint64 now;
+  gint64 now_slot_time;
+  guint budget = PEER_CLEANUP_BUDGET;
+
+  now = g_get_monotonic_time ();
+  now_slot_time = now / G_USEC_PER_SEC;
+
+  while (self->priv->wheel_time <= now_slot_time && budget > 0)
+    {
+      GQueue *slot;
+      EvdPeer *peer;
+
+      if (self->priv->wheel_size == 0)
+        {
+          self->priv->wheel_time = now_slot_time + 1;
+          break;
+        }
 
-  g_timer_start (self->priv->peer_cleanup_timer);
+      slot = self->priv->wheel[self->priv->wheel_time & (WHEEL_SLOTS - 1)];
 
-  g_hash_table_foreach_remove (self->priv->peers,
-                               evd_peer_manager_check_peer,
-                               self);
+      while (budget > 0 && (peer = g_queue_pop_head (slot)) != NULL)
+        {
+          self->priv->wheel_size--;
+          budget--;
+
+          evd_peer_manager_check_peer (self, peer, now);
+        }
+
+      if (g_queue_get_length (slot) == 0)
+        self->priv->wheel_time++;
+    }
 
   while (g_queue_get_length (self->priv->removal_list) > 0)
     {
@@ -219,6 +376,15 @@ evd_peer_manager_cleanup_peers (EvdPeerManager *self)
       evd_peer_manager_close_peer_internal (self, peer, FALSE);
       g_object_unref (peer);
     }
+
+  /* out of budget, continue in the next main loop iteration */
+  if (budget == 0 && self->priv->peer_cleanup_src_id == 0)
+    self->priv->peer_cleanup_src_id =
+      evd_timeout_add (NULL,
+                       0,
+                       G_PRIORITY_DEFAULT,
+                       evd_peer_manager_cleanup_peers_cb,
+                       self);
 }
 
 static gboolean
@@ -250,6 +416,64 @@ evd_peer_manager_cleanup_peers_cb (gpointer user_data)
   return FALSE;
 }
 
+static gboolean
+broadcast_to_peers (GList       *peers,
+                    EvdMessage  *message,
+                    guint64     *delivered,
+                    GError     **error)
+{
+  GHashTable *by_transport;
+  GHashTableIter iter;
+  gpointer key;
+  gpointer value;
+  GList *node;
+  gboolean result = TRUE;
+
+  /* group peers by transport, so each transport encodes the message once */
+  by_transport = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (node = peers; node != NULL; node = node->next)
+    {
+      EvdPeer *peer = EVD_PEER (node->data);
+      EvdTransport *transport;
+      GList *list;
+
+      if (evd_peer_is_closed (peer))
+        continue;
+
+      transport = evd_peer_get_transport (peer);
+      if (transport == NULL)
+        continue;
+
+      list = g_hash_table_lookup (by_transport, transport);
+      g_hash_table_insert (by_transport, transport, g_list_prepend (list, peer));
+    }
+
+  g_hash_table_iter_init (&iter, by_transport);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    {
+      GList *list = value;
+
+      if (! evd_transport_broadcast (EVD_TRANSPORT (key),
+                                     list,
+                                     message,
+                                     result ? error : NULL))
+        {
+          result = FALSE;
+        }
+      else if (delivered != NULL)
+        {
+          *delivered += g_list_length (list);
+        }
+
+      g_list_free (list);
+    }
+
+  g_hash_table_unref (by_transport);
+
+  return result;
+}
+
 /* public methods */
 
 /**
@@ -284,10 +508,16 @@ evd_peer_manager_add_peer (EvdPeerManager *self, EvdPeer *peer)
   g_return_if_fail (EVD_IS_PEER_MANAGER (self));
   g_return_if_fail (EVD_IS_PEER (peer));
 
+  if (g_hash_table_lookup (self->priv->peers, evd_peer_get_id (peer)) != peer)
+    wheel_insert (self,
+                  g_object_ref (peer),
+                  evd_peer_get_deadline (peer),
+                  self->priv->wheel_time);
+
   g_object_ref (peer);
-  g_hash_table_insert (self->priv->peers,
-                       g_strdup (evd_peer_get_id (peer)),
-                       peer);
+  g_hash_table_replace (self->priv->peers,
+                        (gpointer) evd_peer_get_id (peer),
+                        peer);
 
   g_object_set_data (G_OBJECT (peer), PEER_DATA_KEY, self);
   g_object_ref (self);
@@ -320,12 +550,13 @@ evd_peer_manager_lookup_peer (EvdPeerManager *self, const gchar *id)
                                         (gconstpointer) id));
 
   /* trigger a peer cleanup in idle */
-  self->priv->peer_cleanup_src_id =
-    evd_timeout_add (NULL,
-                     0,
-                     G_PRIORITY_DEFAULT,
-                     evd_peer_manager_cleanup_peers_cb,
-                     self);
+  if (self->priv->peer_cleanup_src_id == 0)
+    self->priv->peer_cleanup_src_id =
+      evd_timeout_add (NULL,
+                       0,
+                       G_PRIORITY_DEFAULT,
+                       evd_peer_manager_cleanup_peers_cb,
+                       self);
 
   return peer;
 }
@@ -356,3 +587,370 @@ evd_peer_manager_close_peer (EvdPeerManager *self,
   if (g_hash_table_remove (self->priv->peers, evd_peer_get_id (peer)))
     evd_peer_manager_close_peer_internal (self, peer, gracefully);
 }
+
+/**
+ * evd_peer_manager_broadcast:
+ * @peers: (element-type Evd.Peer) (allow-none): the peers to send @message
+ * to, or %NULL to send it to all the peers of the manager
+ * @message: the message to send
+ *
+ * Sends @message to many peers, which may belong to different transports.
+ * See evd_transport_broadcast().
+ *
+ * Returns: %TRUE on success, %FALSE if @message could not be delivered
+ * nor queued for some peer.
+ **/
+gboolean
+evd_peer_manager_broadcast (EvdPeerManager  *self,
+                            GList           *peers,
+                            EvdMessage      *message,
+                            GError         **error)
+{
+  gboolean result;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), FALSE);
+  g_return_val_if_fail (message != NULL, FALSE);
+
+  if (peers != NULL)
+    return broadcast_to_peers (peers, message, NULL, error);
+
+  peers = evd_peer_manager_get_all_peers (self);
+  result = broadcast_to_peers (peers, message, NULL, error);
+  g_list_free (peers);
+
+  return result;
+}
+
+/**
+ * evd_peer_manager_set_id_prefix:
+ * @prefix: (allow-none): a short alphanumeric string, or %NULL
+ *
+ * Makes the ids of the peers created from now on start with @prefix and a
+ * '-'. When peers are spread over several processes or hosts, giving each
+ * a different prefix lets a front-end route requests by peer id alone.
+ **/
+void
+evd_peer_manager_set_id_prefix (EvdPeerManager *self, const gchar *prefix)
+{
+  const gchar *p;
+
+  g_return_if_fail (EVD_IS_PEER_MANAGER (self));
+
+  for (p = prefix; p != NULL && *p != '\0'; p++)
+    g_return_if_fail (g_ascii_isalnum (*p));
+
+  g_free (self->priv->id_prefix);
+  self->priv->id_prefix = g_strdup (prefix);
+}
+
+const gchar *
+evd_peer_manager_get_id_prefix (EvdPeerManager *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), NULL);
+
+  return self->priv->id_prefix;
+}
+
+/**
+ * evd_peer_manager_get_backlog_size:
+ *
+ * Returns: The number of bytes held in the backlogs of the peers of
+ * @self.
+ **/
+gsize
+evd_peer_manager_get_backlog_size (EvdPeerManager *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), 0);
+
+  return self->priv->backlog_size;
+}
+
+/**
+ * evd_peer_manager_set_max_backlog_size:
+ * @max_size: maximum number of bytes, or 0 for no limit
+ *
+ * Limits the total size of the backlogs of all the peers. When a message
+ * does not fit, the backlog policy of the peer it is queued for applies,
+ * see evd_peer_set_backlog_limits().
+ **/
+void
+evd_peer_manager_set_max_backlog_size (EvdPeerManager *self, gsize max_size)
+{
+  g_return_if_fail (EVD_IS_PEER_MANAGER (self));
+
+  self->priv->max_backlog_size = max_size;
+}
+
+gsize
+evd_peer_manager_get_max_backlog_size (EvdPeerManager *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), 0);
+
+  return self->priv->max_backlog_size;
+}
+
+void
+evd_peer_manager_account_backlog (EvdPeerManager *self, gssize delta)
+{
+  g_return_if_fail (EVD_IS_PEER_MANAGER (self));
+
+  self->priv->backlog_size += delta;
+}
+
+/**
+ * evd_peer_manager_subscribe:
+ * @channel: the name of the channel
+ *
+ * Subscribes @peer to @channel, so that it receives the messages
+ * published on it with evd_peer_manager_publish(). The channel is created
+ * when its first peer subscribes, and removed when its last peer
+ * unsubscribes or is closed.
+ *
+ * Returns: %TRUE if @peer was subscribed, %FALSE if it already was, is
+ *          closed or does not belong to @self.
+ **/
+gboolean
+evd_peer_manager_subscribe (EvdPeerManager *self,
+                            EvdPeer        *peer,
+                            const gchar    *channel)
+{
+  EvdPeerManagerChannel *ch;
+  GHashTable *peer_channels;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), FALSE);
+  g_return_val_if_fail (EVD_IS_PEER (peer), FALSE);
+  g_return_val_if_fail (channel != NULL, FALSE);
+
+  /* only open peers of this manager can subscribe */
+  if (evd_peer_is_closed (peer) ||
+      evd_peer_manager_lookup_peer (self, evd_peer_get_id (peer)) != peer)
+    return FALSE;
+
+  ch = g_hash_table_lookup (self->priv->channels, channel);
+  if (ch == NULL)
+    {
+      ch = g_slice_new0 (EvdPeerManagerChannel);
+      ch->name = g_strdup (channel);
+      ch->peers = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+      g_hash_table_insert (self->priv->channels, ch->name, ch);
+    }
+  else if (g_hash_table_lookup (ch->peers, peer) != NULL)
+    {
+      return FALSE;
+    }
+
+  g_hash_table_insert (ch->peers, peer, peer);
+
+  /* keep track of the channels of each peer, for a quick cleanup */
+  peer_channels = g_hash_table_lookup (self->priv->subscriptions, peer);
+  if (peer_channels == NULL)
+    {
+      peer_channels = g_hash_table_new (g_direct_hash, g_direct_equal);
+      g_hash_table_insert (self->priv->subscriptions, peer, peer_channels);
+    }
+  g_hash_table_insert (peer_channels, ch, ch);
+
+  return TRUE;
+}
+
+/**
+ * evd_peer_manager_unsubscribe:
+ *
+ * Returns: %TRUE if @peer was unsubscribed, %FALSE if it was not subscribed
+ * to @channel.
+ **/
+gboolean
+evd_peer_manager_unsubscribe (EvdPeerManager *self,
+                              EvdPeer        *peer,
+                              const gchar    *channel)
+{
+  EvdPeerManagerChannel *ch;
+  GHashTable *peer_channels;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), FALSE);
+  g_return_val_if_fail (EVD_IS_PEER (peer), FALSE);
+  g_return_val_if_fail (channel != NULL, FALSE);
+
+  ch = g_hash_table_lookup (self->priv->channels, channel);
+  if (ch == NULL || g_hash_table_lookup (ch->peers, peer) == NULL)
+    return FALSE;
+
+  peer_channels = g_hash_table_lookup (self->priv->subscriptions, peer);
+  g_hash_table_remove (peer_channels, ch);
+  if (g_hash_table_size (peer_channels) == 0)
+    g_hash_table_remove (self->priv->subscriptions, peer);
+
+  channel_remove_peer (self, ch, peer);
+
+  return TRUE;
+}
+
+void
+evd_peer_manager_unsubscribe_all (EvdPeerManager *self, EvdPeer *peer)
+{
+  GHashTable *peer_channels;
+  GHashTableIter iter;
+  gpointer key;
+
+  g_return_if_fail (EVD_IS_PEER_MANAGER (self));
+  g_return_if_fail (EVD_IS_PEER (peer));
+
+  peer_channels = g_hash_table_lookup (self->priv->subscriptions, peer);
+  if (peer_channels == NULL)
+    return;
+
+  g_hash_table_steal (self->priv->subscriptions, peer);
+
+  g_hash_table_iter_init (&iter, peer_channels);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    channel_remove_peer (self, (EvdPeerManagerChannel *) key, peer);
+
+  g_hash_table_unref (peer_channels);
+}
+
+/**
+ * evd_peer_manager_get_channel_peers:
+ *
+ * Returns: (transfer container) (element-type Evd.Peer): The peers subscribed
+ * to @channel.
+ **/
+GList *
+evd_peer_manager_get_channel_peers (EvdPeerManager *self,
+                                    const gchar    *channel)
+{
+  EvdPeerManagerChannel *ch;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), NULL);
+  g_return_val_if_fail (channel != NULL, NULL);
+
+  ch = g_hash_table_lookup (self->priv->channels, channel);
+  if (ch == NULL)
+    return NULL;
+
+  return g_hash_table_get_keys (ch->peers);
+}
+
+/**
+ * evd_peer_manager_get_peer_channels:
+ *
+ * Returns: (transfer container) (element-type utf8): The names of the channels
+ * @peer is subscribed to. The strings are owned by @self.
+ **/
+GList *
+evd_peer_manager_get_peer_channels (EvdPeerManager *self,
+                                    EvdPeer        *peer)
+{
+  GHashTable *peer_channels;
+  GHashTableIter iter;
+  gpointer key;
+  GList *list = NULL;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), NULL);
+  g_return_val_if_fail (EVD_IS_PEER (peer), NULL);
+
+  peer_channels = g_hash_table_lookup (self->priv->subscriptions, peer);
+  if (peer_channels == NULL)
+    return NULL;
+
+  g_hash_table_iter_init (&iter, peer_channels);
+  while (g_hash_table_iter_next (&iter, &key, NULL))
+    list = g_list_prepend (list, ((EvdPeerManagerChannel *) key)->name);
+
+  return list;
+}
+
+/**
+ * evd_peer_manager_get_channel_stats:
+ * @subscribers: (out) (allow-none): number of peers subscribed to @channel
+ * @published: (out) (allow-none): number of messages published on @channel
+ * @delivered: (out) (allow-none): number of messages successfully sent or
+ * queued to its subscribers
+ *
+ * Returns: %TRUE if @channel exists, %FALSE otherwise.
+ **/
+gboolean
+evd_peer_manager_get_channel_stats (EvdPeerManager *self,
+                                    const gchar    *channel,
+                                    guint          *subscribers,
+                                    guint64        *published,
+                                    guint64        *delivered)
+{
+  EvdPeerManagerChannel *ch;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), FALSE);
+  g_return_val_if_fail (channel != NULL, FALSE);
+
+  ch = g_hash_table_lookup (self->priv->channels, channel);
+  if (ch == NULL)
+    return FALSE;
+
+  if (subscribers != NULL)
+    *subscribers = g_hash_table_size (ch->peers);
+  if (published != NULL)
+    *published = ch->published;
+  if (delivered != NULL)
+    *delivered = ch->delivered;
+
+  return TRUE;
+}
+
+/**
+ * evd_peer_manager_publish:
+ * @channel: the name of the channel
+ * @message: the message to publish
+ *
+ * Sends @message to all the peers subscribed to @channel, regardless of
+ * their transport. The message is encoded once per transport and its payload
+ * is shared by all the peers that have to queue it. Publishing on a channel
+ * with no subscribers does nothing.
+ *
+ * Returns: %TRUE on success, %FALSE if @message could not be delivered
+ * nor queued for some peer.
+ **/
+gboolean
+evd_peer_manager_publish (EvdPeerManager  *self,
+                          const gchar     *channel,
+                          EvdMessage      *message,
+                          GError         **error)
+{
+  EvdPeerManagerChannel *ch;
+  GList *peers;
+  gboolean result;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), FALSE);
+  g_return_val_if_fail (channel != NULL, FALSE);
+  g_return_val_if_fail (message != NULL, FALSE);
+
+  ch = g_hash_table_lookup (self->priv->channels, channel);
+  if (ch == NULL)
+    return TRUE;
+
+  ch->published++;
+
+  /* only peers whose transport took the message count as delivered */
+  peers = g_hash_table_get_keys (ch->peers);
+  result = broadcast_to_peers (peers, message, &ch->delivered, error);
+  g_list_free (peers);
+
+  return result;
+}
+
+gboolean
+evd_peer_manager_publish_text (EvdPeerManager  *self,
+                               const gchar     *channel,
+                               const gchar     *text,
+                               GError         **error)
+{
+  EvdMessage *message;
+  gboolean result;
+
+  g_return_val_if_fail (EVD_IS_PEER_MANAGER (self), FALSE);
+  g_return_val_if_fail (text != NULL, FALSE);
+
+  message = evd_message_new (text, strlen (text), EVD_MESSAGE_TYPE_TEXT);
+  result = evd_peer_manager_publish (self, channel, message, error);
+  evd_message_unref (message);
+
+  return result;
+}
@@ -84,6 +84,53 @@ void                evd_peer_manager_close_peer               (EvdPeerManager *s
                                                                EvdPeer        *peer,
                                                                gboolean        gracefully);
 
+gboolean            evd_peer_manager_broadcast                (EvdPeerManager  *self,
+                                                               GList           *peers,
+                                                               EvdMessage      *message,
+                                                               GError         **error);
+
+void                evd_peer_manager_set_id_prefix            (EvdPeerManager *self,
+                                                               const gchar    *prefix);
+const gchar        *evd_peer_manager_get_id_prefix            (EvdPeerManager *self);
+
+gsize               evd_peer_manager_get_backlog_size         (EvdPeerManager *self);
+void                evd_peer_manager_set_max_backlog_size     (EvdPeerManager *self,
+                                                               gsize           max_size);
+gsize               evd_peer_manager_get_max_backlog_size     (EvdPeerManager *self);
+
+#ifdef EVD_COMPILATION
+void                evd_peer_manager_account_backlog          (EvdPeerManager *self,
+                                                               gssize          delta);
+#endif
+
+gboolean            evd_peer_manager_subscribe                (EvdPeerManager *self,
+                                                               EvdPeer        *peer,
+                                                               const gchar    *channel);
+gboolean            evd_peer_manager_unsubscribe              (EvdPeerManager *self,
+                                                               EvdPeer        *peer,
+                                                               const gchar    *channel);
+void                evd_peer_manager_unsubscribe_all          (EvdPeerManager *self,
+                                                               EvdPeer        *peer);
+
+GList              *evd_peer_manager_get_channel_peers        (EvdPeerManager *self,
+                                                               const gchar    *channel);
+GList              *evd_peer_manager_get_peer_channels        (EvdPeerManager *self,
+                                                               EvdPeer        *peer);
+gboolean            evd_peer_manager_get_channel_stats        (EvdPeerManager *self,
+                                                               const gchar    *channel,
+                                                               guint          *subscribers,
+                                                               guint64        *published,
+                                                               guint64        *delivered);
+
+gboolean            evd_peer_manager_publish                  (EvdPeerManager  *self,
+                                                               const gchar     *channel,
+                                                               EvdMessage      *message,
+                                                               GError         **error);
+gboolean            evd_peer_manager_publish_text             (EvdPeerManager  *self,
+                                                               const gchar     *channel,
+                                                               const gchar     *text,
+                                                               GError         **error);
+
 G_END_DECLS
 
 #endif /* __EVD_PEER_MANAGER_H__ */
@@ -21,11 +21,16 @@
  */
 
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <uuid/uuid.h>
 
 #include "evd-peer.h"
 
 #include "evd-transport.h"
 #include "evd-utils.h"
+#include "evd-error.h"
 
 G_DEFINE_TYPE (EvdPeer, evd_peer, G_TYPE_OBJECT)
 
@@ -35,6 +40,17 @@ G_DEFINE_TYPE (EvdPeer, evd_peer, G_TYPE_OBJECT)
 
 #define DEFAULT_TIMEOUT_INTERVAL 15
 
+#define DEFAULT_MAX_BACKLOG_LENGTH 0 /* unlimited */
+#define DEFAULT_MAX_BACKLOG_SIZE   0 /* unlimited */
+#define DEFAULT_BACKLOG_POLICY     EVD_BACKLOG_POLICY_DROP_OLDEST
+
+#define DEFAULT_REPLAY_WINDOW 0 /* disabled */
+
+/* ids are 16 random bytes (128 bits, read from the system CSPRNG) in
+   unpadded base64url, optionally preceded by the id prefix of the peer
+   manager and a '-' */
+#define ID_RANDOM_BYTES 16
+
 /* private data */
 struct _EvdPeerPrivate
 {
@@ -43,19 +59,37 @@ struct _EvdPeerPrivate
   gboolean closed;
 
   GQueue *backlog;
-
-  GTimer *idle_timer;
+  gsize backlog_size;
+  guint max_backlog_length;
+  gsize max_backlog_size;
+  EvdBacklogPolicy backlog_policy;
+
+  /* sequence number of the last message sent to the peer, and the most
+     recent of those messages, kept until the peer acknowledges them */
+  guint64 out_seq;
+  GQueue *replay;
+  guint replay_window;
+
+  /* sequence number of the message at the head of the backlog, and whether
+     the backlog holds consecutive messages from it on */
+  guint64 backlog_first_seq;
+  gboolean backlog_in_order;
+
+  gint64 last_touch; /* monotonic time, in microseconds */
   guint timeout_interval;
 
   EvdTransport *transport;
 };
 
-typedef struct
+/* a message payload that can be shared by the backlogs of many peers */
+struct _EvdMessage
 {
+  gint ref_count;
+
   EvdMessageType type;
   gsize len;
   gchar *buf;
-} BacklogFrame;
+};
 
 /* properties */
 enum
@@ -68,6 +102,7 @@ enum
 static void     evd_peer_class_init         (EvdPeerClass *class);
 static void     evd_peer_init               (EvdPeer *self);
 
+static void     evd_peer_constructed        (GObject *obj);
 static void     evd_peer_finalize           (GObject *obj);
 static void     evd_peer_dispose            (GObject *obj);
 
@@ -82,12 +117,14 @@ static void     evd_peer_get_property       (GObject    *obj,
 
 static void     free_backlog_frame          (gpointer data,
                                              gpointer user_data);
+static void     backlog_clear               (EvdPeer *self);
 
 static void
 evd_peer_class_init (EvdPeerClass *class)
 {
   GObjectClass *obj_class = G_OBJECT_CLASS (class);
 
+  obj_class->constructed = evd_peer_constructed;
   obj_class->dispose = evd_peer_dispose;
   obj_class->finalize = evd_peer_finalize;
   obj_class->get_property = evd_peer_get_property;
@@ -95,8 +132,8 @@ evd_peer_class_init (EvdPeerClass *class)
 
   g_object_class_install_property (obj_class, PROP_ID,
                                    g_param_spec_string ("id",
-                                                        "Peer's UUID",
-                                                        "A string representing the UUID of the peer",
+                                                        "Peer's id",
+                                                        "A string uniquely identifying the peer",
                                                         NULL,
                                                         G_PARAM_READABLE |
                                                         G_PARAM_STATIC_STRINGS));
@@ -125,11 +162,111 @@ evd_peer_init (EvdPeer *self)
   self->priv->closed = FALSE;
 
   priv->backlog = g_queue_new ();
+  priv->backlog_size = 0;
+  priv->max_backlog_length = DEFAULT_MAX_BACKLOG_LENGTH;
+  priv->max_backlog_size = DEFAULT_MAX_BACKLOG_SIZE;
+  priv->backlog_policy = DEFAULT_BACKLOG_POLICY;
+
+  priv->out_seq = 0;
+  priv->replay = g_queue_new ();
+  priv->replay_window = DEFAULT_REPLAY_WINDOW;
 
-  priv->idle_timer = g_timer_new ();
+  priv->backlog_first_seq = 0;
+  priv->backlog_in_order = TRUE;
+
+  priv->last_touch = g_get_monotonic_time ();
   priv->timeout_interval = DEFAULT_TIMEOUT_INTERVAL;
+}
+
+/* fills @buf with bytes from the kernel CSPRNG. Returns FALSE if it could
+   not be read */
+static gboolean
+read_random_bytes (guint8 *buf, gsize len)
+{
+  gint fd;
+  gsize done = 0;
+
+  fd = open ("/dev/urandom", O_RDONLY);
+  if (fd < 0)
+    return FALSE;
+
+  while (done < len)
+    {
+      gssize size;
+
+      size = read (fd, buf + done, len - done);
+      if (size < 0 && errno == EINTR)
+        continue;
+      else if (size <= 0)
+        break;
+
+      done += size;
+    }
+
+  close (fd);
+
+  return done == len;
+}
+
+static gchar *
+id_new (const gchar *prefix)
+{
+  static const gchar alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+  guint8 bytes[ID_RANDOM_BYTES];
+  GString *id;
+  guint32 acc = 0;
+  gint bits = 0;
+  gint i;
+
+  /* ids double as session tokens, so all their bits must be random.
+     Version 4 uuids fix 6 of them, but are the fallback */
+  if (! read_random_bytes (bytes, ID_RANDOM_BYTES))
+    uuid_generate_random (bytes);
+
+  id = g_string_sized_new (64);
+  if (prefix != NULL && prefix[0] != '\0')
+    {
+      g_string_append (id, prefix);
+      g_string_append_c (id, '-');
+    }
+
+  for (i = 0; i < ID_RANDOM_BYTES; i++)
+    {
+      acc = (acc << 8) | bytes[i];
+      bits += 8;
+
+      while (bits >= 6)
+        {
+          bits -= 6;
+          g_string_append_c (id, alphabet[(acc >> bits) & 0x3F]);
+        }
+    }
+
+  if (bits > 0)
+    g_string_append_c (id, alphabet[(acc << (6 - bits)) & 0x3F]);
+
+  return g_string_free (id, FALSE);
+}
+
+static EvdPeerManager *get_peer_manager (EvdPeer *self);
+
+static void
+evd_peer_constructed (GObject *obj)
+{
+  EvdPeer *self = EVD_PEER (obj);
+  EvdPeerManager *peer_manager;
+  const gchar *prefix = NULL;
+
+  /* the transport is only known now */
+  peer_manager = get_peer_manager (self);
+  if (peer_manager != NULL)
+    prefix = evd_peer_manager_get_id_prefix (peer_manager);
+
+  self->priv->id = id_new (prefix);
 
-  self->priv->id = evd_uuid_new ();
+  if (G_OBJECT_CLASS (evd_peer_parent_class)->constructed != NULL)
+    G_OBJECT_CLASS (evd_peer_parent_class)->constructed (obj);
 }
 
 static void
@@ -139,6 +276,10 @@ evd_peer_dispose (GObject *obj)
 
   if (self->priv->transport != NULL)
     {
+      /* release the backlog while the peer manager it is accounted in
+         can still be reached */
+      backlog_clear (self);
+
       g_object_unref (self->priv->transport);
       self->priv->transport = NULL;
     }
@@ -151,13 +292,16 @@ evd_peer_finalize (GObject *obj)
 {
   EvdPeer *self = EVD_PEER (obj);
 
-  g_timer_destroy (self->priv->idle_timer);
-
   g_queue_foreach (self->priv->backlog,
                    free_backlog_frame,
                    NULL);
   g_queue_free (self->priv->backlog);
 
+  g_queue_foreach (self->priv->replay,
+                   free_backlog_frame,
+                   NULL);
+  g_queue_free (self->priv->replay);
+
   g_free (self->priv->id);
 
   G_OBJECT_CLASS (evd_peer_parent_class)->finalize (obj);
@@ -214,32 +358,233 @@ evd_peer_get_property (GObject    *obj,
 static void
 free_backlog_frame (gpointer data, gpointer user_data)
 {
-  BacklogFrame *frame = data;
+  evd_message_unref ((EvdMessage *) data);
+}
+
+static EvdPeerManager *
+get_peer_manager (EvdPeer *self)
+{
+  if (self->priv->transport == NULL)
+    return NULL;
+
+  return evd_transport_get_peer_manager (self->priv->transport);
+}
+
+static void
+backlog_account (EvdPeer *self, gssize delta)
+{
+  EvdPeerManager *peer_manager;
+
+  self->priv->backlog_size += delta;
 
-  if (frame->buf != NULL)
-    g_free (frame->buf);
+  peer_manager = get_peer_manager (self);
+  if (peer_manager != NULL)
+    evd_peer_manager_account_backlog (peer_manager, delta);
+}
 
-  g_slice_free (BacklogFrame, frame);
+static void
+backlog_clear (EvdPeer *self)
+{
+  EvdMessage *frame;
+
+  while ((frame = g_queue_pop_head (self->priv->backlog)) != NULL)
+    {
+      backlog_account (self, - (gssize) frame->len);
+      evd_message_unref (frame);
+    }
 }
 
-static BacklogFrame *
-create_new_backlog_frame (const gchar *message, gsize size, EvdMessageType type)
+static gboolean
+backlog_is_full (EvdPeer *self, gsize size)
 {
-  BacklogFrame *frame;
+  EvdPeerManager *peer_manager;
+  gsize max_global;
 
-  frame = g_slice_new0 (BacklogFrame);
-  frame->type = type;
-  frame->len = size;
+  if (self->priv->max_backlog_length > 0 &&
+      g_queue_get_length (self->priv->backlog) >= self->priv->max_backlog_length)
+    return TRUE;
 
-  frame->buf = g_new (gchar, size + 1);
-  memcpy (frame->buf, message, size);
-  frame->buf[size] = '\0';
+  if (self->priv->max_backlog_size > 0 &&
+      self->priv->backlog_size + size > self->priv->max_backlog_size)
+    return TRUE;
 
-  return frame;
+  peer_manager = get_peer_manager (self);
+  if (peer_manager != NULL)
+    {
+      max_global = evd_peer_manager_get_max_backlog_size (peer_manager);
+
+      if (max_global > 0 &&
+          evd_peer_manager_get_backlog_size (peer_manager) + size > max_global)
+        return TRUE;
+    }
+
+  return FALSE;
+}
+
+/* applies the overflow policy until a new message of @size fits in the
+   backlog. Returns FALSE if the message has to be discarded */
+static gboolean
+backlog_make_room (EvdPeer *self, gsize size, GError **error)
+{
+  while (backlog_is_full (self, size))
+    {
+      EvdMessage *frame;
+
+      if (self->priv->backlog_policy == EVD_BACKLOG_POLICY_DROP_OLDEST &&
+          (frame = g_queue_pop_head (self->priv->backlog)) != NULL)
+        {
+          self->priv->backlog_first_seq++;
+          backlog_account (self, - (gssize) frame->len);
+          evd_message_unref (frame);
+
+          continue;
+        }
+
+      g_set_error (error,
+                   EVD_ERRNO_ERROR,
+                   ENOBUFS,
+                   "Peer's backlog is full");
+
+      if (self->priv->backlog_policy == EVD_BACKLOG_POLICY_CLOSE_PEER)
+        evd_peer_close (self, FALSE);
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+backlog_push (EvdPeer *self, EvdMessage *frame, GError **error)
+{
+  guint length;
+
+  if (! backlog_make_room (self, frame->len, error))
+    return FALSE;
+
+  /* messages are numbered right before being queued, so the new one is
+     the last message sent */
+  length = g_queue_get_length (self->priv->backlog);
+  if (length == 0)
+    {
+      self->priv->backlog_first_seq = self->priv->out_seq;
+      self->priv->backlog_in_order = TRUE;
+    }
+  else if (self->priv->backlog_first_seq + length != self->priv->out_seq)
+    {
+      self->priv->backlog_in_order = FALSE;
+    }
+
+  g_queue_push_tail (self->priv->backlog, evd_message_ref (frame));
+  backlog_account (self, frame->len);
+
+  return TRUE;
+}
+
+static void
+replay_trim (EvdPeer *self, guint max_length)
+{
+  while (g_queue_get_length (self->priv->replay) > max_length)
+    evd_message_unref (g_queue_pop_head (self->priv->replay));
 }
 
 /* public methods */
 
+GType
+evd_message_get_type (void)
+{
+  static GType type = 0;
+
+  if (G_UNLIKELY (type == 0))
+    type = g_boxed_type_register_static ("EvdMessage",
+                                         (GBoxedCopyFunc) evd_message_ref,
+                                         (GBoxedFreeFunc) evd_message_unref);
+
+  return type;
+}
+
+/**
+ * evd_message_new:
+ * @buffer: (array length=size) (element-type guint8):
+ *
+ * Creates a reference-counted copy of @buffer, so that the same message can
+ * be queued or sent to many peers without copying it again for each of them.
+ *
+ * Returns: (transfer full): A new #EvdMessage. Free with evd_message_unref().
+ **/
+EvdMessage *
+evd_message_new (const gchar *buffer, gsize size, EvdMessageType type)
+{
+  EvdMessage *self;
+
+  g_return_val_if_fail (buffer != NULL || size == 0, NULL);
+
+  self = g_slice_new (EvdMessage);
+  self->ref_count = 1;
+  self->type = type;
+  self->len = size;
+
+  self->buf = g_new (gchar, size + 1);
+  if (size > 0)
+    memcpy (self->buf, buffer, size);
+  self->buf[size] = '\0';
+
+  return self;
+}
+
+/**
+ * evd_message_ref:
+ *
+ * Returns: (transfer full):
+ **/
+EvdMessage *
+evd_message_ref (EvdMessage *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+evd_message_unref (EvdMessage *self)
+{
+  g_return_if_fail (self != NULL);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_free (self->buf);
+      g_slice_free (EvdMessage, self);
+    }
+}
+
+/**
+ * evd_message_get_data:
+ * @size: (out) (allow-none):
+ *
+ * Returns: (transfer none): The payload of the message, which is always
+ * nul-terminated.
+ **/
+const gchar *
+evd_message_get_data (EvdMessage *self, gsize *size)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  if (size != NULL)
+    *size = self->len;
+
+  return self->buf;
+}
+
+EvdMessageType
+evd_message_get_message_type (EvdMessage *self)
+{
+  g_return_val_if_fail (self != NULL, EVD_MESSAGE_TYPE_BINARY);
+
+  return self->type;
+}
+
 const gchar *
 evd_peer_get_id (EvdPeer *self)
 {
@@ -248,6 +593,72 @@ evd_peer_get_id (EvdPeer *self)
   return self->priv->id;
 }
 
+#define HASH_PRIME_1 G_GUINT64_CONSTANT (0x9E3779B185EBCA87)
+#define HASH_PRIME_2 G_GUINT64_CONSTANT (0xC2B2AE3D27D4EB4F)
+
+static inline guint64
+hash_round (guint64 h, guint64 word)
+{
+  h ^= word * HASH_PRIME_2;
+  h = (h << 31) | (h >> 33);
+
+  return h * HASH_PRIME_1;
+}
+
+/**
+ * evd_peer_id_hash:
+ * @id: (type utf8): a peer id
+ *
+ * Hashes a peer id eight bytes at a time, instead of one as g_str_hash()
+ * does. The hash is seeded randomly once per process, so that clients
+ * cannot choose ids that collide. Use it with g_str_equal() to key hash
+ * tables with peer ids.
+ *
+ * Returns: The hash of @id.
+ **/
+guint
+evd_peer_id_hash (gconstpointer id)
+{
+  static gsize seed_init = 0;
+  static guint64 seed;
+  const gchar *p = id;
+  gsize len;
+  guint64 h;
+  guint64 word;
+
+  if (g_once_init_enter (&seed_init))
+    {
+      seed = ((guint64) g_random_int () << 32) | g_random_int ();
+      g_once_init_leave (&seed_init, 1);
+    }
+
+  len = strlen (p);
+  h = seed ^ (len * HASH_PRIME_1);
+
+  while (len >= 8)
+    {
+      memcpy (&word, p, 8);
+      h = hash_round (h, word);
+
+      p += 8;
+      len -= 8;
+    }
+
+  if (len > 0)
+    {
+      word = 0;
+      memcpy (&word, p, len);
+      h = hash_round (h, word);
+    }
+
+  /* final avalanche, from MurmurHash3 */
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xFF51AFD7ED558CCD);
+  h ^= h >> 33;
+
+  return (guint) h;
+}
+
 /**
  * evd_peer_get_transport:
  *
@@ -307,7 +718,7 @@ evd_peer_touch (EvdPeer *self)
 {
   g_return_if_fail (EVD_IS_PEER (self));
 
-  g_timer_start (self->priv->idle_timer);
+  self->priv->last_touch = g_get_monotonic_time ();
 }
 
 gboolean
@@ -317,12 +728,30 @@ evd_peer_is_alive (EvdPeer *self)
 
   return
     ! self->priv->closed &&
-    (g_timer_elapsed (self->priv->idle_timer, NULL) <=
-     self->priv->timeout_interval ||
+    (g_get_monotonic_time () <= evd_peer_get_deadline (self) ||
      evd_transport_peer_is_connected (self->priv->transport,
                                       self));
 }
 
+/**
+ * evd_peer_get_deadline:
+ *
+ * Returns the time at which the peer will be considered idle, unless it is
+ * touched again with evd_peer_touch() before. Connected peers are never
+ * idle, see evd_peer_is_alive().
+ *
+ * Returns: The deadline in monotonic time, as returned by
+ * g_get_monotonic_time().
+ **/
+gint64
+evd_peer_get_deadline (EvdPeer *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER (self), 0);
+
+  return self->priv->last_touch +
+    (gint64) self->priv->timeout_interval * G_USEC_PER_SEC;
+}
+
 gboolean
 evd_peer_is_closed (EvdPeer *self)
 {
@@ -389,18 +818,17 @@ evd_peer_push_message (EvdPeer         *self,
                        EvdMessageType   type,
                        GError         **error)
 {
-  BacklogFrame *frame;
+  EvdMessage *frame;
+  gboolean result;
 
   g_return_val_if_fail (EVD_IS_PEER (self), FALSE);
   g_return_val_if_fail (message != NULL, FALSE);
 
-  /* TODO: check backlog limits here */
-
-  frame = create_new_backlog_frame (message, size, type);
-
-  g_queue_push_tail (self->priv->backlog, frame);
+  frame = evd_message_new (message, size, type);
+  result = backlog_push (self, frame, error);
+  evd_message_unref (frame);
 
-  return TRUE;
+  return result;
 }
 
 /**
@@ -417,7 +845,7 @@ evd_peer_unshift_message (EvdPeer         *self,
                           EvdMessageType   type,
                           GError         **error)
 {
-  BacklogFrame *frame;
+  EvdMessage *frame;
 
   g_return_val_if_fail (EVD_IS_PEER (self), FALSE);
   g_return_val_if_fail (message != NULL, FALSE);
@@ -425,11 +853,13 @@ evd_peer_unshift_message (EvdPeer         *self,
   if (size == 0)
     return TRUE;
 
-  /* TODO: check backlog limits here */
-
-  frame = create_new_backlog_frame (message, size, type);
+  /* messages are put back at the head of the backlog when they could not
+     be sent after being taken from it, so limits are not enforced here */
+  frame = evd_message_new (message, size, type);
 
   g_queue_push_head (self->priv->backlog, frame);
+  backlog_account (self, size);
+  self->priv->backlog_first_seq--;
 
   return TRUE;
 }
@@ -446,7 +876,7 @@ evd_peer_unshift_message (EvdPeer         *self,
 gchar *
 evd_peer_pop_message (EvdPeer *self, gsize *size, EvdMessageType *type)
 {
-  BacklogFrame *frame;
+  EvdMessage *frame;
 
   g_return_val_if_fail (EVD_IS_PEER (self), NULL);
 
@@ -456,15 +886,26 @@ evd_peer_pop_message (EvdPeer *self, gsize *size, EvdMessageType *type)
     {
       gchar *str;
 
-      str = frame->buf;
-
       if (size != NULL)
         *size = frame->len;
 
       if (type != NULL)
         *type = frame->type;
 
-      g_slice_free (BacklogFrame, frame);
+      backlog_account (self, - (gssize) frame->len);
+      self->priv->backlog_first_seq++;
+
+      if (g_atomic_int_get (&frame->ref_count) == 1)
+        {
+          /* not shared, take its buffer */
+          str = frame->buf;
+          g_slice_free (EvdMessage, frame);
+        }
+      else
+        {
+          str = g_memdup (frame->buf, frame->len + 1);
+          evd_message_unref (frame);
+        }
 
       return str;
     }
@@ -473,3 +914,214 @@ evd_peer_pop_message (EvdPeer *self, gsize *size, EvdMessageType *type)
       return NULL;
     }
 }
+
+/**
+ * evd_peer_push_shared_message:
+ *
+ * Queues @message in the peer's backlog by taking a new reference to it,
+ * instead of copying its payload.
+ *
+ * Returns:
+ **/
+gboolean
+evd_peer_push_shared_message (EvdPeer     *self,
+                              EvdMessage  *message,
+                              GError     **error)
+{
+  g_return_val_if_fail (EVD_IS_PEER (self), FALSE);
+  g_return_val_if_fail (message != NULL, FALSE);
+
+  return backlog_push (self, message, error);
+}
+
+/**
+ * evd_peer_set_backlog_limits:
+ * @max_length: maximum number of messages in the backlog, or 0 for no limit
+ * @max_size: maximum number of bytes in the backlog, or 0 for no limit
+ * @policy: what to do when a new message does not fit in the backlog
+ *
+ * Limits the messages that are kept for the peer while it cannot receive
+ * them. Limits are also checked against the total backlog size allowed by
+ * the peer manager, see evd_peer_manager_set_max_backlog_size().
+ **/
+void
+evd_peer_set_backlog_limits (EvdPeer          *self,
+                             guint             max_length,
+                             gsize             max_size,
+                             EvdBacklogPolicy  policy)
+{
+  g_return_if_fail (EVD_IS_PEER (self));
+
+  self->priv->max_backlog_length = max_length;
+  self->priv->max_backlog_size = max_size;
+  self->priv->backlog_policy = policy;
+}
+
+/**
+ * evd_peer_get_backlog_limits:
+ * @max_length: (out) (allow-none):
+ * @max_size: (out) (allow-none):
+ * @policy: (out) (allow-none):
+ **/
+void
+evd_peer_get_backlog_limits (EvdPeer          *self,
+                             guint            *max_length,
+                             gsize            *max_size,
+                             EvdBacklogPolicy *policy)
+{
+  g_return_if_fail (EVD_IS_PEER (self));
+
+  if (max_length != NULL)
+    *max_length = self->priv->max_backlog_length;
+  if (max_size != NULL)
+    *max_size = self->priv->max_backlog_size;
+  if (policy != NULL)
+    *policy = self->priv->backlog_policy;
+}
+
+/**
+ * evd_peer_get_backlog_size:
+ *
+ * Returns: The number of bytes of the messages in the peer's backlog.
+ **/
+gsize
+evd_peer_get_backlog_size (EvdPeer *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER (self), 0);
+
+  return self->priv->backlog_size;
+}
+
+/**
+ * evd_peer_set_replay_window:
+ * @size: number of sent messages to keep, or 0 to disable replay
+ *
+ * Keeps the last @size messages sent to the peer, so that they can be sent
+ * again if the peer reconnects without having received them. See
+ * evd_peer_resume().
+ **/
+void
+evd_peer_set_replay_window (EvdPeer *self, guint size)
+{
+  g_return_if_fail (EVD_IS_PEER (self));
+
+  self->priv->replay_window = size;
+  replay_trim (self, size);
+}
+
+guint
+evd_peer_get_replay_window (EvdPeer *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER (self), 0);
+
+  return self->priv->replay_window;
+}
+
+/**
+ * evd_peer_get_sequence:
+ *
+ * Returns: The sequence number of the last message sent to the peer. Messages
+ * are numbered from 1, in the order they are sent.
+ **/
+guint64
+evd_peer_get_sequence (EvdPeer *self)
+{
+  g_return_val_if_fail (EVD_IS_PEER (self), 0);
+
+  return self->priv->out_seq;
+}
+
+/* assigns the next sequence number to @message, which the transport is about
+   to send or queue for the peer. Every message sent is numbered, and
+   @message may be NULL when the peer has no replay window to keep it in */
+void
+evd_peer_record_message (EvdPeer *self, EvdMessage *message)
+{
+  g_return_if_fail (EVD_IS_PEER (self));
+  g_return_if_fail (message != NULL || self->priv->replay_window == 0);
+
+  self->priv->out_seq++;
+
+  if (self->priv->replay_window == 0)
+    return;
+
+  g_queue_push_tail (self->priv->replay, evd_message_ref (message));
+  replay_trim (self, self->priv->replay_window);
+}
+
+/**
+ * evd_peer_resume:
+ * @last_seq: sequence number of the last message the peer received
+ *
+ * Acknowledges all messages up to @last_seq, and makes sure the ones sent
+ * after it will reach the peer again: messages that were sent while the peer
+ * was losing its connection are put back in the backlog, from the replay
+ * window.
+ *
+ * Returns: %TRUE on success, %FALSE if some unacknowledged message is
+ * neither in the backlog nor in the replay window, in which case the peer
+ * cannot recover its session without losing messages.
+ **/
+gboolean
+evd_peer_resume (EvdPeer *self, guint64 last_seq)
+{
+  guint64 first_seq;
+  guint64 unacked;
+  guint length;
+  GList *node;
+
+  g_return_val_if_fail (EVD_IS_PEER (self), FALSE);
+
+  if (last_seq > self->priv->out_seq)
+    return FALSE;
+
+  /* forget the messages the peer already has */
+  first_seq = self->priv->out_seq - g_queue_get_length (self->priv->replay) + 1;
+  while (first_seq <= last_seq)
+    {
+      evd_message_unref (g_queue_pop_head (self->priv->replay));
+      first_seq++;
+    }
+
+  /* nothing was lost if the backlog holds, in order, every message from
+     the first unacknowledged one to the last one sent */
+  unacked = self->priv->out_seq - last_seq;
+  length = g_queue_get_length (self->priv->backlog);
+  if (length == 0 ?
+      unacked == 0 :
+      self->priv->backlog_in_order &&
+      self->priv->backlog_first_seq <= last_seq + 1 &&
+      self->priv->backlog_first_seq + length - 1 == self->priv->out_seq)
+    {
+      /* messages put back in the backlog may have reached the peer
+         anyway */
+      while (self->priv->backlog_first_seq <= last_seq)
+        {
+          EvdMessage *frame;
+
+          frame = g_queue_pop_head (self->priv->backlog);
+          backlog_account (self, - (gssize) frame->len);
+          evd_message_unref (frame);
+          self->priv->backlog_first_seq++;
+        }
+
+      return TRUE;
+    }
+
+  if (g_queue_get_length (self->priv->replay) < unacked)
+    return FALSE;
+
+  backlog_clear (self);
+  for (node = self->priv->replay->head; node != NULL; node = node->next)
+    {
+      EvdMessage *frame = node->data;
+
+      g_queue_push_tail (self->priv->backlog, evd_message_ref (frame));
+      backlog_account (self, frame->len);
+    }
+
+  self->priv->backlog_first_seq = last_seq + 1;
+  self->priv->backlog_in_order = TRUE;
+
+  return TRUE;
+}
@@ -37,6 +37,15 @@ typedef enum
   EVD_MESSAGE_TYPE_TEXT   = 1
 } EvdMessageType;
 
+typedef enum
+{
+  EVD_BACKLOG_POLICY_DROP_OLDEST = 0,
+  EVD_BACKLOG_POLICY_DROP_NEWEST = 1,
+  EVD_BACKLOG_POLICY_CLOSE_PEER  = 2
+} EvdBacklogPolicy;
+
+typedef struct _EvdMessage EvdMessage;
+
 typedef struct _EvdPeer EvdPeer;
 typedef struct _EvdPeerClass EvdPeerClass;
 typedef struct _EvdPeerPrivate EvdPeerPrivate;
@@ -71,9 +80,22 @@ struct _EvdPeerClass
 #define EVD_PEER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), EVD_TYPE_PEER, EvdPeerClass))
 
 
+GType             evd_message_get_type             (void) G_GNUC_CONST;
+
+EvdMessage *      evd_message_new                  (const gchar    *buffer,
+                                                    gsize           size,
+                                                    EvdMessageType  type);
+EvdMessage *      evd_message_ref                  (EvdMessage *self);
+void              evd_message_unref                (EvdMessage *self);
+
+const gchar *     evd_message_get_data             (EvdMessage *self,
+                                                    gsize      *size);
+EvdMessageType    evd_message_get_message_type     (EvdMessage *self);
+
 GType             evd_peer_get_type                (void) G_GNUC_CONST;
 
 const gchar *     evd_peer_get_id                  (EvdPeer *self);
+guint             evd_peer_id_hash                 (gconstpointer id);
 
 gboolean          evd_peer_backlog_push_frame      (EvdPeer      *self,
                                                     const gchar  *frame,
@@ -86,9 +108,20 @@ gboolean          evd_peer_backlog_unshift_frame   (EvdPeer      *self,
 gchar *           evd_peer_backlog_pop_frame       (EvdPeer *self,
                                                     gsize   *size) G_GNUC_DEPRECATED_FOR('evd_peer_pop_message');
 guint             evd_peer_backlog_get_length      (EvdPeer *self);
+gsize             evd_peer_get_backlog_size        (EvdPeer *self);
+
+void              evd_peer_set_backlog_limits      (EvdPeer          *self,
+                                                    guint             max_length,
+                                                    gsize             max_size,
+                                                    EvdBacklogPolicy  policy);
+void              evd_peer_get_backlog_limits      (EvdPeer          *self,
+                                                    guint            *max_length,
+                                                    gsize            *max_size,
+                                                    EvdBacklogPolicy *policy);
 
 void              evd_peer_touch                   (EvdPeer *self);
 gboolean          evd_peer_is_alive                (EvdPeer *self);
+gint64            evd_peer_get_deadline            (EvdPeer *self);
 gboolean          evd_peer_is_closed               (EvdPeer *self);
 
 gboolean          evd_peer_send                    (EvdPeer      *self,
@@ -116,6 +149,22 @@ gboolean          evd_peer_unshift_message         (EvdPeer         *self,
                                                     EvdMessageType   type,
                                                     GError         **error);
 
+gboolean          evd_peer_push_shared_message     (EvdPeer     *self,
+                                                    EvdMessage  *message,
+                                                    GError     **error);
+
+void              evd_peer_set_replay_window       (EvdPeer *self,
+                                                    guint    size);
+guint             evd_peer_get_replay_window       (EvdPeer *self);
+guint64           evd_peer_get_sequence            (EvdPeer *self);
+gboolean          evd_peer_resume                  (EvdPeer *self,
+                                                    guint64  last_seq);
+
+#ifdef EVD_COMPILATION
+void              evd_peer_record_message          (EvdPeer    *self,
+                                                    EvdMessage *message);
+#endif
+
 G_END_DECLS
 
 #endif /* __EVD_PEER_H__ */
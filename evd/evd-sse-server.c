@@ -0,0 +1,704 @@
+/*
+ * evd-sse-server.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License at http://www.gnu.org/licenses/lgpl-3.0.txt
+ * for more details.
+ */
+
+#include <string.h>
+#include <libsoup/soup-headers.h>
+
+#include "evd-sse-server.h"
+#include "evd-transport.h"
+
+#include "evd-error.h"
+#include "evd-http-connection.h"
+#include "evd-peer-manager.h"
+#include "evd-longpolling-server.h"
+#include "evd-utils.h"
+
+#define EVD_SSE_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
+                                         EVD_TYPE_SSE_SERVER, \
+                                         EvdSseServerPrivate))
+
+#define PEER_DATA_KEY      "org.eventdance.lib.SseServer.PEER_DATA"
+#define CONN_DATA_KEY      "org.eventdance.lib.SseServer.CONN_DATA"
+#define KEEPALIVE_DATA_KEY "org.eventdance.lib.SseServer.KEEPALIVE"
+
+/* in milliseconds, below the idle timeout of common reverse proxies */
+#define DEFAULT_KEEPALIVE_INTERVAL 15000
+
+/* the first character of each event's data tells how the message is
+   encoded: as is, or in base64 when it cannot be carried by an event
+   stream, which is UTF-8 text where CR is a line break */
+#define EVENT_KIND_TEXT        't'
+#define EVENT_KIND_TEXT_BASE64 'u'
+#define EVENT_KIND_BINARY      'b'
+
+/* private data */
+struct _EvdSseServerPrivate
+{
+  const gchar *current_peer_id;
+
+  guint keepalive_interval;
+};
+
+typedef struct
+{
+  EvdSseServer *self;
+  EvdPeer *peer;
+} EvdSseServerSender;
+
+typedef struct
+{
+  gchar *buf;
+  gsize size;
+  EvdMessageType type;
+} EvdSseServerFrame;
+
+static void     evd_sse_server_class_init           (EvdSseServerClass *class);
+static void     evd_sse_server_init                 (EvdSseServer *self);
+
+static void     evd_sse_server_transport_iface_init (EvdTransportInterface *iface);
+
+static void     evd_sse_server_request_handler      (EvdWebService     *web_service,
+                                                     EvdHttpConnection *conn,
+                                                     EvdHttpRequest    *request);
+
+static gboolean evd_sse_server_remove               (EvdIoStreamGroup *io_stream_group,
+                                                     GIOStream        *io_stream);
+
+static gboolean evd_sse_server_send                 (EvdTransport    *transport,
+                                                     EvdPeer         *peer,
+                                                     const gchar     *buffer,
+                                                     gsize            size,
+                                                     EvdMessageType   type,
+                                                     GError         **error);
+static gboolean evd_sse_server_broadcast            (EvdTransport  *transport,
+                                                     GList         *peers,
+                                                     EvdMessage    *message,
+                                                     GError       **error);
+
+static gboolean evd_sse_server_peer_is_connected    (EvdTransport *transport,
+                                                     EvdPeer      *peer);
+
+static void     evd_sse_server_peer_closed          (EvdTransport *transport,
+                                                     EvdPeer      *peer,
+                                                     gboolean      gracefully);
+
+G_DEFINE_TYPE_WITH_CODE (EvdSseServer, evd_sse_server, EVD_TYPE_WEB_SERVICE,
+                         G_IMPLEMENT_INTERFACE (EVD_TYPE_TRANSPORT,
+                                                evd_sse_server_transport_iface_init));
+
+static void
+evd_sse_server_class_init (EvdSseServerClass *class)
+{
+  GObjectClass *obj_class = G_OBJECT_CLASS (class);
+  EvdIoStreamGroupClass *io_stream_group_class =
+    EVD_IO_STREAM_GROUP_CLASS (class);
+  EvdWebServiceClass *web_service_class = EVD_WEB_SERVICE_CLASS (class);
+
+  io_stream_group_class->remove = evd_sse_server_remove;
+
+  web_service_class->request_handler = evd_sse_server_request_handler;
+
+  g_type_class_add_private (obj_class, sizeof (EvdSseServerPrivate));
+}
+
+static void
+evd_sse_server_transport_iface_init (EvdTransportInterface *iface)
+{
+  iface->send = evd_sse_server_send;
+  iface->broadcast = evd_sse_server_broadcast;
+  iface->peer_is_connected = evd_sse_server_peer_is_connected;
+  iface->peer_closed = evd_sse_server_peer_closed;
+}
+
+static void
+evd_sse_server_init (EvdSseServer *self)
+{
+  EvdSseServerPrivate *priv;
+
+  priv = EVD_SSE_SERVER_GET_PRIVATE (self);
+  self->priv = priv;
+
+  priv->current_peer_id = NULL;
+  priv->keepalive_interval = DEFAULT_KEEPALIVE_INTERVAL;
+
+  evd_service_set_io_stream_type (EVD_SERVICE (self), EVD_TYPE_HTTP_CONNECTION);
+}
+
+static gboolean
+is_plain_text (const gchar *buf, gsize size)
+{
+  if (memchr (buf, '\r', size) != NULL || memchr (buf, '\0', size) != NULL)
+    return FALSE;
+
+  return g_utf8_validate (buf, size, NULL);
+}
+
+/* appends @buf as an event, one 'data' field per line */
+static void
+append_event (GString        *stream,
+              const gchar    *buf,
+              gsize           size,
+              EvdMessageType  type)
+{
+  if (type == EVD_MESSAGE_TYPE_TEXT && is_plain_text (buf, size))
+    {
+      const gchar *line = buf;
+      const gchar *end = buf + size;
+      const gchar *nl;
+
+      g_string_append (stream, "data: ");
+      g_string_append_c (stream, EVENT_KIND_TEXT);
+
+      while ( (nl = memchr (line, '\n', end - line)) != NULL)
+        {
+          g_string_append_len (stream, line, nl - line);
+          g_string_append (stream, "\ndata: ");
+          line = nl + 1;
+        }
+
+      g_string_append_len (stream, line, end - line);
+    }
+  else
+    {
+      gchar *b64;
+
+      b64 = g_base64_encode ((const guchar *) buf, size);
+
+      g_string_append (stream, "data: ");
+      g_string_append_c (stream,
+                         type == EVD_MESSAGE_TYPE_TEXT ?
+                         EVENT_KIND_TEXT_BASE64 : EVENT_KIND_BINARY);
+      g_string_append (stream, b64);
+
+      g_free (b64);
+    }
+
+  g_string_append (stream, "\n\n");
+}
+
+static void
+remove_keepalive (gpointer user_data)
+{
+  g_source_remove (GPOINTER_TO_UINT (user_data));
+}
+
+/* writes a comment line, which clients ignore, so that proxies and
+   browsers do not drop an idle stream */
+static gboolean
+evd_sse_server_send_keepalive (gpointer user_data)
+{
+  EvdHttpConnection *conn = EVD_HTTP_CONNECTION (user_data);
+
+  if (g_io_stream_is_closed (G_IO_STREAM (conn)) ||
+      ! evd_http_connection_write_content (conn, ":\n\n", 3, TRUE, NULL))
+    {
+      g_object_steal_data (G_OBJECT (conn), KEEPALIVE_DATA_KEY);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* ends the event stream of @conn, and returns it to the web service */
+static void
+evd_sse_server_finish_stream (EvdSseServer      *self,
+                              EvdHttpConnection *conn)
+{
+  g_object_set_data (G_OBJECT (conn), KEEPALIVE_DATA_KEY, NULL);
+  g_object_set_data (G_OBJECT (conn), CONN_DATA_KEY, NULL);
+
+  if (! g_io_stream_is_closed (G_IO_STREAM (conn)))
+    evd_http_connection_write_content (conn, NULL, 0, FALSE, NULL);
+
+  EVD_WEB_SERVICE_GET_CLASS (self)->
+    flush_and_return_connection (EVD_WEB_SERVICE (self), conn);
+}
+
+static void
+evd_sse_server_open_stream (EvdSseServer      *self,
+                            EvdPeer           *peer,
+                            EvdHttpConnection *conn)
+{
+  SoupMessageHeaders *headers;
+  EvdHttpRequest *request;
+  EvdHttpConnection *old_conn;
+  GConverter *encoder;
+  GString *events;
+  GQueue frames = G_QUEUE_INIT;
+  EvdSseServerFrame *frame;
+  gboolean result = TRUE;
+  GError *error = NULL;
+
+  headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
+
+  soup_message_headers_replace (headers, "Content-type", "text/event-stream");
+  soup_message_headers_replace (headers, "Cache-Control", "no-cache");
+  soup_message_headers_replace (headers, "Transfer-Encoding", "chunked");
+
+  /* ask reverse proxies not to buffer the stream */
+  soup_message_headers_replace (headers, "X-Accel-Buffering", "no");
+
+  request = evd_http_connection_get_current_request (conn);
+  if (request != NULL)
+    {
+      const gchar *origin;
+
+      origin = evd_http_request_get_origin (request);
+
+      if (origin != NULL &&
+          evd_web_service_origin_allowed (EVD_WEB_SERVICE (self), origin))
+        {
+          soup_message_headers_replace (headers,
+                                        "Access-Control-Allow-Origin",
+                                        origin);
+        }
+    }
+
+  /* the stream has no end, but every event is flushed out of the
+     compressor as soon as it is written */
+  encoder = evd_web_service_get_content_encoder (EVD_WEB_SERVICE (self),
+                                                 conn,
+                                                 headers,
+                                                 G_MAXSIZE);
+  if (encoder != NULL)
+    {
+      evd_http_connection_set_content_encoder (conn, encoder);
+      g_object_unref (encoder);
+    }
+
+  if (! evd_http_connection_write_response_headers (conn,
+                                                    SOUP_HTTP_1_1,
+                                                    SOUP_STATUS_OK,
+                                                    NULL,
+                                                    headers,
+                                                    &error))
+    {
+      g_debug ("Error opening event stream: %s", error->message);
+      g_error_free (error);
+
+      evd_http_connection_set_content_encoder (conn, NULL);
+      soup_message_headers_free (headers);
+
+      return;
+    }
+  soup_message_headers_free (headers);
+
+  /* a peer has one stream at a time, the newest */
+  old_conn = g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY);
+  if (old_conn != NULL)
+    evd_sse_server_finish_stream (self, old_conn);
+
+  g_object_set_data (G_OBJECT (conn), CONN_DATA_KEY, peer);
+
+  g_object_ref (conn);
+  g_object_set_data_full (G_OBJECT (peer),
+                          PEER_DATA_KEY,
+                          conn,
+                          g_object_unref);
+
+  /* the timer goes away with the stream, or with @conn itself */
+  if (self->priv->keepalive_interval > 0)
+    {
+      guint src_id;
+
+      src_id = evd_timeout_add (NULL,
+                                self->priv->keepalive_interval,
+                                G_PRIORITY_DEFAULT,
+                                evd_sse_server_send_keepalive,
+                                conn);
+      g_object_set_data_full (G_OBJECT (conn),
+                              KEEPALIVE_DATA_KEY,
+                              GUINT_TO_POINTER (src_id),
+                              remove_keepalive);
+    }
+
+  /* send peer's backlogged messages at once */
+  events = g_string_new ("");
+
+  frame = g_slice_new (EvdSseServerFrame);
+  while ( (frame->buf = evd_peer_pop_message (peer,
+                                              &frame->size,
+                                              &frame->type)) != NULL)
+    {
+      append_event (events, frame->buf, frame->size, frame->type);
+      g_queue_push_tail (&frames, frame);
+
+      frame = g_slice_new (EvdSseServerFrame);
+    }
+  g_slice_free (EvdSseServerFrame, frame);
+
+  if (events->len > 0 &&
+      ! evd_http_connection_write_content (conn,
+                                           events->str,
+                                           events->len,
+                                           TRUE,
+                                           &error))
+    {
+      g_debug ("Error writing to event stream: %s", error->message);
+      g_error_free (error);
+
+      result = FALSE;
+    }
+
+  /* return messages that could not be sent back to the peer's backlog,
+     keeping their original order */
+  while ( (frame = g_queue_pop_tail (&frames)) != NULL)
+    {
+      if (! result)
+        evd_peer_unshift_message (peer,
+                                  frame->buf,
+                                  frame->size,
+                                  frame->type,
+                                  NULL);
+
+      g_free (frame->buf);
+      g_slice_free (EvdSseServerFrame, frame);
+    }
+
+  g_string_free (events, TRUE);
+}
+
+static void
+evd_sse_server_on_content_read (GObject      *obj,
+                                GAsyncResult *res,
+                                gpointer      user_data)
+{
+  EvdSseServerSender *sender = user_data;
+  EvdHttpConnection *conn = EVD_HTTP_CONNECTION (obj);
+  EvdTransportInterface *iface;
+  gchar *content;
+  gssize size;
+  gsize i = 0;
+  GError *error = NULL;
+
+  iface = EVD_TRANSPORT_GET_INTERFACE (sender->self);
+
+  content = evd_http_connection_read_all_content_finish (conn,
+                                                         res,
+                                                         &size,
+                                                         &error);
+  if (content == NULL)
+    {
+      g_debug ("error reading content: %s", error->message);
+      g_error_free (error);
+
+      size = 0;
+    }
+
+  /* upstream messages use the binary framing of long-polling */
+  while (i < (gsize) size)
+    {
+      gssize hdr_len;
+      guint64 msg_len = 0;
+
+      hdr_len =
+        evd_longpolling_server_read_frame_header (EVD_LONGPOLLING_FRAMING_BINARY,
+                                                  content + i,
+                                                  size - i,
+                                                  &msg_len);
+      if (hdr_len <= 0 || size - i - hdr_len < msg_len)
+        {
+          g_debug ("invalid SSE upstream frame, ignoring rest of content");
+          break;
+        }
+
+      iface->receive (EVD_TRANSPORT (sender->self),
+                      sender->peer,
+                      content + i + hdr_len,
+                      (gsize) msg_len);
+
+      i += hdr_len + msg_len;
+    }
+
+  EVD_WEB_SERVICE_GET_CLASS (sender->self)->
+    respond (EVD_WEB_SERVICE (sender->self),
+             conn,
+             SOUP_STATUS_OK,
+             NULL,
+             NULL,
+             0,
+             NULL);
+
+  g_free (content);
+
+  g_object_unref (sender->peer);
+  g_object_unref (sender->self);
+  g_slice_free (EvdSseServerSender, sender);
+}
+
+static void
+evd_sse_server_request_handler (EvdWebService     *web_service,
+                                EvdHttpConnection *conn,
+                                EvdHttpRequest    *request)
+{
+  EvdSseServer *self = EVD_SSE_SERVER (web_service);
+  EvdLongpollingAction action;
+  EvdPeer *peer;
+  SoupURI *uri;
+
+  uri = evd_http_request_get_uri (request);
+
+  self->priv->current_peer_id = uri->query;
+
+  if (uri->query == NULL ||
+      (peer = evd_transport_lookup_peer (EVD_TRANSPORT (self),
+                                         uri->query)) == NULL)
+    {
+      EVD_WEB_SERVICE_GET_CLASS (self)->respond (EVD_WEB_SERVICE (self),
+                                                 conn,
+                                                 SOUP_STATUS_NOT_FOUND,
+                                                 NULL,
+                                                 NULL,
+                                                 0,
+                                                 NULL);
+      self->priv->current_peer_id = NULL;
+      return;
+    }
+
+  evd_peer_touch (peer);
+
+  action = evd_longpolling_server_parse_action (uri->path);
+
+  /* receive? */
+  if (action == EVD_LONGPOLLING_ACTION_RECEIVE)
+    {
+      evd_sse_server_open_stream (self, peer, conn);
+    }
+
+  /* send? */
+  else if (action == EVD_LONGPOLLING_ACTION_SEND)
+    {
+      EvdSseServerSender *sender;
+
+      sender = g_slice_new (EvdSseServerSender);
+      sender->self = g_object_ref (self);
+      sender->peer = g_object_ref (peer);
+
+      evd_http_connection_read_all_content (conn,
+                                            NULL,
+                                            evd_sse_server_on_content_read,
+                                            sender);
+    }
+
+  /* close? */
+  else if (action == EVD_LONGPOLLING_ACTION_CLOSE)
+    {
+      EVD_WEB_SERVICE_GET_CLASS (self)->respond (EVD_WEB_SERVICE (self),
+                                                 conn,
+                                                 SOUP_STATUS_OK,
+                                                 NULL,
+                                                 NULL,
+                                                 0,
+                                                 NULL);
+
+      evd_transport_close_peer (EVD_TRANSPORT (self),
+                                peer,
+                                TRUE,
+                                NULL);
+    }
+
+  else
+    {
+      EVD_WEB_SERVICE_GET_CLASS (self)->respond (EVD_WEB_SERVICE (self),
+                                                 conn,
+                                                 SOUP_STATUS_NOT_FOUND,
+                                                 NULL,
+                                                 NULL,
+                                                 0,
+                                                 NULL);
+    }
+
+  self->priv->current_peer_id = NULL;
+}
+
+static gboolean
+evd_sse_server_peer_is_connected (EvdTransport *transport,
+                                  EvdPeer      *peer)
+{
+  EvdSseServer *self = EVD_SSE_SERVER (transport);
+  EvdHttpConnection *conn;
+
+  conn = g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY);
+
+  return (conn != NULL && ! g_io_stream_is_closed (G_IO_STREAM (conn))) ||
+    g_strcmp0 (self->priv->current_peer_id, evd_peer_get_id (peer)) == 0;
+}
+
+static gboolean
+evd_sse_server_send (EvdTransport    *transport,
+                     EvdPeer         *peer,
+                     const gchar     *buffer,
+                     gsize            size,
+                     EvdMessageType   type,
+                     GError         **error)
+{
+  EvdHttpConnection *conn;
+  GString *event;
+  gboolean result;
+
+  conn = g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY);
+  if (conn == NULL || g_io_stream_is_closed (G_IO_STREAM (conn)))
+    return FALSE;
+
+  event = g_string_sized_new (size + 16);
+  append_event (event, buffer, size, type);
+
+  result = evd_http_connection_write_content (conn,
+                                              event->str,
+                                              event->len,
+                                              TRUE,
+                                              error);
+
+  g_string_free (event, TRUE);
+
+  return result;
+}
+
+static gboolean
+evd_sse_server_broadcast (EvdTransport  *transport,
+                          GList         *peers,
+                          EvdMessage    *message,
+                          GError       **error)
+{
+  const gchar *buffer;
+  gsize size;
+  EvdMessageType type;
+  GString *event = NULL;
+  GList *node;
+  gboolean result = TRUE;
+
+  buffer = evd_message_get_data (message, &size);
+  type = evd_message_get_message_type (message);
+
+  for (node = peers; node != NULL; node = node->next)
+    {
+      EvdPeer *peer = EVD_PEER (node->data);
+      EvdHttpConnection *conn;
+
+      conn = g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY);
+      if (conn != NULL && ! g_io_stream_is_closed (G_IO_STREAM (conn)))
+        {
+          /* the event is built once, the first time a peer can take it */
+          if (event == NULL)
+            {
+              event = g_string_sized_new (size + 16);
+              append_event (event, buffer, size, type);
+            }
+
+          if (evd_http_connection_write_content (conn,
+                                                 event->str,
+                                                 event->len,
+                                                 TRUE,
+                                                 NULL))
+            {
+              continue;
+            }
+        }
+
+      if (! evd_peer_push_shared_message (peer,
+                                          message,
+                                          result ? error : NULL))
+        {
+          result = FALSE;
+        }
+    }
+
+  if (event != NULL)
+    g_string_free (event, TRUE);
+
+  return result;
+}
+
+static gboolean
+evd_sse_server_remove (EvdIoStreamGroup *io_stream_group,
+                       GIOStream        *io_stream)
+{
+  EvdPeer *peer;
+
+  if (! EVD_IO_STREAM_GROUP_CLASS (evd_sse_server_parent_class)->
+      remove (io_stream_group, io_stream))
+    {
+      return FALSE;
+    }
+
+  peer = g_object_get_data (G_OBJECT (io_stream), CONN_DATA_KEY);
+  if (peer != NULL)
+    {
+      evd_peer_touch (peer);
+
+      g_object_set_data (G_OBJECT (io_stream), KEEPALIVE_DATA_KEY, NULL);
+      g_object_set_data (G_OBJECT (io_stream), CONN_DATA_KEY, NULL);
+
+      if (g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY) == io_stream)
+        g_object_set_data (G_OBJECT (peer), PEER_DATA_KEY, NULL);
+    }
+
+  return TRUE;
+}
+
+static void
+evd_sse_server_peer_closed (EvdTransport *transport,
+                            EvdPeer      *peer,
+                            gboolean      gracefully)
+{
+  EvdHttpConnection *conn;
+
+  conn = g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY);
+  if (conn == NULL)
+    return;
+
+  g_object_ref (conn);
+  g_object_set_data (G_OBJECT (peer), PEER_DATA_KEY, NULL);
+
+  evd_sse_server_finish_stream (EVD_SSE_SERVER (transport), conn);
+
+  g_object_unref (conn);
+}
+
+/* public methods */
+
+EvdSseServer *
+evd_sse_server_new (void)
+{
+  return g_object_new (EVD_TYPE_SSE_SERVER, NULL);
+}
+
+/**
+ * evd_sse_server_set_keepalive_interval:
+ * @interval: milliseconds between keepalive comments, or 0 to disable them
+ *
+ * Sets how often a comment is written to each open event stream, so that
+ * intermediaries do not close it while no messages are sent. Streams opened
+ * afterwards use the new interval. The default is 15 seconds.
+ **/
+void
+evd_sse_server_set_keepalive_interval (EvdSseServer *self, guint interval)
+{
+  g_return_if_fail (EVD_IS_SSE_SERVER (self));
+
+  self->priv->keepalive_interval = interval;
+}
+
+guint
+evd_sse_server_get_keepalive_interval (EvdSseServer *self)
+{
+  g_return_val_if_fail (EVD_IS_SSE_SERVER (self), 0);
+
+  return self->priv->keepalive_interval;
+}
@@ -0,0 +1,76 @@
+/*
+ * evd-sse-server.h
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License at http://www.gnu.org/licenses/lgpl-3.0.txt
+ * for more details.
+ */
+
+#ifndef __EVD_SSE_SERVER_H__
+#define __EVD_SSE_SERVER_H__
+
+#if !defined (__EVD_H_INSIDE__) && !defined (EVD_COMPILATION)
+#error "Only <evd.h> can be included directly."
+#endif
+
+#include "evd-web-service.h"
+#include "evd-peer.h"
+
+G_BEGIN_DECLS
+
+typedef struct _EvdSseServer EvdSseServer;
+typedef struct _EvdSseServerClass EvdSseServerClass;
+typedef struct _EvdSseServerPrivate EvdSseServerPrivate;
+
+struct _EvdSseServer
+{
+  EvdWebService parent;
+
+  EvdSseServerPrivate *priv;
+};
+
+struct _EvdSseServerClass
+{
+  EvdWebServiceClass parent_class;
+
+  /* padding for future expansion */
+  void (* _padding_0_) (void);
+  void (* _padding_1_) (void);
+  void (* _padding_2_) (void);
+  void (* _padding_3_) (void);
+  void (* _padding_4_) (void);
+  void (* _padding_5_) (void);
+  void (* _padding_6_) (void);
+  void (* _padding_7_) (void);
+};
+
+#define EVD_TYPE_SSE_SERVER           (evd_sse_server_get_type ())
+#define EVD_SSE_SERVER(obj)           (G_TYPE_CHECK_INSTANCE_CAST ((obj), EVD_TYPE_SSE_SERVER, EvdSseServer))
+#define EVD_SSE_SERVER_CLASS(obj)     (G_TYPE_CHECK_CLASS_CAST ((obj), EVD_TYPE_SSE_SERVER, EvdSseServerClass))
+#define EVD_IS_SSE_SERVER(obj)        (G_TYPE_CHECK_INSTANCE_TYPE ((obj), EVD_TYPE_SSE_SERVER))
+#define EVD_IS_SSE_SERVER_CLASS(obj)  (G_TYPE_CHECK_CLASS_TYPE ((obj), EVD_TYPE_SSE_SERVER))
+#define EVD_SSE_SERVER_GET_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS ((obj), EVD_TYPE_SSE_SERVER, EvdSseServerClass))
+
+
+GType          evd_sse_server_get_type               (void) G_GNUC_CONST;
+
+EvdSseServer * evd_sse_server_new                    (void);
+
+void           evd_sse_server_set_keepalive_interval (EvdSseServer *self,
+                                                      guint         interval);
+guint          evd_sse_server_get_keepalive_interval (EvdSseServer *self);
+
+G_END_DECLS
+
+#endif /* __EVD_SSE_SERVER_H__ */
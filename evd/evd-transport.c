@@ -66,6 +66,10 @@ static void     evd_transport_notify_peer_closed       (EvdTransport *self,
                                                         gboolean      gracefully);
 static guint    evd_transport_notify_validate_peer     (EvdTransport *self,
                                                         EvdPeer      *peer);
+static gboolean evd_transport_broadcast_internal       (EvdTransport  *self,
+                                                        GList         *peers,
+                                                        EvdMessage    *message,
+                                                        GError       **error);
 static gboolean evd_transport_validate_peer_signal_acc (GSignalInvocationHint *hint,
                                                         GValue                *return_accu,
                                                         const GValue          *handler_return,
@@ -85,6 +89,7 @@ evd_transport_base_init (gpointer g_class)
   iface->notify_peer_closed = evd_transport_notify_peer_closed;
   iface->notify_validate_peer = evd_transport_notify_validate_peer;
   iface->open = NULL;
+  iface->broadcast = evd_transport_broadcast_internal;
 
   if (! is_initialized)
     {
@@ -325,27 +330,78 @@ send_frame (EvdTransport    *self,
             EvdMessageType   type,
             GError         **error)
 {
+  EvdMessage *message = NULL;
+  gboolean result;
+
   g_return_val_if_fail (EVD_IS_TRANSPORT (self), FALSE);
   g_return_val_if_fail (EVD_IS_PEER (peer), FALSE);
 
-  if (! EVD_TRANSPORT_GET_INTERFACE (self)->send (self,
-                                                  peer,
-                                                  buffer,
-                                                  size,
-                                                  type,
-                                                  NULL)
-      && ! evd_peer_push_message (peer,
-                                  buffer,
-                                  size,
-                                  type,
-                                  error))
+  /* peers that can resume their session keep a reference to the message
+     in their replay window. The message is numbered either way, as it is
+     when broadcast */
+  if (evd_peer_get_replay_window (peer) > 0)
+    message = evd_message_new (buffer, size, type);
+
+  evd_peer_record_message (peer, message);
+
+  if (EVD_TRANSPORT_GET_INTERFACE (self)->send (self,
+                                                peer,
+                                                buffer,
+                                                size,
+                                                type,
+                                                NULL))
     {
-      return FALSE;
+      result = TRUE;
+    }
+  else if (message != NULL)
+    {
+      result = evd_peer_push_shared_message (peer, message, error);
     }
   else
     {
-      return TRUE;
+      result = evd_peer_push_message (peer, buffer, size, type, error);
+    }
+
+  if (message != NULL)
+    evd_message_unref (message);
+
+  return result;
+}
+
+static gboolean
+evd_transport_broadcast_internal (EvdTransport  *self,
+                                  GList         *peers,
+                                  EvdMessage    *message,
+                                  GError       **error)
+{
+  EvdTransportInterface *iface;
+  const gchar *buffer;
+  gsize size;
+  EvdMessageType type;
+  GList *node;
+  gboolean result = TRUE;
+
+  iface = EVD_TRANSPORT_GET_INTERFACE (self);
+
+  buffer = evd_message_get_data (message, &size);
+  type = evd_message_get_message_type (message);
+
+  /* peers that cannot take the message right away share it in their
+     backlogs, instead of each keeping its own copy */
+  for (node = peers; node != NULL; node = node->next)
+    {
+      EvdPeer *peer = EVD_PEER (node->data);
+
+      if (! iface->send (self, peer, buffer, size, type, NULL) &&
+          ! evd_peer_push_shared_message (peer,
+                                          message,
+                                          result ? error : NULL))
+        {
+          result = FALSE;
+        }
     }
+
+  return result;
 }
 
 /* public methods */
@@ -373,6 +429,73 @@ evd_transport_send_text (EvdTransport  *self,
   return send_frame (self, peer, text, size, EVD_MESSAGE_TYPE_TEXT, error);
 }
 
+/**
+ * evd_transport_broadcast:
+ * @peers: (element-type Evd.Peer): peers of this transport
+ * @message: the message to send
+ *
+ * Sends the same @message to all the @peers. Transports take advantage of
+ * knowing all the destinations beforehand to encode the message only once,
+ * and peers that cannot send it immediately keep a reference to @message
+ * in their backlogs rather than a copy of it.
+ *
+ * Returns: %TRUE on success, %FALSE if @message could not be delivered
+ * nor queued for some peer.
+ **/
+gboolean
+evd_transport_broadcast (EvdTransport  *self,
+                         GList         *peers,
+                         EvdMessage    *message,
+                         GError       **error)
+{
+  GList *node;
+
+  g_return_val_if_fail (EVD_IS_TRANSPORT (self), FALSE);
+  g_return_val_if_fail (message != NULL, FALSE);
+
+  if (peers == NULL)
+    return TRUE;
+
+  for (node = peers; node != NULL; node = node->next)
+    evd_peer_record_message (EVD_PEER (node->data), message);
+
+  return EVD_TRANSPORT_GET_INTERFACE (self)->broadcast (self,
+                                                        peers,
+                                                        message,
+                                                        error);
+}
+
+/**
+ * evd_transport_broadcast_text:
+ * @peers: (element-type Evd.Peer): peers of this transport
+ * @text: a nul-terminated UTF-8 string
+ *
+ * Sends @text as a text message to all the @peers. Like
+ * evd_transport_broadcast(), the message is encoded only once and shared
+ * by the backlogs of the peers that cannot send it right away.
+ *
+ * Returns: %TRUE on success, %FALSE if @text could not be delivered nor
+ * queued for some peer.
+ **/
+gboolean
+evd_transport_broadcast_text (EvdTransport  *self,
+                              GList         *peers,
+                              const gchar   *text,
+                              GError       **error)
+{
+  EvdMessage *message;
+  gboolean result;
+
+  g_return_val_if_fail (EVD_IS_TRANSPORT (self), FALSE);
+  g_return_val_if_fail (text != NULL, FALSE);
+
+  message = evd_message_new (text, strlen (text), EVD_MESSAGE_TYPE_TEXT);
+  result = evd_transport_broadcast (self, peers, message, error);
+  evd_message_unref (message);
+
+  return result;
+}
+
 /**
  * evd_transport_receive:
  * @size: (out):
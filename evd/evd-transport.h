@@ -99,8 +99,12 @@ struct _EvdTransportInterface
   /* members */
   EvdPeerManager *peer_manager;
 
+  gboolean  (* broadcast)            (EvdTransport  *self,
+                                      GList         *peers,
+                                      EvdMessage    *message,
+                                      GError       **error);
+
   /* padding for future expansion */
-  void (* _padding_0_) (void);
   void (* _padding_1_) (void);
   void (* _padding_2_) (void);
   void (* _padding_3_) (void);
@@ -126,6 +130,14 @@ gboolean        evd_transport_send_text                     (EvdTransport  *self
                                                              EvdPeer       *peer,
                                                              const gchar   *text,
                                                              GError       **error);
+gboolean        evd_transport_broadcast                     (EvdTransport  *self,
+                                                             GList         *peers,
+                                                             EvdMessage    *message,
+                                                             GError       **error);
+gboolean        evd_transport_broadcast_text                (EvdTransport  *self,
+                                                             GList         *peers,
+                                                             const gchar   *text,
+                                                             GError       **error);
 const gchar    *evd_transport_receive                       (EvdTransport *self,
                                                              EvdPeer      *peer,
                                                              gsize        *size);
@@ -21,10 +21,18 @@
  */
 
 #include <string.h>
+#include <errno.h>
 #include <libsoup/soup.h>
 
+#ifdef HAVE_GIO_UNIX
+#include <fcntl.h>
+#include <gio/gfiledescriptorbased.h>
+#endif
+
 #include "evd-web-dir.h"
 
+#include "evd-error.h"
+
 #define EVD_WEB_DIR_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
                                       EVD_TYPE_WEB_DIR, \
                                       EvdWebDirPrivate))
@@ -39,6 +47,18 @@ G_DEFINE_TYPE (EvdWebDir, evd_web_dir, EVD_TYPE_WEB_SERVICE)
 
 #define DEFAULT_DIRECTORY_INDEX "index.html"
 
+#define DEFAULT_CACHE_SIZE                (8 * 1024 * 1024) /* bytes */
+#define DEFAULT_CACHE_MAX_FILE_SIZE       (256 * 1024) /* bytes */
+#define DEFAULT_CACHE_REVALIDATE_INTERVAL 2 /* seconds */
+
+#define DEFAULT_SERVE_PRECOMPRESSED TRUE
+
+#define MAX_RANGES 32
+
+/* content-codings, in order of preference */
+#define ENCODING_BR   (1 << 0)
+#define ENCODING_GZIP (1 << 1)
+
 /* private data */
 struct _EvdWebDirPrivate
 {
@@ -46,22 +66,77 @@ struct _EvdWebDirPrivate
   gchar *alias;
   gboolean allow_put;
   gchar *dir_index;
+
+  GHashTable *cache;
+  GQueue *cache_lru;
+  gsize cache_total_size;
+  guint cache_size;
+  guint cache_max_file_size;
+  guint cache_revalidate_interval;
+
+  gboolean serve_precompressed;
 };
 
+typedef struct
+{
+  gint ref_count;
+
+  gchar *key;
+  gchar *filename;
+  gchar *content_type;
+  gchar *etag;
+  guint64 mtime;
+  const gchar *content_encoding;
+
+  gchar *content;
+  gsize size;
+
+  gint64 validated_at;
+  GList *lru_link;
+} EvdWebDirCacheEntry;
+
 typedef struct
 {
   EvdWebDir *web_dir;
   GFile *file;
   GFileInputStream *file_input_stream;
+  GFile *tmp_file;
+  gboolean tmp_file_created;
+  GFileOutputStream *file_output_stream;
+  gsize write_offset;
+  gboolean more_content;
   EvdHttpConnection *conn;
   EvdHttpRequest *request;
   void *buffer;
   gsize size;
   gchar *filename;
+  gchar *cache_key;
   gsize response_content_size;
   guint response_status_code;
   SoupMessageHeaders *response_headers;
   gboolean response_headers_sent;
+
+  gchar *content_type;
+  gchar *etag;
+  gchar *file_stat_etag;
+  guint64 file_size;
+  guint64 file_mtime;
+  guint32 file_mtime_usec;
+
+  guint accept_encodings;
+  guint encodings_to_try;
+  const gchar *content_encoding;
+  gboolean compress;
+
+  EvdWebDirCacheEntry *cache_entry;
+
+  guint status_code;
+  GArray *ranges;
+  guint range_index;
+  goffset range_pos;
+  goffset stream_pos;
+  gchar *boundary;
+  gboolean part_started;
 } EvdWebDirBinding;
 
 /* properties */
@@ -70,7 +145,11 @@ enum
   PROP_0,
   PROP_ROOT,
   PROP_ALIAS,
-  PROP_ALLOW_PUT
+  PROP_ALLOW_PUT,
+  PROP_CACHE_SIZE,
+  PROP_CACHE_MAX_FILE_SIZE,
+  PROP_CACHE_REVALIDATE_INTERVAL,
+  PROP_SERVE_PRECOMPRESSED
 };
 
 static void     evd_web_dir_class_init           (EvdWebDirClass *class);
@@ -101,6 +180,16 @@ static void     evd_web_dir_request_file         (EvdWebDir        *self,
                                                   const gchar      *filename,
                                                   EvdWebDirBinding *binding);
 
+static void     evd_web_dir_try_next_variant     (EvdWebDirBinding *binding);
+
+static void     evd_web_dir_put_read_block       (EvdWebDirBinding *binding);
+static void     evd_web_dir_put_on_block_written (GObject      *object,
+                                                  GAsyncResult *res,
+                                                  gpointer      user_data);
+
+static void     evd_web_dir_cache_entry_unref    (EvdWebDirCacheEntry *entry);
+static void     evd_web_dir_cache_evict          (EvdWebDir *self);
+
 static void
 evd_web_dir_class_init (EvdWebDirClass *class)
 {
@@ -138,6 +227,44 @@ evd_web_dir_class_init (EvdWebDirClass *class)
                                                          G_PARAM_READWRITE |
                                                          G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (obj_class, PROP_CACHE_SIZE,
+                                   g_param_spec_uint ("cache-size",
+                                                      "Cache size",
+                                                      "Maximum amount of memory used to cache file contents, in bytes. Zero disables the cache",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      DEFAULT_CACHE_SIZE,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (obj_class, PROP_CACHE_MAX_FILE_SIZE,
+                                   g_param_spec_uint ("cache-max-file-size",
+                                                      "Cache maximum file size",
+                                                      "Files bigger than this size in bytes are never cached",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      DEFAULT_CACHE_MAX_FILE_SIZE,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (obj_class, PROP_CACHE_REVALIDATE_INTERVAL,
+                                   g_param_spec_uint ("cache-revalidate-interval",
+                                                      "Cache revalidate interval",
+                                                      "Seconds a cached file is served without checking its modification time on disk",
+                                                      0,
+                                                      G_MAXUINT,
+                                                      DEFAULT_CACHE_REVALIDATE_INTERVAL,
+                                                      G_PARAM_READWRITE |
+                                                      G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (obj_class, PROP_SERVE_PRECOMPRESSED,
+                                   g_param_spec_boolean ("serve-precompressed",
+                                                         "Serve precompressed files",
+                                                         "Sets/gets whether to serve a '.br' or '.gz' sibling of a file, if present and accepted by the client",
+                                                         DEFAULT_SERVE_PRECOMPRESSED,
+                                                         G_PARAM_READWRITE |
+                                                         G_PARAM_STATIC_STRINGS));
+
   g_type_class_add_private (obj_class, sizeof (EvdWebDirPrivate));
 }
 
@@ -153,6 +280,18 @@ evd_web_dir_init (EvdWebDir *self)
 
   priv->dir_index = g_strdup (DEFAULT_DIRECTORY_INDEX);
 
+  priv->cache = g_hash_table_new_full (g_str_hash,
+                                       g_str_equal,
+                                       NULL,
+                                       (GDestroyNotify) evd_web_dir_cache_entry_unref);
+  priv->cache_lru = g_queue_new ();
+  priv->cache_total_size = 0;
+  priv->cache_size = DEFAULT_CACHE_SIZE;
+  priv->cache_max_file_size = DEFAULT_CACHE_MAX_FILE_SIZE;
+  priv->cache_revalidate_interval = DEFAULT_CACHE_REVALIDATE_INTERVAL;
+
+  priv->serve_precompressed = DEFAULT_SERVE_PRECOMPRESSED;
+
   evd_service_set_io_stream_type (EVD_SERVICE (self), EVD_TYPE_HTTP_CONNECTION);
 }
 
@@ -171,6 +310,9 @@ evd_web_dir_finalize (GObject *obj)
   g_free (self->priv->alias);
   g_free (self->priv->dir_index);
 
+  g_queue_free (self->priv->cache_lru);
+  g_hash_table_unref (self->priv->cache);
+
   G_OBJECT_CLASS (evd_web_dir_parent_class)->finalize (obj);
 }
 
@@ -198,6 +340,23 @@ evd_web_dir_set_property (GObject      *obj,
       self->priv->allow_put = g_value_get_boolean (value);
       break;
 
+    case PROP_CACHE_SIZE:
+      self->priv->cache_size = g_value_get_uint (value);
+      evd_web_dir_cache_evict (self);
+      break;
+
+    case PROP_CACHE_MAX_FILE_SIZE:
+      self->priv->cache_max_file_size = g_value_get_uint (value);
+      break;
+
+    case PROP_CACHE_REVALIDATE_INTERVAL:
+      self->priv->cache_revalidate_interval = g_value_get_uint (value);
+      break;
+
+    case PROP_SERVE_PRECOMPRESSED:
+      self->priv->serve_precompressed = g_value_get_boolean (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -228,12 +387,220 @@ evd_web_dir_get_property (GObject    *obj,
       g_value_set_boolean (value, self->priv->allow_put);
       break;
 
+    case PROP_CACHE_SIZE:
+      g_value_set_uint (value, self->priv->cache_size);
+      break;
+
+    case PROP_CACHE_MAX_FILE_SIZE:
+      g_value_set_uint (value, self->priv->cache_max_file_size);
+      break;
+
+    case PROP_CACHE_REVALIDATE_INTERVAL:
+      g_value_set_uint (value, self->priv->cache_revalidate_interval);
+      break;
+
+    case PROP_SERVE_PRECOMPRESSED:
+      g_value_set_boolean (value, self->priv->serve_precompressed);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
     }
 }
 
+static EvdWebDirCacheEntry *
+evd_web_dir_cache_entry_ref (EvdWebDirCacheEntry *entry)
+{
+  g_atomic_int_add (&entry->ref_count, 1);
+
+  return entry;
+}
+
+static void
+evd_web_dir_cache_entry_unref (EvdWebDirCacheEntry *entry)
+{
+  if (! g_atomic_int_dec_and_test (&entry->ref_count))
+    return;
+
+  g_free (entry->key);
+  g_free (entry->filename);
+  g_free (entry->content_type);
+  g_free (entry->etag);
+  g_free (entry->content);
+
+  g_slice_free (EvdWebDirCacheEntry, entry);
+}
+
+static void
+evd_web_dir_cache_remove (EvdWebDir *self, EvdWebDirCacheEntry *entry)
+{
+  g_queue_delete_link (self->priv->cache_lru, entry->lru_link);
+  entry->lru_link = NULL;
+
+  self->priv->cache_total_size -= entry->size;
+
+  /* this drops the reference held by the cache */
+  g_hash_table_remove (self->priv->cache, entry->key);
+}
+
+static void
+evd_web_dir_cache_evict (EvdWebDir *self)
+{
+  /* least recently used entries live at the tail of the queue */
+  while (self->priv->cache_total_size > self->priv->cache_size &&
+         g_queue_get_length (self->priv->cache_lru) > 0)
+    {
+      EvdWebDirCacheEntry *entry;
+
+      entry = g_queue_peek_tail (self->priv->cache_lru);
+      evd_web_dir_cache_remove (self, entry);
+    }
+}
+
+static EvdWebDirCacheEntry *
+evd_web_dir_cache_lookup (EvdWebDir *self, const gchar *key)
+{
+  EvdWebDirCacheEntry *entry;
+
+  entry = g_hash_table_lookup (self->priv->cache, key);
+  if (entry != NULL)
+    {
+      /* move to the head of the LRU queue */
+      g_queue_unlink (self->priv->cache_lru, entry->lru_link);
+      g_queue_push_head_link (self->priv->cache_lru, entry->lru_link);
+    }
+
+  return entry;
+}
+
+static gboolean
+evd_web_dir_cache_entry_is_fresh (EvdWebDir           *self,
+                                  EvdWebDirCacheEntry *entry)
+{
+  return g_get_monotonic_time () - entry->validated_at <
+    (gint64) self->priv->cache_revalidate_interval * G_USEC_PER_SEC;
+}
+
+static gboolean
+evd_web_dir_cache_accepts (EvdWebDir *self, guint64 size)
+{
+  return self->priv->cache_size > 0 &&
+    size <= self->priv->cache_max_file_size &&
+    size <= self->priv->cache_size;
+}
+
+static EvdWebDirCacheEntry *
+evd_web_dir_cache_entry_new (EvdWebDirBinding *binding,
+                             gchar            *content,
+                             gsize             size)
+{
+  EvdWebDirCacheEntry *entry;
+
+  entry = g_slice_new0 (EvdWebDirCacheEntry);
+  entry->ref_count = 1;
+
+  entry->key = g_strdup (binding->cache_key);
+  entry->filename = g_strdup (binding->filename);
+  entry->content_type = g_strdup (binding->content_type);
+  entry->etag = g_strdup (binding->etag);
+  entry->mtime = binding->file_mtime;
+  entry->content_encoding = binding->content_encoding;
+
+  entry->content = content;
+  entry->size = size;
+
+  entry->validated_at = g_get_monotonic_time ();
+
+  return entry;
+}
+
+static EvdWebDirCacheEntry *
+evd_web_dir_cache_insert (EvdWebDir        *self,
+                          EvdWebDirBinding *binding,
+                          gchar            *content,
+                          gsize             size)
+{
+  EvdWebDirCacheEntry *entry;
+
+  entry = g_hash_table_lookup (self->priv->cache, binding->cache_key);
+  if (entry != NULL)
+    evd_web_dir_cache_remove (self, entry);
+
+  entry = evd_web_dir_cache_entry_new (binding, content, size);
+
+  g_queue_push_head (self->priv->cache_lru, entry);
+  entry->lru_link = g_queue_peek_head_link (self->priv->cache_lru);
+
+  g_hash_table_insert (self->priv->cache, entry->key, entry);
+  self->priv->cache_total_size += size;
+
+  /* the returned reference belongs to the caller */
+  evd_web_dir_cache_entry_ref (entry);
+
+  evd_web_dir_cache_evict (self);
+
+  return entry;
+}
+
+static gchar *
+evd_web_dir_build_etag (guint64      size,
+                        guint64      mtime,
+                        guint32      mtime_usec,
+                        const gchar *encoding)
+{
+  /* each encoded variant of a file gets its own entity-tag */
+  return g_strdup_printf ("\"%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x-%x%s%s\"",
+                          size,
+                          mtime,
+                          mtime_usec,
+                          encoding != NULL ? "-" : "",
+                          encoding != NULL ? encoding : "");
+}
+
+static gboolean
+evd_web_dir_content_type_is_compressible (const gchar *content_type)
+{
+  return content_type != NULL &&
+    (g_content_type_is_a (content_type, "text/plain") ||
+     g_strcmp0 (content_type, "application/javascript") == 0 ||
+     g_strcmp0 (content_type, "application/json") == 0 ||
+     g_strcmp0 (content_type, "application/xml") == 0 ||
+     g_strcmp0 (content_type, "image/svg+xml") == 0);
+}
+
+static gchar *
+evd_web_dir_compress (const gchar  *content,
+                      gsize         size,
+                      gsize        *compressed_size,
+                      GError      **error)
+{
+  GConverter *compressor;
+  GOutputStream *mem_stream;
+  GOutputStream *stream;
+  gchar *result = NULL;
+
+  compressor =
+    G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_GZIP, -1));
+  mem_stream = g_memory_output_stream_new (NULL, 0, g_realloc, g_free);
+  stream = g_converter_output_stream_new (mem_stream, compressor);
+
+  if (g_output_stream_write_all (stream, content, size, NULL, NULL, error) &&
+      g_output_stream_close (stream, NULL, error))
+    {
+      GMemoryOutputStream *mem = G_MEMORY_OUTPUT_STREAM (mem_stream);
+
+      *compressed_size = g_memory_output_stream_get_data_size (mem);
+      result = g_memory_output_stream_steal_data (mem);
+    }
+
+  g_object_unref (stream);
+  g_object_unref (mem_stream);
+  g_object_unref (compressor);
+
+  return result;
+}
+
 static void
 evd_web_dir_finish_request (EvdWebDirBinding *binding)
 {
@@ -257,9 +624,17 @@ evd_web_dir_finish_request (EvdWebDirBinding *binding)
 
   g_object_unref (binding->request);
 
-  g_object_unref (binding->file);
+  if (binding->file != NULL)
+    g_object_unref (binding->file);
   if (binding->file_input_stream != NULL)
     g_object_unref (binding->file_input_stream);
+  if (binding->tmp_file != NULL)
+    g_object_unref (binding->tmp_file);
+  if (binding->file_output_stream != NULL)
+    g_object_unref (binding->file_output_stream);
+
+  if (binding->cache_entry != NULL)
+    evd_web_dir_cache_entry_unref (binding->cache_entry);
 
   if (binding->buffer != NULL)
     g_slice_free1 (BLOCK_SIZE, binding->buffer);
@@ -268,6 +643,14 @@ evd_web_dir_finish_request (EvdWebDirBinding *binding)
     soup_message_headers_free (binding->response_headers);
 
   g_free (binding->filename);
+  g_free (binding->cache_key);
+  g_free (binding->content_type);
+  g_free (binding->etag);
+  g_free (binding->file_stat_etag);
+
+  if (binding->ranges != NULL)
+    g_array_free (binding->ranges, TRUE);
+  g_free (binding->boundary);
 
   g_slice_free (EvdWebDirBinding, binding);
 
@@ -281,19 +664,41 @@ static void
 evd_web_dir_handle_content_error (EvdWebDirBinding *binding,
                                   GError           *error)
 {
-  switch (error->code)
+  if (g_error_matches (error, EVD_ERRNO_ERROR, EMSGSIZE))
     {
-    case G_IO_ERROR_NOT_FOUND:
-      binding->response_status_code = SOUP_STATUS_NOT_FOUND;
-      break;
+      binding->response_status_code = SOUP_STATUS_REQUEST_ENTITY_TOO_LARGE;
+    }
+  else
+    {
+      switch (error->code)
+        {
+        case G_IO_ERROR_NOT_FOUND:
+          binding->response_status_code = SOUP_STATUS_NOT_FOUND;
+          break;
 
-    case G_IO_ERROR_PERMISSION_DENIED:
-      binding->response_status_code = SOUP_STATUS_FORBIDDEN;
-      break;
+        case G_IO_ERROR_PERMISSION_DENIED:
+          binding->response_status_code = SOUP_STATUS_FORBIDDEN;
+          break;
 
-    default:
-      binding->response_status_code = SOUP_STATUS_IO_ERROR;
-      break;
+        case G_IO_ERROR_NO_SPACE:
+          binding->response_status_code = SOUP_STATUS_INSUFFICIENT_STORAGE;
+          break;
+
+        default:
+          binding->response_status_code = SOUP_STATUS_IO_ERROR;
+          break;
+        }
+    }
+
+  /* drop any cached copy of a file that can no longer be served */
+  if (binding->cache_key != NULL && binding->cache_entry == NULL)
+    {
+      EvdWebDirCacheEntry *entry;
+
+      entry = g_hash_table_lookup (binding->web_dir->priv->cache,
+                                   binding->cache_key);
+      if (entry != NULL)
+        evd_web_dir_cache_remove (binding->web_dir, entry);
     }
 
   if (! binding->response_headers_sent)
@@ -311,6 +716,102 @@ evd_web_dir_handle_content_error (EvdWebDirBinding *binding,
   evd_web_dir_finish_request (binding);
 }
 
+static gchar *
+evd_web_dir_build_part_header (EvdWebDirBinding *binding, guint index)
+{
+  SoupRange *range;
+
+  range = &g_array_index (binding->ranges, SoupRange, index);
+
+  return g_strdup_printf ("\r\n--%s\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Range: bytes %" G_GINT64_FORMAT "-%" G_GINT64_FORMAT "/%" G_GUINT64_FORMAT "\r\n"
+                          "\r\n",
+                          binding->boundary,
+                          binding->content_type != NULL ?
+                            binding->content_type : "application/octet-stream",
+                          range->start,
+                          range->end,
+                          binding->file_size);
+}
+
+static gchar *
+evd_web_dir_build_multipart_end (EvdWebDirBinding *binding)
+{
+  return g_strdup_printf ("\r\n--%s--\r\n", binding->boundary);
+}
+
+static gboolean
+evd_web_dir_write_string (EvdWebDirBinding  *binding,
+                          gchar             *str,
+                          GError           **error)
+{
+  gboolean result;
+  gsize len;
+
+  len = strlen (str);
+  result = evd_http_connection_write_content (binding->conn,
+                                              str,
+                                              len,
+                                              TRUE,
+                                              error);
+  if (result)
+    binding->response_content_size += len;
+
+  g_free (str);
+
+  return result;
+}
+
+/* Returns the size of the next block of content to send, writing
+   multipart delimiters as ranges are walked through. Zero means the
+   whole response content has been sent, and -1 an error occurred. */
+static gssize
+evd_web_dir_next_block_size (EvdWebDirBinding  *binding,
+                             GError           **error)
+{
+  while (binding->range_index < binding->ranges->len)
+    {
+      SoupRange *range;
+
+      range = &g_array_index (binding->ranges, SoupRange, binding->range_index);
+
+      if (binding->boundary != NULL && ! binding->part_started)
+        {
+          binding->part_started = TRUE;
+
+          if (! evd_web_dir_write_string (binding,
+                                          evd_web_dir_build_part_header (binding,
+                                                     binding->range_index),
+                                          error))
+            {
+              return -1;
+            }
+        }
+
+      if (binding->range_pos <= range->end)
+        return MIN (BLOCK_SIZE, range->end - binding->range_pos + 1);
+
+      /* range done, move to next one */
+      binding->range_index++;
+      binding->part_started = FALSE;
+
+      if (binding->range_index < binding->ranges->len)
+        binding->range_pos = g_array_index (binding->ranges,
+                                            SoupRange,
+                                            binding->range_index).start;
+      else if (binding->boundary != NULL &&
+               ! evd_web_dir_write_string (binding,
+                                     evd_web_dir_build_multipart_end (binding),
+                                     error))
+        {
+          return -1;
+        }
+    }
+
+  return 0;
+}
+
 static void
 evd_web_dir_file_on_block_read (GObject      *object,
                                 GAsyncResult *res,
@@ -336,6 +837,8 @@ evd_web_dir_file_on_block_read (GObject      *object,
       else
         {
           binding->response_content_size += size;
+          binding->range_pos += size;
+          binding->stream_pos += size;
 
           evd_web_dir_file_read_block (binding);
         }
@@ -353,24 +856,127 @@ evd_web_dir_file_on_block_read (GObject      *object,
     }
 }
 
+static void
+evd_web_dir_cache_write_blocks (EvdWebDirBinding *binding)
+{
+  EvdWebDirCacheEntry *entry = binding->cache_entry;
+  GError *error = NULL;
+  gssize size = 1; /* content pending */
+
+  while (evd_connection_get_max_writable (EVD_CONNECTION (binding->conn)) > 0)
+    {
+      size = evd_web_dir_next_block_size (binding, &error);
+      if (size <= 0)
+        break;
+
+      if (! evd_http_connection_write_content (binding->conn,
+                                               entry->content + binding->range_pos,
+                                               size,
+                                               TRUE,
+                                               &error))
+        {
+          size = -1;
+          break;
+        }
+
+      binding->range_pos += size;
+      binding->response_content_size += size;
+    }
+
+  if (size < 0)
+    {
+      evd_web_dir_handle_content_error (binding, error);
+      g_error_free (error);
+    }
+  else if (size == 0)
+    {
+      evd_web_dir_finish_request (binding);
+    }
+}
+
 static void
 evd_web_dir_file_read_block (EvdWebDirBinding *binding)
 {
   GInputStream *stream;
+  GError *error = NULL;
+  gssize size;
+
+  /* cached content is written straight from memory */
+  if (binding->cache_entry != NULL)
+    {
+      evd_web_dir_cache_write_blocks (binding);
+      return;
+    }
 
   stream = G_INPUT_STREAM (binding->file_input_stream);
 
-  if (! g_input_stream_has_pending (stream) &&
-      evd_connection_get_max_writable (EVD_CONNECTION (binding->conn)) > 0)
+  if (g_input_stream_has_pending (stream) ||
+      evd_connection_get_max_writable (EVD_CONNECTION (binding->conn)) <= 0)
     {
-      g_input_stream_read_async (stream,
-                                 binding->buffer,
-                                 BLOCK_SIZE,
-                                 evd_connection_get_priority (EVD_CONNECTION (binding->conn)),
-                                 NULL,
-                                 evd_web_dir_file_on_block_read,
-                                 binding);
+      return;
+    }
+
+  size = evd_web_dir_next_block_size (binding, &error);
+  if (size == 0)
+    {
+      evd_web_dir_finish_request (binding);
+      return;
+    }
+
+  /* seek to the beginning of a new range */
+  if (size > 0 &&
+      binding->stream_pos != binding->range_pos &&
+      g_seekable_seek (G_SEEKABLE (stream),
+                       binding->range_pos,
+                       G_SEEK_SET,
+                       NULL,
+                       &error))
+    {
+      binding->stream_pos = binding->range_pos;
+    }
+
+  if (error != NULL)
+    {
+      evd_web_dir_handle_content_error (binding, error);
+      g_error_free (error);
+      return;
+    }
+
+  g_input_stream_read_async (stream,
+                             binding->buffer,
+                             size,
+                             evd_connection_get_priority (EVD_CONNECTION (binding->conn)),
+                             NULL,
+                             evd_web_dir_file_on_block_read,
+                             binding);
+}
+
+static gboolean
+evd_web_dir_write_response_headers (EvdWebDirBinding *binding)
+{
+  GError *error = NULL;
+  SoupHTTPVersion ver;
+
+  ver = evd_http_message_get_version (EVD_HTTP_MESSAGE (binding->request));
+  if (! evd_http_connection_write_response_headers (binding->conn,
+                                                    ver,
+                                                    binding->status_code,
+                                                    NULL,
+                                                    binding->response_headers,
+                                                    &error))
+    {
+      g_print ("Error sending response headers: %s\n", error->message);
+      evd_web_dir_handle_content_error (binding, error);
+      g_error_free (error);
+
+      return FALSE;
     }
+
+  /* headers successfully sent */
+  binding->response_headers_sent = TRUE;
+  binding->response_status_code = binding->status_code;
+
+  return TRUE;
 }
 
 static void
@@ -381,7 +987,6 @@ evd_web_dir_file_on_open (GObject      *object,
   EvdWebDirBinding *binding = (EvdWebDirBinding *) user_data;
   GFile *file = G_FILE (object);
   GError *error = NULL;
-  SoupHTTPVersion ver;
 
   if ( (binding->file_input_stream = g_file_read_finish (file,
                                                          res,
@@ -398,28 +1003,128 @@ evd_web_dir_file_on_open (GObject      *object,
   /* file opened successfully */
 
   /* now it is ok to send response headers */
-  ver = evd_http_message_get_version (EVD_HTTP_MESSAGE (binding->request));
-  if (! evd_http_connection_write_response_headers (binding->conn,
-                                                    ver,
-                                                    SOUP_STATUS_OK,
-                                                    NULL,
-                                                    binding->response_headers,
-                                                    &error))
+  if (! evd_web_dir_write_response_headers (binding))
+    return;
+
+  /* start reading */
+  binding->buffer = g_slice_alloc (BLOCK_SIZE);
+  evd_web_dir_file_read_block (binding);
+}
+
+static void
+evd_web_dir_file_on_load (GObject      *object,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+  EvdWebDirBinding *binding = (EvdWebDirBinding *) user_data;
+  GError *error = NULL;
+  gchar *content;
+  gsize size;
+  gchar *stat_etag = NULL;
+
+  if (! g_file_load_contents_finish (G_FILE (object),
+                                     res,
+                                     &content,
+                                     &size,
+                                     &stat_etag,
+                                     &error))
     {
-      g_print ("Error sending response headers: %s\n", error->message);
       evd_web_dir_handle_content_error (binding, error);
       g_error_free (error);
 
       return;
     }
 
-  /* headers successfully sent */
-  binding->response_headers_sent = TRUE;
-  binding->response_status_code = SOUP_STATUS_OK;
+  if (binding->compress)
+    {
+      gchar *compressed;
 
-  /* start reading */
-  binding->buffer = g_slice_alloc (BLOCK_SIZE);
-  evd_web_dir_file_read_block (binding);
+      compressed = evd_web_dir_compress (content, size, &size, &error);
+      g_free (content);
+
+      if (compressed == NULL)
+        {
+          evd_web_dir_handle_content_error (binding, error);
+          g_error_free (error);
+
+          return;
+        }
+
+      content = compressed;
+    }
+
+  if (g_strcmp0 (stat_etag, binding->file_stat_etag) == 0)
+    {
+      binding->cache_entry = evd_web_dir_cache_insert (binding->web_dir,
+                                                       binding,
+                                                       content,
+                                                       size);
+    }
+  else
+    {
+      /* the file changed since it was queried, so the entity-tag and date
+         computed then do not describe this content. Serve it without them,
+         and don't cache it */
+      binding->cache_entry = evd_web_dir_cache_entry_new (binding,
+                                                          content,
+                                                          size);
+
+      soup_message_headers_remove (binding->response_headers, "ETag");
+      soup_message_headers_remove (binding->response_headers, "Last-Modified");
+    }
+  g_free (stat_etag);
+
+  if (size != binding->file_size)
+    {
+      /* the file changed since its size was queried, ranges computed
+         against the old size no longer apply */
+      if (binding->status_code == SOUP_STATUS_PARTIAL_CONTENT)
+        {
+          g_set_error (&error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_FAILED,
+                       "File changed while being read");
+          evd_web_dir_handle_content_error (binding, error);
+          g_error_free (error);
+
+          return;
+        }
+
+      binding->file_size = size;
+      g_array_index (binding->ranges, SoupRange, 0).end = (goffset) size - 1;
+      soup_message_headers_set_content_length (binding->response_headers,
+                                               size);
+    }
+
+  if (evd_web_dir_write_response_headers (binding))
+    evd_web_dir_file_read_block (binding);
+}
+
+static gboolean
+evd_web_dir_etag_matches (const gchar *header_value, const gchar *etag)
+{
+  gchar **tags;
+  gint i;
+  gboolean result = FALSE;
+
+  tags = g_strsplit (header_value, ",", 0);
+
+  for (i=0; tags[i] != NULL && ! result; i++)
+    {
+      gchar *tag;
+
+      tag = g_strstrip (tags[i]);
+
+      /* If-None-Match uses the weak comparison function [RFC 7232, 3.2] */
+      if (g_str_has_prefix (tag, "W/"))
+        tag += 2;
+
+      result = g_strcmp0 (tag, "*") == 0 || g_strcmp0 (tag, etag) == 0;
+    }
+
+  g_strfreev (tags);
+
+  return result;
 }
 
 static gboolean
@@ -428,122 +1133,301 @@ evd_web_dir_check_not_modified (EvdWebDir          *self,
                                 EvdHttpRequest     *request,
                                 SoupMessageHeaders *response_headers,
                                 SoupHTTPVersion     http_version,
-                                guint64             file_last_modified_time)
+                                guint64             file_last_modified_time,
+                                const gchar        *etag)
 {
   gboolean result = FALSE;
   SoupMessageHeaders *req_headers;
-  const gchar *modified_date_st;
-  SoupDate *modified_date;
+  const gchar *if_none_match;
 
   req_headers = evd_http_message_get_headers (EVD_HTTP_MESSAGE (request));
 
-  modified_date_st = soup_message_headers_get_one (req_headers,
-                                                   "If-Modified-Since");
-  if (modified_date_st == NULL)
-    return FALSE;
-
-  modified_date = soup_date_new_from_string (modified_date_st);
-  if (modified_date != NULL)
+  /* If-None-Match takes precedence over If-Modified-Since [RFC 7232, 6] */
+  if_none_match = soup_message_headers_get_one (req_headers, "If-None-Match");
+  if (if_none_match != NULL)
+    {
+      result = evd_web_dir_etag_matches (if_none_match, etag);
+    }
+  else
     {
-      guint64 modified_date_int;
+      const gchar *modified_date_st;
+      SoupDate *modified_date;
 
-      modified_date_int = soup_date_to_time_t (modified_date);
+      modified_date_st = soup_message_headers_get_one (req_headers,
+                                                       "If-Modified-Since");
+      if (modified_date_st == NULL)
+        return FALSE;
 
-      if (modified_date_int >= file_last_modified_time)
+      modified_date = soup_date_new_from_string (modified_date_st);
+      if (modified_date != NULL)
         {
-          GError *error = NULL;
-
-          if (! evd_web_service_respond (EVD_WEB_SERVICE (self),
-                                         conn,
-                                         SOUP_STATUS_NOT_MODIFIED,
-                                         response_headers,
-                                         NULL,
-                                         0,
-                                         &error))
-            {
-              g_debug ("Error sending NOT-MODIFIED response headers: %s",
-                       error->message);
-              g_error_free (error);
-            }
+          guint64 modified_date_int;
 
-          result = TRUE;
+          modified_date_int = soup_date_to_time_t (modified_date);
+          result = modified_date_int >= file_last_modified_time;
+
+          soup_date_free (modified_date);
         }
     }
 
-  soup_date_free (modified_date);
+  if (result)
+    {
+      GError *error = NULL;
+
+      if (! evd_web_service_respond (EVD_WEB_SERVICE (self),
+                                     conn,
+                                     SOUP_STATUS_NOT_MODIFIED,
+                                     response_headers,
+                                     NULL,
+                                     0,
+                                     &error))
+        {
+          g_debug ("Error sending NOT-MODIFIED response headers: %s",
+                   error->message);
+          g_error_free (error);
+        }
+    }
 
   return result;
 }
 
+static gboolean
+evd_web_dir_negotiates_encoding (EvdWebDir *self)
+{
+  return self->priv->serve_precompressed ||
+    evd_web_service_get_compression_threshold (EVD_WEB_SERVICE (self)) > 0;
+}
+
+/* Parses a 'bytes' Range header value against a representation of @total
+   bytes. Returns %NULL if the header is not valid and must be ignored, or
+   an array with the satisfiable ranges, which may be empty. */
+static gint
+evd_web_dir_compare_ranges (gconstpointer a, gconstpointer b)
+{
+  const SoupRange *range_a = a;
+  const SoupRange *range_b = b;
+
+  if (range_a->start < range_b->start)
+    return -1;
+  else
+    return range_a->start > range_b->start ? 1 : 0;
+}
+
+/* merges overlapping and adjacent ranges, so that no byte of the file is
+   sent more than once however the ranges were requested */
 static void
-evd_web_dir_file_on_info (GObject      *object,
-                          GAsyncResult *res,
-                          gpointer      user_data)
+evd_web_dir_coalesce_ranges (GArray *ranges)
 {
-  EvdWebDirBinding *binding = user_data;
-  EvdWebDir *self = binding->web_dir;
-  GFile *file = G_FILE (object);
-  EvdHttpConnection *conn = binding->conn;
-  GError *error = NULL;
-  GFileInfo *info;
-  SoupHTTPVersion ver;
-  EvdHttpRequest *request;
-  GFileType file_type;
-  SoupMessageHeaders *headers = NULL;
+  SoupRange *last;
+  guint i;
 
-  guint64 file_modified_date_int;
-  SoupDate *sdate;
-  gchar *date;
+  if (ranges->len < 2)
+    return;
 
-  request = binding->request;
-  ver = evd_http_message_get_version (EVD_HTTP_MESSAGE (request));
+  g_array_sort (ranges, evd_web_dir_compare_ranges);
 
-  info = g_file_query_info_finish (G_FILE (object), res, &error);
-  if (info == NULL)
+  last = &g_array_index (ranges, SoupRange, 0);
+  for (i = 1; i < ranges->len; )
     {
-      evd_web_dir_handle_content_error (binding, error);
-      g_error_free (error);
-      return;
+      SoupRange *range = &g_array_index (ranges, SoupRange, i);
+
+      if (range->start <= last->end + 1)
+        {
+          last->end = MAX (last->end, range->end);
+          g_array_remove_index (ranges, i);
+        }
+      else
+        {
+          last = range;
+          i++;
+        }
     }
+}
 
-  file_type = g_file_info_get_file_type (info);
+static GArray *
+evd_web_dir_parse_ranges (const gchar *header_value, guint64 total)
+{
+  GArray *ranges;
+  gchar **specs;
+  gint i;
 
-  /* file is a directory */
-  if (file_type == G_FILE_TYPE_DIRECTORY)
+  while (g_ascii_isspace (*header_value))
+    header_value++;
+
+  if (g_ascii_strncasecmp (header_value, "bytes", 5) != 0)
+    return NULL;
+  header_value += 5;
+
+  while (g_ascii_isspace (*header_value))
+    header_value++;
+
+  if (*header_value != '=')
+    return NULL;
+  header_value++;
+
+  ranges = g_array_new (FALSE, FALSE, sizeof (SoupRange));
+  specs = g_strsplit (header_value, ",", 0);
+
+  for (i=0; specs[i] != NULL; i++)
     {
-      if (self->priv->dir_index != NULL)
+      gchar *spec;
+      gchar *end;
+      guint64 start;
+      guint64 last;
+      SoupRange range;
+
+      spec = g_strstrip (specs[i]);
+      if (*spec == '\0')
+        continue;
+
+      if (i >= MAX_RANGES)
+        goto invalid;
+
+      if (*spec == '-')
         {
-          gchar *new_filename;
+          /* suffix range, the last N bytes */
+          guint64 len;
 
-          new_filename = g_strdup_printf ("%s/%s",
-                                          binding->filename,
-                                          self->priv->dir_index);
+          len = g_ascii_strtoull (spec + 1, &end, 10);
+          if (end == spec + 1 || *end != '\0')
+            goto invalid;
 
-          evd_web_dir_request_file (self, new_filename, binding);
+          if (len == 0 || total == 0)
+            continue;
 
-          g_free (new_filename);
+          start = total - MIN (len, total);
+          last = total - 1;
         }
       else
         {
-          /* @TODO: respond with 404 Not Found */
+          start = g_ascii_strtoull (spec, &end, 10);
+          if (end == spec || *end != '-')
+            goto invalid;
+
+          spec = end + 1;
+          if (*spec == '\0')
+            {
+              last = total - 1;
+            }
+          else
+            {
+              last = g_ascii_strtoull (spec, &end, 10);
+              if (*end != '\0' || last < start)
+                goto invalid;
+
+              last = MIN (last, total - 1);
+            }
+
+          if (start >= total)
+            continue;
         }
 
-      goto out;
+      range.start = start;
+      range.end = last;
+      g_array_append_val (ranges, range);
     }
-  /* file is a symbolic link */
-  else if (file_type == G_FILE_TYPE_SYMBOLIC_LINK)
+
+  g_strfreev (specs);
+
+  evd_web_dir_coalesce_ranges (ranges);
+
+  return ranges;
+
+ invalid:
+  g_strfreev (specs);
+  g_array_free (ranges, TRUE);
+
+  return NULL;
+}
+
+static gboolean
+evd_web_dir_if_range_matches (EvdWebDirBinding *binding,
+                              const gchar      *if_range)
+{
+  SoupDate *date;
+  gboolean result;
+
+  /* entity-tags are compared with the strong function, and weak ones
+     never match [RFC 7233, 3.2] */
+  if (*if_range == '"')
+    return g_strcmp0 (if_range, binding->etag) == 0;
+  else if (g_str_has_prefix (if_range, "W/"))
+    return FALSE;
+
+  date = soup_date_new_from_string (if_range);
+  if (date == NULL)
+    return FALSE;
+
+  result = (guint64) soup_date_to_time_t (date) == binding->file_mtime;
+  soup_date_free (date);
+
+  return result;
+}
+
+/* Decides which ranges of the file the response will carry, and sets the
+   response status accordingly. Returns %FALSE if none of the requested
+   ranges are satisfiable. */
+static gboolean
+evd_web_dir_setup_ranges (EvdWebDirBinding *binding,
+                          gboolean          ranges_allowed)
+{
+  SoupMessageHeaders *req_headers;
+  const gchar *range_header;
+  const gchar *if_range;
+  SoupRange range;
+
+  binding->status_code = SOUP_STATUS_OK;
+
+  req_headers =
+    evd_http_message_get_headers (EVD_HTTP_MESSAGE (binding->request));
+  range_header = soup_message_headers_get_one (req_headers, "Range");
+  if_range = soup_message_headers_get_one (req_headers, "If-Range");
+
+  if (ranges_allowed &&
+      range_header != NULL &&
+      (if_range == NULL || evd_web_dir_if_range_matches (binding, if_range)))
     {
-      /* @TODO: check if we allow following symlinks */
-      goto out;
+      binding->ranges = evd_web_dir_parse_ranges (range_header,
+                                                  binding->file_size);
     }
-  /* file is not a regular file */
-  else if (file_type != G_FILE_TYPE_REGULAR)
+
+  if (binding->ranges != NULL)
     {
-      /* @TODO: respond with 404 Not Found */
-      goto out;
+      if (binding->ranges->len == 0)
+        return FALSE;
+
+      binding->status_code = SOUP_STATUS_PARTIAL_CONTENT;
     }
+  else
+    {
+      /* the whole file as a single range */
+      binding->ranges = g_array_sized_new (FALSE, FALSE, sizeof (SoupRange), 1);
+
+      range.start = 0;
+      range.end = (goffset) binding->file_size - 1;
+      g_array_append_val (binding->ranges, range);
+    }
+
+  binding->range_index = 0;
+  binding->range_pos = g_array_index (binding->ranges, SoupRange, 0).start;
+
+  return TRUE;
+}
+
+static void
+evd_web_dir_respond_file (EvdWebDirBinding *binding)
+{
+  EvdWebDir *self = binding->web_dir;
+  EvdHttpConnection *conn = binding->conn;
+  EvdHttpRequest *request = binding->request;
+  SoupMessageHeaders *headers;
+  SoupHTTPVersion ver;
+  SoupDate *sdate;
+  gchar *date;
+  gboolean ranges_allowed;
+
+  ver = evd_http_message_get_version (EVD_HTTP_MESSAGE (request));
 
-  /* file is a regular file */
   headers = soup_message_headers_new (SOUP_MESSAGE_HEADERS_RESPONSE);
 
   if (evd_http_connection_get_keepalive (conn))
@@ -551,25 +1435,28 @@ evd_web_dir_file_on_info (GObject      *object,
   else
     soup_message_headers_replace (headers, "Connection", "close");
 
-  /* obtain last-modified value from file info */
-  file_modified_date_int =
-    g_file_info_get_attribute_uint64 (info, "time::modified");
+  soup_message_headers_replace (headers, "ETag", binding->etag);
 
-  /* check last-modified time */
+  if (evd_web_dir_negotiates_encoding (self))
+    soup_message_headers_replace (headers, "Vary", "Accept-Encoding");
+
+  /* check entity tag and last-modified time */
   if (evd_web_dir_check_not_modified (self,
                                       conn,
                                       request,
                                       headers,
                                       ver,
-                                      file_modified_date_int))
+                                      binding->file_mtime,
+                                      binding->etag))
     {
+      soup_message_headers_free (headers);
       evd_web_dir_finish_request (binding);
 
-      goto out;
+      return;
     }
 
   /* set 'last-modified' header in response */
-  sdate = soup_date_new_from_time_t (file_modified_date_int);
+  sdate = soup_date_new_from_time_t (binding->file_mtime);
   date = soup_date_to_string (sdate, SOUP_DATE_HTTP);
   soup_message_headers_replace (headers, "Last-Modified", date);
   g_free (date);
@@ -591,25 +1478,337 @@ evd_web_dir_file_on_info (GObject      *object,
         }
     }
 
-  soup_message_headers_set_content_type (headers,
-                                         g_file_info_get_content_type (info),
-                                         NULL);
-  soup_message_headers_set_content_length (headers,
-                                           g_file_info_get_size (info));
+  if (binding->content_encoding != NULL)
+    soup_message_headers_replace (headers,
+                                  "Content-Encoding",
+                                  binding->content_encoding);
 
-  /* now open file */
-  g_file_read_async (file,
-                     evd_connection_get_priority (EVD_CONNECTION (conn)),
-                     NULL,
-                     evd_web_dir_file_on_open,
-                     binding);
+  /* the size of a file compressed on-the-fly is not known until it is
+     loaded, so ranges cannot be served until then */
+  ranges_allowed = ! binding->compress || binding->cache_entry != NULL;
+
+  if (! evd_web_dir_setup_ranges (binding, ranges_allowed))
+    {
+      gchar *content_range;
+
+      content_range = g_strdup_printf ("bytes */%" G_GUINT64_FORMAT,
+                                       binding->file_size);
+      soup_message_headers_replace (headers, "Content-Range", content_range);
+      g_free (content_range);
+
+      binding->response_status_code =
+        SOUP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE;
+      evd_web_service_respond (EVD_WEB_SERVICE (self),
+                               conn,
+                               binding->response_status_code,
+                               headers,
+                               NULL,
+                               0,
+                               NULL);
+
+      soup_message_headers_free (headers);
+      evd_web_dir_finish_request (binding);
+
+      return;
+    }
+
+  if (ranges_allowed)
+    soup_message_headers_replace (headers, "Accept-Ranges", "bytes");
+
+  if (binding->ranges->len > 1)
+    {
+      guint i;
+      guint64 len = 0;
+      gchar *str;
+
+      /* multiple ranges, respond with a multipart/byteranges content */
+      binding->boundary = g_strdup_printf ("%08x%08x",
+                                           g_random_int (),
+                                           g_random_int ());
+
+      for (i=0; i<binding->ranges->len; i++)
+        {
+          SoupRange *range;
+
+          range = &g_array_index (binding->ranges, SoupRange, i);
+
+          str = evd_web_dir_build_part_header (binding, i);
+          len += strlen (str) + range->end - range->start + 1;
+          g_free (str);
+        }
+
+      str = evd_web_dir_build_multipart_end (binding);
+      len += strlen (str);
+      g_free (str);
+
+      str = g_strdup_printf ("multipart/byteranges; boundary=%s",
+                             binding->boundary);
+      soup_message_headers_replace (headers, "Content-Type", str);
+      g_free (str);
+
+      soup_message_headers_set_content_length (headers, len);
+    }
+  else
+    {
+      SoupRange *range;
+
+      range = &g_array_index (binding->ranges, SoupRange, 0);
+
+      soup_message_headers_set_content_type (headers,
+                                             binding->content_type,
+                                             NULL);
+      soup_message_headers_set_content_length (headers,
+                                               range->end - range->start + 1);
+
+      if (binding->status_code == SOUP_STATUS_PARTIAL_CONTENT)
+        soup_message_headers_set_content_range (headers,
+                                                range->start,
+                                                range->end,
+                                                binding->file_size);
+    }
 
   binding->response_headers = headers;
-  headers = NULL;
+
+  if (binding->cache_entry != NULL)
+    {
+      /* serve from cache */
+      if (evd_web_dir_write_response_headers (binding))
+        evd_web_dir_file_read_block (binding);
+    }
+  else if (binding->compress ||
+           evd_web_dir_cache_accepts (self, binding->file_size))
+    {
+      /* load the whole file (compress it if needed) and cache it */
+      g_file_load_contents_async (binding->file,
+                                  NULL,
+                                  evd_web_dir_file_on_load,
+                                  binding);
+    }
+  else
+    {
+      /* now open file */
+      g_file_read_async (binding->file,
+                         evd_connection_get_priority (EVD_CONNECTION (conn)),
+                         NULL,
+                         evd_web_dir_file_on_open,
+                         binding);
+    }
+}
+
+static void
+evd_web_dir_file_resolved (EvdWebDirBinding *binding)
+{
+  EvdWebDir *self = binding->web_dir;
+  EvdWebDirCacheEntry *entry;
+  gsize threshold;
+
+  /* no precompressed variant found, consider compressing the file
+     on-the-fly. Only files that fit in the cache are compressed, so that
+     the work is done once */
+  threshold =
+    evd_web_service_get_compression_threshold (EVD_WEB_SERVICE (self));
+
+  if (binding->content_encoding == NULL &&
+      (binding->accept_encodings & ENCODING_GZIP) != 0 &&
+      threshold > 0 &&
+      binding->file_size >= threshold &&
+      evd_web_dir_cache_accepts (self, binding->file_size) &&
+      evd_web_dir_content_type_is_compressible (binding->content_type))
+    {
+      binding->compress = TRUE;
+      binding->content_encoding = "gzip";
+
+      g_free (binding->etag);
+      binding->etag = evd_web_dir_build_etag (binding->file_size,
+                                              binding->file_mtime,
+                                              binding->file_mtime_usec,
+                                              binding->content_encoding);
+    }
+
+  /* check whether a cached copy of the file is still valid */
+  entry = evd_web_dir_cache_lookup (self, binding->cache_key);
+  if (entry != NULL)
+    {
+      if (g_strcmp0 (entry->filename, binding->filename) == 0 &&
+          g_strcmp0 (entry->etag, binding->etag) == 0)
+        {
+          entry->validated_at = g_get_monotonic_time ();
+          binding->cache_entry = evd_web_dir_cache_entry_ref (entry);
+          binding->file_size = entry->size;
+        }
+      else
+        {
+          evd_web_dir_cache_remove (self, entry);
+        }
+    }
+
+  evd_web_dir_respond_file (binding);
+}
+
+static void
+evd_web_dir_variant_on_info (GObject      *object,
+                             GAsyncResult *res,
+                             gpointer      user_data)
+{
+  EvdWebDirBinding *binding = user_data;
+  GFileInfo *info;
+
+  info = g_file_query_info_finish (G_FILE (object), res, NULL);
+  if (info == NULL ||
+      g_file_info_get_file_type (info) != G_FILE_TYPE_REGULAR)
+    {
+      /* variant not available, try next one */
+      binding->content_encoding = NULL;
+      evd_web_dir_try_next_variant (binding);
+    }
+  else
+    {
+      /* serve the variant instead of the file */
+      g_object_unref (binding->file);
+      binding->file = G_FILE (g_object_ref (object));
+
+      binding->file_size = g_file_info_get_size (info);
+      binding->file_mtime =
+        g_file_info_get_attribute_uint64 (info, "time::modified");
+      binding->file_mtime_usec =
+        g_file_info_get_attribute_uint32 (info, "time::modified-usec");
+
+      g_free (binding->file_stat_etag);
+      binding->file_stat_etag = g_strdup (g_file_info_get_etag (info));
+
+      g_free (binding->etag);
+      binding->etag = evd_web_dir_build_etag (binding->file_size,
+                                              binding->file_mtime,
+                                              binding->file_mtime_usec,
+                                              binding->content_encoding);
+
+      evd_web_dir_file_resolved (binding);
+    }
+
+  if (info != NULL)
+    g_object_unref (info);
+}
+
+static void
+evd_web_dir_try_next_variant (EvdWebDirBinding *binding)
+{
+  const gchar *FILE_ATTRS =
+    "standard::size,standard::type,time::modified,time::modified-usec,"
+    "etag::value";
+  const gchar *ext;
+  gchar *filename;
+  GFile *file;
+
+  if ((binding->encodings_to_try & ENCODING_BR) != 0)
+    {
+      binding->encodings_to_try &= ~ENCODING_BR;
+      binding->content_encoding = "br";
+      ext = ".br";
+    }
+  else if ((binding->encodings_to_try & ENCODING_GZIP) != 0)
+    {
+      binding->encodings_to_try &= ~ENCODING_GZIP;
+      binding->content_encoding = "gzip";
+      ext = ".gz";
+    }
+  else
+    {
+      evd_web_dir_file_resolved (binding);
+      return;
+    }
+
+  filename = g_strconcat (binding->filename, ext, NULL);
+  file = g_file_new_for_path (filename);
+  g_free (filename);
+
+  g_file_query_info_async (file,
+                           FILE_ATTRS,
+                           G_FILE_QUERY_INFO_NONE,
+                           evd_connection_get_priority (EVD_CONNECTION (binding->conn)),
+                           NULL,
+                           evd_web_dir_variant_on_info,
+                           binding);
+
+  g_object_unref (file);
+}
+
+static void
+evd_web_dir_file_on_info (GObject      *object,
+                          GAsyncResult *res,
+                          gpointer      user_data)
+{
+  EvdWebDirBinding *binding = user_data;
+  EvdWebDir *self = binding->web_dir;
+  GError *error = NULL;
+  GFileInfo *info;
+  GFileType file_type;
+
+  info = g_file_query_info_finish (G_FILE (object), res, &error);
+  if (info == NULL)
+    {
+      evd_web_dir_handle_content_error (binding, error);
+      g_error_free (error);
+      return;
+    }
+
+  file_type = g_file_info_get_file_type (info);
+
+  /* file is a directory */
+  if (file_type == G_FILE_TYPE_DIRECTORY)
+    {
+      if (self->priv->dir_index != NULL)
+        {
+          gchar *new_filename;
+
+          new_filename = g_strdup_printf ("%s/%s",
+                                          binding->filename,
+                                          self->priv->dir_index);
+
+          evd_web_dir_request_file (self, new_filename, binding);
+
+          g_free (new_filename);
+        }
+      else
+        {
+          /* @TODO: respond with 404 Not Found */
+        }
+
+      goto out;
+    }
+  /* file is a symbolic link */
+  else if (file_type == G_FILE_TYPE_SYMBOLIC_LINK)
+    {
+      /* @TODO: check if we allow following symlinks */
+      goto out;
+    }
+  /* file is not a regular file */
+  else if (file_type != G_FILE_TYPE_REGULAR)
+    {
+      /* @TODO: respond with 404 Not Found */
+      goto out;
+    }
+
+  /* file is a regular file */
+  binding->content_type = g_strdup (g_file_info_get_content_type (info));
+  binding->file_size = g_file_info_get_size (info);
+  binding->file_mtime =
+    g_file_info_get_attribute_uint64 (info, "time::modified");
+  binding->file_mtime_usec =
+    g_file_info_get_attribute_uint32 (info, "time::modified-usec");
+  g_free (binding->file_stat_etag);
+  binding->file_stat_etag = g_strdup (g_file_info_get_etag (info));
+  binding->etag = evd_web_dir_build_etag (binding->file_size,
+                                          binding->file_mtime,
+                                          binding->file_mtime_usec,
+                                          NULL);
+
+  /* look for precompressed siblings of the file */
+  if (self->priv->serve_precompressed)
+    binding->encodings_to_try = binding->accept_encodings;
+
+  evd_web_dir_try_next_variant (binding);
 
  out:
-  if (headers != NULL)
-    soup_message_headers_free (headers);
   g_object_unref (info);
 }
 
@@ -618,8 +1817,11 @@ evd_web_dir_conn_on_write (EvdConnection *conn, gpointer user_data)
 {
   EvdWebDirBinding *binding = (EvdWebDirBinding *) user_data;
 
-  if (binding->file_input_stream != NULL)
-    evd_web_dir_file_read_block (binding);
+  if (binding->response_headers_sent &&
+      (binding->file_input_stream != NULL || binding->cache_entry != NULL))
+    {
+      evd_web_dir_file_read_block (binding);
+    }
 }
 
 static gboolean
@@ -636,7 +1838,8 @@ evd_web_dir_request_file (EvdWebDir        *self,
 {
   GFile *file;
   const gchar *FILE_ATTRS =
-    "standard::content-type,standard::size,standard::type,time::modified";
+    "standard::content-type,standard::size,standard::type,"
+    "time::modified,time::modified-usec,etag::value";
 
   g_free (binding->filename);
   binding->filename = g_strdup (filename);
@@ -656,6 +1859,324 @@ evd_web_dir_request_file (EvdWebDir        *self,
                            binding);
 }
 
+static void
+evd_web_dir_request_cached_file (EvdWebDir           *self,
+                                 EvdWebDirCacheEntry *entry,
+                                 EvdWebDirBinding    *binding)
+{
+  binding->filename = g_strdup (entry->filename);
+  binding->content_type = g_strdup (entry->content_type);
+  binding->etag = g_strdup (entry->etag);
+  binding->file_size = entry->size;
+  binding->file_mtime = entry->mtime;
+  binding->content_encoding = entry->content_encoding;
+
+  binding->cache_entry = evd_web_dir_cache_entry_ref (entry);
+
+  evd_web_dir_respond_file (binding);
+}
+
+static void
+evd_web_dir_cache_invalidate (EvdWebDir *self, const gchar *filename)
+{
+  GList *node;
+
+  node = self->priv->cache_lru->head;
+  while (node != NULL)
+    {
+      EvdWebDirCacheEntry *entry = node->data;
+
+      node = node->next;
+
+      if (g_strcmp0 (entry->filename, filename) == 0)
+        evd_web_dir_cache_remove (self, entry);
+    }
+}
+
+static void
+evd_web_dir_put_abort (EvdWebDirBinding *binding, GError *error)
+{
+  /* the rest of the request content will not be read */
+  evd_http_connection_set_keepalive (binding->conn, FALSE);
+
+  if (binding->file_output_stream != NULL)
+    g_output_stream_close (G_OUTPUT_STREAM (binding->file_output_stream),
+                           NULL,
+                           NULL);
+
+  /* a temporary file that failed to be created may belong to another
+     upload, only remove ours */
+  if (binding->tmp_file_created)
+    {
+      g_file_delete (binding->tmp_file, NULL, NULL);
+      binding->tmp_file_created = FALSE;
+    }
+
+  evd_web_dir_handle_content_error (binding, error);
+}
+
+static void
+evd_web_dir_put_on_closed (GObject      *object,
+                           GAsyncResult *res,
+                           gpointer      user_data)
+{
+  EvdWebDirBinding *binding = user_data;
+  GError *error = NULL;
+  gboolean existed;
+
+  if (! g_output_stream_close_finish (G_OUTPUT_STREAM (object), res, &error))
+    {
+      evd_web_dir_put_abort (binding, error);
+      g_error_free (error);
+      return;
+    }
+
+  g_object_unref (binding->file_output_stream);
+  binding->file_output_stream = NULL;
+
+  /* atomically replace the destination file with the uploaded one */
+  existed = g_file_query_exists (binding->file, NULL);
+  if (! g_file_move (binding->tmp_file,
+                     binding->file,
+                     G_FILE_COPY_OVERWRITE | G_FILE_COPY_NOFOLLOW_SYMLINKS,
+                     NULL,
+                     NULL,
+                     NULL,
+                     &error))
+    {
+      evd_web_dir_put_abort (binding, error);
+      g_error_free (error);
+      return;
+    }
+  binding->tmp_file_created = FALSE;
+
+  evd_web_dir_cache_invalidate (binding->web_dir, binding->filename);
+
+  binding->response_status_code =
+    existed ? SOUP_STATUS_NO_CONTENT : SOUP_STATUS_CREATED;
+
+  evd_web_service_respond (EVD_WEB_SERVICE (binding->web_dir),
+                           binding->conn,
+                           binding->response_status_code,
+                           NULL,
+                           NULL,
+                           0,
+                           NULL);
+
+  evd_web_dir_finish_request (binding);
+}
+
+static void
+evd_web_dir_put_write_block (EvdWebDirBinding *binding)
+{
+  g_output_stream_write_async (G_OUTPUT_STREAM (binding->file_output_stream),
+                               (gchar *) binding->buffer + binding->write_offset,
+                               binding->size - binding->write_offset,
+                               evd_connection_get_priority (EVD_CONNECTION (binding->conn)),
+                               NULL,
+                               evd_web_dir_put_on_block_written,
+                               binding);
+}
+
+static void
+evd_web_dir_put_on_block_written (GObject      *object,
+                                  GAsyncResult *res,
+                                  gpointer      user_data)
+{
+  EvdWebDirBinding *binding = user_data;
+  GError *error = NULL;
+  gssize size;
+
+  size = g_output_stream_write_finish (G_OUTPUT_STREAM (object), res, &error);
+  if (size < 0)
+    {
+      evd_web_dir_put_abort (binding, error);
+      g_error_free (error);
+      return;
+    }
+
+  binding->write_offset += size;
+
+  if (binding->write_offset < binding->size)
+    evd_web_dir_put_write_block (binding);
+  else if (binding->more_content)
+    evd_web_dir_put_read_block (binding);
+  else
+    g_output_stream_close_async (G_OUTPUT_STREAM (binding->file_output_stream),
+                                 evd_connection_get_priority (EVD_CONNECTION (binding->conn)),
+                                 NULL,
+                                 evd_web_dir_put_on_closed,
+                                 binding);
+}
+
+static void
+evd_web_dir_put_on_content_read (GObject      *object,
+                                 GAsyncResult *res,
+                                 gpointer      user_data)
+{
+  EvdWebDirBinding *binding = user_data;
+  GError *error = NULL;
+  gssize size;
+
+  size = evd_http_connection_read_content_finish (EVD_HTTP_CONNECTION (object),
+                                                  res,
+                                                  &binding->more_content,
+                                                  &error);
+  if (size < 0)
+    {
+      evd_web_dir_put_abort (binding, error);
+      g_error_free (error);
+      return;
+    }
+
+  binding->size = size;
+  binding->write_offset = 0;
+
+  if (size > 0)
+    evd_web_dir_put_write_block (binding);
+  else if (binding->more_content)
+    evd_web_dir_put_read_block (binding);
+  else
+    g_output_stream_close_async (G_OUTPUT_STREAM (binding->file_output_stream),
+                                 evd_connection_get_priority (EVD_CONNECTION (binding->conn)),
+                                 NULL,
+                                 evd_web_dir_put_on_closed,
+                                 binding);
+}
+
+static void
+evd_web_dir_put_read_block (EvdWebDirBinding *binding)
+{
+  evd_http_connection_read_content (binding->conn,
+                                    binding->buffer,
+                                    BLOCK_SIZE,
+                                    NULL,
+                                    evd_web_dir_put_on_content_read,
+                                    binding);
+}
+
+static gboolean
+evd_web_dir_put_reserve_space (EvdWebDirBinding  *binding,
+                               GError           **error)
+{
+#ifdef HAVE_GIO_UNIX
+  gint fd;
+  gint err;
+
+  if (binding->file_size == 0 ||
+      ! G_IS_FILE_DESCRIPTOR_BASED (binding->file_output_stream))
+    {
+      return TRUE;
+    }
+
+  fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (binding->file_output_stream));
+
+  /* allocating the whole file up-front avoids fragmentation, and detects
+     a full disk before any content is read */
+  err = posix_fallocate (fd, 0, binding->file_size);
+  if (err == ENOSPC)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NO_SPACE,
+                   "Not enough space left on device");
+      return FALSE;
+    }
+#endif
+
+  return TRUE;
+}
+
+static void
+evd_web_dir_put_on_created (GObject      *object,
+                            GAsyncResult *res,
+                            gpointer      user_data)
+{
+  EvdWebDirBinding *binding = user_data;
+  GError *error = NULL;
+
+  binding->file_output_stream = g_file_create_finish (G_FILE (object),
+                                                      res,
+                                                      &error);
+  binding->tmp_file_created = binding->file_output_stream != NULL;
+
+  if (binding->file_output_stream == NULL ||
+      ! evd_web_dir_put_reserve_space (binding, &error))
+    {
+      evd_web_dir_put_abort (binding, error);
+      g_error_free (error);
+      return;
+    }
+
+  binding->buffer = g_slice_alloc (BLOCK_SIZE);
+  evd_web_dir_put_read_block (binding);
+}
+
+static void
+evd_web_dir_put_file (EvdWebDir        *self,
+                      const gchar      *filename,
+                      EvdWebDirBinding *binding)
+{
+  SoupMessageHeaders *headers;
+  SoupEncoding encoding;
+  gchar *dirname;
+  gchar *basename;
+  gchar *tmp_filename;
+
+  headers = evd_http_message_get_headers (EVD_HTTP_MESSAGE (binding->request));
+
+  /* content is streamed block by block, either with a known length or
+     chunked. Only the former allows reserving disk space in advance. */
+  encoding = soup_message_headers_get_encoding (headers);
+  if (encoding != SOUP_ENCODING_CONTENT_LENGTH &&
+      encoding != SOUP_ENCODING_CHUNKED)
+    {
+      binding->response_status_code = SOUP_STATUS_LENGTH_REQUIRED;
+
+      evd_http_connection_set_keepalive (binding->conn, FALSE);
+      evd_web_service_respond (EVD_WEB_SERVICE (self),
+                               binding->conn,
+                               binding->response_status_code,
+                               NULL,
+                               NULL,
+                               0,
+                               NULL);
+
+      evd_web_dir_finish_request (binding);
+      return;
+    }
+
+  if (encoding == SOUP_ENCODING_CONTENT_LENGTH)
+    binding->file_size = soup_message_headers_get_content_length (headers);
+  else
+    binding->file_size = 0;
+
+  binding->filename = g_strdup (filename);
+  binding->file = g_file_new_for_path (filename);
+
+  /* content is written to a temporary file in the same directory, and
+     moved over the destination once complete */
+  dirname = g_path_get_dirname (filename);
+  basename = g_path_get_basename (filename);
+  tmp_filename = g_strdup_printf ("%s/.%s.%08x.upload",
+                                  dirname,
+                                  basename,
+                                  g_random_int ());
+
+  binding->tmp_file = g_file_new_for_path (tmp_filename);
+
+  g_free (tmp_filename);
+  g_free (basename);
+  g_free (dirname);
+
+  g_file_create_async (binding->tmp_file,
+                       G_FILE_CREATE_NONE,
+                       evd_connection_get_priority (EVD_CONNECTION (binding->conn)),
+                       NULL,
+                       evd_web_dir_put_on_created,
+                       binding);
+}
+
 static void
 evd_web_dir_request_handler (EvdWebService     *web_service,
                              EvdHttpConnection *conn,
@@ -666,6 +2187,7 @@ evd_web_dir_request_handler (EvdWebService     *web_service,
   EvdWebDirBinding *binding;
   SoupURI *uri;
   const gchar *path_without_alias = "";
+  EvdWebDirCacheEntry *entry;
 
   if (! evd_web_dir_method_allowed (self,
                                     evd_http_request_get_method (request)))
@@ -741,7 +2263,51 @@ evd_web_dir_request_handler (EvdWebService     *web_service,
   g_object_ref (request);
   binding->request = request;
 
-  evd_web_dir_request_file (self, filename, binding);
+  /* uploads */
+  if (g_strcmp0 (evd_http_request_get_method (request), "PUT") == 0)
+    {
+      evd_web_dir_put_file (self, filename, binding);
+
+      g_free (filename);
+      return;
+    }
+
+  /* negotiate content-coding */
+  if (evd_web_dir_negotiates_encoding (self))
+    {
+      if (self->priv->serve_precompressed &&
+          evd_http_request_accepts_encoding (request, "br"))
+        {
+          binding->accept_encodings |= ENCODING_BR;
+        }
+
+      if (evd_http_request_accepts_encoding (request, "gzip"))
+        binding->accept_encodings |= ENCODING_GZIP;
+    }
+
+  /* each set of accepted encodings caches its own variant of the file */
+  if (binding->accept_encodings == 0)
+    binding->cache_key = g_strdup (filename);
+  else
+    binding->cache_key = g_strdup_printf ("%s#%x",
+                                          filename,
+                                          binding->accept_encodings);
+
+  entry = evd_web_dir_cache_lookup (self, binding->cache_key);
+  if (entry == NULL)
+    {
+      evd_web_dir_request_file (self, filename, binding);
+    }
+  else if (evd_web_dir_cache_entry_is_fresh (self, entry))
+    {
+      /* hot path, the file system is not touched at all */
+      evd_web_dir_request_cached_file (self, entry, binding);
+    }
+  else
+    {
+      /* revalidate the cached copy against the file on disk */
+      evd_web_dir_request_file (self, entry->filename, binding);
+    }
 
   g_free (filename);
 }
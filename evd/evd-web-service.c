@@ -37,12 +37,20 @@ G_DEFINE_TYPE (EvdWebService, evd_web_service, EVD_TYPE_SERVICE)
 
 #define DEFAULT_CORS_PREFLIGHT_MAX_AGE "600" /* in seconds */
 
+#define DEFAULT_COMPRESSION_THRESHOLD 0 /* disabled */
+#define DEFAULT_MAX_CONTENT_SIZE      0 /* unlimited */
+
+#define ENCODE_BLOCK_SIZE 4096
+
 typedef struct _EvdWebServicePrivate EvdWebServicePrivate;
 
 struct _EvdWebServicePrivate
 {
   GHashTable *origins;
   EvdPolicy origin_policy;
+
+  gsize compression_threshold;
+  gsize max_content_size;
 };
 
 /* signals */
@@ -131,6 +139,8 @@ evd_web_service_init (EvdWebService *self)
   evd_service_set_io_stream_type (EVD_SERVICE (self), EVD_TYPE_HTTP_CONNECTION);
 
   priv->origin_policy = DEFAULT_ORIGIN_POLICY;
+  priv->compression_threshold = DEFAULT_COMPRESSION_THRESHOLD;
+  priv->max_content_size = DEFAULT_MAX_CONTENT_SIZE;
   priv->origins = g_hash_table_new_full (g_str_hash,
                                          g_str_equal,
                                          g_free,
@@ -154,6 +164,12 @@ evd_web_service_invoke_request_handler (EvdWebService     *self,
                                         EvdHttpRequest    *request)
 {
   EvdWebServiceClass *class;
+  EvdWebServicePrivate *priv;
+
+  priv = EVD_WEB_SERVICE_GET_PRIVATE (self);
+
+  /* the connection may come from another service, so always apply ours */
+  evd_http_connection_set_max_content_size (conn, priv->max_content_size);
 
   class = EVD_WEB_SERVICE_GET_CLASS (self);
   if (class->request_handler != NULL)
@@ -478,6 +494,78 @@ prepare_response_headers (EvdWebService      *self,
   return headers;
 }
 
+static gchar *
+evd_web_service_encode_content (GConverter   *encoder,
+                                const gchar  *content,
+                                gsize         size,
+                                gsize        *encoded_size,
+                                GError      **error)
+{
+  GConverterResult result;
+  gsize bytes_read;
+  gsize bytes_written;
+  gchar *buf;
+  gsize buf_size;
+  gsize len = 0;
+
+  buf_size = size / 2 + ENCODE_BLOCK_SIZE;
+  buf = g_malloc (buf_size);
+
+  do
+    {
+      if (buf_size - len < ENCODE_BLOCK_SIZE)
+        {
+          buf_size *= 2;
+          buf = g_realloc (buf, buf_size);
+        }
+
+      result = g_converter_convert (encoder,
+                                    content,
+                                    size,
+                                    buf + len,
+                                    buf_size - len,
+                                    G_CONVERTER_INPUT_AT_END,
+                                    &bytes_read,
+                                    &bytes_written,
+                                    error);
+      if (result == G_CONVERTER_ERROR)
+        {
+          g_free (buf);
+          return NULL;
+        }
+
+      content += bytes_read;
+      size -= bytes_read;
+      len += bytes_written;
+    }
+  while (result != G_CONVERTER_FINISHED);
+
+  *encoded_size = len;
+
+  return buf;
+}
+
+static void
+merge_vary_header (SoupMessageHeaders *headers, const gchar *field)
+{
+  const gchar *vary;
+  gchar *merged;
+
+  vary = soup_message_headers_get_list (headers, "Vary");
+  if (vary == NULL)
+    {
+      soup_message_headers_replace (headers, "Vary", field);
+      return;
+    }
+
+  if (soup_header_contains (vary, field) || soup_header_contains (vary, "*"))
+    return;
+
+  merged = g_strdup_printf ("%s, %s", vary, field);
+  soup_message_headers_replace (headers, "Vary", merged);
+  g_free (merged);
+}
+
 static gboolean
 evd_web_service_respond_internal (EvdWebService       *self,
                                   EvdHttpConnection   *conn,
@@ -490,9 +578,51 @@ evd_web_service_respond_internal (EvdWebService       *self,
   SoupMessageHeaders *_headers;
   gboolean result;
   SoupHTTPVersion ver;
+  GConverter *encoder = NULL;
+  gchar *encoded_content = NULL;
+  gchar *vary = NULL;
 
   _headers = prepare_response_headers (self, conn, headers, &ver);
 
+  /* compress content if the client accepts it and it is worth the effort.
+     Negotiating it touches the headers, so keep what is needed to undo it */
+  if (content != NULL)
+    {
+      vary = g_strdup (soup_message_headers_get_list (_headers, "Vary"));
+      encoder = evd_web_service_get_content_encoder (self,
+                                                     conn,
+                                                     _headers,
+                                                     size);
+    }
+
+  if (encoder != NULL)
+    {
+      gsize encoded_size;
+
+      encoded_content = evd_web_service_encode_content (encoder,
+                                                        content,
+                                                        size,
+                                                        &encoded_size,
+                                                        NULL);
+      if (encoded_content != NULL && encoded_size < size)
+        {
+          content = encoded_content;
+          size = encoded_size;
+        }
+      else
+        {
+          soup_message_headers_remove (_headers, "Content-Encoding");
+
+          if (vary != NULL)
+            soup_message_headers_replace (_headers, "Vary", vary);
+          else
+            soup_message_headers_remove (_headers, "Vary");
+        }
+
+      g_object_unref (encoder);
+    }
+  g_free (vary);
+
   if (evd_http_connection_respond (conn,
                                    ver,
                                    status_code,
@@ -516,6 +646,8 @@ evd_web_service_respond_internal (EvdWebService       *self,
   if (headers == NULL)
     soup_message_headers_free (_headers);
 
+  g_free (encoded_content);
+
   return result;
 }
 
@@ -822,3 +954,130 @@ evd_web_service_respond_headers (EvdWebService       *self,
 
   return result;
 }
+
+/**
+ * evd_web_service_set_compression_threshold:
+ * @threshold: minimum content size in bytes, or 0 to disable compression
+ *
+ * Sets the minimum size a response content must have to be compressed
+ * on-the-fly, for clients that accept gzip or deflate content-codings.
+ * Compression is disabled by default.
+ **/
+void
+evd_web_service_set_compression_threshold (EvdWebService *self,
+                                           gsize          threshold)
+{
+  EvdWebServicePrivate *priv;
+
+  g_return_if_fail (EVD_IS_WEB_SERVICE (self));
+
+  priv = EVD_WEB_SERVICE_GET_PRIVATE (self);
+
+  priv->compression_threshold = threshold;
+}
+
+gsize
+evd_web_service_get_compression_threshold (EvdWebService *self)
+{
+  EvdWebServicePrivate *priv;
+
+  g_return_val_if_fail (EVD_IS_WEB_SERVICE (self), 0);
+
+  priv = EVD_WEB_SERVICE_GET_PRIVATE (self);
+
+  return priv->compression_threshold;
+}
+
+/**
+ * evd_web_service_set_max_content_size:
+ * @size: maximum size in bytes of a request's content, or 0 for no limit
+ *
+ * Limits the size of the content that request handlers can read from
+ * the connections of this service. Larger contents fail to be read with
+ * an %EVD_ERRNO_ERROR error of code %EMSGSIZE. There is no limit by default.
+ **/
+void
+evd_web_service_set_max_content_size (EvdWebService *self,
+                                      gsize          size)
+{
+  EvdWebServicePrivate *priv;
+
+  g_return_if_fail (EVD_IS_WEB_SERVICE (self));
+
+  priv = EVD_WEB_SERVICE_GET_PRIVATE (self);
+
+  priv->max_content_size = size;
+}
+
+gsize
+evd_web_service_get_max_content_size (EvdWebService *self)
+{
+  EvdWebServicePrivate *priv;
+
+  g_return_val_if_fail (EVD_IS_WEB_SERVICE (self), 0);
+
+  priv = EVD_WEB_SERVICE_GET_PRIVATE (self);
+
+  return priv->max_content_size;
+}
+
+/**
+ * evd_web_service_get_content_encoder:
+ * @headers: the response headers
+ * @size: the (expected) size of the response content
+ *
+ * Negotiates on-the-fly compression of a response of @size bytes, with the
+ * client of the request currently handled on @conn. If compression applies,
+ * a Content-Encoding header is set in @headers.
+ *
+ * Returns: (transfer full): a #GConverter to encode the response content
+ * with, or %NULL if the content should be sent as is.
+ **/
+GConverter *
+evd_web_service_get_content_encoder (EvdWebService      *self,
+                                     EvdHttpConnection  *conn,
+                                     SoupMessageHeaders *headers,
+                                     gsize               size)
+{
+  EvdWebServicePrivate *priv;
+  EvdHttpRequest *request;
+  GZlibCompressorFormat format;
+  const gchar *encoding;
+
+  g_return_val_if_fail (EVD_IS_WEB_SERVICE (self), NULL);
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), NULL);
+  g_return_val_if_fail (headers != NULL, NULL);
+
+  priv = EVD_WEB_SERVICE_GET_PRIVATE (self);
+
+  if (priv->compression_threshold == 0 || size < priv->compression_threshold)
+    return NULL;
+
+  /* don't encode content twice */
+  if (soup_message_headers_get_one (headers, "Content-Encoding") != NULL)
+    return NULL;
+
+  request = evd_http_connection_get_current_request (conn);
+  if (request == NULL)
+    return NULL;
+
+  if (evd_http_request_accepts_encoding (request, "gzip"))
+    {
+      encoding = "gzip";
+      format = G_ZLIB_COMPRESSOR_FORMAT_GZIP;
+    }
+  else if (evd_http_request_accepts_encoding (request, "deflate"))
+    {
+      encoding = "deflate";
+      format = G_ZLIB_COMPRESSOR_FORMAT_ZLIB;
+    }
+  else
+    {
+      return NULL;
+    }
+
+  soup_message_headers_replace (headers, "Content-Encoding", encoding);
+  merge_vary_header (headers, "Accept-Encoding");
+
+  return G_CONVERTER (g_zlib_compressor_new (format, -1));
+}
@@ -135,6 +135,19 @@ gboolean          evd_web_service_respond_headers             (EvdWebService
                                                                SoupMessageHeaders  *headers,
                                                                GError             **error);
 
+void              evd_web_service_set_compression_threshold   (EvdWebService *self,
+                                                               gsize          threshold);
+gsize             evd_web_service_get_compression_threshold   (EvdWebService *self);
+
+void              evd_web_service_set_max_content_size        (EvdWebService *self,
+                                                               gsize          size);
+gsize             evd_web_service_get_max_content_size        (EvdWebService *self);
+
+GConverter *      evd_web_service_get_content_encoder         (EvdWebService      *self,
+                                                               EvdHttpConnection  *conn,
+                                                               SoupMessageHeaders *headers,
+                                                               gsize               size);
+
 #define EVD_WEB_SERVICE_LOG(web_service, conn, request, status_code, content_size, error) \
   (EVD_WEB_SERVICE_GET_CLASS (web_service)->log (web_service, conn, request, status_code, content_size, error))
 
@@ -31,9 +31,11 @@
 #include "evd-http-connection.h"
 #include "evd-peer-manager.h"
 #include "evd-web-dir.h"
+#include "evd-peer-directory.h"
 
 #include "evd-longpolling-server.h"
 #include "evd-websocket-server.h"
+#include "evd-sse-server.h"
 
 #define EVD_WEB_TRANSPORT_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
                                                    EVD_TYPE_WEB_TRANSPORT_SERVER, \
@@ -48,14 +50,24 @@
 #define HANDSHAKE_TOKEN_NAME    "handshake"
 #define LONG_POLLING_TOKEN_NAME "lp"
 #define WEB_SOCKET_TOKEN_NAME   "ws"
+#define SSE_TOKEN_NAME          "sse"
 
 #define LONG_POLLING_MECHANISM_NAME "long-polling"
 #define WEB_SOCKET_MECHANISM_NAME   "websocket"
+#define SSE_MECHANISM_NAME          "server-sent-events"
+
+#define LONG_POLLING_FRAMING_NAME "lp-framing"
 
 #define HANDSHAKE_DATA_KEY "org.eventdance.lib.WebTransport.HANDSHAKE_DATA"
 
 #define PEER_DATA_KEY "org.eventdance.lib.WebTransportServer.PEER_DATA"
 
+#define DEFAULT_REPLAY_WINDOW 128
+
+/* query parameter carrying the sequence number of the last message
+   received by a reconnecting peer, as in '?<peer-id>&ack=<seq>' */
+#define ACK_PARAM "&ack="
+
 /* handshake data */
 typedef struct
 {
@@ -78,11 +90,18 @@ struct _EvdWebTransportServerPrivate
   EvdWebsocketServer *ws;
   gchar *ws_base_path;
 
+  EvdSseServer *sse;
+  gchar *sse_base_path;
+
   gboolean enable_ws;
 
   HandshakeData *current_handshake_data;
 
   gchar *external_url;
+
+  guint replay_window;
+
+  EvdPeerDirectory *peer_directory;
 };
 
 /* properties */
@@ -91,7 +110,8 @@ enum
   PROP_0,
   PROP_BASE_PATH,
   PROP_LP_SERVICE,
-  PROP_WEBSOCKET_SERVICE
+  PROP_WEBSOCKET_SERVICE,
+  PROP_SSE_SERVICE
 };
 
 static void     evd_web_transport_server_class_init           (EvdWebTransportServerClass *class);
@@ -122,6 +142,10 @@ static gboolean evd_web_transport_server_send                 (EvdTransport    *
                                                                gsize            size,
                                                                EvdMessageType   type,
                                                                GError         **error);
+static gboolean evd_web_transport_server_broadcast            (EvdTransport  *transport,
+                                                               GList         *peers,
+                                                               EvdMessage    *message,
+                                                               GError       **error);
 
 static gboolean evd_web_transport_server_peer_is_connected    (EvdTransport *transport,
                                                                EvdPeer      *peer);
@@ -137,6 +161,9 @@ static gboolean evd_web_transport_server_accept_peer          (EvdTransport *tra
                                                                EvdPeer      *peer);
 static gboolean evd_web_transport_server_reject_peer          (EvdTransport *transport,
                                                                EvdPeer      *peer);
+static void     evd_web_transport_server_peer_closed          (EvdTransport *transport,
+                                                               EvdPeer      *peer,
+                                                               gboolean      gracefully);
 
 G_DEFINE_TYPE_WITH_CODE (EvdWebTransportServer, evd_web_transport_server, EVD_TYPE_WEB_DIR,
                          G_IMPLEMENT_INTERFACE (EVD_TYPE_TRANSPORT,
@@ -179,6 +206,14 @@ evd_web_transport_server_class_init (EvdWebTransportServerClass *class)
                                                         G_PARAM_READABLE |
                                                         G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (obj_class, PROP_SSE_SERVICE,
+                                   g_param_spec_object ("sse-service",
+                                                        "Server-Sent Events service",
+                                                        "Internal Server-Sent Events service used by the transport",
+                                                        EVD_TYPE_SSE_SERVER,
+                                                        G_PARAM_READABLE |
+                                                        G_PARAM_STATIC_STRINGS));
+
   g_type_class_add_private (obj_class, sizeof (EvdWebTransportServerPrivate));
 }
 
@@ -186,9 +221,11 @@ static void
 evd_web_transport_server_transport_iface_init (EvdTransportInterface *iface)
 {
   iface->send = evd_web_transport_server_send;
+  iface->broadcast = evd_web_transport_server_broadcast;
   iface->peer_is_connected = evd_web_transport_server_peer_is_connected;
   iface->accept_peer = evd_web_transport_server_accept_peer;
   iface->reject_peer = evd_web_transport_server_reject_peer;
+  iface->peer_closed = evd_web_transport_server_peer_closed;
   iface->open = evd_web_transport_server_open;
 }
 
@@ -203,6 +240,7 @@ evd_web_transport_server_init (EvdWebTransportServer *self)
 
   priv->lp = evd_longpolling_server_new ();
   priv->ws = evd_websocket_server_new ();
+  priv->sse = evd_sse_server_new ();
 
   js_path = g_getenv ("JSLIBDIR");
   if (js_path == NULL)
@@ -215,11 +253,23 @@ evd_web_transport_server_init (EvdWebTransportServer *self)
   priv->current_handshake_data = NULL;
 
   priv->external_url = NULL;
+
+  priv->replay_window = DEFAULT_REPLAY_WINDOW;
+
+  priv->peer_directory = NULL;
 }
 
 static void
 evd_web_transport_server_dispose (GObject *obj)
 {
+  EvdWebTransportServer *self = EVD_WEB_TRANSPORT_SERVER (obj);
+
+  if (self->priv->peer_directory != NULL)
+    {
+      g_object_unref (self->priv->peer_directory);
+      self->priv->peer_directory = NULL;
+    }
+
   G_OBJECT_CLASS (evd_web_transport_server_parent_class)->dispose (obj);
 }
 
@@ -234,6 +284,9 @@ evd_web_transport_server_finalize (GObject *obj)
   g_free (self->priv->ws_base_path);
   g_object_unref (self->priv->ws);
 
+  g_free (self->priv->sse_base_path);
+  g_object_unref (self->priv->sse);
+
   g_free (self->priv->hs_base_path);
   g_free (self->priv->base_path);
 
@@ -288,6 +341,10 @@ evd_web_transport_server_get_property (GObject    *obj,
       g_value_set_object (value, self->priv->ws);
       break;
 
+    case PROP_SSE_SERVICE:
+      g_value_set_object (value, self->priv->sse);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -325,6 +382,80 @@ evd_web_transport_server_send (EvdTransport    *transport,
     }
 }
 
+static gboolean
+evd_web_transport_server_broadcast (EvdTransport  *transport,
+                                    GList         *peers,
+                                    EvdMessage    *message,
+                                    GError       **error)
+{
+  EvdWebTransportServer *self = EVD_WEB_TRANSPORT_SERVER (transport);
+  GList *ws_peers = NULL;
+  GList *lp_peers = NULL;
+  GList *sse_peers = NULL;
+  GList *node;
+  gboolean result = TRUE;
+
+  /* split peers by sub-transport, so that each one broadcasts to its
+     own peers at once. Sub-transports are called through their interface
+     because the message was already recorded in the peers' sequence */
+  for (node = peers; node != NULL; node = node->next)
+    {
+      EvdPeer *peer = EVD_PEER (node->data);
+      EvdTransport *_transport;
+
+      _transport = g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY);
+
+      if (_transport == EVD_TRANSPORT (self->priv->ws))
+        ws_peers = g_list_prepend (ws_peers, peer);
+      else if (_transport == EVD_TRANSPORT (self->priv->lp))
+        lp_peers = g_list_prepend (lp_peers, peer);
+      else if (_transport == EVD_TRANSPORT (self->priv->sse))
+        sse_peers = g_list_prepend (sse_peers, peer);
+      else if (! evd_peer_push_shared_message (peer,
+                                               message,
+                                               result ? error : NULL))
+        result = FALSE;
+    }
+
+  if (ws_peers != NULL)
+    {
+      if (! EVD_TRANSPORT_GET_INTERFACE (self->priv->ws)->broadcast (
+                                             EVD_TRANSPORT (self->priv->ws),
+                                             ws_peers,
+                                             message,
+                                             result ? error : NULL))
+        result = FALSE;
+
+      g_list_free (ws_peers);
+    }
+
+  if (lp_peers != NULL)
+    {
+      if (! EVD_TRANSPORT_GET_INTERFACE (self->priv->lp)->broadcast (
+                                             EVD_TRANSPORT (self->priv->lp),
+                                             lp_peers,
+                                             message,
+                                             result ? error : NULL))
+        result = FALSE;
+
+      g_list_free (lp_peers);
+    }
+
+  if (sse_peers != NULL)
+    {
+      if (! EVD_TRANSPORT_GET_INTERFACE (self->priv->sse)->broadcast (
+                                             EVD_TRANSPORT (self->priv->sse),
+                                             sse_peers,
+                                             message,
+                                             result ? error : NULL))
+        result = FALSE;
+
+      g_list_free (sse_peers);
+    }
+
+  return result;
+}
+
 static gboolean
 evd_web_transport_server_peer_is_connected (EvdTransport *transport,
                                             EvdPeer      *peer)
@@ -477,6 +608,26 @@ evd_web_transport_server_respond_handshake (HandshakeData *data,
       g_free (mechanism_url);
     }
 
+  /* server-sent events? */
+  if (has_mechanism (request_mechs, SSE_MECHANISM_NAME))
+    {
+      SoupURI *sse_uri;
+
+      if (self->priv->external_url != NULL)
+        sse_uri = soup_uri_new (self->priv->external_url);
+      else
+        sse_uri = soup_uri_copy (uri);
+      soup_uri_set_path (sse_uri, self->priv->sse_base_path);
+      soup_uri_set_query (sse_uri, NULL);
+      mechanism_url = soup_uri_to_string (sse_uri, FALSE);
+      soup_uri_free (sse_uri);
+
+      add_mechanism_to_response_list (response_mechs,
+                                      SSE_MECHANISM_NAME,
+                                      mechanism_url);
+      g_free (mechanism_url);
+    }
+
   /* long-polling? */
   if (has_mechanism (request_mechs, LONG_POLLING_MECHANISM_NAME))
     {
@@ -495,6 +646,32 @@ evd_web_transport_server_respond_handshake (HandshakeData *data,
                                       LONG_POLLING_MECHANISM_NAME,
                                       mechanism_url);
       g_free (mechanism_url);
+
+      /* use binary framing if the peer supports it */
+      if (json_object_has_member (request_obj, LONG_POLLING_FRAMING_NAME) &&
+          json_object_get_int_member (request_obj, LONG_POLLING_FRAMING_NAME) >=
+          EVD_LONGPOLLING_FRAMING_BINARY)
+        {
+          evd_longpolling_server_set_peer_framing (self->priv->lp,
+                                                   peer,
+                                                   EVD_LONGPOLLING_FRAMING_BINARY);
+
+          json_object_set_int_member (response_obj,
+                                      LONG_POLLING_FRAMING_NAME,
+                                      EVD_LONGPOLLING_FRAMING_BINARY);
+        }
+    }
+
+  /* session resumption? */
+  if (self->priv->replay_window > 0 &&
+      json_object_has_member (request_obj, "resume") &&
+      json_object_get_boolean_member (request_obj, "resume"))
+    {
+      evd_peer_set_replay_window (peer, self->priv->replay_window);
+
+      json_object_set_int_member (response_obj,
+                                  "replay-window",
+                                  self->priv->replay_window);
     }
 
   /* generate JSON data for the response */
@@ -567,6 +744,7 @@ evd_web_transport_handshake (HandshakeData *data)
 
   if (request_mechs == NULL ||
       (! has_mechanism (request_mechs, WEB_SOCKET_MECHANISM_NAME) &&
+       ! has_mechanism (request_mechs, SSE_MECHANISM_NAME) &&
        ! has_mechanism (request_mechs, LONG_POLLING_MECHANISM_NAME)))
     {
       /* return 503 Service Unavailable, no mechanism can be negotiated */
@@ -746,6 +924,8 @@ get_actual_transport_from_path (EvdWebTransportServer *self,
   else if (self->priv->enable_ws &&
            g_strstr_len (path, -1, self->priv->ws_base_path) == path)
     return EVD_WEB_SERVICE (self->priv->ws);
+  else if (g_strstr_len (path, -1, self->priv->sse_base_path) == path)
+    return EVD_WEB_SERVICE (self->priv->sse);
   else
     return NULL;
 }
@@ -766,19 +946,79 @@ evd_web_transport_server_on_request (EvdWebService     *web_service,
     {
       evd_web_transport_server_read_handshake_data (self, conn, request);
     }
-  /* longpolling or websocket? */
+  /* longpolling, websocket or server-sent events? */
   else if ((actual_service =
             get_actual_transport_from_path (self, uri->path)) != NULL)
     {
-      EvdPeer *peer;
+      EvdPeer *peer = NULL;
       EvdTransport *current_transport;
+      const gchar *peer_id = NULL;
+      gchar *acked_peer_id = NULL;
+      const gchar *ack_str = NULL;
+      guint64 ack = 0;
+
+      /* the query is only copied when it carries an ack */
+      if (uri->query != NULL)
+        {
+          ack_str = strstr (uri->query, ACK_PARAM);
+          if (ack_str != NULL)
+            {
+              ack = g_ascii_strtoull (ack_str + strlen (ACK_PARAM), NULL, 10);
+              acked_peer_id = g_strndup (uri->query, ack_str - uri->query);
+              peer_id = acked_peer_id;
+            }
+          else
+            {
+              peer_id = uri->query;
+            }
 
-      if (uri->query != NULL &&
-          (peer = evd_transport_lookup_peer (EVD_TRANSPORT (self),
-                                             uri->query)) != NULL)
+          peer = evd_transport_lookup_peer (EVD_TRANSPORT (self), peer_id);
+        }
+
+      /* peers created by another worker are served by it */
+      if (peer == NULL &&
+          peer_id != NULL &&
+          self->priv->peer_directory != NULL &&
+          evd_peer_directory_forward (self->priv->peer_directory,
+                                      peer_id,
+                                      conn,
+                                      request))
+        {
+          g_free (acked_peer_id);
+          return;
+        }
+
+      /* sub-transports take the whole query as the peer id */
+      if (acked_peer_id != NULL)
+        {
+          soup_uri_set_query (uri, acked_peer_id);
+          g_free (acked_peer_id);
+        }
+
+      if (peer != NULL)
         {
           evd_peer_touch (peer);
 
+          /* put back in the backlog the messages the peer missed while
+             reconnecting, before the sub-transport flushes it. If some
+             are gone, the session is lost and the peer has to handshake
+             again */
+          if (ack_str != NULL && ! evd_peer_resume (peer, ack))
+            {
+              evd_peer_close (peer, FALSE);
+
+              /* return 410 Gone, the peer cannot use this session anymore */
+              EVD_WEB_SERVICE_GET_CLASS (self)->
+                respond (EVD_WEB_SERVICE (self),
+                         conn,
+                         SOUP_STATUS_GONE,
+                         NULL,
+                         NULL,
+                         0,
+                         NULL);
+              return;
+            }
+
           current_transport = EVD_TRANSPORT (g_object_get_data (G_OBJECT (peer),
                                                                 PEER_DATA_KEY));
           if (current_transport != EVD_TRANSPORT (actual_service))
@@ -825,6 +1065,9 @@ evd_web_transport_server_set_base_path (EvdWebTransportServer *self,
   self->priv->ws_base_path = g_strdup_printf ("%s%s",
                                               self->priv->base_path,
                                               WEB_SOCKET_TOKEN_NAME);
+  self->priv->sse_base_path = g_strdup_printf ("%s%s",
+                                               self->priv->base_path,
+                                               SSE_TOKEN_NAME);
 
   evd_web_dir_set_alias (EVD_WEB_DIR (self), base_path);
 }
@@ -832,8 +1075,10 @@ evd_web_transport_server_set_base_path (EvdWebTransportServer *self,
 static gboolean
 evd_web_transport_server_accept_peer (EvdTransport *transport, EvdPeer *peer)
 {
+  EvdWebTransportServer *self = EVD_WEB_TRANSPORT_SERVER (transport);
   EvdPeerManager *peer_manager;
   HandshakeData *data;
+  GError *error = NULL;
 
   peer_manager = evd_transport_get_peer_manager (transport);
 
@@ -842,6 +1087,16 @@ evd_web_transport_server_accept_peer (EvdTransport *transport, EvdPeer *peer)
     {
       evd_peer_manager_add_peer (peer_manager, peer);
 
+      if (self->priv->peer_directory != NULL &&
+          ! evd_peer_directory_register (self->priv->peer_directory,
+                                         evd_peer_get_id (peer),
+                                         &error))
+        {
+          /* @TODO: do proper logging */
+          g_warning ("Failed to register peer: %s", error->message);
+          g_error_free (error);
+        }
+
       EVD_TRANSPORT_GET_INTERFACE (transport)->
         notify_new_peer (transport, peer);
     }
@@ -920,6 +1175,18 @@ evd_web_transport_server_open (EvdTransport       *transport,
                       async_result);
 }
 
+static void
+evd_web_transport_server_peer_closed (EvdTransport *transport,
+                                      EvdPeer      *peer,
+                                      gboolean      gracefully)
+{
+  EvdWebTransportServer *self = EVD_WEB_TRANSPORT_SERVER (transport);
+
+  if (self->priv->peer_directory != NULL)
+    evd_peer_directory_unregister (self->priv->peer_directory,
+                                   evd_peer_get_id (peer));
+}
+
 /* public methods */
 
 EvdWebTransportServer *
@@ -1017,3 +1284,92 @@ evd_web_transport_server_set_external_base_url (EvdWebTransportServer *self,
   if (base_url != NULL)
     self->priv->external_url = g_strdup (base_url);
 }
+
+/**
+ * evd_web_transport_server_set_replay_window:
+ * @size: number of messages, or 0 to disable session resumption
+ *
+ * Sets how many of the last messages sent to each peer are kept, so that
+ * peers negotiating session resumption in the handshake can reconnect
+ * without losing messages. Only affects peers that handshake afterwards.
+ **/
+void
+evd_web_transport_server_set_replay_window (EvdWebTransportServer *self,
+                                            guint                  size)
+{
+  g_return_if_fail (EVD_IS_WEB_TRANSPORT_SERVER (self));
+
+  self->priv->replay_window = size;
+}
+
+guint
+evd_web_transport_server_get_replay_window (EvdWebTransportServer *self)
+{
+  g_return_val_if_fail (EVD_IS_WEB_TRANSPORT_SERVER (self), 0);
+
+  return self->priv->replay_window;
+}
+
+/**
+ * evd_web_transport_server_set_coalescing_delay:
+ * @delay: milliseconds to hold messages back for, between 0 and 5, or -1
+ *
+ * Sets the coalescing delay of both the long-polling and the websocket
+ * transports. See evd_longpolling_server_set_coalescing_delay() and
+ * evd_websocket_server_set_coalescing_delay().
+ **/
+void
+evd_web_transport_server_set_coalescing_delay (EvdWebTransportServer *self,
+                                               gint                   delay)
+{
+  g_return_if_fail (EVD_IS_WEB_TRANSPORT_SERVER (self));
+
+  evd_longpolling_server_set_coalescing_delay (self->priv->lp, delay);
+  evd_websocket_server_set_coalescing_delay (self->priv->ws, delay);
+}
+
+gint
+evd_web_transport_server_get_coalescing_delay (EvdWebTransportServer *self)
+{
+  g_return_val_if_fail (EVD_IS_WEB_TRANSPORT_SERVER (self), -1);
+
+  return evd_longpolling_server_get_coalescing_delay (self->priv->lp);
+}
+
+/**
+ * evd_web_transport_server_set_peer_directory:
+ * @directory: (allow-none):
+ *
+ * Shares the peers of this transport with other processes serving the
+ * same URL, through @directory. Peers created here are registered in
+ * @directory, and requests for peers owned by another process are relayed
+ * to it. Only peers created afterwards are registered.
+ **/
+void
+evd_web_transport_server_set_peer_directory (EvdWebTransportServer *self,
+                                             EvdPeerDirectory      *directory)
+{
+  g_return_if_fail (EVD_IS_WEB_TRANSPORT_SERVER (self));
+  g_return_if_fail (directory == NULL || EVD_IS_PEER_DIRECTORY (directory));
+
+  if (directory != NULL)
+    g_object_ref (directory);
+
+  if (self->priv->peer_directory != NULL)
+    g_object_unref (self->priv->peer_directory);
+
+  self->priv->peer_directory = directory;
+}
+
+/**
+ * evd_web_transport_server_get_peer_directory:
+ *
+ * Returns: (transfer none) (allow-none):
+ **/
+EvdPeerDirectory *
+evd_web_transport_server_get_peer_directory (EvdWebTransportServer *self)
+{
+  g_return_val_if_fail (EVD_IS_WEB_TRANSPORT_SERVER (self), NULL);
+
+  return self->priv->peer_directory;
+}
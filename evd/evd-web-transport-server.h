@@ -29,6 +29,7 @@
 
 #include "evd-web-dir.h"
 #include "evd-web-selector.h"
+#include "evd-peer-directory.h"
 #include "evd-peer.h"
 
 G_BEGIN_DECLS
@@ -88,6 +89,18 @@ void                    evd_web_transport_server_get_validate_peer_arguments (Ev
 void                    evd_web_transport_server_set_external_base_url       (EvdWebTransportServer *self,
                                                                               const gchar           *base_url);
 
+void                    evd_web_transport_server_set_replay_window           (EvdWebTransportServer *self,
+                                                                              guint                  size);
+guint                   evd_web_transport_server_get_replay_window           (EvdWebTransportServer *self);
+
+void                    evd_web_transport_server_set_coalescing_delay        (EvdWebTransportServer *self,
+                                                                              gint                   delay);
+gint                    evd_web_transport_server_get_coalescing_delay        (EvdWebTransportServer *self);
+
+void                    evd_web_transport_server_set_peer_directory          (EvdWebTransportServer *self,
+                                                                              EvdPeerDirectory      *directory);
+EvdPeerDirectory *      evd_web_transport_server_get_peer_directory          (EvdWebTransportServer *self);
+
 G_END_DECLS
 
 #endif /* __EVD_WEB_TRANSPORT_SERVER_H__ */
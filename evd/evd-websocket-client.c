@@ -37,10 +37,19 @@
 
 #define DEFAULT_STANDALONE TRUE
 
+#define DEFAULT_DEFLATE                     FALSE
+#define DEFAULT_DEFLATE_MAX_WINDOW_BITS     15
+#define DEFAULT_DEFLATE_NO_CONTEXT_TAKEOVER FALSE
+#define DEFAULT_DEFLATE_MEM_LEVEL           8
+#define DEFAULT_DEFLATE_THRESHOLD           128
+
 struct _EvdWebsocketClientPrivate
 {
   gboolean standalone;
 
+  gboolean deflate_enabled;
+  EvdWebsocketDeflateParams deflate;
+
   EvdHttpConnection *peer_arg_conn;
   SoupMessageHeaders *peer_arg_headers;
 };
@@ -139,6 +148,14 @@ evd_websocket_client_init (EvdWebsocketClient *self)
   self->priv = priv;
 
   priv->standalone = DEFAULT_STANDALONE;
+
+  priv->deflate_enabled = DEFAULT_DEFLATE;
+  priv->deflate.server_max_window_bits = DEFAULT_DEFLATE_MAX_WINDOW_BITS;
+  priv->deflate.client_max_window_bits = DEFAULT_DEFLATE_MAX_WINDOW_BITS;
+  priv->deflate.server_no_context_takeover = DEFAULT_DEFLATE_NO_CONTEXT_TAKEOVER;
+  priv->deflate.client_no_context_takeover = DEFAULT_DEFLATE_NO_CONTEXT_TAKEOVER;
+  priv->deflate.mem_level = DEFAULT_DEFLATE_MEM_LEVEL;
+  priv->deflate.threshold = DEFAULT_DEFLATE_THRESHOLD;
 }
 
 static gboolean
@@ -543,12 +560,14 @@ on_handshake_response (GObject      *obj,
     }
 
   /* validate handshake response */
-  if (! evd_websocket_protocol_handle_handshake_response (conn,
-                                                          http_version,
-                                                          status_code,
-                                                          res_headers,
-                                                          conn_data->handshake_key,
-                                                          &error))
+  if (! evd_websocket_protocol_handle_handshake_response_full (conn,
+                                  http_version,
+                                  status_code,
+                                  res_headers,
+                                  conn_data->handshake_key,
+                                  conn_data->self->priv->deflate_enabled ?
+                                    &conn_data->self->priv->deflate : NULL,
+                                  &error))
     {
       goto out;
     }
@@ -617,10 +636,11 @@ start_opening_handshake (EvdWebsocketClient *self, EvdHttpConnection *conn)
   g_assert (data != NULL);
 
   request =
-    evd_websocket_protocol_create_handshake_request (data->address,
-                                                     NULL,
-                                                     NULL,
-                                                     &data->handshake_key);
+    evd_websocket_protocol_create_handshake_request_full (data->address,
+                                  NULL,
+                                  NULL,
+                                  self->priv->deflate_enabled ? &self->priv->deflate : NULL,
+                                  &data->handshake_key);
 
   evd_http_connection_write_request_headers (conn,
                                              request,
@@ -766,3 +786,66 @@ evd_websocket_client_get_validate_peer_arguments (EvdWebsocketClient  *self,
   if (response_headers != NULL)
     *response_headers = self->priv->peer_arg_headers;
 }
+
+/**
+ * evd_websocket_client_set_deflate:
+ * @enabled: whether to negotiate the permessage-deflate extension
+ *
+ * Enables compression of messages with the permessage-deflate extension
+ * (RFC 7692), for connections opened from now on. The client offers it in
+ * its handshake, and messages are only compressed if the server accepts
+ * the offer. Disabled by default.
+ **/
+void
+evd_websocket_client_set_deflate (EvdWebsocketClient *self,
+                                 gboolean            enabled)
+{
+  g_return_if_fail (EVD_IS_WEBSOCKET_CLIENT (self));
+
+  self->priv->deflate_enabled = enabled;
+}
+
+gboolean
+evd_websocket_client_get_deflate (EvdWebsocketClient *self)
+{
+  g_return_val_if_fail (EVD_IS_WEBSOCKET_CLIENT (self), FALSE);
+
+  return self->priv->deflate_enabled;
+}
+
+/**
+ * evd_websocket_client_set_deflate_options:
+ * @max_window_bits: base-2 logarithm of the largest LZ77 window, between
+ * 9 and 15
+ * @no_context_takeover: whether to reset the compression contexts after
+ * each message
+ * @mem_level: zlib memory level of the compressor, between 1 and 9
+ * @threshold: size in bytes below which messages are sent uncompressed
+ *
+ * Tunes the permessage-deflate offer of the client. The client compresses
+ * with a window of at most @max_window_bits, or smaller if the server's
+ * response asks for it, and offers the server a window of the same size.
+ * If @no_context_takeover is %TRUE, the client resets its compression
+ * context after each message and asks the server to do the same, which
+ * the server may decline. Smaller windows, no context takeover and lower
+ * memory levels reduce the memory used by each connection, at the cost of
+ * compression ratio.
+ **/
+void
+evd_websocket_client_set_deflate_options (EvdWebsocketClient *self,
+                                         guint8              max_window_bits,
+                                         gboolean            no_context_takeover,
+                                         guint8              mem_level,
+                                         gsize               threshold)
+{
+  g_return_if_fail (EVD_IS_WEBSOCKET_CLIENT (self));
+  g_return_if_fail (max_window_bits >= 9 && max_window_bits <= 15);
+  g_return_if_fail (mem_level >= 1 && mem_level <= 9);
+
+  self->priv->deflate.server_max_window_bits = max_window_bits;
+  self->priv->deflate.client_max_window_bits = max_window_bits;
+  self->priv->deflate.server_no_context_takeover = no_context_takeover;
+  self->priv->deflate.client_no_context_takeover = no_context_takeover;
+  self->priv->deflate.mem_level = mem_level;
+  self->priv->deflate.threshold = threshold;
+}
@@ -76,6 +76,15 @@ void                    evd_websocket_client_set_standalone              (EvdWeb
                                                                           gboolean            standalone);
 gboolean                evd_websocket_client_get_standalone              (EvdWebsocketClient *self);
 
+void                    evd_websocket_client_set_deflate                 (EvdWebsocketClient *self,
+                                                                          gboolean            enabled);
+gboolean                evd_websocket_client_get_deflate                 (EvdWebsocketClient *self);
+void                    evd_websocket_client_set_deflate_options         (EvdWebsocketClient *self,
+                                                                          guint8              max_window_bits,
+                                                                          gboolean            no_context_takeover,
+                                                                          guint8              mem_level,
+                                                                          gsize               threshold);
+
 void                    evd_websocket_client_get_validate_peer_arguments (EvdWebsocketClient  *self,
                                                                           EvdPeer             *peer,
                                                                           EvdHttpConnection  **conn,
@@ -21,8 +21,21 @@
  */
 
 #include <string.h>
+#include <zlib.h>
 #include <libsoup/soup-headers.h>
 
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2_MASKING 1
+#endif
+
+#if (defined (__x86_64__) || defined (__i386__)) && \
+  (defined (__clang__) || \
+   (defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#include <immintrin.h>
+#define HAVE_AVX2_MASKING 1
+#endif
+
 #include "evd-websocket-protocol.h"
 
 #include "evd-utils.h"
@@ -34,6 +47,15 @@
 #define BLOCK_SIZE        0x00000FFF
 #define MAX_FRAGMENT_SIZE 0x10000000
 #define MAX_PAYLOAD_SIZE  0x40000000
+#define MAX_CORK_SIZE     0x00010000
+#define MAX_READ_SIZE     0x00010000
+
+#define EXTENSION_DEFLATE  "permessage-deflate"
+#define DEFLATE_BLOCK_SIZE 4096
+
+/* a message compressed with Z_SYNC_FLUSH ends with these 4 bytes, which
+   are removed before sending and appended back before inflating */
+static const gchar DEFLATE_TAIL[4] = { 0x00, 0x00, (gchar) 0xFF, (gchar) 0xFF };
 
 /* websocket reading states */
 typedef enum
@@ -52,6 +74,7 @@ typedef enum
 } EvdWebsocketReadingStates;
 
 static const guint16 HEADER_MASK_FIN         = (1 << 15);
+static const guint16 HEADER_MASK_RSV1        = (1 << 14);
 static const guint16 HEADER_MASK_OPCODE      = ((1 << 8) | (1 << 9) | (1 << 10) | (1 << 11));
 static const guint16 HEADER_MASK_MASKED      = (1 << 7);
 static const guint16 HEADER_MASK_PAYLOAD_LEN = (0x00FF & ~(1 << 7));
@@ -76,6 +99,34 @@ typedef enum
   OPCODE_CONTROL_RSV4     = 0x0F
 } EvdWebsocketOpcodes;
 
+typedef struct
+{
+  z_stream deflater;
+  z_stream inflater;
+
+  /* whether the compression context is dropped after each message */
+  gboolean deflater_reset;
+  gboolean inflater_reset;
+
+  gsize threshold;
+
+  /* kept apart, since an inflated message is dispatched from @in_buf and
+     the handler may send on the same connection */
+  GString *in_buf;
+  GString *out_buf;
+} EvdWebsocketDeflate;
+
+/* a permessage-deflate offer or response, as parsed from the
+   Sec-WebSocket-Extensions header. Window bits are -1 if absent, and 0 if
+   present without a value */
+typedef struct
+{
+  gint server_max_window_bits;
+  gint client_max_window_bits;
+  gboolean server_no_context_takeover;
+  gboolean client_no_context_takeover;
+} EvdWebsocketDeflateOffer;
+
 typedef struct
 {
   gboolean server;
@@ -107,12 +158,25 @@ typedef struct
   gchar *close_reason;
 
   gboolean fin;
+  gboolean compressed;
   gboolean masked;
   guint8 masking_key[4];
   gchar *extensions_data;
   gsize extension_len;
 
   guint close_timeout_src_id;
+
+  EvdWebsocketDeflate *deflate;
+
+  /* reassembly of fragmented messages */
+  gboolean fragmented;
+  guint8 msg_opcode;
+  gboolean msg_compressed;
+  GString *msg;
+
+  /* frames held back while the connection is corked */
+  gboolean corked;
+  GString *cork_buf;
 } EvdWebsocketData;
 
 static void read_from_connection    (EvdWebsocketData *data);
@@ -121,23 +185,427 @@ static void on_close_frame_received (EvdWebsocketData *data,
                                      guint16           code,
                                      const gchar      *reason);
 
+static gboolean flush_cork          (EvdWebsocketData  *data,
+                                     GError           **error);
+
+/* Masking XORs the payload with a 4-byte key that repeats all along it.
+   Since 8, 16 and 32 are multiples of 4, wider registers can be filled with
+   the key repeated and applied to whole words. Unaligned loads and stores
+   are done with memcpy(), which compilers turn into single instructions. */
+
+typedef void (* MaskFunc) (guint8 *data, gsize len, guint32 key);
+
 static void
-apply_masking (gchar *frame, gsize frame_len, guint8 masking_key[4])
+mask_words (guint8 *data, gsize len, guint32 key)
 {
+  guint64 key64;
+  guint64 word;
   gsize i;
-  guint8 j;
 
-  for (i=0; i<frame_len; i++)
+  key64 = ((guint64) key << 32) | key;
+
+  while (len >= 8)
+    {
+      memcpy (&word, data, 8);
+      word ^= key64;
+      memcpy (data, &word, 8);
+
+      data += 8;
+      len -= 8;
+    }
+
+  for (i = 0; i < len; i++)
+    data[i] ^= ((const guint8 *) &key)[i & 3];
+}
+
+#ifdef HAVE_SSE2_MASKING
+static void
+mask_sse2 (guint8 *data, gsize len, guint32 key)
+{
+  __m128i key128;
+
+  key128 = _mm_set1_epi32 ((gint) key);
+
+  while (len >= 16)
+    {
+      __m128i block;
+
+      block = _mm_loadu_si128 ((const __m128i *) data);
+      _mm_storeu_si128 ((__m128i *) data, _mm_xor_si128 (block, key128));
+
+      data += 16;
+      len -= 16;
+    }
+
+  mask_words (data, len, key);
+}
+#endif
+
+#ifdef HAVE_AVX2_MASKING
+__attribute__ ((target ("avx2")))
+static void
+mask_avx2 (guint8 *data, gsize len, guint32 key)
+{
+  __m256i key256;
+
+  key256 = _mm256_set1_epi32 ((gint) key);
+
+  while (len >= 32)
+    {
+      __m256i block;
+
+      block = _mm256_loadu_si256 ((const __m256i *) data);
+      _mm256_storeu_si256 ((__m256i *) data, _mm256_xor_si256 (block, key256));
+
+      data += 32;
+      len -= 32;
+    }
+
+  mask_words (data, len, key);
+}
+#endif
+
+static MaskFunc
+get_mask_func (void)
+{
+  static gsize initialized = 0;
+  static MaskFunc mask_func = mask_words;
+
+  if (g_once_init_enter (&initialized))
+    {
+#ifdef HAVE_SSE2_MASKING
+      mask_func = mask_sse2;
+#endif
+
+#ifdef HAVE_AVX2_MASKING
+      __builtin_cpu_init ();
+      if (__builtin_cpu_supports ("avx2"))
+        mask_func = mask_avx2;
+#endif
+
+      g_once_init_leave (&initialized, 1);
+    }
+
+  return mask_func;
+}
+
+static gint
+parse_window_bits (const gchar *value)
+{
+  guint64 bits;
+  gchar *end = NULL;
+
+  bits = g_ascii_strtoull (value, &end, 10);
+  if (end == value || *end != '\0' || bits < 8 || bits > 15)
+    return -1;
+
+  return (gint) bits;
+}
+
+static gboolean
+parse_deflate_extension (const gchar              *extension,
+                         EvdWebsocketDeflateOffer *offer)
+{
+  gchar **tokens;
+  gboolean result = TRUE;
+  gint i;
+
+  offer->server_max_window_bits = -1;
+  offer->client_max_window_bits = -1;
+  offer->server_no_context_takeover = FALSE;
+  offer->client_no_context_takeover = FALSE;
+
+  tokens = g_strsplit (extension, ";", -1);
+
+  if (tokens[0] == NULL ||
+      g_strcmp0 (g_strstrip (tokens[0]), EXTENSION_DEFLATE) != 0)
+    {
+      g_strfreev (tokens);
+      return FALSE;
+    }
+
+  for (i = 1; tokens[i] != NULL && result; i++)
     {
-      j = i % 4;
-      frame[i] = frame[i] ^ masking_key[j];
+      gchar *param;
+      gchar *value;
+      gsize value_len;
+
+      param = g_strstrip (tokens[i]);
+
+      value = strchr (param, '=');
+      if (value != NULL)
+        {
+          *value = '\0';
+          value = g_strstrip (value + 1);
+          g_strstrip (param);
+
+          /* unquote */
+          value_len = strlen (value);
+          if (value_len >= 2 && value[0] == '"' && value[value_len - 1] == '"')
+            {
+              value[value_len - 1] = '\0';
+              value++;
+            }
+        }
+
+      if (g_strcmp0 (param, "server_no_context_takeover") == 0 &&
+          value == NULL && ! offer->server_no_context_takeover)
+        {
+          offer->server_no_context_takeover = TRUE;
+        }
+      else if (g_strcmp0 (param, "client_no_context_takeover") == 0 &&
+               value == NULL && ! offer->client_no_context_takeover)
+        {
+          offer->client_no_context_takeover = TRUE;
+        }
+      else if (g_strcmp0 (param, "server_max_window_bits") == 0 &&
+               value != NULL && offer->server_max_window_bits == -1)
+        {
+          offer->server_max_window_bits = parse_window_bits (value);
+          result = offer->server_max_window_bits > 0;
+        }
+      else if (g_strcmp0 (param, "client_max_window_bits") == 0 &&
+               offer->client_max_window_bits == -1)
+        {
+          if (value != NULL)
+            {
+              offer->client_max_window_bits = parse_window_bits (value);
+              result = offer->client_max_window_bits > 0;
+            }
+          else
+            {
+              offer->client_max_window_bits = 0;
+            }
+        }
+      else
+        {
+          /* unknown, repeated or malformed parameter */
+          result = FALSE;
+        }
     }
+
+  g_strfreev (tokens);
+
+  return result;
+}
+
+static gchar *
+build_deflate_extension (const EvdWebsocketDeflateParams *params,
+                         gboolean                         with_client_bits)
+{
+  GString *ext;
+
+  ext = g_string_new (EXTENSION_DEFLATE);
+
+  if (params->server_no_context_takeover)
+    g_string_append (ext, "; server_no_context_takeover");
+
+  if (params->client_no_context_takeover)
+    g_string_append (ext, "; client_no_context_takeover");
+
+  if (params->server_max_window_bits < 15)
+    g_string_append_printf (ext,
+                            "; server_max_window_bits=%u",
+                            params->server_max_window_bits);
+
+  if (with_client_bits)
+    {
+      g_string_append (ext, "; client_max_window_bits");
+
+      if (params->client_max_window_bits < 15)
+        g_string_append_printf (ext, "=%u", params->client_max_window_bits);
+    }
+
+  return g_string_free (ext, FALSE);
+}
+
+static EvdWebsocketDeflate *
+deflate_new (const EvdWebsocketDeflateParams *params, gboolean is_server)
+{
+  EvdWebsocketDeflate *ctx;
+  gint deflate_bits;
+  gint inflate_bits;
+
+  ctx = g_slice_new0 (EvdWebsocketDeflate);
+
+  /* zlib does not support a raw deflate window of 8 bits */
+  deflate_bits = is_server ?
+    params->server_max_window_bits : params->client_max_window_bits;
+  deflate_bits = CLAMP (deflate_bits, 9, 15);
+
+  inflate_bits = is_server ?
+    params->client_max_window_bits : params->server_max_window_bits;
+  inflate_bits = CLAMP (inflate_bits, 8, 15);
+
+  if (deflateInit2 (&ctx->deflater,
+                    Z_DEFAULT_COMPRESSION,
+                    Z_DEFLATED,
+                    - deflate_bits,
+                    CLAMP (params->mem_level, 1, MAX_MEM_LEVEL),
+                    Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+      g_slice_free (EvdWebsocketDeflate, ctx);
+      return NULL;
+    }
+
+  if (inflateInit2 (&ctx->inflater, - inflate_bits) != Z_OK)
+    {
+      deflateEnd (&ctx->deflater);
+      g_slice_free (EvdWebsocketDeflate, ctx);
+      return NULL;
+    }
+
+  ctx->deflater_reset = is_server ?
+    params->server_no_context_takeover : params->client_no_context_takeover;
+  ctx->inflater_reset = is_server ?
+    params->client_no_context_takeover : params->server_no_context_takeover;
+
+  ctx->threshold = params->threshold;
+
+  ctx->in_buf = g_string_sized_new (DEFLATE_BLOCK_SIZE);
+  ctx->out_buf = g_string_sized_new (DEFLATE_BLOCK_SIZE);
+
+  return ctx;
+}
+
+static void
+deflate_free (EvdWebsocketDeflate *ctx)
+{
+  deflateEnd (&ctx->deflater);
+  inflateEnd (&ctx->inflater);
+
+  g_string_free (ctx->in_buf, TRUE);
+  g_string_free (ctx->out_buf, TRUE);
+
+  g_slice_free (EvdWebsocketDeflate, ctx);
+}
+
+static gboolean
+deflate_message (EvdWebsocketDeflate *ctx,
+                 const gchar         *payload,
+                 gsize                payload_len)
+{
+  z_stream *z = &ctx->deflater;
+  GString *buf = ctx->out_buf;
+
+  g_string_set_size (buf, 0);
+
+  z->next_in = (Bytef *) payload;
+  z->avail_in = payload_len;
+
+  do
+    {
+      gsize used = buf->len;
+      gint ret;
+
+      g_string_set_size (buf, used + DEFLATE_BLOCK_SIZE);
+
+      z->next_out = (Bytef *) buf->str + used;
+      z->avail_out = DEFLATE_BLOCK_SIZE;
+
+      ret = deflate (z, Z_SYNC_FLUSH);
+
+      g_string_set_size (buf, used + DEFLATE_BLOCK_SIZE - z->avail_out);
+
+      if (ret != Z_OK && ret != Z_BUF_ERROR)
+        return FALSE;
+    }
+  while (z->avail_out == 0);
+
+  if (buf->len >= 4 && memcmp (buf->str + buf->len - 4, DEFLATE_TAIL, 4) == 0)
+    g_string_truncate (buf, buf->len - 4);
+
+  if (ctx->deflater_reset)
+    deflateReset (z);
+
+  return TRUE;
+}
+
+static gboolean
+inflate_block (EvdWebsocketDeflate  *ctx,
+               const gchar          *data,
+               gsize                 data_len,
+               GError              **error)
+{
+  z_stream *z = &ctx->inflater;
+  GString *buf = ctx->in_buf;
+
+  z->next_in = (Bytef *) data;
+  z->avail_in = data_len;
+
+  do
+    {
+      gsize used = buf->len;
+      gint ret;
+
+      g_string_set_size (buf, used + DEFLATE_BLOCK_SIZE);
+
+      z->next_out = (Bytef *) buf->str + used;
+      z->avail_out = DEFLATE_BLOCK_SIZE;
+
+      ret = inflate (z, Z_SYNC_FLUSH);
+
+      g_string_set_size (buf, used + DEFLATE_BLOCK_SIZE - z->avail_out);
+
+      if (ret == Z_STREAM_END)
+        {
+          /* the peer closed the deflate stream, what follows is ignored */
+          inflateReset (z);
+          break;
+        }
+      else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_INVALID_DATA,
+                       "Failed to inflate compressed message");
+          return FALSE;
+        }
+
+      /* protect against decompression bombs */
+      if (buf->len > MAX_PAYLOAD_SIZE)
+        {
+          g_set_error (error,
+                       G_IO_ERROR,
+                       G_IO_ERROR_MESSAGE_TOO_LARGE,
+                       "Inflated message exceeds the maximum payload size");
+          return FALSE;
+        }
+
+      if (ret == Z_BUF_ERROR)
+        break;
+    }
+  while (z->avail_in > 0 || z->avail_out == 0);
+
+  return TRUE;
+}
+
+static gboolean
+inflate_message (EvdWebsocketDeflate  *ctx,
+                 const gchar          *payload,
+                 gsize                 payload_len,
+                 GError              **error)
+{
+  g_string_set_size (ctx->in_buf, 0);
+
+  if (! inflate_block (ctx, payload, payload_len, error) ||
+      ! inflate_block (ctx, DEFLATE_TAIL, 4, error))
+    {
+      inflateReset (&ctx->inflater);
+      return FALSE;
+    }
+
+  if (ctx->inflater_reset)
+    inflateReset (&ctx->inflater);
+
+  return TRUE;
 }
 
 static void
 build_frame (GString     *frame,
              gboolean     fin,
              guint8       opcode,
+             gboolean     compressed,
              gboolean     masked,
              const gchar *payload,
              gsize        payload_len)
@@ -153,6 +621,7 @@ build_frame (GString     *frame,
   payload_len_len = 0;
 
   header = fin ? HEADER_MASK_FIN : 0;
+  header |= compressed ? HEADER_MASK_RSV1 : 0;
   header |= opcode << 8;
   header |= masked ? HEADER_MASK_MASKED : 0;
 
@@ -174,8 +643,8 @@ build_frame (GString     *frame,
     }
 
   g_string_set_size (frame, frame->len + 2);
-  frame->str[0] = (gchar) ((header & 0xFF00) >> 8);
-  frame->str[1] = (gchar) (header & 0x00FF);
+  frame->str[frame->len - 2] = (gchar) ((header & 0xFF00) >> 8);
+  frame->str[frame->len - 1] = (gchar) (header & 0x00FF);
 
   if (payload_len_len > 0)
     g_string_append_len (frame,
@@ -194,9 +663,9 @@ build_frame (GString     *frame,
 
   if (masked)
     {
-      apply_masking (frame->str + (frame->len - payload_len),
-                     payload_len,
-                     (guint8 *) &masking_key);
+      evd_websocket_protocol_apply_masking (frame->str + (frame->len - payload_len),
+                                            payload_len,
+                                            (guint8 *) &masking_key);
     }
 }
 
@@ -210,6 +679,11 @@ send_close_frame (EvdWebsocketData  *data,
   GString *frame;
   GOutputStream *stream;
 
+  /* frames held by a cork go out before the close frame */
+  data->corked = FALSE;
+  if (! flush_cork (data, error))
+    return FALSE;
+
   /* @TODO: send the code and reason. By now send no payload */
   data->frame_data = NULL;
   data->frame_len = 0;
@@ -218,6 +692,7 @@ send_close_frame (EvdWebsocketData  *data,
   build_frame (frame,
                TRUE,
                OPCODE_CLOSE,
+               FALSE,
                (! data->server),
                data->frame_data,
                data->frame_len);
@@ -237,31 +712,24 @@ send_close_frame (EvdWebsocketData  *data,
   return result;
 }
 
-static gboolean
-send_data_frame (EvdWebsocketData  *data,
-                 const gchar       *frame,
-                 gsize              frame_len,
-                 EvdMessageType     frame_type,
-                 GError           **error)
+static void
+build_message (GString        *msg,
+               const gchar    *frame,
+               gsize           frame_len,
+               EvdMessageType  frame_type,
+               gboolean        compressed,
+               gboolean        masked)
 {
   gsize bytes_sent;
   gsize bytes_left;
-  GString *frag;
-  GOutputStream *stream;
-  gboolean result = TRUE;
-
-  frag = g_string_new ("");
-
-  stream = g_io_stream_get_output_stream (G_IO_STREAM (data->conn));
 
   bytes_sent = 0;
   bytes_left = frame_len;
-  while (bytes_left > 0)
+  do
     {
       gsize frag_len;
       gboolean fin;
       guint8 opcode;
-      gboolean masked;
 
       frag_len = MIN (MAX_FRAGMENT_SIZE, bytes_left);
 
@@ -271,36 +739,145 @@ send_data_frame (EvdWebsocketData  *data,
         (frame_type == EVD_MESSAGE_TYPE_TEXT ? OPCODE_TEXT_FRAME : OPCODE_BINARY_FRAME) :
         OPCODE_CONTINUATION;
 
-      masked = ! data->server;
-
-      build_frame (frag,
+      /* only the first fragment of a message carries the RSV1 bit */
+      build_frame (msg,
                    fin,
                    opcode,
+                   compressed && bytes_sent == 0,
                    masked,
                    frame + bytes_sent,
                    frag_len);
 
-      if (! g_output_stream_write (stream,
-                                   frag->str,
-                                   frag->len,
-                                   NULL,
-                                   error) < 0)
-        {
-          result = FALSE;
-          break;
-        }
-
       bytes_sent += frag_len;
       bytes_left -= frag_len;
+    }
+  while (bytes_left > 0);
+}
+
+static gboolean
+flush_cork (EvdWebsocketData *data, GError **error)
+{
+  GOutputStream *stream;
+  gboolean result;
+
+  if (data->cork_buf == NULL || data->cork_buf->len == 0)
+    return TRUE;
+
+  stream = g_io_stream_get_output_stream (G_IO_STREAM (data->conn));
+
+  result = g_output_stream_write (stream,
+                                  data->cork_buf->str,
+                                  data->cork_buf->len,
+                                  NULL,
+                                  error) >= 0;
+
+  g_string_truncate (data->cork_buf, 0);
+
+  return result;
+}
+
+static gboolean
+write_message (EvdWebsocketData  *data,
+               const gchar       *msg,
+               gsize              msg_len,
+               GError           **error)
+{
+  GOutputStream *stream;
+
+  if (data->corked)
+    {
+      g_string_append_len (data->cork_buf, msg, msg_len);
+
+      if (data->cork_buf->len >= MAX_CORK_SIZE)
+        return flush_cork (data, error);
+      else
+        return TRUE;
+    }
+
+  stream = g_io_stream_get_output_stream (G_IO_STREAM (data->conn));
+
+  return g_output_stream_write (stream, msg, msg_len, NULL, error) >= 0;
+}
 
-      g_string_set_size (frag, 0);
+static gboolean
+send_data_frame (EvdWebsocketData  *data,
+                 const gchar       *frame,
+                 gsize              frame_len,
+                 EvdMessageType     frame_type,
+                 GError           **error)
+{
+  GString *msg;
+  gboolean result;
+  gboolean compressed = FALSE;
+
+  /* compress the whole message, then fragment it */
+  if (data->deflate != NULL &&
+      frame_len >= data->deflate->threshold &&
+      frame_len <= G_MAXUINT)
+    {
+      if (deflate_message (data->deflate, frame, frame_len))
+        {
+          frame = data->deflate->out_buf->str;
+          frame_len = data->deflate->out_buf->len;
+          compressed = TRUE;
+        }
     }
 
-  g_string_free (frag, TRUE);
+  /* a corked connection gets the frames built right into its buffer */
+  if (data->corked)
+    {
+      build_message (data->cork_buf,
+                     frame,
+                     frame_len,
+                     frame_type,
+                     compressed,
+                     ! data->server);
+
+      if (data->cork_buf->len >= MAX_CORK_SIZE)
+        return flush_cork (data, error);
+      else
+        return TRUE;
+    }
+
+  msg = g_string_sized_new (frame_len + 14);
+  build_message (msg, frame, frame_len, frame_type, compressed, ! data->server);
+
+  result = write_message (data, msg->str, msg->len, error);
+
+  g_string_free (msg, TRUE);
 
   return result;
 }
 
+static EvdWebsocketData *
+get_open_websocket_data (EvdHttpConnection  *conn,
+                         GError            **error)
+{
+  EvdWebsocketData *data;
+
+  data = g_object_get_data (G_OBJECT (conn), EVD_WEBSOCKET_DATA_KEY);
+  if (data == NULL)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_INITIALIZED,
+                   "Given HTTP connection doesn't appear to be initialized for Websocket");
+      return NULL;
+    }
+
+  if (data->state == EVD_WEBSOCKET_STATE_CLOSING ||
+      data->state == EVD_WEBSOCKET_STATE_CLOSED)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_CLOSED,
+                   "Websocket connection is closed");
+      return NULL;
+    }
+
+  return data;
+}
+
 static gboolean
 handle_control_frame (EvdWebsocketData *data)
 {
@@ -323,6 +900,96 @@ handle_control_frame (EvdWebsocketData *data)
   return TRUE;
 }
 
+static gboolean
+fail_connection (EvdWebsocketData *data, const gchar *reason)
+{
+  g_warning ("Error, %s", reason);
+
+  data->state = EVD_WEBSOCKET_STATE_CLOSED;
+  g_io_stream_close (G_IO_STREAM (data->conn), NULL, NULL);
+
+  return FALSE;
+}
+
+static gboolean
+handle_data_frame (EvdWebsocketData *data)
+{
+  const gchar *payload;
+  gsize payload_len;
+  guint8 opcode;
+  gboolean compressed;
+
+  if (data->opcode == OPCODE_CONTINUATION && ! data->fragmented)
+    return fail_connection (data, "received a continuation frame out of a message");
+
+  if (data->opcode != OPCODE_CONTINUATION && data->fragmented)
+    return fail_connection (data, "received a new message before the previous one finished");
+
+  if (data->fin && ! data->fragmented)
+    {
+      /* the common case: a whole message in a single frame, delivered
+         straight from the read buffer */
+      payload = data->frame_data;
+      payload_len = data->frame_len;
+      opcode = data->opcode;
+      compressed = data->compressed;
+    }
+  else
+    {
+      /* fragments are the only case where payload is copied */
+      if (! data->fragmented)
+        {
+          data->fragmented = TRUE;
+          data->msg_opcode = data->opcode;
+          data->msg_compressed = data->compressed;
+
+          if (data->msg == NULL)
+            data->msg = g_string_sized_new (data->frame_len);
+          else
+            g_string_set_size (data->msg, 0);
+        }
+
+      if (data->msg->len + data->frame_len > MAX_PAYLOAD_SIZE)
+        return fail_connection (data, "fragmented message exceeds the maximum payload size");
+
+      g_string_append_len (data->msg, data->frame_data, data->frame_len);
+
+      if (! data->fin)
+        return TRUE;
+
+      data->fragmented = FALSE;
+
+      payload = data->msg->str;
+      payload_len = data->msg->len;
+      opcode = data->msg_opcode;
+      compressed = data->msg_compressed;
+    }
+
+  if (compressed)
+    {
+      GError *error = NULL;
+
+      if (! inflate_message (data->deflate, payload, payload_len, &error))
+        {
+          fail_connection (data, error->message);
+          g_error_free (error);
+
+          return FALSE;
+        }
+
+      payload = data->deflate->in_buf->str;
+      payload_len = data->deflate->in_buf->len;
+    }
+
+  data->frame_cb (EVD_HTTP_CONNECTION (data->conn),
+                  payload,
+                  payload_len,
+                  opcode == OPCODE_BINARY_FRAME,
+                  data->user_data);
+
+  return TRUE;
+}
+
 static gboolean
 read_payload (EvdWebsocketData *data)
 {
@@ -334,44 +1001,27 @@ read_payload (EvdWebsocketData *data)
   data->frame_len = data->payload_len - data->extension_len;
   data->frame_data = data->buf->str + data->offset + data->extension_len;
 
+  /* unmask in place */
   if (data->masked)
-    apply_masking (data->frame_data, data->frame_len, data->masking_key);
+    evd_websocket_protocol_apply_masking (data->frame_data,
+                                          data->frame_len,
+                                          data->masking_key);
 
   if (data->opcode >= OPCODE_CLOSE)
     {
-      /* control frame */
+      /* control frame, may come in between the fragments of a message */
       handle_control_frame (data);
     }
-  else
+  else if (! handle_data_frame (data))
     {
-      /* data frame */
-
-      if (data->fin)
-        {
-          data->frame_cb (EVD_HTTP_CONNECTION (data->conn),
-                          data->frame_data,
-                          data->frame_len,
-                          data->opcode == OPCODE_BINARY_FRAME,
-                          data->user_data);
-        }
-      else
-        {
-          /* @TODO: handle fragmented frames */
-          g_warning ("Error, receiving fragmented frames is not yet implemented"
-                     " in websocket version 08");
-          data->state = EVD_WEBSOCKET_STATE_CLOSED;
-          g_io_stream_close (G_IO_STREAM (data->conn), NULL, NULL);
-        }
+      return FALSE;
     }
 
-  /* reset state */
+  /* reset state. Consumed bytes are dropped from the buffer only before
+     the next read, so consecutive frames are not moved around */
   data->offset += data->payload_len;
   data->reading_state = EVD_WEBSOCKET_READING_STATE_IDLE;
 
-  g_string_erase (data->buf, 0, data->offset);
-  data->buf_len -= data->offset;
-  data->offset = 0;
-
   return TRUE;
 }
 
@@ -420,7 +1070,8 @@ read_payload_len (EvdWebsocketData *data)
       data->payload_len = (gsize) GUINT64_FROM_BE(len);
     }
 
-  /* @TODO: validated payload length against MAX_PAYLOAD_SIZE */
+  if (data->payload_len > MAX_PAYLOAD_SIZE)
+    return fail_connection (data, "frame exceeds the maximum payload size");
 
   if (data->masked)
     data->reading_state = EVD_WEBSOCKET_READING_STATE_MASKING_KEY;
@@ -446,6 +1097,10 @@ read_header (EvdWebsocketData *data)
   /* fin flag */
   data->fin = (guint16) (header & HEADER_MASK_FIN);
 
+  /* compressed flag, only valid if permessage-deflate was negotiated, and
+     never on control frames */
+  data->compressed = (guint16) (header & HEADER_MASK_RSV1);
+
   /* opcode */
   data->opcode = (guint8) ((header & HEADER_MASK_OPCODE) >> 8);
 
@@ -455,6 +1110,16 @@ read_header (EvdWebsocketData *data)
   /* payload len */
   data->payload_len = header & HEADER_MASK_PAYLOAD_LEN;
 
+  if (data->compressed &&
+      (data->deflate == NULL ||
+       data->opcode == OPCODE_CONTINUATION ||
+       data->opcode >= OPCODE_CLOSE))
+    {
+      return fail_connection (data,
+                              "received a compressed frame without permessage-deflate"
+                              " negotiated, or a compressed continuation or control frame");
+    }
+
   /* @TODO: validate header values */
 
   if (data->payload_len > 125)
@@ -470,28 +1135,32 @@ read_header (EvdWebsocketData *data)
 static gboolean
 process_data (EvdWebsocketData *data)
 {
-  while (data->offset < data->buf_len &&
+  /* a frame with an empty payload completes without further data */
+  while ((data->offset < data->buf_len ||
+          data->reading_state == EVD_WEBSOCKET_READING_STATE_PAYLOAD) &&
          data->state != EVD_WEBSOCKET_STATE_CLOSED)
     {
+      /* readers return FALSE either when they need more data, or when
+         the connection was closed due to an error */
       if (data->reading_state == EVD_WEBSOCKET_READING_STATE_IDLE)
         if (! read_header (data))
-          return TRUE;
+          return data->state != EVD_WEBSOCKET_STATE_CLOSED;
 
       switch (data->reading_state)
         {
         case EVD_WEBSOCKET_READING_STATE_PAYLOAD_LEN:
           if (! read_payload_len (data))
-            return TRUE;
+            return data->state != EVD_WEBSOCKET_STATE_CLOSED;
           break;
 
         case EVD_WEBSOCKET_READING_STATE_MASKING_KEY:
           if (! read_masking_key (data))
-            return TRUE;
+            return data->state != EVD_WEBSOCKET_STATE_CLOSED;
           break;
 
         case EVD_WEBSOCKET_READING_STATE_PAYLOAD:
           if (! read_payload (data))
-            return TRUE;
+            return data->state != EVD_WEBSOCKET_STATE_CLOSED;
           break;
 
         default:
@@ -547,18 +1216,41 @@ static void
 read_from_connection (EvdWebsocketData *data)
 {
   GInputStream *stream;
+  gsize block_size = BLOCK_SIZE;
 
   g_return_if_fail (data != NULL);
 
-  if (data->buf_len + BLOCK_SIZE >= data->buf->len)
-    g_string_set_size (data->buf, data->buf_len + BLOCK_SIZE);
+  /* drop the bytes already processed. Only the beginning of a frame that
+     spans several reads (if any) needs to be moved */
+  if (data->offset > 0)
+    {
+      if (data->offset < data->buf_len)
+        memmove (data->buf->str,
+                 data->buf->str + data->offset,
+                 data->buf_len - data->offset);
+
+      data->buf_len -= data->offset;
+      data->offset = 0;
+    }
+
+  /* when the size of the payload being read is known, ask for more of it
+     at once. The size is what the peer claims, so each read is capped and
+     the buffer only grows as the bytes actually arrive */
+  if (data->reading_state == EVD_WEBSOCKET_READING_STATE_PAYLOAD &&
+      data->payload_len > data->buf_len)
+    block_size = CLAMP (data->payload_len - data->buf_len,
+                        BLOCK_SIZE,
+                        MAX_READ_SIZE);
+
+  if (data->buf_len + block_size >= data->buf->len)
+    g_string_set_size (data->buf, data->buf_len + block_size);
 
   stream = g_io_stream_get_input_stream (G_IO_STREAM (data->conn));
 
   g_object_ref (data->conn);
   g_input_stream_read_async (stream,
                              data->buf->str + data->buf_len,
-                             BLOCK_SIZE,
+                             block_size,
                              G_PRIORITY_DEFAULT,
                              NULL,
                              on_connection_read,
@@ -650,13 +1342,23 @@ free_websocket_connection_data (EvdWebsocketData *data)
 
   g_free (data->close_reason);
 
+  if (data->deflate != NULL)
+    deflate_free (data->deflate);
+
+  if (data->msg != NULL)
+    g_string_free (data->msg, TRUE);
+
+  if (data->cork_buf != NULL)
+    g_string_free (data->cork_buf, TRUE);
+
   g_slice_free (EvdWebsocketData, data);
 }
 
 static void
-setup_connection (EvdHttpConnection *conn,
-                  gboolean           is_server,
-                  EvdWebsocketState  state)
+setup_connection (EvdHttpConnection               *conn,
+                  gboolean                         is_server,
+                  EvdWebsocketState                state,
+                  const EvdWebsocketDeflateParams *deflate)
 {
   EvdWebsocketData *data;
 
@@ -667,6 +1369,9 @@ setup_connection (EvdHttpConnection *conn,
   data->state = state;
   data->reading_state = EVD_WEBSOCKET_READING_STATE_IDLE;
 
+  if (deflate != NULL)
+    data->deflate = deflate_new (deflate, is_server);
+
   g_object_set_data_full (G_OBJECT (conn),
                           EVD_WEBSOCKET_DATA_KEY,
                           data,
@@ -743,12 +1448,144 @@ on_connection_flushed (GObject      *obj,
   g_object_unref (obj);
 }
 
+static gboolean
+accept_deflate_offer (const EvdWebsocketDeflateParams *config,
+                      const EvdWebsocketDeflateOffer  *offer,
+                      EvdWebsocketDeflateParams       *result,
+                      gchar                          **response)
+{
+  *result = *config;
+
+  /* we cannot compress with a window smaller than 9 bits */
+  if (offer->server_max_window_bits > 0)
+    {
+      if (offer->server_max_window_bits < 9)
+        return FALSE;
+
+      result->server_max_window_bits = MIN (config->server_max_window_bits,
+                                            offer->server_max_window_bits);
+    }
+
+  /* the client's window can only be limited if it supports it */
+  if (offer->client_max_window_bits >= 0)
+    {
+      guint8 offered;
+
+      offered = offer->client_max_window_bits > 0 ?
+        offer->client_max_window_bits : 15;
+
+      result->client_max_window_bits = MIN (config->client_max_window_bits,
+                                            offered);
+    }
+  else
+    {
+      result->client_max_window_bits = 15;
+    }
+
+  result->server_no_context_takeover =
+    config->server_no_context_takeover || offer->server_no_context_takeover;
+  result->client_no_context_takeover =
+    config->client_no_context_takeover || offer->client_no_context_takeover;
+
+  *response = build_deflate_extension (result,
+                                       result->client_max_window_bits < 15);
+
+  return TRUE;
+}
+
+static gboolean
+negotiate_deflate_response (const EvdWebsocketDeflateParams  *config,
+                            SoupMessageHeaders               *headers,
+                            EvdWebsocketDeflateParams        *result,
+                            gboolean                         *accepted,
+                            GError                          **error)
+{
+  const gchar *header;
+  GSList *extensions;
+  EvdWebsocketDeflateOffer response;
+  gboolean valid;
+
+  *accepted = FALSE;
+
+  header = soup_message_headers_get_list (headers, "Sec-WebSocket-Extensions");
+  if (header == NULL)
+    return TRUE;
+
+  /* only permessage-deflate is ever offered, and at most once */
+  extensions = soup_header_parse_list (header);
+  valid = config != NULL &&
+    extensions != NULL &&
+    extensions->next == NULL &&
+    parse_deflate_extension (extensions->data, &response);
+  soup_header_free_list (extensions);
+
+  if (! valid)
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_INVALID_DATA,
+                   "Received unexpected or invalid 'Sec-WebSocket-Extensions' header");
+      return FALSE;
+    }
+
+  *result = *config;
+
+  /* server's window, only affects our inflater */
+  if (response.server_max_window_bits > 0)
+    result->server_max_window_bits = response.server_max_window_bits;
+  else
+    result->server_max_window_bits = 15;
+
+  /* client's window, we must honor it */
+  if (response.client_max_window_bits == 0 ||
+      (response.client_max_window_bits > 0 &&
+       response.client_max_window_bits < 9))
+    {
+      g_set_error (error,
+                   G_IO_ERROR,
+                   G_IO_ERROR_NOT_SUPPORTED,
+                   "Unsupported 'client_max_window_bits' in permessage-deflate response");
+      return FALSE;
+    }
+  else if (response.client_max_window_bits > 0)
+    {
+      result->client_max_window_bits = MIN (config->client_max_window_bits,
+                                            response.client_max_window_bits);
+    }
+
+  result->server_no_context_takeover = response.server_no_context_takeover;
+  result->client_no_context_takeover =
+    config->client_no_context_takeover || response.client_no_context_takeover;
+
+  *accepted = TRUE;
+
+  return TRUE;
+}
+
 /* public methods */
 
 gboolean
 evd_websocket_protocol_handle_handshake_request (EvdHttpConnection  *conn,
                                                  EvdHttpRequest     *request,
                                                  GError            **error)
+{
+  return evd_websocket_protocol_handle_handshake_request_full (conn,
+                                                               request,
+                                                               NULL,
+                                                               error);
+}
+
+/**
+ * evd_websocket_protocol_handle_handshake_request_full:
+ * @deflate: (allow-none): The local permessage-deflate configuration, or
+ * %NULL to not accept the extension.
+ *
+ **/
+gboolean
+evd_websocket_protocol_handle_handshake_request_full (EvdHttpConnection                *conn,
+                                                      EvdHttpRequest                   *request,
+                                                      const EvdWebsocketDeflateParams  *deflate,
+                                                      GError                          **error)
 {
   guint8 version;
   gboolean result = FALSE;
@@ -774,6 +1611,9 @@ evd_websocket_protocol_handle_handshake_request (EvdHttpConnection  *conn,
   gchar *accept_key;
   const gchar *conn_header;
 
+  EvdWebsocketDeflateParams deflate_params;
+  gboolean deflate_accepted = FALSE;
+
   req_headers = evd_http_message_get_headers (EVD_HTTP_MESSAGE (request));
 
   conn_header = soup_message_headers_get_one (req_headers, "Connection");
@@ -810,6 +1650,46 @@ evd_websocket_protocol_handle_handshake_request (EvdHttpConnection  *conn,
 
   g_free (accept_key);
 
+  /* accept the first permessage-deflate offer we can satisfy, if any */
+  if (deflate != NULL)
+    {
+      const gchar *extensions_header;
+
+      extensions_header = soup_message_headers_get_list (req_headers,
+                                                         "Sec-WebSocket-Extensions");
+      if (extensions_header != NULL)
+        {
+          GSList *extensions;
+          GSList *node;
+
+          extensions = soup_header_parse_list (extensions_header);
+
+          for (node = extensions;
+               node != NULL && ! deflate_accepted;
+               node = node->next)
+            {
+              EvdWebsocketDeflateOffer offer;
+              gchar *response;
+
+              if (parse_deflate_extension (node->data, &offer) &&
+                  accept_deflate_offer (deflate,
+                                        &offer,
+                                        &deflate_params,
+                                        &response))
+                {
+                  soup_message_headers_replace (res_headers,
+                                                "Sec-WebSocket-Extensions",
+                                                response);
+                  g_free (response);
+
+                  deflate_accepted = TRUE;
+                }
+            }
+
+          soup_header_free_list (extensions);
+        }
+    }
+
   /* send handshake response headers */
   if (! evd_http_connection_write_response_headers (conn,
                                                     SOUP_HTTP_1_1,
@@ -822,7 +1702,10 @@ evd_websocket_protocol_handle_handshake_request (EvdHttpConnection  *conn,
     }
 
   /* success, setup the WebSocket connection */
-  setup_connection (conn, TRUE, EVD_WEBSOCKET_STATE_OPENED);
+  setup_connection (conn,
+                    TRUE,
+                    EVD_WEBSOCKET_STATE_OPENED,
+                    deflate_accepted ? &deflate_params : NULL);
 
   result = TRUE;
 
@@ -844,6 +1727,27 @@ evd_websocket_protocol_create_handshake_request (const gchar  *url,
                                                  const gchar  *sub_protocol,
                                                  const gchar  *origin,
                                                  gchar       **key_base64)
+{
+  return evd_websocket_protocol_create_handshake_request_full (url,
+                                                               sub_protocol,
+                                                               origin,
+                                                               NULL,
+                                                               key_base64);
+}
+
+/**
+ * evd_websocket_protocol_create_handshake_request_full:
+ * @deflate: (allow-none): The local permessage-deflate configuration to
+ * offer, or %NULL to not offer the extension.
+ *
+ * Returns: (transfer full):
+ **/
+EvdHttpRequest *
+evd_websocket_protocol_create_handshake_request_full (const gchar                      *url,
+                                                      const gchar                      *sub_protocol,
+                                                      const gchar                      *origin,
+                                                      const EvdWebsocketDeflateParams  *deflate,
+                                                      gchar                           **key_base64)
 {
   EvdHttpRequest *request;
   SoupMessageHeaders *headers;
@@ -881,6 +1785,15 @@ evd_websocket_protocol_create_handshake_request (const gchar  *url,
       key[i*4 + 3] = rnd       & 0xFF;
     }
 
+  if (deflate != NULL)
+    {
+      gchar *offer;
+
+      offer = build_deflate_extension (deflate, TRUE);
+      soup_message_headers_replace (headers, "Sec-WebSocket-Extensions", offer);
+      g_free (offer);
+    }
+
   key_b64 = g_base64_encode (key, 16);
   soup_message_headers_replace (headers, "Sec-WebSocket-Key", key_b64);
 
@@ -899,10 +1812,36 @@ evd_websocket_protocol_handle_handshake_response (EvdHttpConnection   *conn,
                                                   SoupMessageHeaders  *headers,
                                                   const gchar         *handshake_key,
                                                   GError             **error)
+{
+  return evd_websocket_protocol_handle_handshake_response_full (conn,
+                                                                http_version,
+                                                                status_code,
+                                                                headers,
+                                                                handshake_key,
+                                                                NULL,
+                                                                error);
+}
+
+/**
+ * evd_websocket_protocol_handle_handshake_response_full:
+ * @deflate: (allow-none): The permessage-deflate configuration that was
+ * offered, or %NULL if none was.
+ *
+ **/
+gboolean
+evd_websocket_protocol_handle_handshake_response_full (EvdHttpConnection                *conn,
+                                                       SoupHTTPVersion                   http_version,
+                                                       guint                             status_code,
+                                                       SoupMessageHeaders               *headers,
+                                                       const gchar                      *handshake_key,
+                                                       const EvdWebsocketDeflateParams  *deflate,
+                                                       GError                          **error)
 {
   const gchar *accept_key;
   gchar *expected_accept_key;
   gboolean result = TRUE;
+  EvdWebsocketDeflateParams deflate_params;
+  gboolean deflate_accepted;
 
   g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), FALSE);
 
@@ -944,10 +1883,21 @@ evd_websocket_protocol_handle_handshake_response (EvdHttpConnection   *conn,
                    "Received invalid accept key");
       result = FALSE;
     }
+  else if (! negotiate_deflate_response (deflate,
+                                          headers,
+                                          &deflate_params,
+                                          &deflate_accepted,
+                                          error))
+    {
+      result = FALSE;
+    }
   else
     {
       /* setup websocket data on connection */
-      setup_connection (conn, FALSE, EVD_WEBSOCKET_STATE_OPENED);
+      setup_connection (conn,
+                        FALSE,
+                        EVD_WEBSOCKET_STATE_OPENED,
+                        deflate_accepted ? &deflate_params : NULL);
     }
 
   g_free (expected_accept_key);
@@ -1093,27 +2043,148 @@ evd_websocket_protocol_send (EvdHttpConnection  *conn,
   g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), FALSE);
   g_return_val_if_fail (frame != NULL, FALSE);
 
-  data = g_object_get_data (G_OBJECT (conn), EVD_WEBSOCKET_DATA_KEY);
+  data = get_open_websocket_data (conn, error);
   if (data == NULL)
+    return FALSE;
+
+  return send_data_frame (data, frame, frame_len, frame_type, error);
+}
+
+/**
+ * evd_websocket_protocol_encode_message:
+ * @frame: (array length=frame_len) (element-type guint8):
+ * @encoded_len: (out):
+ *
+ * Builds the unmasked and uncompressed frames that a server sends to carry
+ * @frame. The result can be written to any number of server connections with
+ * evd_websocket_protocol_send_encoded(), to avoid encoding the same message
+ * once per connection when broadcasting.
+ *
+ * Returns: (transfer full): The encoded message. Free with g_free().
+ **/
+gchar *
+evd_websocket_protocol_encode_message (const gchar    *frame,
+                                       gsize           frame_len,
+                                       EvdMessageType  frame_type,
+                                       gsize          *encoded_len)
+{
+  GString *msg;
+
+  g_return_val_if_fail (frame != NULL, NULL);
+  g_return_val_if_fail (encoded_len != NULL, NULL);
+
+  msg = g_string_sized_new (frame_len + 14);
+  build_message (msg, frame, frame_len, frame_type, FALSE, FALSE);
+
+  *encoded_len = msg->len;
+
+  return g_string_free (msg, FALSE);
+}
+
+/**
+ * evd_websocket_protocol_send_encoded:
+ * @encoded: (array length=encoded_len) (element-type guint8):
+ * @frame: (array length=frame_len) (element-type guint8):
+ *
+ * Sends a message previously encoded with
+ * evd_websocket_protocol_encode_message(). Client connections, which have to
+ * mask every frame, and connections that compress @frame using
+ * permessage-deflate cannot use the shared encoding, so @frame is encoded
+ * again for them as evd_websocket_protocol_send() does.
+ *
+ * Returns:
+ **/
+gboolean
+evd_websocket_protocol_send_encoded (EvdHttpConnection  *conn,
+                                     const gchar        *encoded,
+                                     gsize               encoded_len,
+                                     const gchar        *frame,
+                                     gsize               frame_len,
+                                     EvdMessageType      frame_type,
+                                     GError            **error)
+{
+  EvdWebsocketData *data;
+
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), FALSE);
+  g_return_val_if_fail (encoded != NULL, FALSE);
+  g_return_val_if_fail (frame != NULL, FALSE);
+
+  data = get_open_websocket_data (conn, error);
+  if (data == NULL)
+    return FALSE;
+
+  if (data->server &&
+      (data->deflate == NULL ||
+       frame_len < data->deflate->threshold ||
+       frame_len > G_MAXUINT))
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_NOT_INITIALIZED,
-                   "Given HTTP connection doesn't appear to be initialized for Websocket");
-      return FALSE;
+      return write_message (data, encoded, encoded_len, error);
     }
+  else
+    {
+      return send_data_frame (data, frame, frame_len, frame_type, error);
+    }
+}
 
-  if (data->state == EVD_WEBSOCKET_STATE_CLOSING ||
-      data->state == EVD_WEBSOCKET_STATE_CLOSED)
+/**
+ * evd_websocket_protocol_cork:
+ *
+ * Holds back the frames sent through @conn, so that several small messages
+ * can be written to the socket at once by a later call to
+ * evd_websocket_protocol_uncork(). Corked frames are also written when they
+ * grow too large, and before a close frame.
+ *
+ * Returns: %TRUE if @conn was corked, %FALSE on error
+ **/
+gboolean
+evd_websocket_protocol_cork (EvdHttpConnection  *conn,
+                             GError            **error)
+{
+  EvdWebsocketData *data;
+
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), FALSE);
+
+  data = get_open_websocket_data (conn, error);
+  if (data == NULL)
+    return FALSE;
+
+  if (data->cork_buf == NULL)
+    data->cork_buf = g_string_new ("");
+
+  data->corked = TRUE;
+
+  return TRUE;
+}
+
+/**
+ * evd_websocket_protocol_uncork:
+ *
+ * Writes the frames held back since evd_websocket_protocol_cork() was
+ * called, and lets following frames be written right away again.
+ *
+ * Returns: %TRUE on success, %FALSE on error
+ **/
+gboolean
+evd_websocket_protocol_uncork (EvdHttpConnection  *conn,
+                               GError            **error)
+{
+  EvdWebsocketData *data;
+
+  g_return_val_if_fail (EVD_IS_HTTP_CONNECTION (conn), FALSE);
+
+  data = g_object_get_data (G_OBJECT (conn), EVD_WEBSOCKET_DATA_KEY);
+  if (data == NULL || ! data->corked)
+    return TRUE;
+
+  data->corked = FALSE;
+
+  if (data->state != EVD_WEBSOCKET_STATE_OPENED)
     {
-      g_set_error (error,
-                   G_IO_ERROR,
-                   G_IO_ERROR_CLOSED,
-                   "Websocket connection is closed");
-      return FALSE;
+      g_string_truncate (data->cork_buf, 0);
+      return TRUE;
     }
 
-  return send_data_frame (data, frame, frame_len, frame_type, error);
+  return flush_cork (data, error);
 }
 
 EvdWebsocketState
@@ -1129,3 +2200,25 @@ evd_websocket_protocol_get_state (EvdHttpConnection *conn)
   else
     return data->state;
 }
+
+/**
+ * evd_websocket_protocol_apply_masking:
+ * @data: the payload to mask or unmask, in place
+ * @len: the length of @data
+ * @masking_key: the 4 bytes of the frame's masking key
+ *
+ * Applies the websocket masking algorithm to @data, using the widest
+ * vector instructions supported by the CPU. Since masking is a XOR,
+ * the same function unmasks a payload.
+ **/
+void
+evd_websocket_protocol_apply_masking (gchar        *data,
+                                      gsize         len,
+                                      const guint8  masking_key[4])
+{
+  guint32 key;
+
+  memcpy (&key, masking_key, 4);
+
+  get_mask_func () ((guint8 *) data, len, key);
+}
@@ -57,6 +57,20 @@ typedef enum
   EVD_WEBSOCKET_CLOSE_TLS_HANDSHAKE    = 1015
 } EvdWebsocketClose;
 
+/* permessage-deflate extension (RFC 7692) parameters. Used both as the
+   local configuration of an endpoint, and as the result of negotiating it */
+typedef struct
+{
+  guint8   server_max_window_bits;
+  guint8   client_max_window_bits;
+  gboolean server_no_context_takeover;
+  gboolean client_no_context_takeover;
+
+  /* local only, never negotiated */
+  guint8   mem_level;
+  gsize    threshold;
+} EvdWebsocketDeflateParams;
+
 typedef void (* EvdWebsocketFrameCb)         (EvdHttpConnection *conn,
                                               const gchar       *frame,
                                               gsize              frame_length,
@@ -70,11 +84,20 @@ typedef void (* EvdWebsocketCloseCb)         (EvdHttpConnection *conn,
 gboolean          evd_websocket_protocol_handle_handshake_request  (EvdHttpConnection  *conn,
                                                                     EvdHttpRequest     *request,
                                                                     GError            **error);
+gboolean          evd_websocket_protocol_handle_handshake_request_full (EvdHttpConnection                *conn,
+                                                                        EvdHttpRequest                   *request,
+                                                                        const EvdWebsocketDeflateParams  *deflate,
+                                                                        GError                          **error);
 
 EvdHttpRequest *  evd_websocket_protocol_create_handshake_request  (const gchar  *url,
                                                                     const gchar  *sub_protocol,
                                                                     const gchar  *origin,
                                                                     gchar       **key_base64);
+EvdHttpRequest *  evd_websocket_protocol_create_handshake_request_full (const gchar                      *url,
+                                                                        const gchar                      *sub_protocol,
+                                                                        const gchar                      *origin,
+                                                                        const EvdWebsocketDeflateParams  *deflate,
+                                                                        gchar                           **key_base64);
 
 gboolean          evd_websocket_protocol_handle_handshake_response (EvdHttpConnection   *conn,
                                                                     SoupHTTPVersion      http_version,
@@ -82,6 +105,13 @@ gboolean          evd_websocket_protocol_handle_handshake_response (EvdHttpConne
                                                                     SoupMessageHeaders  *headers,
                                                                     const gchar         *handshake_key,
                                                                     GError             **error);
+gboolean          evd_websocket_protocol_handle_handshake_response_full (EvdHttpConnection                *conn,
+                                                                         SoupHTTPVersion                   http_version,
+                                                                         guint                             status_code,
+                                                                         SoupMessageHeaders               *headers,
+                                                                         const gchar                      *handshake_key,
+                                                                         const EvdWebsocketDeflateParams  *deflate,
+                                                                         GError                          **error);
 
 void              evd_websocket_protocol_bind                      (EvdHttpConnection   *conn,
                                                                     EvdWebsocketFrameCb  frame_cb,
@@ -101,8 +131,29 @@ gboolean          evd_websocket_protocol_send                      (EvdHttpConne
                                                                     EvdMessageType      frame_type,
                                                                     GError            **error);
 
+gchar *           evd_websocket_protocol_encode_message            (const gchar    *frame,
+                                                                    gsize           frame_len,
+                                                                    EvdMessageType  frame_type,
+                                                                    gsize          *encoded_len);
+gboolean          evd_websocket_protocol_send_encoded              (EvdHttpConnection  *conn,
+                                                                    const gchar        *encoded,
+                                                                    gsize               encoded_len,
+                                                                    const gchar        *frame,
+                                                                    gsize               frame_len,
+                                                                    EvdMessageType      frame_type,
+                                                                    GError            **error);
+
+gboolean          evd_websocket_protocol_cork                      (EvdHttpConnection  *conn,
+                                                                    GError            **error);
+gboolean          evd_websocket_protocol_uncork                    (EvdHttpConnection  *conn,
+                                                                    GError            **error);
+
 EvdWebsocketState evd_websocket_protocol_get_state                 (EvdHttpConnection *conn);
 
+void              evd_websocket_protocol_apply_masking             (gchar        *data,
+                                                                    gsize         len,
+                                                                    const guint8  masking_key[4]);
+
 G_END_DECLS
 
 #endif /* __EVD_WEBSOCKET_PROTOCOL_H__ */
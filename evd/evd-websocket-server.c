@@ -26,6 +26,7 @@
 
 #include "evd-transport.h"
 #include "evd-websocket-protocol.h"
+#include "evd-utils.h"
 
 #define EVD_WEBSOCKET_SERVER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE ((obj), \
                                                EVD_TYPE_WEBSOCKET_SERVER, \
@@ -34,13 +35,28 @@
 #define CONN_DATA_KEY      "org.eventdance.lib.WebsocketServer.CONN_DATA"
 #define PEER_DATA_KEY      "org.eventdance.lib.WebsocketServer.PEER_DATA"
 #define HANDSHAKE_DATA_KEY "org.eventdance.lib.WebsocketServer.HANDSHAKE_DATA"
+#define UNCORK_DATA_KEY    "org.eventdance.lib.WebsocketServer.UNCORK_DATA"
 
 #define DEFAULT_STANDALONE TRUE
 
+#define DEFAULT_DEFLATE                     FALSE
+#define DEFAULT_DEFLATE_MAX_WINDOW_BITS     15
+#define DEFAULT_DEFLATE_NO_CONTEXT_TAKEOVER FALSE
+#define DEFAULT_DEFLATE_MEM_LEVEL           8
+#define DEFAULT_DEFLATE_THRESHOLD           128
+
+#define DEFAULT_COALESCING_DELAY -1
+#define MAX_COALESCING_DELAY     5
+
 struct _EvdWebsocketServerPrivate
 {
   gboolean standalone;
 
+  gboolean deflate_enabled;
+  EvdWebsocketDeflateParams deflate;
+
+  gint coalescing_delay;
+
   EvdHttpConnection *peer_arg_conn;
   EvdHttpRequest *peer_arg_request;
 };
@@ -71,6 +87,11 @@ static gboolean evd_websocket_server_send                 (EvdTransport    *tran
                                                            EvdMessageType   type,
                                                            GError         **error);
 
+static gboolean evd_websocket_server_broadcast            (EvdTransport  *transport,
+                                                           GList         *peers,
+                                                           EvdMessage    *message,
+                                                           GError       **error);
+
 static gboolean evd_websocket_server_peer_is_connected    (EvdTransport *transport,
                                                            EvdPeer      *peer);
 
@@ -111,6 +132,7 @@ static void
 evd_websocket_server_transport_iface_init (EvdTransportInterface *iface)
 {
   iface->send = evd_websocket_server_send;
+  iface->broadcast = evd_websocket_server_broadcast;
   iface->peer_is_connected = evd_websocket_server_peer_is_connected;
   iface->peer_closed = evd_websocket_server_peer_closed;
   iface->accept_peer = accept_peer;
@@ -128,6 +150,16 @@ evd_websocket_server_init (EvdWebsocketServer *self)
 
   priv->standalone = DEFAULT_STANDALONE;
 
+  priv->deflate_enabled = DEFAULT_DEFLATE;
+  priv->deflate.server_max_window_bits = DEFAULT_DEFLATE_MAX_WINDOW_BITS;
+  priv->deflate.client_max_window_bits = DEFAULT_DEFLATE_MAX_WINDOW_BITS;
+  priv->deflate.server_no_context_takeover = DEFAULT_DEFLATE_NO_CONTEXT_TAKEOVER;
+  priv->deflate.client_no_context_takeover = DEFAULT_DEFLATE_NO_CONTEXT_TAKEOVER;
+  priv->deflate.mem_level = DEFAULT_DEFLATE_MEM_LEVEL;
+  priv->deflate.threshold = DEFAULT_DEFLATE_THRESHOLD;
+
+  priv->coalescing_delay = DEFAULT_COALESCING_DELAY;
+
   evd_service_set_io_stream_type (EVD_SERVICE (self), EVD_TYPE_HTTP_CONNECTION);
 }
 
@@ -342,9 +374,10 @@ evd_websocket_server_request_handler (EvdWebService     *web_service,
     }
 
   /* let WebSocket protocol handle request */
-  if (! evd_websocket_protocol_handle_handshake_request (conn,
-                                                         request,
-                                                         &error))
+  if (! evd_websocket_protocol_handle_handshake_request_full (conn,
+                                  request,
+                                  self->priv->deflate_enabled ? &self->priv->deflate : NULL,
+                                  &error))
     {
       g_print ("%s\n", error->message);
       g_error_free (error);
@@ -421,6 +454,55 @@ evd_websocket_server_peer_is_connected (EvdTransport *transport, EvdPeer *peer)
   return (conn != NULL && ! g_io_stream_is_closed (G_IO_STREAM (conn)));
 }
 
+static gboolean
+uncork_connection (gpointer user_data)
+{
+  EvdHttpConnection *conn = EVD_HTTP_CONNECTION (user_data);
+  GError *error = NULL;
+
+  g_object_set_data (G_OBJECT (conn), UNCORK_DATA_KEY, NULL);
+
+  if (! g_io_stream_is_closed (G_IO_STREAM (conn)) &&
+      ! evd_websocket_protocol_uncork (conn, &error))
+    {
+      /* @TODO: do proper error logging */
+      g_print ("Error writing coalesced websocket frames: %s\n",
+               error->message);
+      g_error_free (error);
+
+      g_io_stream_close (G_IO_STREAM (conn), NULL, NULL);
+    }
+
+  g_object_unref (conn);
+
+  return FALSE;
+}
+
+/* holds back the frames sent through @conn until the coalescing delay
+   expires, so that all of them are written at once */
+static void
+cork_connection (EvdWebsocketServer *self, EvdHttpConnection *conn)
+{
+  guint src_id;
+
+  if (self->priv->coalescing_delay < 0 ||
+      g_object_get_data (G_OBJECT (conn), UNCORK_DATA_KEY) != NULL ||
+      ! evd_websocket_protocol_cork (conn, NULL))
+    {
+      return;
+    }
+
+  g_object_ref (conn);
+  src_id = evd_timeout_add (NULL,
+                            (guint) self->priv->coalescing_delay,
+                            G_PRIORITY_DEFAULT,
+                            uncork_connection,
+                            conn);
+  g_object_set_data (G_OBJECT (conn),
+                     UNCORK_DATA_KEY,
+                     GUINT_TO_POINTER (src_id));
+}
+
 static gboolean
 evd_websocket_server_send (EvdTransport    *transport,
                            EvdPeer         *peer,
@@ -442,10 +524,71 @@ evd_websocket_server_send (EvdTransport    *transport,
     }
   else
     {
+      cork_connection (EVD_WEBSOCKET_SERVER (transport), conn);
+
       return evd_websocket_protocol_send (conn, buffer, size, type, error);
     }
 }
 
+static gboolean
+evd_websocket_server_broadcast (EvdTransport  *transport,
+                                GList         *peers,
+                                EvdMessage    *message,
+                                GError       **error)
+{
+  const gchar *buffer;
+  gsize size;
+  EvdMessageType type;
+  gchar *encoded = NULL;
+  gsize encoded_len = 0;
+  GList *node;
+  gboolean result = TRUE;
+
+  buffer = evd_message_get_data (message, &size);
+  type = evd_message_get_message_type (message);
+
+  for (node = peers; node != NULL; node = node->next)
+    {
+      EvdPeer *peer = EVD_PEER (node->data);
+      EvdHttpConnection *conn;
+
+      conn = g_object_get_data (G_OBJECT (peer), PEER_DATA_KEY);
+      if (conn != NULL)
+        {
+          /* frames are built once, the first time a peer can take them */
+          if (encoded == NULL)
+            encoded = evd_websocket_protocol_encode_message (buffer,
+                                                             size,
+                                                             type,
+                                                             &encoded_len);
+
+          cork_connection (EVD_WEBSOCKET_SERVER (transport), conn);
+
+          if (evd_websocket_protocol_send_encoded (conn,
+                                                   encoded,
+                                                   encoded_len,
+                                                   buffer,
+                                                   size,
+                                                   type,
+                                                   NULL))
+            {
+              continue;
+            }
+        }
+
+      if (! evd_peer_push_shared_message (peer,
+                                          message,
+                                          result ? error : NULL))
+        {
+          result = FALSE;
+        }
+    }
+
+  g_free (encoded);
+
+  return result;
+}
+
 static gboolean
 evd_websocket_server_remove (EvdIoStreamGroup *io_stream_group,
                              GIOStream        *io_stream)
@@ -577,3 +720,95 @@ evd_websocket_server_get_validate_peer_arguments (EvdWebsocketServer  *self,
   if (request != NULL)
     *request = self->priv->peer_arg_request;
 }
+
+/**
+ * evd_websocket_server_set_deflate:
+ * @enabled: whether to negotiate the permessage-deflate extension
+ *
+ * Enables compression of messages with the permessage-deflate extension
+ * (RFC 7692), for connections accepted from now on. The server accepts the
+ * first valid permessage-deflate offer of each client, and connections of
+ * clients that offer none are left uncompressed. Disabled by default.
+ **/
+void
+evd_websocket_server_set_deflate (EvdWebsocketServer *self,
+                                 gboolean            enabled)
+{
+  g_return_if_fail (EVD_IS_WEBSOCKET_SERVER (self));
+
+  self->priv->deflate_enabled = enabled;
+}
+
+gboolean
+evd_websocket_server_get_deflate (EvdWebsocketServer *self)
+{
+  g_return_val_if_fail (EVD_IS_WEBSOCKET_SERVER (self), FALSE);
+
+  return self->priv->deflate_enabled;
+}
+
+/**
+ * evd_websocket_server_set_deflate_options:
+ * @max_window_bits: base-2 logarithm of the largest LZ77 window, between
+ * 9 and 15
+ * @no_context_takeover: whether to reset the compression contexts after
+ * each message
+ * @mem_level: zlib memory level of the compressor, between 1 and 9
+ * @threshold: size in bytes below which messages are sent uncompressed
+ *
+ * Tunes the permessage-deflate parameters the server answers with. The
+ * server compresses with a window of at most @max_window_bits, or smaller
+ * if the client asks for it, and limits the window of the client to
+ * @max_window_bits only if its offer allows it. If @no_context_takeover is
+ * %TRUE, the response asks both endpoints to reset their contexts after
+ * each message; otherwise they are only reset when the client asks for it.
+ * Smaller windows, no context takeover and lower memory levels reduce the
+ * memory used by each connection, at the cost of compression ratio.
+ **/
+void
+evd_websocket_server_set_deflate_options (EvdWebsocketServer *self,
+                                         guint8              max_window_bits,
+                                         gboolean            no_context_takeover,
+                                         guint8              mem_level,
+                                         gsize               threshold)
+{
+  g_return_if_fail (EVD_IS_WEBSOCKET_SERVER (self));
+  g_return_if_fail (max_window_bits >= 9 && max_window_bits <= 15);
+  g_return_if_fail (mem_level >= 1 && mem_level <= 9);
+
+  self->priv->deflate.server_max_window_bits = max_window_bits;
+  self->priv->deflate.client_max_window_bits = max_window_bits;
+  self->priv->deflate.server_no_context_takeover = no_context_takeover;
+  self->priv->deflate.client_no_context_takeover = no_context_takeover;
+  self->priv->deflate.mem_level = mem_level;
+  self->priv->deflate.threshold = threshold;
+}
+
+/**
+ * evd_websocket_server_set_coalescing_delay:
+ * @delay: milliseconds to hold messages back for, between 0 and 5, or -1
+ *
+ * Enables coalescing of the messages sent to each peer. The first message
+ * sent to a peer starts a window of @delay milliseconds, and every message
+ * sent to that peer within the window is written to the socket at once when
+ * it ends. A @delay of 0 makes the window last until the main loop finishes
+ * the current dispatch. This trades a little latency for fewer writes when
+ * peers receive bursts of small messages. -1, the default, disables it.
+ **/
+void
+evd_websocket_server_set_coalescing_delay (EvdWebsocketServer *self,
+                                           gint                delay)
+{
+  g_return_if_fail (EVD_IS_WEBSOCKET_SERVER (self));
+  g_return_if_fail (delay >= -1 && delay <= MAX_COALESCING_DELAY);
+
+  self->priv->coalescing_delay = delay;
+}
+
+gint
+evd_websocket_server_get_coalescing_delay (EvdWebsocketServer *self)
+{
+  g_return_val_if_fail (EVD_IS_WEBSOCKET_SERVER (self), -1);
+
+  return self->priv->coalescing_delay;
+}
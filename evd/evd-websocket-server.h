@@ -76,6 +76,19 @@ void                    evd_websocket_server_set_standalone              (EvdWeb
                                                                           gboolean            standalone);
 gboolean                evd_websocket_server_get_standalone              (EvdWebsocketServer *self);
 
+void                    evd_websocket_server_set_deflate                 (EvdWebsocketServer *self,
+                                                                          gboolean            enabled);
+gboolean                evd_websocket_server_get_deflate                 (EvdWebsocketServer *self);
+void                    evd_websocket_server_set_deflate_options         (EvdWebsocketServer *self,
+                                                                          guint8              max_window_bits,
+                                                                          gboolean            no_context_takeover,
+                                                                          guint8              mem_level,
+                                                                          gsize               threshold);
+
+void                    evd_websocket_server_set_coalescing_delay        (EvdWebsocketServer *self,
+                                                                          gint                delay);
+gint                    evd_websocket_server_get_coalescing_delay        (EvdWebsocketServer *self);
+
 void                    evd_websocket_server_get_validate_peer_arguments (EvdWebsocketServer  *self,
                                                                           EvdPeer             *peer,
                                                                           EvdHttpConnection  **conn,
@@ -45,9 +45,11 @@
 #include "evd-http-request.h"
 #include "evd-longpolling-server.h"
 #include "evd-websocket-server.h"
+#include "evd-sse-server.h"
 #include "evd-websocket-client.h"
 #include "evd-connection-pool.h"
 #include "evd-reproxy.h"
+#include "evd-peer-directory.h"
 #include "evd-web-selector.h"
 #include "evd-web-transport-server.h"
 #include "evd-web-dir.h"
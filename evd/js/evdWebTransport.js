@@ -116,12 +116,48 @@ Evd.Object.extend (Evd.Peer.prototype, {
 Evd.LongPolling = new Evd.Constructor ();
 Evd.LongPolling.prototype = new Evd.Object (Evd.LongPolling);
 
+Evd.Object.extend (Evd.LongPolling, {
+    TEXT_FRAMING: 1,
+    BINARY_FRAMING: 2,
+
+    // binary framing needs XHR2 and typed arrays
+    supportsBinaryFraming: function () {
+        return window["Uint8Array"] &&
+            "responseType" in new XMLHttpRequest ();
+    },
+
+    utf8Encode: function (str) {
+        if (window["TextEncoder"])
+            return new TextEncoder ().encode (str);
+
+        var st = unescape (encodeURIComponent (str));
+        var bytes = new Uint8Array (st.length);
+        for (var i=0; i<st.length; i++)
+            bytes[i] = st.charCodeAt (i);
+
+        return bytes;
+    },
+
+    utf8Decode: function (bytes) {
+        if (window["TextDecoder"])
+            return new TextDecoder ("utf-8").decode (bytes);
+
+        var st = "";
+        for (var i=0; i<bytes.length; i++)
+            st += String.fromCharCode (bytes[i]);
+
+        return decodeURIComponent (escape (st));
+    }
+});
+
 Evd.Object.extend (Evd.LongPolling.prototype, {
     PEER_DATA_KEY: "org.eventdance.lib.LongPolling",
 
     _init: function (args) {
         this._peerId = args.peerId;
+        this._getAck = args.getAck;
         this._onError = args.onError;
+        this._binary = args.framing == Evd.LongPolling.BINARY_FRAMING;
 
         this._nrReceivers = 1;
         this._nrSenders = 1;
@@ -170,7 +206,37 @@ Evd.Object.extend (Evd.LongPolling.prototype, {
         return [hdr_len, msg_len];
     },
 
+    _readBinaryFrames: function (data) {
+        var bytes = new Uint8Array (data);
+        var frames = [];
+        var pos = 0;
+
+        while (pos < bytes.length) {
+            // varint length, multiplying instead of shifting to support
+            // lengths beyond 32 bits
+            var msg_len = 0;
+            var mult = 1;
+            var b;
+            do {
+                b = bytes[pos++];
+                msg_len += (b & 0x7F) * mult;
+                mult *= 128;
+            } while (b & 0x80);
+
+            frames.push (Evd.LongPolling.utf8Decode (
+                bytes.subarray (pos, pos + msg_len)));
+            pos += msg_len;
+        }
+
+        return frames;
+    },
+
     _xhrOnLoad: function (data) {
+        if (this._binary) {
+            this._fireEvent ("receive", [this._readBinaryFrames (data), null]);
+            return;
+        }
+
         var hdr_len, msg_len, msg, t;
         var frames = [];
         while (data != "") {
@@ -231,7 +297,18 @@ Evd.Object.extend (Evd.LongPolling.prototype, {
                     self._fireEvent ("receive", [null, error]);
             }
             else {
-                var data = xhr.responseText.toString ();
+                var data;
+                if (self._binary && ! this._sender)
+                    data = this.response.byteLength > 0 ? this.response : null;
+                else
+                    data = xhr.responseText.toString ();
+
+                // received messages are processed before polling again,
+                // so that the next request acknowledges them
+                if (data)
+                    setTimeout (function () {
+                                    self._xhrOnLoad (data);
+                                }, 1);
 
                 if (this._sender)
                     self._fireEvent ("send", [true, null]);
@@ -239,11 +316,6 @@ Evd.Object.extend (Evd.LongPolling.prototype, {
                     setTimeout (function () {
                                     self._connect ();
                                 }, 1);
-
-                if (data)
-                    setTimeout (function () {
-                                    self._xhrOnLoad (data);
-                                }, 1);
             }
         };
 
@@ -258,7 +330,13 @@ Evd.Object.extend (Evd.LongPolling.prototype, {
     },
 
     _connectXhr: function (xhr) {
-        xhr.open ("GET", this._addr + "/receive?" + this._peerId, true);
+        var query = this._peerId;
+        if (this._getAck)
+            query += "&ack=" + this._getAck ();
+
+        xhr.open ("GET", this._addr + "/receive?" + query, true);
+        if (this._binary)
+            xhr.responseType = "arraybuffer";
 
         this._activeXhrs.push (xhr);
 
@@ -301,12 +379,47 @@ Evd.Object.extend (Evd.LongPolling.prototype, {
         return hdr_st + msg;
     },
 
+    _buildBinaryMsgs: function (msgs) {
+        var encoded = [];
+        var size = 0;
+        var i;
+
+        for (i in msgs) {
+            var bytes = Evd.LongPolling.utf8Encode (msgs[i]);
+            encoded.push (bytes);
+
+            // room for the longest varint
+            size += bytes.length + 10;
+        }
+
+        var buf = new Uint8Array (size);
+        var pos = 0;
+        for (i=0; i<encoded.length; i++) {
+            var len = encoded[i].length;
+            do {
+                var b = len % 128;
+                len = Math.floor (len / 128);
+                if (len > 0)
+                    b |= 0x80;
+                buf[pos++] = b;
+            } while (len > 0);
+
+            buf.set (encoded[i], pos);
+            pos += encoded[i].length;
+        }
+
+        return buf.subarray (0, pos);
+    },
+
     send: function (msgs) {
-        var buf = "";
-        var msg;
-        for (var i in msgs) {
-            msg = msgs[i];
-            buf += this._buildMsg (msg);
+        var buf;
+        if (this._binary) {
+            buf = this._buildBinaryMsgs (msgs);
+        }
+        else {
+            buf = "";
+            for (var i in msgs)
+                buf += this._buildMsg (msgs[i]);
         }
 
         var xhr = this._senders.shift ();
@@ -363,6 +476,7 @@ Evd.Object.extend (Evd.WebSocket.prototype, {
 
     _init: function (args) {
         this._peerId = args.peerId;
+        this._getAck = args.getAck;
     },
 
     open: function (address, callback) {
@@ -383,7 +497,11 @@ Evd.Object.extend (Evd.WebSocket.prototype, {
             this._onclose = null;
         }
 
-        this._ws = new WebSocket (this._addr + "?" + this._peerId);
+        var query = this._peerId;
+        if (this._getAck)
+            query += "&ack=" + this._getAck ();
+
+        this._ws = new WebSocket (this._addr + "?" + query);
         this._ws.onopen = function () {
             self._connected = true;
 
@@ -445,6 +563,162 @@ Evd.Object.extend (Evd.WebSocket.prototype, {
     }
 });
 
+// Evd.ServerSentEvents
+Evd.ServerSentEvents = new Evd.Constructor ();
+Evd.ServerSentEvents.prototype = new Evd.Object (Evd.ServerSentEvents);
+
+Evd.Object.extend (Evd.ServerSentEvents, {
+    // first character of an event's data
+    TEXT: "t",
+    TEXT_BASE64: "u",
+    BINARY: "b",
+
+    base64Decode: function (st) {
+        var bin = atob (st);
+        var bytes = new Uint8Array (bin.length);
+        for (var i=0; i<bin.length; i++)
+            bytes[i] = bin.charCodeAt (i);
+
+        return bytes;
+    }
+});
+
+Evd.Object.extend (Evd.ServerSentEvents.prototype, {
+
+    _init: function (args) {
+        this._peerId = args.peerId;
+        this._getAck = args.getAck;
+
+        this._opened = false;
+        this._connected = false;
+        this._sender = null;
+    },
+
+    _decode: function (data) {
+        var kind = data.charAt (0);
+        var content = data.substr (1);
+
+        if (kind == Evd.ServerSentEvents.TEXT_BASE64)
+            return Evd.LongPolling.utf8Decode (
+                Evd.ServerSentEvents.base64Decode (content));
+        else if (kind == Evd.ServerSentEvents.BINARY)
+            return Evd.ServerSentEvents.base64Decode (content).buffer;
+        else
+            return content;
+    },
+
+    _connect: function () {
+        var self = this;
+
+        if (this._es != null) {
+            this._es.onopen = null;
+            this._es.onmessage = null;
+            this._es.onerror = null;
+            this._es.close ();
+        }
+
+        var query = this._peerId;
+        if (this._getAck)
+            query += "&ack=" + this._getAck ();
+
+        this._es = new EventSource (this._addr + "/receive?" + query);
+
+        this._es.onopen = function () {
+            if (self._connected)
+                return;
+
+            self._connected = true;
+            self._fireEvent ("connect", [true, null]);
+        };
+
+        this._es.onmessage = function (e) {
+            self._fireEvent ("receive", [[self._decode (e.data)], null]);
+        };
+
+        // the browser would reconnect by itself, but acknowledging what
+        // was received before needs a new URL
+        this._es.onerror = function () {
+            if (! self._opened)
+                return;
+
+            self._es.close ();
+            self._es = null;
+            self._connected = false;
+
+            self._fireEvent ("disconnect", [false]);
+        };
+    },
+
+    open: function (address, callback) {
+        this._addr = address;
+        this._opened = true;
+
+        this._connect ();
+    },
+
+    canSend: function () {
+        return this._opened && this._connected && this._sender == null;
+    },
+
+    send: function (msgs) {
+        var self = this;
+
+        // browsers supporting EventSource also have typed arrays
+        var buf = Evd.LongPolling.prototype._buildBinaryMsgs (msgs);
+
+        var xhr = new XMLHttpRequest ();
+        xhr.onreadystatechange = function () {
+            if (this.readyState != 4)
+                return;
+
+            self._sender = null;
+
+            if (this.status == 200) {
+                self._fireEvent ("send", [true, null]);
+            }
+            else {
+                var error = new Error ("Server-sent events error " + this.status);
+                error.code = this.status;
+
+                self._fireEvent ("send", [false, error]);
+            }
+        };
+
+        this._sender = xhr;
+
+        xhr.open ("POST", this._addr + "/send?" + this._peerId, true);
+        xhr.send (buf);
+    },
+
+    reconnect: function () {
+        this._connect ();
+    },
+
+    close: function (gracefully) {
+        this._opened = false;
+        this._connected = false;
+
+        if (this._es) {
+            this._es.close ();
+            this._es = null;
+        }
+
+        if (this._sender) {
+            this._sender.abort ();
+            this._sender = null;
+        }
+
+        if (gracefully) {
+            // send a 'close' command
+            var xhr = new XMLHttpRequest ();
+            xhr.open ("POST", this._addr + "/close?" + this._peerId, false);
+            xhr.send ();
+        }
+
+        this._peerId = null;
+    }
+});
+
 // Evd.WebTransport
 Evd.WebTransport = new Evd.Constructor ();
 Evd.WebTransport.prototype = new Evd.Object (Evd.WebTransport);
@@ -473,7 +747,14 @@ Evd.Object.extend (Evd.WebTransport.prototype, {
 
         this._dispatching = false;
 
+        // number of messages received in the current session, which
+        // reconnections acknowledge if the server can replay lost ones
+        this._inSeq = 0;
+        this._resume = false;
+
         this._availableMechs = ["long-polling"];
+        if (window["EventSource"])
+            this._availableMechs.unshift ("server-sent-events");
         if (window["WebSocket"])
             this._availableMechs.unshift ("websocket");
         this._negotiatedMechs = null;
@@ -513,6 +794,8 @@ Evd.Object.extend (Evd.WebTransport.prototype, {
             transportProto = Evd.LongPolling;
         else if (mechName == "websocket")
             transportProto = Evd.WebSocket;
+        else if (mechName == "server-sent-events")
+            transportProto = Evd.ServerSentEvents;
         else {
             // @TODO: raise error, failed to negotiate mechanism
             throw ("No mechanism can be negotiated");
@@ -521,7 +804,15 @@ Evd.Object.extend (Evd.WebTransport.prototype, {
 
         var self = this;
 
-        this._transport = new transportProto ({ peerId: peerId });
+        var getAck = null;
+        if (this._resume)
+            getAck = function () { return self._inSeq; };
+
+        this._transport = new transportProto ({
+            peerId: peerId,
+            getAck: getAck,
+            framing: this._handshakeData["lp-framing"]
+        });
 
         this._transport.addEventListener ("connect",
             function (result, error) {
@@ -572,6 +863,9 @@ Evd.Object.extend (Evd.WebTransport.prototype, {
                 var peerId = self._handshakeData["peer-id"];
                 self._negotiatedMechs = self._handshakeData["mechanisms"];
 
+                self._inSeq = 0;
+                self._resume = self._handshakeData["replay-window"] > 0;
+
                 // create new peer
                 var peer = new Evd.Peer ({
                     id: peerId,
@@ -590,9 +884,13 @@ Evd.Object.extend (Evd.WebTransport.prototype, {
 
         var hsData = {
             mechanisms: this._availableMechs,
-            url: this._addr
+            url: this._addr,
+            resume: true
         };
 
+        if (Evd.LongPolling.supportsBinaryFraming ())
+            hsData["lp-framing"] = Evd.LongPolling.BINARY_FRAMING;
+
         this._handshaking = true;
         xhr.open ("POST", this._addr + "handshake", true);
         xhr.send (JSON.stringify (hsData));
@@ -659,6 +957,7 @@ Evd.Object.extend (Evd.WebTransport.prototype, {
             var msg;
             for (var i in msgs) {
                 msg = msgs[i];
+                this._inSeq++;
 
                 this._peer[Evd.WebTransport.PEER_DATA_KEY].msg = msg;
                 this._fireEvent ("receive", [this._peer]);
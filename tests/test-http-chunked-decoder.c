@@ -0,0 +1,340 @@
+/*
+ * test-http-chunked-decoder.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "evd-http-chunked-decoder.h"
+
+#define PAYLOAD_SIZE       (256 * 1024)
+#define PERF_PAYLOAD_SIZE  (64 * 1024 * 1024)
+
+typedef struct
+{
+  GConverter *decoder;
+  gchar *payload;
+  gsize payload_size;
+} Fixture;
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  test_data)
+{
+  gsize i;
+
+  f->decoder = G_CONVERTER (evd_http_chunked_decoder_new ());
+
+  f->payload_size = PAYLOAD_SIZE;
+  f->payload = g_malloc (f->payload_size);
+  for (i = 0; i < f->payload_size; i++)
+    f->payload[i] = (gchar) g_test_rand_int_range (0, 256);
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  test_data)
+{
+  g_free (f->payload);
+  g_object_unref (f->decoder);
+}
+
+static GString *
+encode_chunked (const gchar *data,
+                gsize        size,
+                gsize        chunk_size,
+                const gchar *extension,
+                const gchar *trailer)
+{
+  GString *str;
+  gsize pos = 0;
+
+  str = g_string_sized_new (size + (size / chunk_size + 1) * 16);
+
+  while (pos < size)
+    {
+      gsize len;
+
+      len = MIN (chunk_size, size - pos);
+
+      g_string_append_printf (str,
+                              "%" G_GSIZE_MODIFIER "x%s\r\n",
+                              len,
+                              extension != NULL ? extension : "");
+      g_string_append_len (str, data + pos, len);
+      g_string_append (str, "\r\n");
+
+      pos += len;
+    }
+
+  g_string_append (str, "0\r\n");
+  if (trailer != NULL)
+    g_string_append (str, trailer);
+  g_string_append (str, "\r\n");
+
+  return str;
+}
+
+static GConverterResult
+decode_chunked (GConverter   *decoder,
+                const gchar  *data,
+                gsize         size,
+                gsize         feed_size,
+                GString      *out,
+                gsize        *total_read,
+                GError      **error)
+{
+  gchar outbuf[4096];
+  GConverterResult result = G_CONVERTER_CONVERTED;
+  gsize pos = 0;
+
+  while (pos < size && result == G_CONVERTER_CONVERTED)
+    {
+      gsize bytes_read = 0;
+      gsize bytes_written = 0;
+
+      result = g_converter_convert (decoder,
+                                    data + pos,
+                                    MIN (feed_size, size - pos),
+                                    outbuf,
+                                    sizeof (outbuf),
+                                    G_CONVERTER_NO_FLAGS,
+                                    &bytes_read,
+                                    &bytes_written,
+                                    error);
+
+      pos += bytes_read;
+
+      if (out != NULL)
+        g_string_append_len (out, outbuf, bytes_written);
+    }
+
+  if (total_read != NULL)
+    *total_read = pos;
+
+  return result;
+}
+
+static void
+test_decode (Fixture       *f,
+             gconstpointer  test_data)
+{
+  const gsize chunk_sizes[] = { 1, 7, 1024, 65536 };
+  const gsize feed_sizes[] = { 1, 3, 4096, G_MAXSIZE };
+  guint i;
+  guint j;
+
+  for (i = 0; i < G_N_ELEMENTS (chunk_sizes); i++)
+    {
+      GString *encoded;
+
+      encoded = encode_chunked (f->payload,
+                                f->payload_size,
+                                chunk_sizes[i],
+                                NULL,
+                                NULL);
+
+      for (j = 0; j < G_N_ELEMENTS (feed_sizes); j++)
+        {
+          GString *decoded;
+          GError *error = NULL;
+          gsize total_read;
+
+          decoded = g_string_sized_new (f->payload_size);
+
+          g_assert_cmpint (decode_chunked (f->decoder,
+                                           encoded->str,
+                                           encoded->len,
+                                           feed_sizes[j],
+                                           decoded,
+                                           &total_read,
+                                           &error),
+                           ==,
+                           G_CONVERTER_FINISHED);
+          g_assert_no_error (error);
+
+          g_assert_cmpuint (total_read, ==, encoded->len);
+          g_assert_cmpuint (decoded->len, ==, f->payload_size);
+          g_assert (memcmp (decoded->str, f->payload, f->payload_size) == 0);
+
+          g_string_free (decoded, TRUE);
+          g_converter_reset (f->decoder);
+        }
+
+      g_string_free (encoded, TRUE);
+    }
+}
+
+static void
+test_extensions_and_trailer (Fixture       *f,
+                             gconstpointer  test_data)
+{
+  const gchar *next_message = "GET / HTTP/1.1\r\n";
+  GString *encoded;
+  GString *decoded;
+  GError *error = NULL;
+  gsize total_read;
+
+  encoded = encode_chunked (f->payload,
+                            1000,
+                            100,
+                            ";name=value;other",
+                            "X-Checksum: abcdef\r\nX-Other: 1\r\n");
+  g_string_append (encoded, next_message);
+
+  decoded = g_string_new ("");
+
+  g_assert_cmpint (decode_chunked (f->decoder,
+                                   encoded->str,
+                                   encoded->len,
+                                   5,
+                                   decoded,
+                                   &total_read,
+                                   &error),
+                   ==,
+                   G_CONVERTER_FINISHED);
+  g_assert_no_error (error);
+
+  /* content that follows the chunked message is left unread */
+  g_assert_cmpuint (encoded->len - total_read, ==, strlen (next_message));
+  g_assert_cmpuint (decoded->len, ==, 1000);
+  g_assert (memcmp (decoded->str, f->payload, 1000) == 0);
+
+  g_string_free (decoded, TRUE);
+  g_string_free (encoded, TRUE);
+}
+
+static void
+test_invalid (Fixture       *f,
+              gconstpointer  test_data)
+{
+  const gchar *inputs[] = {
+    "zz\r\nhello\r\n0\r\n\r\n",
+    "5\r\nhelloXX0\r\n\r\n",
+    "fffffffffffffffffffff\r\n",
+    "5\r\nhello\r\n0\r\n\rX"
+  };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (inputs); i++)
+    {
+      GError *error = NULL;
+
+      g_assert_cmpint (decode_chunked (f->decoder,
+                                       inputs[i],
+                                       strlen (inputs[i]),
+                                       G_MAXSIZE,
+                                       NULL,
+                                       NULL,
+                                       &error),
+                       ==,
+                       G_CONVERTER_ERROR);
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+
+      g_error_free (error);
+      g_converter_reset (f->decoder);
+    }
+}
+
+static void
+test_throughput (Fixture       *f,
+                 gconstpointer  test_data)
+{
+  gsize chunk_size = GPOINTER_TO_SIZE (test_data);
+  gchar *payload;
+  GString *encoded;
+  GTimer *timer;
+  GError *error = NULL;
+  gdouble elapsed;
+  gsize i;
+
+  if (! g_test_perf ())
+    return;
+
+  payload = g_malloc (PERF_PAYLOAD_SIZE);
+  for (i = 0; i < PERF_PAYLOAD_SIZE; i += f->payload_size)
+    memcpy (payload + i, f->payload, f->payload_size);
+
+  encoded = encode_chunked (payload,
+                            PERF_PAYLOAD_SIZE,
+                            chunk_size,
+                            NULL,
+                            NULL);
+  g_free (payload);
+
+  timer = g_timer_new ();
+
+  g_assert_cmpint (decode_chunked (f->decoder,
+                                   encoded->str,
+                                   encoded->len,
+                                   4096,
+                                   NULL,
+                                   NULL,
+                                   &error),
+                   ==,
+                   G_CONVERTER_FINISHED);
+  g_assert_no_error (error);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+
+  g_test_maximized_result (encoded->len / elapsed / (1024 * 1024),
+                           "%" G_GSIZE_FORMAT "-byte chunks: %.2f MB/s",
+                           chunk_size,
+                           encoded->len / elapsed / (1024 * 1024));
+
+  g_timer_destroy (timer);
+  g_string_free (encoded, TRUE);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/evd/http/chunked-decoder/decode",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_decode,
+              fixture_teardown);
+
+  g_test_add ("/evd/http/chunked-decoder/extensions-and-trailer",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_extensions_and_trailer,
+              fixture_teardown);
+
+  g_test_add ("/evd/http/chunked-decoder/invalid",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_invalid,
+              fixture_teardown);
+
+  /* benchmarks, only run in perf mode (-m perf) */
+  g_test_add ("/evd/http/chunked-decoder/throughput/small-chunks",
+              Fixture,
+              GSIZE_TO_POINTER (64),
+              fixture_setup,
+              test_throughput,
+              fixture_teardown);
+
+  g_test_add ("/evd/http/chunked-decoder/throughput/large-chunks",
+              Fixture,
+              GSIZE_TO_POINTER (64 * 1024),
+              fixture_setup,
+              test_throughput,
+              fixture_teardown);
+
+  return g_test_run ();
+}
@@ -15,6 +15,16 @@
 
 #include "evd-json-filter.h"
 
+#define PERF_BATCH_SIZE (1024 * 1024)
+#define PERF_ITERATIONS 20
+
+/* a JSON-RPC call with long string bodies, escapes and whitespace runs */
+#define BATCH_ITEM \
+  "{\"id\": 17, \"method\": \"org.eventdance.echo\",\n" \
+  "   \"params\": [\"lorem ipsum dolor sit amet, consectetur adipiscing " \
+  "elit, sed do eiusmod tempor\", \"tab\\tquote \\\" and \\u00e1\",\n" \
+  "              null, -12.5e3, true]}                \n"
+
 static const gchar *evd_json_filter_chunks[] =
 {
   "   [\"hell",
@@ -149,6 +159,189 @@ evd_json_filter_test_chunked (EvdJsonFilterFixture *f,
     }
 }
 
+static void
+count_packets (EvdJsonFilter *filter,
+               const gchar   *buffer,
+               gsize          size,
+               gpointer       user_data)
+{
+  guint *count = user_data;
+
+  (*count)++;
+}
+
+static GString *
+build_batch (gsize size)
+{
+  GString *batch;
+
+  batch = g_string_sized_new (size + strlen (BATCH_ITEM));
+  while (batch->len < size)
+    g_string_append (batch, BATCH_ITEM);
+
+  return batch;
+}
+
+static guint
+feed_in_chunks (EvdJsonFilter *filter,
+                const gchar   *buffer,
+                gsize          size,
+                gsize          chunk_size)
+{
+  guint count = 0;
+  gsize i;
+  GError *error = NULL;
+
+  evd_json_filter_reset (filter);
+  evd_json_filter_set_packet_handler (filter, count_packets, &count, NULL);
+
+  for (i = 0; i < size; i += chunk_size)
+    {
+      g_assert (evd_json_filter_feed_len (filter,
+                                          buffer + i,
+                                          MIN (chunk_size, size - i),
+                                          &error));
+      g_assert_no_error (error);
+    }
+
+  return count;
+}
+
+static void
+evd_json_filter_test_batch (EvdJsonFilterFixture *f,
+                            gconstpointer         test_data)
+{
+  GString *batch;
+  guint expected;
+  gsize chunk_sizes[] = { 1, 7, 16, 33, 4096 };
+  gint i;
+  GError *error = NULL;
+  const gchar *wrong[] =
+    {
+      /* control characters deep inside a string body */
+      "[\"0123456789abcdef0123456789abcdef\n\"]",
+      "[\"0123456789abcdef0123456789abcdef\x01\"]",
+      /* bad escape after a long string body */
+      "[\"0123456789abcdef0123456789abcdef\\x\"]",
+      /* garbage after a long whitespace run */
+      "[1,                                  x]"
+    };
+
+  batch = build_batch (64 * 1024);
+  expected = batch->len / strlen (BATCH_ITEM);
+
+  /* packet boundaries do not depend on how the stream is split */
+  g_assert_cmpuint (feed_in_chunks (f->filter, batch->str, batch->len, batch->len),
+                    ==,
+                    expected);
+  for (i = 0; i < G_N_ELEMENTS (chunk_sizes); i++)
+    g_assert_cmpuint (feed_in_chunks (f->filter,
+                                      batch->str,
+                                      batch->len,
+                                      chunk_sizes[i]),
+                      ==,
+                      expected);
+
+  g_string_free (batch, TRUE);
+
+  for (i = 0; i < G_N_ELEMENTS (wrong); i++)
+    {
+      evd_json_filter_reset (f->filter);
+      g_assert (! evd_json_filter_feed (f->filter, wrong[i], &error));
+      g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+      g_error_free (error);
+      error = NULL;
+    }
+}
+
+static void
+evd_json_filter_test_max_packet_size (EvdJsonFilterFixture *f,
+                                      gconstpointer         test_data)
+{
+  guint count = 0;
+  GError *error = NULL;
+
+  evd_json_filter_set_packet_handler (f->filter, count_packets, &count, NULL);
+
+  g_assert_cmpuint (evd_json_filter_get_max_packet_size (f->filter), ==, 0);
+  evd_json_filter_set_max_packet_size (f->filter, 16);
+  g_assert_cmpuint (evd_json_filter_get_max_packet_size (f->filter), ==, 16);
+
+  /* packets within the limit, contiguous and split across feeds */
+  g_assert (evd_json_filter_feed (f->filter, "[1,2,3] [\"abc", &error));
+  g_assert (evd_json_filter_feed (f->filter, "def\"]", &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (count, ==, 2);
+
+  /* too big while still incomplete */
+  g_assert (evd_json_filter_feed (f->filter, "[\"0123456", &error));
+  g_assert (! evd_json_filter_feed (f->filter, "789abcdef", &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_clear_error (&error);
+
+  /* too big when completed */
+  g_assert (evd_json_filter_feed (f->filter, "[\"01234", &error));
+  g_assert (! evd_json_filter_feed (f->filter, "56789abcdef\"]", &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_clear_error (&error);
+
+  /* too big in a single feed */
+  g_assert (! evd_json_filter_feed (f->filter, "[\"0123456789abcdef\"]", &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+  g_clear_error (&error);
+
+  /* the filter is usable again after rejecting a packet */
+  g_assert (evd_json_filter_feed (f->filter, "{\"a\":", &error));
+  g_assert (evd_json_filter_feed (f->filter, "1}", &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (count, ==, 3);
+}
+
+static gdouble
+measure (EvdJsonFilter *filter, GString *batch, gsize chunk_size)
+{
+  GTimer *timer;
+  gdouble elapsed;
+  guint i;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < PERF_ITERATIONS; i++)
+    feed_in_chunks (filter, batch->str, batch->len, chunk_size);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return (gdouble) batch->len * PERF_ITERATIONS / elapsed / (1024 * 1024);
+}
+
+static void
+evd_json_filter_test_throughput (EvdJsonFilterFixture *f,
+                                 gconstpointer         test_data)
+{
+  GString *batch;
+  gdouble bytewise;
+  gdouble scanned;
+
+  if (! g_test_perf ())
+    return;
+
+  batch = build_batch (PERF_BATCH_SIZE);
+
+  /* feeding one byte at a time leaves nothing to skip, so every byte
+     goes through the state machine as before */
+  bytewise = measure (f->filter, batch, 1);
+  scanned = measure (f->filter, batch, batch->len);
+
+  g_test_message ("byte-at-a-time state machine: %.2f MB/s", bytewise);
+  g_test_maximized_result (scanned,
+                           "block scanning: %.2f MB/s (%.1fx)",
+                           scanned,
+                           scanned / bytewise);
+
+  g_string_free (batch, TRUE);
+}
+
 gint
 main (gint argc, gchar *argv[])
 {
@@ -172,5 +365,26 @@ main (gint argc, gchar *argv[])
               evd_json_filter_test_chunked,
               evd_json_filter_fixture_teardown);
 
+  g_test_add ("/evd/json/filter/batch",
+              EvdJsonFilterFixture,
+              NULL,
+              evd_json_filter_fixture_setup,
+              evd_json_filter_test_batch,
+              evd_json_filter_fixture_teardown);
+
+  g_test_add ("/evd/json/filter/max-packet-size",
+              EvdJsonFilterFixture,
+              NULL,
+              evd_json_filter_fixture_setup,
+              evd_json_filter_test_max_packet_size,
+              evd_json_filter_fixture_teardown);
+
+  g_test_add ("/evd/json/filter/throughput",
+              EvdJsonFilterFixture,
+              NULL,
+              evd_json_filter_fixture_setup,
+              evd_json_filter_test_throughput,
+              evd_json_filter_fixture_teardown);
+
   return g_test_run ();
 }
@@ -0,0 +1,808 @@
+/*
+ * test-jsonrpc.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ */
+
+#include <string.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <evd.h>
+
+#define PERF_ITERATIONS 200000
+
+typedef struct
+{
+  EvdJsonrpc *a;
+  EvdJsonrpc *b;
+
+  gchar *last_msg;
+  gboolean deliver;
+  guint sends;
+
+  gboolean defer;
+  guint deferred[4];
+  guint n_deferred;
+
+  JsonNode *notified_params;
+  gchar *notified_name;
+
+  JsonNode *result;
+  guint calls_done;
+} Fixture;
+
+static void
+on_send (EvdJsonrpc  *self,
+         const gchar *message,
+         gpointer     context,
+         guint        invocation_id,
+         gpointer     user_data)
+{
+  Fixture *f = user_data;
+  EvdJsonrpc *other;
+  GError *error = NULL;
+
+  g_free (f->last_msg);
+  f->last_msg = g_strdup (message);
+  f->sends++;
+
+  if (! f->deliver)
+    return;
+
+  /* the sender is the context of the receiving end */
+  other = self == f->a ? f->b : f->a;
+  g_assert (evd_jsonrpc_transport_receive (other, message, self, 0, &error));
+  g_assert_no_error (error);
+}
+
+static void
+on_method_call (EvdJsonrpc  *self,
+                const gchar *method_name,
+                JsonNode    *params,
+                guint        invocation_id,
+                gpointer     context,
+                gpointer     user_data)
+{
+  Fixture *f = user_data;
+  JsonArray *args;
+  JsonNode *result;
+  GError *error = NULL;
+
+  g_assert_cmpstr (method_name, ==, "sum");
+
+  if (f->defer)
+    {
+      g_assert_cmpuint (f->n_deferred, <, G_N_ELEMENTS (f->deferred));
+      f->deferred[f->n_deferred++] = invocation_id;
+      return;
+    }
+
+  args = json_node_get_array (params);
+
+  result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_int (result,
+                     json_array_get_int_element (args, 0) +
+                     json_array_get_int_element (args, 1));
+
+  g_assert (evd_jsonrpc_respond (self, invocation_id, result, context, &error));
+  g_assert_no_error (error);
+
+  json_node_free (result);
+}
+
+static void
+on_notification (EvdJsonrpc  *self,
+                 const gchar *notification_name,
+                 JsonNode    *params,
+                 gpointer     context,
+                 gpointer     user_data)
+{
+  Fixture *f = user_data;
+
+  g_free (f->notified_name);
+  f->notified_name = g_strdup (notification_name);
+
+  if (f->notified_params != NULL)
+    json_node_free (f->notified_params);
+  f->notified_params = json_node_copy (params);
+}
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  test_data)
+{
+  memset (f, 0, sizeof (Fixture));
+  f->deliver = TRUE;
+
+  f->a = evd_jsonrpc_new ();
+  f->b = evd_jsonrpc_new ();
+
+  evd_jsonrpc_transport_set_send_callback (f->a, on_send, f, NULL);
+  evd_jsonrpc_transport_set_send_callback (f->b, on_send, f, NULL);
+
+  evd_jsonrpc_set_callbacks (f->b, on_method_call, on_notification, f, NULL);
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  test_data)
+{
+  g_object_unref (f->a);
+  g_object_unref (f->b);
+
+  g_free (f->last_msg);
+  g_free (f->notified_name);
+
+  if (f->notified_params != NULL)
+    json_node_free (f->notified_params);
+  if (f->result != NULL)
+    json_node_free (f->result);
+}
+
+static JsonNode *
+build_params (void)
+{
+  JsonArray *array;
+  JsonObject *obj;
+  JsonNode *node;
+
+  obj = json_object_new ();
+  json_object_set_string_member (obj, "text", "quote \" backslash \\ tab \t nl \n \001");
+  json_object_set_int_member (obj, "int", -42);
+  json_object_set_double_member (obj, "double", 0.5);
+  json_object_set_boolean_member (obj, "bool", TRUE);
+  json_object_set_null_member (obj, "null");
+  json_object_set_array_member (obj, "empty", json_array_new ());
+
+  array = json_array_new ();
+  json_array_add_object_element (array, obj);
+  json_array_add_string_element (array, "");
+
+  node = json_node_new (JSON_NODE_ARRAY);
+  json_node_take_array (node, array);
+
+  return node;
+}
+
+static void
+test_encoding (Fixture       *f,
+               gconstpointer  test_data)
+{
+  JsonNode *params;
+  JsonObject *obj;
+  JsonParser *parser;
+  GError *error = NULL;
+
+  params = build_params ();
+
+  g_assert (evd_jsonrpc_send_notification (f->a, "note", params, NULL, &error));
+  g_assert_no_error (error);
+
+  /* the message is valid JSON... */
+  parser = json_parser_new ();
+  g_assert (json_parser_load_from_data (parser, f->last_msg, -1, &error));
+  g_assert_no_error (error);
+  g_object_unref (parser);
+
+  /* ...and the params survive the round trip */
+  g_assert_cmpstr (f->notified_name, ==, "note");
+  g_assert (JSON_NODE_HOLDS_ARRAY (f->notified_params));
+
+  obj = json_array_get_object_element (json_node_get_array (f->notified_params), 0);
+  g_assert_cmpstr (json_object_get_string_member (obj, "text"),
+                   ==,
+                   "quote \" backslash \\ tab \t nl \n \001");
+  g_assert_cmpint (json_object_get_int_member (obj, "int"), ==, -42);
+  g_assert_cmpfloat (json_object_get_double_member (obj, "double"), ==, 0.5);
+  g_assert (json_object_get_boolean_member (obj, "bool"));
+  g_assert (json_object_get_null_member (obj, "null"));
+  g_assert_cmpuint (json_array_get_length (json_object_get_array_member (obj, "empty")),
+                    ==,
+                    0);
+
+  json_node_free (params);
+}
+
+static void
+test_serialized_params (Fixture       *f,
+                        gconstpointer  test_data)
+{
+  JsonArray *array;
+  GError *error = NULL;
+
+  g_assert (evd_jsonrpc_send_notification_serialized (f->a,
+                                                      "note",
+                                                      "[1,\"two\",{\"three\":3}]",
+                                                      NULL,
+                                                      &error));
+  g_assert_no_error (error);
+
+  g_assert_cmpstr (f->last_msg,
+                   ==,
+                   "{\"id\":null,\"method\":\"note\",\"params\":[1,\"two\",{\"three\":3}]}");
+
+  array = json_node_get_array (f->notified_params);
+  g_assert_cmpuint (json_array_get_length (array), ==, 3);
+  g_assert_cmpstr (json_array_get_string_element (array, 1), ==, "two");
+}
+
+static void
+on_call_done (GObject      *obj,
+              GAsyncResult *res,
+              gpointer      user_data)
+{
+  Fixture *f = user_data;
+  GError *error = NULL;
+
+  if (f->result != NULL)
+    json_node_free (f->result);
+
+  g_assert (evd_jsonrpc_call_method_finish (EVD_JSONRPC (obj),
+                                            res,
+                                            &f->result,
+                                            NULL,
+                                            &error));
+  g_assert_no_error (error);
+
+  f->calls_done++;
+}
+
+static JsonNode *
+build_sum_params (gint a, gint b)
+{
+  JsonArray *args;
+  JsonNode *params;
+
+  args = json_array_new ();
+  json_array_add_int_element (args, a);
+  json_array_add_int_element (args, b);
+  params = json_node_new (JSON_NODE_ARRAY);
+  json_node_take_array (params, args);
+
+  return params;
+}
+
+static void
+test_call (Fixture       *f,
+           gconstpointer  test_data)
+{
+  JsonNode *params;
+
+  params = build_sum_params (2, 3);
+
+  /* the transport is synchronous, so the call completes right away */
+  evd_jsonrpc_call_method (f->a, "sum", params, NULL, NULL, on_call_done, f);
+  g_assert_cmpuint (f->calls_done, ==, 1);
+  g_assert_cmpint (json_node_get_int (f->result), ==, 5);
+
+  json_node_free (params);
+}
+
+static JsonArray *
+parse_batch_response (Fixture *f, JsonParser *parser)
+{
+  GError *error = NULL;
+  JsonNode *root;
+
+  g_assert (json_parser_load_from_data (parser, f->last_msg, -1, &error));
+  g_assert_no_error (error);
+
+  root = json_parser_get_root (parser);
+  g_assert (JSON_NODE_HOLDS_ARRAY (root));
+
+  return json_node_get_array (root);
+}
+
+static void
+test_batch_incoming (Fixture       *f,
+                     gconstpointer  test_data)
+{
+  JsonParser *parser;
+  JsonArray *responses;
+  JsonObject *obj;
+  JsonNode *result;
+  GError *error = NULL;
+  gint i;
+  const gchar *batch =
+    "[{\"id\":\"x1\",\"method\":\"sum\",\"params\":[1,2]},"
+    " {\"id\":null,\"method\":\"note\",\"params\":[]},"
+    " {\"id\":\"x2\",\"method\":\"sum\",\"params\":[3,4]}]";
+
+  f->deliver = FALSE;
+  parser = json_parser_new ();
+
+  /* answered while the batch is dispatched */
+  g_assert (evd_jsonrpc_transport_receive (f->b, batch, f->a, 0, &error));
+  g_assert_no_error (error);
+
+  g_assert_cmpstr (f->notified_name, ==, "note");
+  g_assert_cmpuint (f->sends, ==, 1);
+
+  responses = parse_batch_response (f, parser);
+  g_assert_cmpuint (json_array_get_length (responses), ==, 2);
+  obj = json_array_get_object_element (responses, 0);
+  g_assert_cmpstr (json_object_get_string_member (obj, "id"), ==, "x1");
+  g_assert_cmpint (json_object_get_int_member (obj, "result"), ==, 3);
+
+  /* answered later, in any order */
+  f->defer = TRUE;
+  g_assert (evd_jsonrpc_transport_receive (f->b, batch, f->a, 0, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (f->n_deferred, ==, 2);
+
+  result = json_node_new (JSON_NODE_VALUE);
+  for (i = f->n_deferred - 1; i >= 0; i--)
+    {
+      g_assert_cmpuint (f->sends, ==, 1);
+
+      json_node_set_int (result, i);
+      g_assert (evd_jsonrpc_respond (f->b, f->deferred[i], result, NULL, &error));
+      g_assert_no_error (error);
+    }
+  json_node_free (result);
+
+  g_assert_cmpuint (f->sends, ==, 2);
+
+  responses = parse_batch_response (f, parser);
+  g_assert_cmpuint (json_array_get_length (responses), ==, 2);
+  obj = json_array_get_object_element (responses, 0);
+  g_assert_cmpstr (json_object_get_string_member (obj, "id"), ==, "x2");
+  g_assert_cmpint (json_object_get_int_member (obj, "result"), ==, 1);
+
+  /* notifications only, no response */
+  g_assert (evd_jsonrpc_transport_receive (f->b,
+                        "[{\"id\":null,\"method\":\"note\",\"params\":[]}]",
+                        f->a,
+                        0,
+                        &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (f->sends, ==, 2);
+
+  g_object_unref (parser);
+}
+
+static void
+test_batch_invalid (Fixture       *f,
+                    gconstpointer  test_data)
+{
+  JsonParser *parser;
+  JsonArray *responses;
+  JsonObject *obj;
+  JsonObject *error_obj;
+  GError *error = NULL;
+
+  f->deliver = FALSE;
+  parser = json_parser_new ();
+
+  /* invalid elements are answered with an error, in their place */
+  g_assert (evd_jsonrpc_transport_receive (f->b,
+                  "[{\"id\":\"x1\",\"method\":\"sum\",\"params\":[5,6]},"
+                  " 42,"
+                  " {\"id\":\"x2\",\"method\":7,\"params\":[]}]",
+                  f->a,
+                  0,
+                  &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (f->sends, ==, 1);
+
+  responses = parse_batch_response (f, parser);
+  g_assert_cmpuint (json_array_get_length (responses), ==, 3);
+
+  obj = json_array_get_object_element (responses, 0);
+  g_assert_cmpstr (json_object_get_string_member (obj, "id"), ==, "x1");
+  g_assert_cmpint (json_object_get_int_member (obj, "result"), ==, 11);
+
+  obj = json_array_get_object_element (responses, 1);
+  g_assert (json_object_get_null_member (obj, "id"));
+  error_obj = json_object_get_object_member (obj, "error");
+  g_assert_cmpint (json_object_get_int_member (error_obj, "code"),
+                   ==,
+                   G_IO_ERROR_INVALID_DATA);
+
+  obj = json_array_get_object_element (responses, 2);
+  g_assert_cmpstr (json_object_get_string_member (obj, "id"), ==, "x2");
+  g_assert (json_object_get_null_member (obj, "result"));
+  g_assert (json_object_get_object_member (obj, "error") != NULL);
+
+  /* an empty batch gets a single error */
+  g_assert (evd_jsonrpc_transport_receive (f->b, "[]", f->a, 0, &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (f->sends, ==, 2);
+
+  responses = parse_batch_response (f, parser);
+  g_assert_cmpuint (json_array_get_length (responses), ==, 1);
+  obj = json_array_get_object_element (responses, 0);
+  g_assert (json_object_get_null_member (obj, "id"));
+  g_assert (json_object_get_object_member (obj, "error") != NULL);
+
+  g_object_unref (parser);
+}
+
+static void
+test_batch_outgoing (Fixture       *f,
+                     gconstpointer  test_data)
+{
+  JsonNode *params;
+  GError *error = NULL;
+
+  evd_jsonrpc_begin_batch (f->a);
+
+  params = build_sum_params (2, 3);
+  evd_jsonrpc_call_method (f->a, "sum", params, NULL, NULL, on_call_done, f);
+  json_node_free (params);
+
+  g_assert (evd_jsonrpc_send_notification (f->a, "note", NULL, NULL, &error));
+  g_assert_no_error (error);
+
+  params = build_sum_params (4, 5);
+  evd_jsonrpc_call_method (f->a, "sum", params, NULL, NULL, on_call_done, f);
+  json_node_free (params);
+
+  /* nothing is sent until the batch ends */
+  g_assert_cmpuint (f->sends, ==, 0);
+
+  g_assert (evd_jsonrpc_end_batch (f->a, NULL, &error));
+  g_assert_no_error (error);
+
+  /* one message each way */
+  g_assert_cmpuint (f->sends, ==, 2);
+  g_assert_cmpuint (f->calls_done, ==, 2);
+  g_assert_cmpint (json_node_get_int (f->result), ==, 9);
+  g_assert_cmpstr (f->notified_name, ==, "note");
+}
+
+static void
+on_call_failed (GObject      *obj,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  Fixture *f = user_data;
+  GError *error = NULL;
+
+  g_assert (! evd_jsonrpc_call_method_finish (EVD_JSONRPC (obj),
+                                              res,
+                                              NULL,
+                                              NULL,
+                                              &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+  g_error_free (error);
+
+  f->calls_done++;
+}
+
+static void
+test_batch_no_transport (Fixture       *f,
+                         gconstpointer  test_data)
+{
+  EvdJsonrpc *rpc;
+  GError *error = NULL;
+
+  rpc = evd_jsonrpc_new ();
+
+  evd_jsonrpc_begin_batch (rpc);
+  evd_jsonrpc_call_method (rpc, "sum", NULL, NULL, NULL, on_call_failed, f);
+  evd_jsonrpc_call_method (rpc, "sum", NULL, NULL, NULL, on_call_failed, f);
+
+  g_assert (! evd_jsonrpc_end_batch (rpc, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CLOSED);
+  g_error_free (error);
+
+  /* calls fail from an idle */
+  while (f->calls_done < 2)
+    g_main_context_iteration (NULL, TRUE);
+
+  g_object_unref (rpc);
+}
+
+static void
+test_numeric_id (Fixture       *f,
+                 gconstpointer  test_data)
+{
+  GError *error = NULL;
+
+  f->deliver = FALSE;
+
+  evd_jsonrpc_call_method (f->a, "sum", NULL, NULL, NULL, on_call_done, f);
+  g_assert_cmpuint (f->calls_done, ==, 0);
+
+  /* ids are sent as strings, but a peer may answer with a number */
+  g_assert (evd_jsonrpc_transport_receive (f->a,
+                                  "{\"id\":1,\"error\":null,\"result\":7}",
+                                  f->b,
+                                  0,
+                                  &error));
+  g_assert_no_error (error);
+
+  g_assert_cmpuint (f->calls_done, ==, 1);
+  g_assert_cmpint (json_node_get_int (f->result), ==, 7);
+
+  /* the invocation is gone, a second response is ignored */
+  g_assert (evd_jsonrpc_transport_receive (f->a,
+                                  "{\"id\":\"1\",\"error\":null,\"result\":8}",
+                                  f->b,
+                                  0,
+                                  &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (f->calls_done, ==, 1);
+}
+
+static void
+on_call_timed_out (GObject      *obj,
+                   GAsyncResult *res,
+                   gpointer      user_data)
+{
+  Fixture *f = user_data;
+  GError *error = NULL;
+
+  g_assert (! evd_jsonrpc_call_method_finish (EVD_JSONRPC (obj),
+                                              res,
+                                              NULL,
+                                              NULL,
+                                              &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_error_free (error);
+
+  f->calls_done++;
+}
+
+static void
+test_timeout (Fixture       *f,
+              gconstpointer  test_data)
+{
+  JsonNode *params;
+  JsonNode *result;
+  GError *error = NULL;
+
+  /* invocations don't time out unless asked to */
+  g_assert_cmpuint (evd_jsonrpc_get_timeout_interval (f->a), ==, 0);
+
+  /* the remote end gives up first */
+  evd_jsonrpc_set_timeout_interval (f->a, 2);
+  evd_jsonrpc_set_timeout_interval (f->b, 1);
+  g_assert_cmpuint (evd_jsonrpc_get_timeout_interval (f->a), ==, 2);
+
+  f->defer = TRUE;
+
+  params = build_sum_params (2, 3);
+  evd_jsonrpc_call_method (f->a, "sum", params, NULL, NULL, on_call_timed_out, f);
+  json_node_free (params);
+
+  g_assert_cmpuint (f->n_deferred, ==, 1);
+
+  while (f->calls_done < 1)
+    g_main_context_iteration (NULL, TRUE);
+
+  /* the remote end dropped the call too */
+  result = json_node_new (JSON_NODE_VALUE);
+  json_node_set_int (result, 5);
+  g_assert (! evd_jsonrpc_respond (f->b, f->deferred[0], result, NULL, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_error_free (error);
+  json_node_free (result);
+}
+
+static void
+on_http_call_timed_out (GObject      *obj,
+                        GAsyncResult *res,
+                        gpointer      user_data)
+{
+  GMainLoop *main_loop = user_data;
+  GError *error = NULL;
+
+  g_assert (! evd_jsonrpc_http_client_call_method_finish (EVD_JSONRPC_HTTP_CLIENT (obj),
+                                                          res,
+                                                          NULL,
+                                                          NULL,
+                                                          &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_TIMED_OUT);
+  g_error_free (error);
+
+  g_main_loop_quit (main_loop);
+}
+
+static gboolean
+quit_main_loop (gpointer user_data)
+{
+  g_main_loop_quit (user_data);
+
+  return FALSE;
+}
+
+static void
+test_http_client_timeout (void)
+{
+  GSocketListener *listener;
+  EvdJsonrpcHttpClient *client;
+  GMainLoop *main_loop;
+  guint16 port;
+  gchar *url;
+  GError *error = NULL;
+
+  /* a server that never answers. Connections wait in its backlog */
+  listener = g_socket_listener_new ();
+  port = g_socket_listener_add_any_inet_port (listener, NULL, &error);
+  g_assert_no_error (error);
+
+  url = g_strdup_printf ("http://127.0.0.1:%u/", port);
+  client = evd_jsonrpc_http_client_new (url);
+  g_free (url);
+
+  evd_jsonrpc_http_client_set_timeout_interval (client, 1);
+  g_assert_cmpuint (evd_jsonrpc_http_client_get_timeout_interval (client), ==, 1);
+
+  main_loop = g_main_loop_new (NULL, FALSE);
+
+  evd_jsonrpc_http_client_call_method (client,
+                                       "sum",
+                                       NULL,
+                                       NULL,
+                                       on_http_call_timed_out,
+                                       main_loop);
+  g_main_loop_run (main_loop);
+
+  /* the HTTP request is still pending. Closing the server makes it fail
+     after its call is gone */
+  g_socket_listener_close (listener);
+  g_object_unref (listener);
+
+  g_timeout_add (200, quit_main_loop, main_loop);
+  g_main_loop_run (main_loop);
+
+  g_main_loop_unref (main_loop);
+  g_object_unref (client);
+}
+
+/* what messages were built with before: a json-glib tree with copies of
+   the params, and a generator */
+static gchar *
+build_with_generator (const gchar *method_name, JsonNode *params)
+{
+  JsonNode *root;
+  JsonObject *obj;
+  JsonGenerator *gen;
+  gchar *msg;
+
+  root = json_node_new (JSON_NODE_OBJECT);
+  obj = json_object_new ();
+  json_node_set_object (root, obj);
+
+  json_object_set_member (obj, "id", json_node_new (JSON_NODE_NULL));
+  json_object_set_string_member (obj, "method", method_name);
+  json_object_set_member (obj, "params", json_node_copy (params));
+
+  gen = json_generator_new ();
+  json_generator_set_root (gen, root);
+  msg = json_generator_to_data (gen, NULL);
+
+  g_object_unref (gen);
+  json_object_unref (obj);
+  json_node_free (root);
+
+  return msg;
+}
+
+static void
+test_notification_throughput (Fixture       *f,
+                              gconstpointer  test_data)
+{
+  JsonNode *params;
+  GTimer *timer;
+  gdouble generator;
+  gdouble direct;
+  guint i;
+
+  if (! g_test_perf ())
+    return;
+
+  params = build_params ();
+  f->deliver = FALSE;
+
+  timer = g_timer_new ();
+  for (i = 0; i < PERF_ITERATIONS; i++)
+    g_free (build_with_generator ("note", params));
+  generator = PERF_ITERATIONS / g_timer_elapsed (timer, NULL);
+
+  g_timer_start (timer);
+  for (i = 0; i < PERF_ITERATIONS; i++)
+    evd_jsonrpc_send_notification (f->a, "note", params, NULL, NULL);
+  direct = PERF_ITERATIONS / g_timer_elapsed (timer, NULL);
+
+  g_timer_destroy (timer);
+
+  g_test_message ("json-glib tree and generator: %.0f notifications/s",
+                  generator);
+  g_test_maximized_result (direct,
+                           "direct encoding: %.0f notifications/s (%.1fx)",
+                           direct,
+                           direct / generator);
+
+  json_node_free (params);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/evd/jsonrpc/encoding",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_encoding,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/serialized-params",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_serialized_params,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/call",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_call,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/batch/incoming",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_batch_incoming,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/batch/invalid",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_batch_invalid,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/batch/outgoing",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_batch_outgoing,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/batch/no-transport",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_batch_no_transport,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/numeric-id",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_numeric_id,
+              fixture_teardown);
+
+  g_test_add ("/evd/jsonrpc/timeout",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_timeout,
+              fixture_teardown);
+
+  g_test_add_func ("/evd/jsonrpc/http-client/timeout",
+                   test_http_client_timeout);
+
+  g_test_add ("/evd/jsonrpc/notification/throughput",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_notification_throughput,
+              fixture_teardown);
+
+  return g_test_run ();
+}
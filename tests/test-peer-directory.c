@@ -0,0 +1,200 @@
+/*
+ * test-peer-directory.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <evd.h>
+
+#define PEER_ID       "0a1b2c3d-4e5f-6a7b-8c9d-0e1f2a3b4c5d"
+#define OTHER_PEER_ID "5d4c3b2a-1f0e-9d8c-7b6a-5f4e3d2c1b0a"
+
+typedef struct
+{
+  gchar *path;
+
+  EvdPeerDirectory *worker0;
+  EvdPeerDirectory *worker1;
+} Fixture;
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  test_data)
+{
+  f->path = g_build_filename (g_get_tmp_dir (),
+                              "test-peer-directory-XXXXXX",
+                              NULL);
+  g_assert (mkdtemp (f->path) != NULL);
+
+  f->worker0 = evd_peer_directory_new (f->path, "/run/test/worker0.sock");
+  f->worker1 = evd_peer_directory_new (f->path, "/run/test/worker1.sock");
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  test_data)
+{
+  g_object_unref (f->worker0);
+  g_object_unref (f->worker1);
+
+  g_rmdir (f->path);
+  g_free (f->path);
+}
+
+static void
+test_register (Fixture       *f,
+               gconstpointer  test_data)
+{
+  GError *error = NULL;
+  gchar *owner;
+
+  g_assert (evd_peer_directory_lookup (f->worker1, PEER_ID) == NULL);
+
+  g_assert (evd_peer_directory_register (f->worker0, PEER_ID, &error));
+  g_assert_no_error (error);
+
+  /* all workers see the owner of the peer */
+  owner = evd_peer_directory_lookup (f->worker1, PEER_ID);
+  g_assert_cmpstr (owner, ==, "/run/test/worker0.sock");
+  g_free (owner);
+
+  /* a peer has only one owner */
+  g_assert (! evd_peer_directory_register (f->worker1, PEER_ID, &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_EXISTS);
+  g_clear_error (&error);
+
+  /* only the owner can unregister a peer */
+  evd_peer_directory_unregister (f->worker1, PEER_ID);
+  owner = evd_peer_directory_lookup (f->worker1, PEER_ID);
+  g_assert_cmpstr (owner, ==, "/run/test/worker0.sock");
+  g_free (owner);
+
+  evd_peer_directory_unregister (f->worker0, PEER_ID);
+  g_assert (evd_peer_directory_lookup (f->worker1, PEER_ID) == NULL);
+}
+
+static void
+test_invalid_id (Fixture       *f,
+                 gconstpointer  test_data)
+{
+  GError *error = NULL;
+
+  g_assert (! evd_peer_directory_register (f->worker0, "../escape", &error));
+  g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT);
+  g_clear_error (&error);
+
+  g_assert (evd_peer_directory_lookup (f->worker0, "..") == NULL);
+  g_assert (evd_peer_directory_lookup (f->worker0, "") == NULL);
+}
+
+/* leaves an entry for @peer_id as a worker that has exited would */
+static void
+add_stale_entry (Fixture *f, const gchar *peer_id)
+{
+  pid_t pid;
+  gchar *entry;
+  gchar *target;
+
+  pid = fork ();
+  g_assert (pid >= 0);
+  if (pid == 0)
+    _exit (0);
+  g_assert (waitpid (pid, NULL, 0) == pid);
+
+  entry = g_build_filename (f->path, peer_id, NULL);
+  target = g_strdup_printf ("%d:/run/test/worker2.sock", (gint) pid);
+  g_assert (symlink (target, entry) == 0);
+
+  g_free (target);
+  g_free (entry);
+}
+
+static gboolean
+entry_exists (Fixture *f, const gchar *peer_id)
+{
+  gchar *entry;
+  gchar *target;
+
+  entry = g_build_filename (f->path, peer_id, NULL);
+  target = g_file_read_link (entry, NULL);
+  g_free (entry);
+  g_free (target);
+
+  return target != NULL;
+}
+
+static void
+test_stale_entries (Fixture       *f,
+                    gconstpointer  test_data)
+{
+  GError *error = NULL;
+  EvdPeerDirectory *worker3;
+  gchar *owner;
+
+  /* looking up a stale entry removes it */
+  add_stale_entry (f, PEER_ID);
+  g_assert (evd_peer_directory_lookup (f->worker0, PEER_ID) == NULL);
+  g_assert (! entry_exists (f, PEER_ID));
+
+  /* stale entries do not prevent registering the peer again */
+  add_stale_entry (f, PEER_ID);
+  g_assert (evd_peer_directory_register (f->worker0, PEER_ID, &error));
+  g_assert_no_error (error);
+
+  owner = evd_peer_directory_lookup (f->worker1, PEER_ID);
+  g_assert_cmpstr (owner, ==, "/run/test/worker0.sock");
+  g_free (owner);
+
+  /* new workers sweep stale entries, and keep the live ones */
+  add_stale_entry (f, OTHER_PEER_ID);
+  worker3 = evd_peer_directory_new (f->path, "/run/test/worker3.sock");
+  g_assert (! entry_exists (f, OTHER_PEER_ID));
+  g_assert (entry_exists (f, PEER_ID));
+  g_object_unref (worker3);
+
+  evd_peer_directory_unregister (f->worker0, PEER_ID);
+  g_assert (! entry_exists (f, PEER_ID));
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/evd/peer-directory/register",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_register,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-directory/invalid-id",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_invalid_id,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-directory/stale-entries",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_stale_entries,
+              fixture_teardown);
+
+  return g_test_run ();
+}
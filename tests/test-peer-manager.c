@@ -0,0 +1,657 @@
+/*
+ * test-peer-manager.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <evd.h>
+
+#define NUM_PEERS 3
+
+#define PERF_PEERS    10000
+#define PERF_LOOKUPS  1000000
+#define PERF_PATH     "/transport/lp/receive"
+
+typedef struct
+{
+  EvdLongpollingServer *transport;
+  EvdPeerManager *peer_manager;
+
+  EvdPeer *peers[NUM_PEERS];
+} Fixture;
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  test_data)
+{
+  gint i;
+
+  f->transport = evd_longpolling_server_new ();
+  f->peer_manager = evd_transport_get_peer_manager (EVD_TRANSPORT (f->transport));
+
+  for (i = 0; i < NUM_PEERS; i++)
+    {
+      f->peers[i] = g_object_new (EVD_TYPE_PEER,
+                                  "transport", f->transport,
+                                  NULL);
+      evd_peer_manager_add_peer (f->peer_manager, f->peers[i]);
+    }
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  test_data)
+{
+  gint i;
+
+  for (i = 0; i < NUM_PEERS; i++)
+    {
+      evd_peer_close (f->peers[i], FALSE);
+      g_object_unref (f->peers[i]);
+    }
+
+  g_object_unref (f->transport);
+}
+
+static void
+test_subscribe (Fixture       *f,
+                gconstpointer  test_data)
+{
+  EvdPeerManager *other;
+  GList *list;
+  guint subscribers;
+
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[0], "news"));
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[1], "news"));
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[1], "sports"));
+
+  /* subscribing twice is a no-op */
+  g_assert (! evd_peer_manager_subscribe (f->peer_manager, f->peers[0], "news"));
+
+  /* peers of other managers are rejected */
+  other = evd_peer_manager_new ();
+  g_assert (! evd_peer_manager_subscribe (other, f->peers[2], "news"));
+  g_object_unref (other);
+
+  g_assert (evd_peer_manager_get_channel_stats (f->peer_manager,
+                                                "news",
+                                                &subscribers,
+                                                NULL,
+                                                NULL));
+  g_assert_cmpuint (subscribers, ==, 2);
+
+  list = evd_peer_manager_get_peer_channels (f->peer_manager, f->peers[1]);
+  g_assert_cmpuint (g_list_length (list), ==, 2);
+  g_list_free (list);
+
+  list = evd_peer_manager_get_channel_peers (f->peer_manager, "sports");
+  g_assert_cmpuint (g_list_length (list), ==, 1);
+  g_assert (list->data == f->peers[1]);
+  g_list_free (list);
+
+  g_assert (evd_peer_manager_unsubscribe (f->peer_manager, f->peers[1], "sports"));
+  g_assert (! evd_peer_manager_unsubscribe (f->peer_manager, f->peers[1], "sports"));
+
+  /* channels without subscribers are removed */
+  g_assert (! evd_peer_manager_get_channel_stats (f->peer_manager,
+                                                  "sports",
+                                                  NULL,
+                                                  NULL,
+                                                  NULL));
+  g_assert (evd_peer_manager_get_channel_peers (f->peer_manager, "sports") == NULL);
+}
+
+static void
+test_publish (Fixture       *f,
+              gconstpointer  test_data)
+{
+  const gchar *text = "Hello World!";
+  GError *error = NULL;
+  guint subscribers;
+  guint64 published;
+  guint64 delivered;
+  gchar *msg;
+  gsize size;
+  gint i;
+
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[0], "news"));
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[1], "news"));
+
+  /* peers have no connection, so messages end up in their backlogs */
+  g_assert (evd_peer_manager_publish_text (f->peer_manager, "news", text, &error));
+  g_assert_no_error (error);
+
+  g_assert_cmpuint (evd_peer_backlog_get_length (f->peers[0]), ==, 1);
+  g_assert_cmpuint (evd_peer_backlog_get_length (f->peers[1]), ==, 1);
+  g_assert_cmpuint (evd_peer_backlog_get_length (f->peers[2]), ==, 0);
+
+  for (i = 0; i < 2; i++)
+    {
+      msg = evd_peer_pop_message (f->peers[i], &size, NULL);
+      g_assert_cmpuint (size, ==, strlen (text));
+      g_assert_cmpstr (msg, ==, text);
+      g_free (msg);
+    }
+
+  /* publishing on a channel nobody listens to is not an error */
+  g_assert (evd_peer_manager_publish_text (f->peer_manager, "void", text, &error));
+  g_assert_no_error (error);
+
+  g_assert (evd_peer_manager_get_channel_stats (f->peer_manager,
+                                                "news",
+                                                &subscribers,
+                                                &published,
+                                                &delivered));
+  g_assert_cmpuint (subscribers, ==, 2);
+  g_assert_cmpuint (published, ==, 1);
+  g_assert_cmpuint (delivered, ==, 2);
+}
+
+static void
+test_peer_closed (Fixture       *f,
+                  gconstpointer  test_data)
+{
+  guint subscribers;
+
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[0], "news"));
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[0], "sports"));
+  g_assert (evd_peer_manager_subscribe (f->peer_manager, f->peers[1], "news"));
+
+  evd_peer_close (f->peers[0], TRUE);
+
+  g_assert (evd_peer_manager_get_peer_channels (f->peer_manager, f->peers[0]) == NULL);
+
+  g_assert (evd_peer_manager_get_channel_stats (f->peer_manager,
+                                                "news",
+                                                &subscribers,
+                                                NULL,
+                                                NULL));
+  g_assert_cmpuint (subscribers, ==, 1);
+
+  g_assert (! evd_peer_manager_get_channel_stats (f->peer_manager,
+                                                  "sports",
+                                                  NULL,
+                                                  NULL,
+                                                  NULL));
+
+  /* closed peers cannot subscribe */
+  g_assert (! evd_peer_manager_subscribe (f->peer_manager, f->peers[0], "news"));
+}
+
+static void
+push_messages (EvdPeer *peer, guint count, gboolean expect_success)
+{
+  guint i;
+
+  for (i = 0; i < count; i++)
+    {
+      gchar *msg;
+      GError *error = NULL;
+      gboolean ok;
+
+      msg = g_strdup_printf ("message %u", i);
+      ok = evd_peer_push_message (peer,
+                                  msg,
+                                  strlen (msg),
+                                  EVD_MESSAGE_TYPE_TEXT,
+                                  &error);
+      g_free (msg);
+
+      if (expect_success)
+        {
+          g_assert_no_error (error);
+          g_assert (ok);
+        }
+      else
+        {
+          g_assert (error != NULL);
+          g_assert_cmpint (error->code, ==, ENOBUFS);
+          g_assert (! ok);
+          g_error_free (error);
+        }
+    }
+}
+
+static void
+test_backlog_limits (Fixture       *f,
+                     gconstpointer  test_data)
+{
+  gsize base_size;
+  gchar *msg;
+
+  base_size = evd_peer_manager_get_backlog_size (f->peer_manager);
+
+  /* drop oldest */
+  evd_peer_set_backlog_limits (f->peers[0], 2, 0, EVD_BACKLOG_POLICY_DROP_OLDEST);
+  push_messages (f->peers[0], 3, TRUE);
+  g_assert_cmpuint (evd_peer_backlog_get_length (f->peers[0]), ==, 2);
+
+  msg = evd_peer_pop_message (f->peers[0], NULL, NULL);
+  g_assert_cmpstr (msg, ==, "message 1");
+  g_free (msg);
+
+  /* drop newest */
+  evd_peer_set_backlog_limits (f->peers[1],
+                               0,
+                               strlen ("message 0") * 2,
+                               EVD_BACKLOG_POLICY_DROP_NEWEST);
+  push_messages (f->peers[1], 2, TRUE);
+  push_messages (f->peers[1], 1, FALSE);
+  g_assert_cmpuint (evd_peer_backlog_get_length (f->peers[1]), ==, 2);
+  g_assert_cmpuint (evd_peer_get_backlog_size (f->peers[1]),
+                    ==,
+                    strlen ("message 0") * 2);
+
+  /* close peer */
+  evd_peer_set_backlog_limits (f->peers[2], 1, 0, EVD_BACKLOG_POLICY_CLOSE_PEER);
+  push_messages (f->peers[2], 1, TRUE);
+  push_messages (f->peers[2], 1, FALSE);
+  g_assert (evd_peer_is_closed (f->peers[2]));
+
+  /* the manager accounts the bytes of all backlogs */
+  g_assert_cmpuint (evd_peer_manager_get_backlog_size (f->peer_manager) - base_size,
+                    ==,
+                    evd_peer_get_backlog_size (f->peers[0]) +
+                    evd_peer_get_backlog_size (f->peers[1]) +
+                    evd_peer_get_backlog_size (f->peers[2]));
+}
+
+static void
+test_backlog_global_limit (Fixture       *f,
+                           gconstpointer  test_data)
+{
+  gsize base_size;
+
+  base_size = evd_peer_manager_get_backlog_size (f->peer_manager);
+
+  evd_peer_manager_set_max_backlog_size (f->peer_manager,
+                                         base_size + strlen ("message 0") * 3);
+
+  evd_peer_set_backlog_limits (f->peers[0], 0, 0, EVD_BACKLOG_POLICY_DROP_NEWEST);
+  evd_peer_set_backlog_limits (f->peers[1], 0, 0, EVD_BACKLOG_POLICY_DROP_NEWEST);
+
+  push_messages (f->peers[0], 2, TRUE);
+  push_messages (f->peers[1], 1, TRUE);
+  push_messages (f->peers[1], 1, FALSE);
+
+  /* popping a message makes room for another one */
+  g_free (evd_peer_pop_message (f->peers[0], NULL, NULL));
+  push_messages (f->peers[1], 1, TRUE);
+
+  g_assert_cmpuint (evd_peer_manager_get_backlog_size (f->peer_manager) - base_size,
+                    ==,
+                    strlen ("message 0") * 3);
+
+  evd_peer_manager_set_max_backlog_size (f->peer_manager, 0);
+}
+
+static void
+send_messages (EvdPeer *peer, guint first, guint count)
+{
+  guint i;
+
+  for (i = first; i < first + count; i++)
+    {
+      gchar *msg;
+      GError *error = NULL;
+
+      msg = g_strdup_printf ("message %u", i);
+      g_assert (evd_peer_send_text (peer, msg, &error));
+      g_assert_no_error (error);
+      g_free (msg);
+    }
+}
+
+static void
+assert_pop_message (EvdPeer *peer, const gchar *expected)
+{
+  gchar *msg;
+
+  msg = evd_peer_pop_message (peer, NULL, NULL);
+  g_assert_cmpstr (msg, ==, expected);
+  g_free (msg);
+}
+
+static void
+test_replay_resume (Fixture       *f,
+                    gconstpointer  test_data)
+{
+  EvdPeer *peer = f->peers[0];
+
+  evd_peer_set_replay_window (peer, 4);
+
+  /* peers have no connection, so messages stay in their backlogs */
+  send_messages (peer, 1, 3);
+  g_assert_cmpuint (evd_peer_get_sequence (peer), ==, 3);
+  g_assert_cmpuint (evd_peer_backlog_get_length (peer), ==, 3);
+
+  /* nothing was lost, the backlog is left untouched */
+  g_assert (evd_peer_resume (peer, 0));
+  g_assert_cmpuint (evd_peer_backlog_get_length (peer), ==, 3);
+
+  /* messages taken from the backlog but never received are replayed */
+  assert_pop_message (peer, "message 1");
+  assert_pop_message (peer, "message 2");
+  assert_pop_message (peer, "message 3");
+
+  g_assert (evd_peer_resume (peer, 1));
+  g_assert_cmpuint (evd_peer_backlog_get_length (peer), ==, 2);
+  assert_pop_message (peer, "message 2");
+  assert_pop_message (peer, "message 3");
+
+  /* acknowledging a message the peer was never sent fails */
+  g_assert (! evd_peer_resume (peer, 4));
+
+  /* message 2 falls out of the replay window */
+  send_messages (peer, 4, 3);
+  g_assert_cmpuint (evd_peer_get_sequence (peer), ==, 6);
+  g_free (evd_peer_pop_message (peer, NULL, NULL));
+
+  g_assert (! evd_peer_resume (peer, 1));
+
+  g_assert (evd_peer_resume (peer, 2));
+  g_assert_cmpuint (evd_peer_backlog_get_length (peer), ==, 4);
+  assert_pop_message (peer, "message 3");
+}
+
+static void
+test_replay_resume_gap (Fixture       *f,
+                        gconstpointer  test_data)
+{
+  EvdPeer *peer = f->peers[0];
+  GError *error = NULL;
+
+  evd_peer_set_replay_window (peer, 4);
+  evd_peer_set_backlog_limits (peer, 2, 0, EVD_BACKLOG_POLICY_DROP_NEWEST);
+
+  /* message 3 is numbered but does not fit in the backlog */
+  send_messages (peer, 1, 2);
+  g_assert (! evd_peer_send_text (peer, "message 3", &error));
+  g_clear_error (&error);
+
+  assert_pop_message (peer, "message 1");
+  send_messages (peer, 4, 1);
+
+  /* the backlog has as many messages as are unacknowledged, but not the
+     right ones, so they are taken from the replay window */
+  g_assert (evd_peer_resume (peer, 2));
+  g_assert_cmpuint (evd_peer_backlog_get_length (peer), ==, 2);
+  assert_pop_message (peer, "message 3");
+  assert_pop_message (peer, "message 4");
+
+  /* without a replay window the session cannot be recovered */
+  evd_peer_set_replay_window (peer, 0);
+  send_messages (peer, 5, 2);
+  g_assert (! evd_peer_send_text (peer, "message 7", &error));
+  g_clear_error (&error);
+  assert_pop_message (peer, "message 5");
+  send_messages (peer, 8, 1);
+
+  g_assert (! evd_peer_resume (peer, 6));
+}
+
+static void
+test_replay_sequence (Fixture       *f,
+                      gconstpointer  test_data)
+{
+  EvdPeer *peer = f->peers[0];
+  EvdMessage *message;
+  GList *peers;
+  GError *error = NULL;
+
+  /* messages are numbered whether they are sent or broadcast, with or
+     without a replay window */
+  send_messages (peer, 1, 2);
+  g_assert_cmpuint (evd_peer_get_sequence (peer), ==, 2);
+
+  message = evd_message_new ("broadcast", 9, EVD_MESSAGE_TYPE_TEXT);
+  peers = g_list_append (NULL, peer);
+  g_assert (evd_transport_broadcast (EVD_TRANSPORT (f->transport),
+                                     peers,
+                                     message,
+                                     &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (evd_peer_get_sequence (peer), ==, 3);
+
+  evd_peer_set_replay_window (peer, 4);
+
+  send_messages (peer, 4, 1);
+  g_assert (evd_transport_broadcast (EVD_TRANSPORT (f->transport),
+                                     peers,
+                                     message,
+                                     &error));
+  g_assert_no_error (error);
+  g_assert_cmpuint (evd_peer_get_sequence (peer), ==, 5);
+
+  /* only the two messages sent with the window are kept for replay */
+  while (evd_peer_backlog_get_length (peer) > 0)
+    g_free (evd_peer_pop_message (peer, NULL, NULL));
+
+  g_assert (evd_peer_resume (peer, 3));
+  g_assert_cmpuint (evd_peer_backlog_get_length (peer), ==, 2);
+  assert_pop_message (peer, "message 4");
+  assert_pop_message (peer, "broadcast");
+
+  g_list_free (peers);
+  evd_message_unref (message);
+}
+
+static void
+test_ids (Fixture       *f,
+          gconstpointer  test_data)
+{
+  EvdPeer *peer;
+  const gchar *id;
+
+  /* 128 random bits, unpadded base64url */
+  id = evd_peer_get_id (f->peers[0]);
+  g_assert_cmpint (strlen (id), ==, 22);
+  g_assert (strchr (id, '=') == NULL);
+  g_assert_cmpstr (id, !=, evd_peer_get_id (f->peers[1]));
+
+  g_assert (evd_peer_manager_lookup_peer (f->peer_manager, id) == f->peers[0]);
+  g_assert_cmpuint (evd_peer_id_hash (id), ==, evd_peer_id_hash (id));
+
+  evd_peer_manager_set_id_prefix (f->peer_manager, "shard7");
+  g_assert_cmpstr (evd_peer_manager_get_id_prefix (f->peer_manager),
+                   ==,
+                   "shard7");
+
+  peer = g_object_new (EVD_TYPE_PEER, "transport", f->transport, NULL);
+  evd_peer_manager_add_peer (f->peer_manager, peer);
+
+  id = evd_peer_get_id (peer);
+  g_assert (g_str_has_prefix (id, "shard7-"));
+  g_assert_cmpint (strlen (id), ==, 22 + strlen ("shard7-"));
+  g_assert (evd_peer_manager_lookup_peer (f->peer_manager, id) == peer);
+
+  evd_peer_close (peer, FALSE);
+  g_object_unref (peer);
+}
+
+/* the dispatch this replaces: a split of the path, a copy of the action
+   and a lookup of a 36 chars uuid */
+static gboolean
+dispatch_by_strings (GHashTable *peers, const gchar *path, const gchar *id)
+{
+  gchar **tokens;
+  gchar *action;
+  guint i;
+  gboolean found;
+
+  tokens = g_strsplit (path, "/", 32);
+  i = 0;
+  while (tokens[i] != NULL)
+    i++;
+  action = g_strdup (tokens[i - 1]);
+  g_strfreev (tokens);
+
+  found = g_strcmp0 (action, "receive") == 0 &&
+    g_hash_table_lookup (peers, id) != NULL;
+
+  g_free (action);
+
+  return found;
+}
+
+static void
+test_lookup_throughput (Fixture       *f,
+                        gconstpointer  test_data)
+{
+  GHashTable *uuids;
+  gchar **uuid_keys;
+  EvdPeer **peers;
+  GTimer *timer;
+  gdouble by_strings;
+  gdouble compact;
+  guint i;
+  guint hits;
+
+  if (! g_test_perf ())
+    return;
+
+  uuids = g_hash_table_new (g_str_hash, g_str_equal);
+  uuid_keys = g_new (gchar *, PERF_PEERS);
+  peers = g_new (EvdPeer *, PERF_PEERS);
+
+  for (i = 0; i < PERF_PEERS; i++)
+    {
+      peers[i] = g_object_new (EVD_TYPE_PEER, "transport", f->transport, NULL);
+      evd_peer_manager_add_peer (f->peer_manager, peers[i]);
+
+      uuid_keys[i] = evd_uuid_new ();
+      g_hash_table_insert (uuids, uuid_keys[i], peers[i]);
+    }
+
+  hits = 0;
+  timer = g_timer_new ();
+  for (i = 0; i < PERF_LOOKUPS; i++)
+    if (dispatch_by_strings (uuids, PERF_PATH, uuid_keys[i % PERF_PEERS]))
+      hits++;
+  by_strings = PERF_LOOKUPS / g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (hits, ==, PERF_LOOKUPS);
+
+  hits = 0;
+  g_timer_start (timer);
+  for (i = 0; i < PERF_LOOKUPS; i++)
+    {
+      const gchar *action;
+
+      action = strrchr (PERF_PATH, '/') + 1;
+      if (action[0] == 'r' &&
+          evd_peer_manager_lookup_peer (f->peer_manager,
+                        evd_peer_get_id (peers[i % PERF_PEERS])) != NULL)
+        {
+          hits++;
+        }
+    }
+  compact = PERF_LOOKUPS / g_timer_elapsed (timer, NULL);
+  g_assert_cmpuint (hits, ==, PERF_LOOKUPS);
+
+  g_timer_destroy (timer);
+
+  g_test_message ("split path and uuid lookup: %.0f requests/s", by_strings);
+  g_test_maximized_result (compact,
+                           "parsed action and compact id lookup: %.0f requests/s (%.1fx)",
+                           compact,
+                           compact / by_strings);
+
+  for (i = 0; i < PERF_PEERS; i++)
+    {
+      evd_peer_close (peers[i], FALSE);
+      g_object_unref (peers[i]);
+      g_free (uuid_keys[i]);
+    }
+  g_free (peers);
+  g_free (uuid_keys);
+  g_hash_table_unref (uuids);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/evd/peer-manager/channels/subscribe",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_subscribe,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/channels/publish",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_publish,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/channels/peer-closed",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_peer_closed,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/backlog/limits",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_backlog_limits,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/backlog/global-limit",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_backlog_global_limit,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/replay/resume",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_replay_resume,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/replay/resume-gap",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_replay_resume_gap,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/replay/sequence",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_replay_sequence,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/ids",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_ids,
+              fixture_teardown);
+
+  g_test_add ("/evd/peer-manager/lookup/throughput",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_lookup_throughput,
+              fixture_teardown);
+
+  return g_test_run ();
+}
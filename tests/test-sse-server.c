@@ -0,0 +1,261 @@
+/*
+ * test-sse-server.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ */
+
+#include <string.h>
+#include <gio/gio.h>
+
+#include <evd.h>
+
+#define LISTEN_ADDR "127.0.0.1:%d"
+#define MESSAGE     "Hello World!"
+
+typedef enum
+{
+  STAGE_HEADERS,
+  STAGE_MESSAGE,
+  STAGE_KEEPALIVE,
+  STAGE_END
+} Stage;
+
+typedef struct
+{
+  EvdSseServer *server;
+  EvdPeer *peer;
+
+  GMainLoop *main_loop;
+  guint listen_port;
+
+  GSocketClient *client;
+  GSocketConnection *conn;
+  gchar buf[1024];
+  GString *received;
+
+  Stage stage;
+} Fixture;
+
+static void
+fixture_setup (Fixture       *f,
+               gconstpointer  test_data)
+{
+  f->server = evd_sse_server_new ();
+  evd_sse_server_set_keepalive_interval (f->server, 50);
+
+  f->peer = evd_transport_create_new_peer (EVD_TRANSPORT (f->server));
+
+  f->main_loop = g_main_loop_new (NULL, FALSE);
+  f->listen_port = g_random_int_range (1025, 65535);
+
+  f->client = g_socket_client_new ();
+  f->conn = NULL;
+  f->received = g_string_new ("");
+
+  f->stage = STAGE_HEADERS;
+}
+
+static void
+fixture_teardown (Fixture       *f,
+                  gconstpointer  test_data)
+{
+  g_string_free (f->received, TRUE);
+
+  if (f->conn != NULL)
+    g_object_unref (f->conn);
+  g_object_unref (f->client);
+
+  g_object_unref (f->peer);
+  g_object_unref (f->server);
+
+  g_main_loop_unref (f->main_loop);
+}
+
+static void read_stream (Fixture *f);
+
+/* moves through the stages as the expected bits of the stream arrive */
+static void
+on_read (GObject      *obj,
+         GAsyncResult *res,
+         gpointer      user_data)
+{
+  Fixture *f = user_data;
+  GError *error = NULL;
+  gssize size;
+
+  size = g_input_stream_read_finish (G_INPUT_STREAM (obj), res, &error);
+  g_assert_no_error (error);
+
+  if (size == 0)
+    {
+      g_assert_cmpint (f->stage, ==, STAGE_END);
+      g_main_loop_quit (f->main_loop);
+      return;
+    }
+
+  g_string_append_len (f->received, f->buf, size);
+
+  if (f->stage == STAGE_HEADERS &&
+      strstr (f->received->str, "\r\n\r\n") != NULL)
+    {
+      g_assert (g_str_has_prefix (f->received->str, "HTTP/1.1 200 OK\r\n"));
+      g_assert (strstr (f->received->str, "text/event-stream") != NULL);
+
+      g_assert (evd_transport_peer_is_connected (EVD_TRANSPORT (f->server),
+                                                 f->peer));
+
+      g_assert (evd_transport_send_text (EVD_TRANSPORT (f->server),
+                                         f->peer,
+                                         MESSAGE,
+                                         &error));
+      g_assert_no_error (error);
+
+      f->stage = STAGE_MESSAGE;
+    }
+
+  if (f->stage == STAGE_MESSAGE &&
+      strstr (f->received->str, "data: t" MESSAGE "\n\n") != NULL)
+    {
+      f->stage = STAGE_KEEPALIVE;
+    }
+
+  if (f->stage == STAGE_KEEPALIVE &&
+      strstr (f->received->str, "\r\n:\n\n\r\n") != NULL)
+    {
+      /* closing the peer ends its stream */
+      evd_transport_close_peer (EVD_TRANSPORT (f->server),
+                                f->peer,
+                                TRUE,
+                                &error);
+      g_assert_no_error (error);
+
+      g_assert (! evd_transport_peer_is_connected (EVD_TRANSPORT (f->server),
+                                                   f->peer));
+
+      f->stage = STAGE_END;
+    }
+
+  if (f->stage == STAGE_END &&
+      g_str_has_suffix (f->received->str, "\r\n0\r\n\r\n"))
+    {
+      g_main_loop_quit (f->main_loop);
+      return;
+    }
+
+  read_stream (f);
+}
+
+static void
+read_stream (Fixture *f)
+{
+  GInputStream *stream;
+
+  stream = g_io_stream_get_input_stream (G_IO_STREAM (f->conn));
+  g_input_stream_read_async (stream,
+                             f->buf,
+                             sizeof (f->buf),
+                             G_PRIORITY_DEFAULT,
+                             NULL,
+                             on_read,
+                             f);
+}
+
+static void
+on_connect (GObject      *obj,
+            GAsyncResult *res,
+            gpointer      user_data)
+{
+  Fixture *f = user_data;
+  GOutputStream *stream;
+  gchar *request;
+  GError *error = NULL;
+
+  f->conn = g_socket_client_connect_to_host_finish (G_SOCKET_CLIENT (obj),
+                                                    res,
+                                                    &error);
+  g_assert_no_error (error);
+
+  request = g_strdup_printf ("GET /receive?%s HTTP/1.1\r\n"
+                             "Host: 127.0.0.1:%d\r\n"
+                             "\r\n",
+                             evd_peer_get_id (f->peer),
+                             f->listen_port);
+
+  stream = g_io_stream_get_output_stream (G_IO_STREAM (f->conn));
+  g_assert (g_output_stream_write_all (stream,
+                                       request,
+                                       strlen (request),
+                                       NULL,
+                                       NULL,
+                                       &error));
+  g_assert_no_error (error);
+  g_free (request);
+
+  read_stream (f);
+}
+
+static void
+on_listen (GObject      *obj,
+           GAsyncResult *res,
+           gpointer      user_data)
+{
+  Fixture *f = user_data;
+  GError *error = NULL;
+
+  g_assert (evd_service_listen_finish (EVD_SERVICE (obj), res, &error));
+  g_assert_no_error (error);
+
+  g_socket_client_connect_to_host_async (f->client,
+                                         "127.0.0.1",
+                                         f->listen_port,
+                                         NULL,
+                                         on_connect,
+                                         f);
+}
+
+static void
+test_stream (Fixture       *f,
+             gconstpointer  test_data)
+{
+  gchar *addr;
+
+  g_assert_cmpuint (evd_sse_server_get_keepalive_interval (f->server), ==, 50);
+
+  /* the peer has no stream yet */
+  g_assert (! evd_transport_peer_is_connected (EVD_TRANSPORT (f->server),
+                                               f->peer));
+
+  addr = g_strdup_printf (LISTEN_ADDR, f->listen_port);
+  evd_service_listen (EVD_SERVICE (f->server),
+                      addr,
+                      NULL,
+                      on_listen,
+                      f);
+  g_free (addr);
+
+  g_main_loop_run (f->main_loop);
+
+  g_assert_cmpint (f->stage, ==, STAGE_END);
+  g_assert (evd_peer_is_closed (f->peer));
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add ("/evd/sse-server/stream",
+              Fixture,
+              NULL,
+              fixture_setup,
+              test_stream,
+              fixture_teardown);
+
+  return g_test_run ();
+}
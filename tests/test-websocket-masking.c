@@ -0,0 +1,115 @@
+/*
+ * test-websocket-masking.c
+ *
+ * EventDance, Peer-to-peer IPC library <http://eventdance.org>
+ *
+ * Copyright (C) 2026, the EventDance contributors
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include <evd.h>
+#include "evd-websocket-protocol.h"
+
+#define PERF_PAYLOAD_SIZE (16 * 1024 * 1024)
+#define PERF_ITERATIONS   16
+
+static const guint8 masking_key[4] = { 0x37, 0xfa, 0x21, 0x3d };
+
+static void
+apply_masking_bytewise (gchar *data, gsize len, const guint8 key[4])
+{
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    data[i] ^= key[i % 4];
+}
+
+static void
+test_masking (void)
+{
+  gchar buf[256 + 32];
+  gchar expected[256 + 32];
+  gsize offset;
+  gsize len;
+  gsize i;
+
+  /* all lengths around the word and vector sizes, at every alignment */
+  for (offset = 0; offset < 32; offset++)
+    for (len = 0; len <= 256; len++)
+      {
+        for (i = 0; i < sizeof (buf); i++)
+          buf[i] = expected[i] = (gchar) g_test_rand_int_range (0, 256);
+
+        evd_websocket_protocol_apply_masking (buf + offset, len, masking_key);
+        apply_masking_bytewise (expected + offset, len, masking_key);
+
+        g_assert (memcmp (buf, expected, sizeof (buf)) == 0);
+
+        /* masking twice gives back the original payload */
+        evd_websocket_protocol_apply_masking (buf + offset, len, masking_key);
+        apply_masking_bytewise (expected + offset, len, masking_key);
+
+        g_assert (memcmp (buf, expected, sizeof (buf)) == 0);
+      }
+}
+
+static gdouble
+measure (void (* func) (gchar *, gsize, const guint8 *), gchar *payload)
+{
+  GTimer *timer;
+  gdouble elapsed;
+  guint i;
+
+  timer = g_timer_new ();
+
+  for (i = 0; i < PERF_ITERATIONS; i++)
+    func (payload, PERF_PAYLOAD_SIZE, masking_key);
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+
+  return (gdouble) PERF_PAYLOAD_SIZE * PERF_ITERATIONS / elapsed / (1024 * 1024);
+}
+
+static void
+test_throughput (void)
+{
+  gchar *payload;
+  gdouble bytewise;
+  gdouble vectorized;
+
+  if (! g_test_perf ())
+    return;
+
+  payload = g_malloc0 (PERF_PAYLOAD_SIZE);
+
+  bytewise = measure (apply_masking_bytewise, payload);
+  vectorized = measure (evd_websocket_protocol_apply_masking, payload);
+
+  g_test_message ("byte-at-a-time masking: %.2f MB/s", bytewise);
+  g_test_maximized_result (vectorized,
+                           "vectorized masking: %.2f MB/s (%.1fx)",
+                           vectorized,
+                           vectorized / bytewise);
+
+  g_free (payload);
+}
+
+gint
+main (gint argc, gchar *argv[])
+{
+#ifndef GLIB_VERSION_2_36
+  g_type_init ();
+#endif
+
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/evd/websocket/masking", test_masking);
+
+  /* benchmark, only run in perf mode (-m perf) */
+  g_test_add_func ("/evd/websocket/masking/throughput", test_throughput);
+
+  return g_test_run ();
+}
@@ -9,6 +9,7 @@
  *   Eduardo Lima Mitev <elima@igalia.com>
  */
 
+#include <string.h>
 #include <evd.h>
 
 #define LISTEN_ADDR "0.0.0.0:%d"
@@ -20,6 +21,9 @@ typedef struct
   gchar *msg;
   gssize msg_len;
   EvdMessageType msg_type;
+  gboolean deflate;
+  gboolean broadcast;
+  gboolean coalesce;
 } TestCase;
 
 typedef struct
@@ -40,14 +44,90 @@ static const TestCase test_cases[] =
       "/text-message",
       "Hello World!",
       -1,
-      EVD_MESSAGE_TYPE_TEXT
+      EVD_MESSAGE_TYPE_TEXT,
+      FALSE,
+      FALSE,
+      FALSE
     },
 
     {
       "/binary-message",
       "Hello\0World!\0",
       13,
-      EVD_MESSAGE_TYPE_BINARY
+      EVD_MESSAGE_TYPE_BINARY,
+      FALSE,
+      FALSE,
+      FALSE
+    },
+
+    {
+      "/deflate/text-message",
+      "[\"Hello World!\", \"Hello World!\", \"Hello World!\", \"Hello World!\"]",
+      -1,
+      EVD_MESSAGE_TYPE_TEXT,
+      TRUE,
+      FALSE,
+      FALSE
+    },
+
+    {
+      "/deflate/binary-message",
+      "Hello\0World!\0",
+      13,
+      EVD_MESSAGE_TYPE_BINARY,
+      TRUE,
+      FALSE,
+      FALSE
+    },
+
+    {
+      "/broadcast/text-message",
+      "Hello World!",
+      -1,
+      EVD_MESSAGE_TYPE_TEXT,
+      FALSE,
+      TRUE,
+      FALSE
+    },
+
+    {
+      "/broadcast/binary-message",
+      "Hello\0World!\0",
+      13,
+      EVD_MESSAGE_TYPE_BINARY,
+      FALSE,
+      TRUE,
+      FALSE
+    },
+
+    {
+      "/deflate/broadcast/text-message",
+      "[\"Hello World!\", \"Hello World!\", \"Hello World!\", \"Hello World!\"]",
+      -1,
+      EVD_MESSAGE_TYPE_TEXT,
+      TRUE,
+      TRUE,
+      FALSE
+    },
+
+    {
+      "/coalesce/text-message",
+      "Hello World!",
+      -1,
+      EVD_MESSAGE_TYPE_TEXT,
+      FALSE,
+      FALSE,
+      TRUE
+    },
+
+    {
+      "/coalesce/broadcast/binary-message",
+      "Hello\0World!\0",
+      13,
+      EVD_MESSAGE_TYPE_BINARY,
+      FALSE,
+      TRUE,
+      TRUE
     }
   };
 
@@ -149,7 +229,28 @@ on_new_peer (EvdTransport *transport,
   g_assert (EVD_IS_PEER (peer));
   g_assert (! evd_peer_is_closed (peer));
 
-  if (EVD_IS_WEBSOCKET_SERVER (transport))
+  if (EVD_IS_WEBSOCKET_SERVER (transport) && f->test_case->broadcast)
+    {
+      EvdMessage *msg;
+      GList *peers;
+      gsize msg_len;
+
+      msg_len = f->test_case->msg_len >= 0 ?
+        (gsize) f->test_case->msg_len : strlen (f->test_case->msg);
+
+      msg = evd_message_new (f->test_case->msg,
+                             msg_len,
+                             f->test_case->msg_type);
+      peers = g_list_append (NULL, peer);
+
+      ok = evd_transport_broadcast (transport, peers, msg, &error);
+      g_assert_no_error (error);
+      g_assert (ok);
+
+      g_list_free (peers);
+      evd_message_unref (msg);
+    }
+  else if (EVD_IS_WEBSOCKET_SERVER (transport))
     {
       if (f->test_case->msg_type == EVD_MESSAGE_TYPE_TEXT)
         {
@@ -208,6 +309,7 @@ on_receive (EvdTransport *transport,
     {
       msg = evd_transport_receive (transport, peer, &msg_len);
       g_assert_cmpuint (msg_len, ==, f->test_case->msg_len);
+      g_assert (memcmp (msg, f->test_case->msg, msg_len) == 0);
 
       if (EVD_IS_WEBSOCKET_CLIENT (transport))
         {
@@ -281,6 +383,15 @@ test_func (Fixture       *f,
 
   evd_websocket_server_set_standalone (f->ws_server, TRUE);
 
+  /* compress every message, regardless of its size */
+  evd_websocket_server_set_deflate (f->ws_server, f->test_case->deflate);
+  evd_websocket_server_set_deflate_options (f->ws_server, 15, FALSE, 8, 0);
+  evd_websocket_client_set_deflate (f->ws_client, f->test_case->deflate);
+  evd_websocket_client_set_deflate_options (f->ws_client, 15, FALSE, 8, 0);
+
+  if (f->test_case->coalesce)
+    evd_websocket_server_set_coalescing_delay (f->ws_server, 1);
+
   /* open server transport */
   addr = g_strdup_printf (LISTEN_ADDR, f->listen_port);
 